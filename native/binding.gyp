@@ -1,21 +1,126 @@
 {
+  "target_defaults": {
+    "cflags_cc": ["-std=c++17", "-O3"],
+    "xcode_settings": {
+      "CLANG_CXX_LANGUAGE_STANDARD": "c++17",
+      "GCC_OPTIMIZATION_LEVEL": "3"
+    }
+  },
   "targets": [
     {
-      "target_name": "watermark",
+      "target_name": "kernels_sse42",
+      "type": "static_library",
+      "sources": ["src/kernels_sse42.cc"],
+      "include_dirs": ["src"],
+      "defines": ["MUSMARK_OPENMP_SIMD"],
+      "cflags": ["-fPIC"],
+      "cflags_cc": ["-fopenmp-simd"],
+      "conditions": [
+        ["target_arch=='x64' or target_arch=='ia32'", {
+          "cflags_cc": ["-msse4.2"],
+          "xcode_settings": {"OTHER_CPLUSPLUSFLAGS": ["-fopenmp-simd", "-msse4.2"]}
+        }]
+      ]
+    },
+    {
+      "target_name": "kernels_avx2",
+      "type": "static_library",
+      "sources": ["src/kernels_avx2.cc"],
+      "include_dirs": ["src"],
+      "defines": ["MUSMARK_OPENMP_SIMD"],
+      "cflags": ["-fPIC"],
+      "cflags_cc": ["-fopenmp-simd"],
+      "conditions": [
+        ["target_arch=='x64' or target_arch=='ia32'", {
+          "cflags_cc": ["-mavx2", "-mfma"],
+          "xcode_settings": {"OTHER_CPLUSPLUSFLAGS": ["-fopenmp-simd", "-mavx2", "-mfma"]},
+          "msvs_settings": {"VCCLCompilerTool": {"AdditionalOptions": ["/arch:AVX2"]}}
+        }]
+      ]
+    },
+    {
+      "target_name": "kernels_avx512",
+      "type": "static_library",
+      "sources": ["src/kernels_avx512.cc"],
+      "include_dirs": ["src"],
+      "defines": ["MUSMARK_OPENMP_SIMD"],
+      "cflags": ["-fPIC"],
+      "cflags_cc": ["-fopenmp-simd"],
+      "conditions": [
+        ["target_arch=='x64' or target_arch=='ia32'", {
+          "cflags_cc": ["-mavx512f", "-mavx512dq", "-mavx512bw", "-mavx512vl"],
+          "xcode_settings": {"OTHER_CPLUSPLUSFLAGS": ["-fopenmp-simd", "-mavx512f", "-mavx512dq", "-mavx512bw", "-mavx512vl"]},
+          "msvs_settings": {"VCCLCompilerTool": {"AdditionalOptions": ["/arch:AVX512"]}}
+        }]
+      ]
+    },
+    {
+      "target_name": "libmusmark",
+      "product_name": "musmark",
+      "type": "static_library",
       "sources": [
-        "src/watermark.cc",
+        "src/capi.cc",
+        "src/engine.cc",
+        "src/payload.cc",
+        "src/reed_solomon.cc",
+        "src/sha256.cc",
+        "src/wav.cc",
         "src/fft.cc",
-        "src/wav.cc"
+        "src/psychoacoustic.cc",
+        "src/scheduler.cc",
+        "src/cpu.cc",
+        "src/kernels.cc",
+        "src/wisdom.cc",
+        "src/daemon.cc",
+        "src/scan.cc",
+        "src/scan_lease.cc",
+        "src/signature_store.cc",
+        "src/detection_cache.cc",
+        "src/float_codec.cc",
+        "src/master_cache.cc",
+        "src/flac.cc",
+        "src/audio_file.cc",
+        "src/media_decoder.cc",
+        "src/mp3_frames.cc",
+        "src/fd_stream.cc",
+        "src/sign_pipeline.cc",
+        "src/synth.cc",
+        "src/attacks.cc",
+        "src/bench.cc"
       ],
+      "include_dirs": ["include", "src"],
+      "dependencies": [
+        "kernels_sse42",
+        "kernels_avx2",
+        "kernels_avx512"
+      ],
+      "direct_dependent_settings": {
+        "include_dirs": ["include", "src"]
+      },
+      "cflags": ["-fPIC"],
+      "cflags_cc!": ["-fno-exceptions"],
+      "xcode_settings": {"GCC_ENABLE_CPP_EXCEPTIONS": "YES"},
+      "conditions": [
+        ["OS=='linux'", {"link_settings": {"libraries": ["-pthread", "-lrt"]}}],
+        ["OS=='win'", {
+          "msvs_settings": {
+            "VCCLCompilerTool": {"ExceptionHandling": 1},
+            "VCBuildConfiguration": {"PlatformToolset": "v143"}
+          }
+        }]
+      ]
+    },
+    {
+      "target_name": "watermark",
+      "sources": ["src/watermark.cc"],
       "include_dirs": [
-        "<!@(node -p \"require('node-addon-api').include\")",
-        "src"
+        "<!@(node -p \"require('node-addon-api').include\")"
       ],
       "dependencies": [
-        "<!(node -p \"require('node-addon-api').gyp\")"
+        "<!(node -p \"require('node-addon-api').gyp\")",
+        "libmusmark"
       ],
       "cflags_cc!": ["-fno-exceptions"],
-      "cflags_cc": ["-std=c++17"],
       "defines": ["NAPI_CPP_EXCEPTIONS"],
       "conditions": [
         ["OS=='win'", {
@@ -25,6 +130,22 @@
           }
         }]
       ]
+    },
+    {
+      "target_name": "musmark",
+      "type": "executable",
+      "sources": ["src/cli.cc"],
+      "dependencies": ["libmusmark"],
+      "cflags_cc!": ["-fno-exceptions"],
+      "xcode_settings": {"GCC_ENABLE_CPP_EXCEPTIONS": "YES"},
+      "conditions": [
+        ["OS=='win'", {
+          "msvs_settings": {
+            "VCCLCompilerTool": {"ExceptionHandling": 1},
+            "VCBuildConfiguration": {"PlatformToolset": "v143"}
+          }
+        }]
+      ]
     }
   ]
 }
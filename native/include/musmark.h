@@ -0,0 +1,351 @@
+/*
+ * libmusmark — C API of the musmark watermark engine.
+ *
+ * C and C++ services link the static library to sign and detect in-process.
+ * The Node addon signs and detects through this API but reaches the engine's
+ * C++ internals for the rest (scan, signature store, caches, decoding); the
+ * musmark CLI uses those internals throughout.
+ *
+ * Conventions:
+ *  - Every function that can fail returns musmark_status. On failure the
+ *    message is available from musmark_last_error() on the same thread.
+ *  - Audio is interleaved 32-bit float. Only the first two channels carry
+ *    the watermark; mono is supported.
+ *  - Handles are opaque. A key may be shared by any number of threads;
+ *    embedder and detector handles must be used by one thread at a time.
+ *  - Structs passed by the caller start with a `size` field set to
+ *    sizeof(struct) so fields can be appended without breaking the ABI.
+ */
+#ifndef MUSMARK_H
+#define MUSMARK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MUSMARK_API_VERSION 1
+
+typedef enum musmark_status {
+  MUSMARK_OK = 0,
+  MUSMARK_ERROR_INVALID_ARGUMENT = 1,
+  MUSMARK_ERROR_FAILED = 2,
+  MUSMARK_ERROR_OUT_OF_MEMORY = 3
+} musmark_status;
+
+typedef enum musmark_priority {
+  MUSMARK_PRIORITY_INTERACTIVE = 0,
+  MUSMARK_PRIORITY_BATCH = 1
+} musmark_priority;
+
+/* Length of a UUID string plus terminator, and of a SHA-256 hex digest. */
+#define MUSMARK_SIGNATURE_ID_SIZE 37
+#define MUSMARK_HASH_SIZE 65
+
+int musmark_api_version(void);
+
+/* Message for the last failed call on this thread ("" if none). */
+const char* musmark_last_error(void);
+
+/* ------------------------------------------------------------------------
+ * Runtime
+ * ---------------------------------------------------------------------- */
+
+/* 0 restores the default (MUSMARK_THREADS or every available core). */
+musmark_status musmark_set_threads(int threads);
+
+/* Applies a wisdom file written by autotune; NULL loads the default path. */
+musmark_status musmark_load_wisdom(const char* path);
+
+/* ------------------------------------------------------------------------
+ * Keys
+ *
+ * A key is a secret plus hop size. It owns the PN sequences derived from
+ * them, built on first use and reused by every later call, so long-lived
+ * services should create keys once and keep them.
+ * ---------------------------------------------------------------------- */
+
+typedef struct musmark_key musmark_key;
+
+/* hop_size 0 selects the default (1024). */
+musmark_status musmark_key_create(
+  const char* secret, size_t secret_length, int hop_size, musmark_key** out);
+void musmark_key_destroy(musmark_key* key);
+
+/* Builds the PN bank now instead of on first use. */
+musmark_status musmark_key_warm(musmark_key* key);
+
+/* ------------------------------------------------------------------------
+ * Payloads
+ * ---------------------------------------------------------------------- */
+
+typedef struct musmark_payload {
+  size_t size;
+  char signature_id[MUSMARK_SIGNATURE_ID_SIZE];
+  /* SHA-256 of the JSON payload, as returned by sign() in Node. */
+  char payload_hash[MUSMARK_HASH_SIZE];
+  char timestamp[32];
+} musmark_payload;
+
+/* Generates a fresh signature id and timestamp for project/recipient. */
+musmark_status musmark_payload_create(
+  const char* project_id, const char* recipient_id, musmark_payload* out);
+
+/* ------------------------------------------------------------------------
+ * Whole-buffer embed / detect
+ * ---------------------------------------------------------------------- */
+
+/* Embeds signature_id into `samples` in place. */
+musmark_status musmark_embed(
+  musmark_key* key,
+  const char* signature_id,
+  float* samples,
+  size_t frames,
+  int channels,
+  musmark_priority priority);
+
+/* Lower-level embed of a raw payload-period bitstream (one byte per bit),
+ * optionally cancelling a previous bitstream (remove_bits may be NULL). */
+musmark_status musmark_embed_bits(
+  musmark_key* key,
+  const uint8_t* bits,
+  size_t bit_count,
+  const uint8_t* remove_bits,
+  size_t remove_bit_count,
+  float* samples,
+  size_t frames,
+  int channels,
+  musmark_priority priority);
+
+/* musmark_embed_bits from one 32-bit float WAV file into another without
+ * loading either: reads, embedding and writes overlap through a small ring
+ * of window buffers (io_uring on Linux, I/O threads elsewhere, or when the
+ * environment sets MUSMARK_IO_URING=0). The output keeps every non-audio
+ * chunk of `input` and equals a whole-buffer embed; `output` may be `input`.
+ * Fails for other formats and FLAC outputs. Not available on Windows. */
+musmark_status musmark_embed_wav_file(
+  musmark_key* key,
+  const uint8_t* bits,
+  size_t bit_count,
+  const uint8_t* remove_bits,
+  size_t remove_bit_count,
+  const char* input,
+  const char* output,
+  musmark_priority priority);
+
+typedef struct musmark_detection {
+  size_t size;
+  int decoded;  /* non-zero when a signature id was recovered */
+  char signature_id[MUSMARK_SIGNATURE_ID_SIZE];
+  char payload_hash[MUSMARK_HASH_SIZE];  /* SHA-256 of the 16 id bytes */
+  int confidence;  /* 0-100, same formula as detect() without the lookup term */
+  double bit_confidence;
+  double band_agreement;
+  size_t blocks_analyzed;
+  int error_count;
+} musmark_detection;
+
+musmark_status musmark_detect(
+  musmark_key* key,
+  const float* samples,
+  size_t frames,
+  int channels,
+  musmark_priority priority,
+  musmark_detection* out);
+
+typedef struct musmark_extraction {
+  size_t size;
+  float* correlations;  /* one per block (4 * hop_size frames), library-owned */
+  size_t block_count;
+  double bit_confidence;
+  double band_agreement;
+  int finished;  /* zero when a deadline stopped the analysis early */
+  size_t periods_analyzed;  /* payload periods correlated, of period_count */
+  size_t period_count;
+} musmark_extraction;
+
+/* Raw per-block correlations for callers that run their own decoding.
+ * Release with musmark_extraction_free. */
+musmark_status musmark_extract(
+  musmark_key* key,
+  const float* samples,
+  size_t frames,
+  int channels,
+  musmark_priority priority,
+  musmark_extraction* out);
+void musmark_extraction_free(musmark_extraction* extraction);
+
+/* Anytime extraction for latency budgets: payload periods are correlated
+ * quietest (most reliable) first until deadline_ms after the call, at
+ * least one period always. Blocks not reached are 0. If time runs out, the
+ * correlations are the snapshot that decoded with the fewest errors, and
+ * `finished` is 0. */
+musmark_status musmark_extract_until(
+  musmark_key* key,
+  const float* samples,
+  size_t frames,
+  int channels,
+  musmark_priority priority,
+  uint32_t deadline_ms,
+  musmark_extraction* out);
+
+typedef struct musmark_triage {
+  size_t size;
+  int likely;  /* non-zero when the sync pattern is clearly present */
+  double sync_score;  /* fraction of sync bits recovered, ~0.5 for chance */
+  size_t blocks_analyzed;
+} musmark_triage;
+
+/* Sync-only check, roughly 1/7 of the cost of musmark_detect. */
+musmark_status musmark_triage_samples(
+  musmark_key* key,
+  const float* samples,
+  size_t frames,
+  int channels,
+  musmark_priority priority,
+  musmark_triage* out);
+
+/* ------------------------------------------------------------------------
+ * Analysis handles
+ *
+ * Analysis runs on a mono downmix of the first two channels. A handle
+ * holds that downmix so one recording can be extracted, triaged and
+ * detected under any number of keys without converting it again. Results
+ * match the calls taking interleaved samples. Handles are immutable and may
+ * be shared by any number of threads.
+ * ---------------------------------------------------------------------- */
+
+typedef struct musmark_analysis musmark_analysis;
+
+/* `samples` is not referenced after the call returns. */
+musmark_status musmark_analysis_create(
+  const float* samples, size_t frames, int channels, musmark_analysis** out);
+void musmark_analysis_destroy(musmark_analysis* analysis);
+size_t musmark_analysis_frames(const musmark_analysis* analysis);
+
+musmark_status musmark_analysis_detect(
+  musmark_key* key, const musmark_analysis* analysis, musmark_priority priority, musmark_detection* out);
+musmark_status musmark_analysis_extract(
+  musmark_key* key, const musmark_analysis* analysis, musmark_priority priority, musmark_extraction* out);
+musmark_status musmark_analysis_extract_until(
+  musmark_key* key,
+  const musmark_analysis* analysis,
+  musmark_priority priority,
+  uint32_t deadline_ms,
+  musmark_extraction* out);
+musmark_status musmark_analysis_triage(
+  musmark_key* key, const musmark_analysis* analysis, musmark_priority priority, musmark_triage* out);
+
+/* ------------------------------------------------------------------------
+ * Streaming
+ *
+ * Embedder: push audio of any length with musmark_embedder_write, pull
+ * marked audio with musmark_embedder_read. Output lags input by less than
+ * one block; musmark_embedder_finish releases the tail. The concatenated
+ * output is identical to a whole-buffer musmark_embed.
+ *
+ * Detector: push audio of any length; musmark_detector_result may be called
+ * at any point and decodes everything seen so far.
+ * ---------------------------------------------------------------------- */
+
+typedef struct musmark_embedder musmark_embedder;
+
+musmark_status musmark_embedder_create(
+  musmark_key* key, const char* signature_id, int channels, musmark_priority priority, musmark_embedder** out);
+musmark_status musmark_embedder_write(musmark_embedder* embedder, const float* samples, size_t frames);
+musmark_status musmark_embedder_finish(musmark_embedder* embedder);
+/* Copies up to `capacity` ready frames into `out` and stores the number
+ * copied in `*frames`. */
+musmark_status musmark_embedder_read(
+  musmark_embedder* embedder, float* out, size_t capacity, size_t* frames);
+size_t musmark_embedder_available(const musmark_embedder* embedder);
+void musmark_embedder_destroy(musmark_embedder* embedder);
+
+typedef struct musmark_detector musmark_detector;
+
+musmark_status musmark_detector_create(
+  musmark_key* key, int channels, musmark_priority priority, musmark_detector** out);
+musmark_status musmark_detector_write(musmark_detector* detector, const float* samples, size_t frames);
+musmark_status musmark_detector_result(musmark_detector* detector, musmark_detection* out);
+void musmark_detector_destroy(musmark_detector* detector);
+
+/* ------------------------------------------------------------------------
+ * Audio files: 32-bit float WAV and FLAC (8 to 24 bit)
+ * ---------------------------------------------------------------------- */
+
+typedef struct musmark_audio {
+  size_t size;
+  float* samples;  /* interleaved, owned by the library */
+  size_t frames;
+  int channels;
+  int sample_rate;
+  int bits_per_sample;  /* depth of the source file; 32 for float WAV */
+} musmark_audio;
+
+musmark_status musmark_wav_read(const char* path, musmark_audio* out);
+musmark_status musmark_wav_write(const char* path, const musmark_audio* audio);
+
+/* Reads WAV or FLAC by content. Writes FLAC when `path` ends in ".flac",
+ * at bits_per_sample (float sources and unset depths become 24-bit),
+ * otherwise float WAV. Both run on the shared scheduler. */
+musmark_status musmark_audio_read(const char* path, musmark_priority priority, musmark_audio* out);
+musmark_status musmark_audio_write(const char* path, const musmark_audio* audio, musmark_priority priority);
+/* musmark_audio_write for a signed copy of `source`: when both are WAV, the
+ * non-audio chunks of `source` (bext, iXML, LIST, cue, JUNK, ...) are
+ * copied into the output verbatim and in place, by the kernel where the
+ * platform allows. `source` may be `path` itself. */
+musmark_status musmark_audio_write_preserving(const char* path, const musmark_audio* audio,
+  const char* source, musmark_priority priority);
+
+/* Several deliverables from one signed buffer, written at once on the
+ * shared scheduler: WAV at 16 or 24 bit (integer PCM) or 32 (float), FLAC
+ * at 8 to 24 bit. bits_per_sample 0 means float for WAV and the source depth
+ * for FLAC. Float WAV targets keep the chunks of a WAV `source` (may be
+ * NULL), as musmark_audio_write_preserving does. Every element of
+ * `targets` sets `size` to sizeof(musmark_audio_target); it is also the
+ * array stride. */
+typedef enum musmark_audio_format {
+  MUSMARK_FORMAT_WAV = 0,
+  MUSMARK_FORMAT_FLAC = 1
+} musmark_audio_format;
+
+typedef struct musmark_audio_target {
+  size_t size;
+  const char* path;
+  musmark_audio_format format;
+  int bits_per_sample;
+} musmark_audio_target;
+
+musmark_status musmark_audio_write_targets(const musmark_audio_target* targets, size_t count,
+  const musmark_audio* audio, const char* source, musmark_priority priority);
+
+/* The same over a descriptor (pipe, socket, the stdout of a decoder), read
+ * to EOF without seeking; WAV sizes of 0xFFFFFFFF or 0 mean "until EOF".
+ * The write side emits float WAV and fills in the header sizes at the end
+ * when `fd` can seek. Neither closes `fd`. Not available on Windows. */
+musmark_status musmark_audio_read_fd(int fd, musmark_priority priority, musmark_audio* out);
+musmark_status musmark_wav_write_fd(int fd, const musmark_audio* audio);
+void musmark_audio_free(musmark_audio* audio);
+
+/* musmark_embed_bits of an audio buffer (e.g. from musmark_audio_read) that
+ * also writes the result as float WAV to `output`: the file is preallocated
+ * with its final header and every block range is written at its offset as
+ * soon as it is marked, overlapping the writes with the embedding. The
+ * buffer is marked in place as well. */
+musmark_status musmark_embed_bits_to_wav(
+  musmark_key* key,
+  const uint8_t* bits,
+  size_t bit_count,
+  const uint8_t* remove_bits,
+  size_t remove_bit_count,
+  musmark_audio* audio,
+  const char* output,
+  musmark_priority priority);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MUSMARK_H */
@@ -0,0 +1,100 @@
+/*
+ * Wire protocol of the musmark detection daemon (`musmark serve`).
+ *
+ * The daemon listens on a Unix domain socket, so both ends share a machine
+ * and all integers are in host byte order. A connection carries one request
+ * at a time: the client sends a musmark_daemon_request header followed by
+ * `secret_length` bytes of key, `input_length` bytes of input name and
+ * `output_length` bytes of output path, then reads a
+ * musmark_daemon_response header followed by `body_length` bytes.
+ *
+ * Audio sources:
+ *   PATH  input names a 32-bit float WAV file readable by the daemon.
+ *   FD    the WAV arrives as a file descriptor passed with SCM_RIGHTS on the
+ *         header message (pipes work). For SIGN a second descriptor receives
+ *         the marked WAV unless an output path is given.
+ *   SHM   input names a POSIX shared-memory object holding `frames` frames
+ *         of interleaved f32 PCM with `channels` channels. SIGN marks it in
+ *         place.
+ *
+ * Bodies: DETECT answers with musmark_daemon_detect_body, TRIAGE with
+ * musmark_daemon_triage_body, SIGN and PING with nothing. Any non-zero
+ * status carries a UTF-8 error message as the body.
+ */
+#ifndef MUSMARK_DAEMON_H
+#define MUSMARK_DAEMON_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MUSMARK_DAEMON_MAGIC 0x314b4d4du /* "MMK1" */
+
+enum {
+  MUSMARK_DAEMON_OP_PING = 0,
+  MUSMARK_DAEMON_OP_DETECT = 1,
+  MUSMARK_DAEMON_OP_TRIAGE = 2,
+  MUSMARK_DAEMON_OP_SIGN = 3
+};
+
+enum {
+  MUSMARK_DAEMON_SOURCE_PATH = 0,
+  MUSMARK_DAEMON_SOURCE_FD = 1,
+  MUSMARK_DAEMON_SOURCE_SHM = 2
+};
+
+enum {
+  MUSMARK_DAEMON_STATUS_OK = 0,
+  MUSMARK_DAEMON_STATUS_BAD_REQUEST = 1,
+  MUSMARK_DAEMON_STATUS_FAILED = 2
+};
+
+typedef struct musmark_daemon_request {
+  uint32_t magic;
+  uint16_t op;
+  uint16_t source;
+  uint32_t request_id;     /* echoed in the response */
+  uint32_t hop_size;       /* 0 = default */
+  uint32_t secret_length;
+  uint32_t input_length;
+  uint32_t output_length;
+  uint32_t channels;       /* SHM only */
+  uint64_t frames;         /* SHM only */
+  char signature_id[36];   /* SIGN only, canonical UUID without terminator */
+  uint32_t reserved;
+} musmark_daemon_request;
+
+typedef struct musmark_daemon_response {
+  uint32_t magic;
+  uint32_t request_id;
+  int32_t status;
+  uint32_t body_length;
+} musmark_daemon_response;
+
+typedef struct musmark_daemon_detect_body {
+  uint8_t decoded;
+  uint8_t reserved[3];
+  int32_t error_count;
+  int32_t confidence;
+  uint32_t reserved2;
+  uint64_t blocks_analyzed;
+  double bit_confidence;
+  double band_agreement;
+  char signature_id[36];   /* not terminated; zeros when not decoded */
+  char payload_hash[64];
+} musmark_daemon_detect_body;
+
+typedef struct musmark_daemon_triage_body {
+  uint8_t likely;
+  uint8_t reserved[7];
+  uint64_t blocks_analyzed;
+  double sync_score;
+} musmark_daemon_triage_body;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* MUSMARK_DAEMON_H */
@@ -0,0 +1,453 @@
+#include "attacks.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+
+#include "engine.h"
+#include "fft.h"
+
+// ============================================================================
+// ATTACK SIMULATOR
+// Every attack maps a whole signal to a new one. Resampling, speed change
+// and low-pass share one windowed-sinc interpolator (tabulated kernel, each
+// output frame computed independently, so output chunks run in parallel).
+// The transform coder runs its MDCT frames in two passes, even frames then
+// odd ones, so that frames overlapping the same output never run at once.
+// ============================================================================
+
+constexpr int kZeroCrossings = 16;
+constexpr int kTablePhases = 512;  // kernel samples per zero crossing
+constexpr size_t kOutputChunk = 1 << 14;
+
+constexpr size_t kMdctSize = 1024;  // coefficients per frame; frames are twice as long
+constexpr double kDeadZone = 0.2;   // rounding bias towards zero, as transform coders do
+
+static uint64_t splitMix(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+// Uniform in (0, 1], a pure function of (seed, index).
+static double uniformAt(uint64_t seed, uint64_t index) {
+  return (static_cast<double>(splitMix(seed ^ splitMix(index)) >> 11) + 1.0) * (1.0 / 9007199254740992.0);
+}
+
+static size_t frameCount(const WavData& wav) {
+  return wav.channels > 0 ? wav.samples.size() / wav.channels : 0;
+}
+
+// ----------------------------------------------------------------------------
+// Parsing
+// ----------------------------------------------------------------------------
+
+struct AttackName {
+  AttackKind kind;
+  const char* name;
+  double minValue;
+  double maxValue;
+};
+
+static const AttackName kAttackNames[] = {
+  { AttackKind::Mp3, "mp3", 8.0, 320.0 },
+  { AttackKind::LowPass, "lowpass", 100.0, 192000.0 },
+  { AttackKind::Resample, "resample", 4000.0, 384000.0 },
+  { AttackKind::Gain, "gain", -120.0, 60.0 },
+  { AttackKind::Crop, "crop", 0.0, 86400.0 },
+  { AttackKind::Noise, "noise", -20.0, 140.0 },
+  { AttackKind::Speed, "speed", 0.5, 2.0 },
+};
+
+Attack parseAttack(const std::string& spec) {
+  const size_t colon = spec.find(':');
+  const std::string name = spec.substr(0, colon);
+  for (const AttackName& entry : kAttackNames) {
+    if (name != entry.name) continue;
+    if (colon == std::string::npos) throw std::runtime_error("Attack " + name + " needs a value, e.g. " + name + ":N");
+    const std::string text = spec.substr(colon + 1);
+    char* end = nullptr;
+    const double value = std::strtod(text.c_str(), &end);
+    if (text.empty() || *end != '\0' || !(value >= entry.minValue && value <= entry.maxValue)) {
+      throw std::runtime_error("Invalid value for attack " + name + ": " + text);
+    }
+    return { entry.kind, value };
+  }
+  throw std::runtime_error("Unknown attack: " + name);
+}
+
+std::vector<Attack> parseAttackChain(const std::string& specs) {
+  std::vector<Attack> attacks;
+  std::stringstream stream(specs);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    if (!item.empty()) attacks.push_back(parseAttack(item));
+  }
+  return attacks;
+}
+
+std::string attackSpec(const Attack& attack) {
+  for (const AttackName& entry : kAttackNames) {
+    if (entry.kind != attack.kind) continue;
+    std::ostringstream out;
+    out << entry.name << ':' << attack.value;
+    return out.str();
+  }
+  return "unknown";
+}
+
+// ----------------------------------------------------------------------------
+// Windowed-sinc interpolation
+// ----------------------------------------------------------------------------
+
+// sinc(x) under a Hann window spanning kZeroCrossings either side, sampled
+// kTablePhases times per unit of x.
+class SincTable {
+ public:
+  SincTable() : values_(kZeroCrossings * kTablePhases + 2, 0.0) {
+    values_[0] = 1.0;
+    for (size_t i = 1; i < values_.size() - 1; i++) {
+      const double x = static_cast<double>(i) / kTablePhases;
+      const double window = 0.5 + 0.5 * std::cos(kPi * x / kZeroCrossings);
+      values_[i] = std::sin(kPi * x) / (kPi * x) * window;
+    }
+  }
+
+  double at(double x) const {
+    const double position = std::fabs(x) * kTablePhases;
+    const size_t index = static_cast<size_t>(position);
+    if (index >= values_.size() - 1) return 0.0;
+    const double fraction = position - static_cast<double>(index);
+    return values_[index] + (values_[index + 1] - values_[index]) * fraction;
+  }
+
+ private:
+  std::vector<double> values_;
+};
+
+static const SincTable& sincTable() {
+  static const SincTable table;
+  return table;
+}
+
+// Output frame j is the input band-limited to `cutoff` (a fraction of the
+// input Nyquist, at most 1) and evaluated at input position j * step.
+static WavData sincInterpolate(const WavData& input, double step, double cutoff, size_t outFrames, int outRate,
+    JobPriority priority) {
+  const SincTable& table = sincTable();
+  const size_t inFrames = frameCount(input);
+  const int channels = input.channels;
+  const double halfWidth = kZeroCrossings / cutoff;
+
+  WavData out;
+  out.sampleRate = outRate;
+  out.channels = channels;
+  out.bitsPerSample = input.bitsPerSample;
+  out.samples.assign(outFrames * channels, 0.0f);
+
+  const size_t chunks = (outFrames + kOutputChunk - 1) / kOutputChunk;
+  parallelFor(chunks, 1, priority, [&](size_t begin, size_t end) {
+    std::vector<double> weights;
+    std::vector<double> acc(channels);
+    double lastFraction = -1.0;
+    for (size_t j = begin * kOutputChunk; j < std::min(end * kOutputChunk, outFrames); j++) {
+      const double t = static_cast<double>(j) * step;
+      const double base = std::floor(t);
+      const double fraction = t - base;
+      const long long first = static_cast<long long>(base) - static_cast<long long>(std::floor(halfWidth));
+      const size_t taps = static_cast<size_t>(2 * std::floor(halfWidth)) + 2;
+      // Integer steps (plain filtering) reuse one set of weights throughout.
+      if (fraction != lastFraction || weights.size() != taps) {
+        weights.resize(taps);
+        for (size_t k = 0; k < taps; k++) {
+          weights[k] = cutoff * table.at(cutoff * (t - static_cast<double>(first + static_cast<long long>(k))));
+        }
+        lastFraction = fraction;
+      }
+      std::fill(acc.begin(), acc.end(), 0.0);
+      for (size_t k = 0; k < taps; k++) {
+        const long long n = first + static_cast<long long>(k);
+        if (n < 0 || n >= static_cast<long long>(inFrames) || weights[k] == 0.0) continue;
+        const float* frame = input.samples.data() + static_cast<size_t>(n) * channels;
+        for (int c = 0; c < channels; c++) acc[c] += weights[k] * frame[c];
+      }
+      float* target = out.samples.data() + j * channels;
+      for (int c = 0; c < channels; c++) target[c] = static_cast<float>(acc[c]);
+    }
+  });
+  return out;
+}
+
+static WavData lowPass(const WavData& input, double hz, JobPriority priority) {
+  const double cutoff = hz / (0.5 * input.sampleRate);
+  if (cutoff >= 1.0) return input;
+  return sincInterpolate(input, 1.0, cutoff, frameCount(input), input.sampleRate, priority);
+}
+
+static WavData resampleRoundTrip(const WavData& input, double rate, JobPriority priority) {
+  const double ratio = rate / input.sampleRate;
+  const size_t frames = frameCount(input);
+  const size_t middleFrames = static_cast<size_t>(std::floor(frames * ratio));
+  const WavData middle = sincInterpolate(input, 1.0 / ratio, std::min(1.0, ratio), middleFrames,
+    static_cast<int>(std::lround(rate)), priority);
+  WavData out = sincInterpolate(middle, ratio, std::min(1.0, 1.0 / ratio), frames, input.sampleRate, priority);
+  return out;
+}
+
+static WavData speedChange(const WavData& input, double factor, JobPriority priority) {
+  const size_t frames = static_cast<size_t>(std::floor(frameCount(input) / factor));
+  return sincInterpolate(input, factor, std::min(1.0, 1.0 / factor), frames, input.sampleRate, priority);
+}
+
+// ----------------------------------------------------------------------------
+// Transform coder
+// ----------------------------------------------------------------------------
+
+// Upper band edges in Hz, roughly critical bands.
+static const double kBandEdges[] = {
+  100, 200, 300, 400, 510, 630, 770, 920, 1080, 1270, 1480, 1720, 2000, 2320, 2700, 3150, 3700, 4400, 5300, 6400,
+  7700, 9500, 12000, 15500, 1e9,
+};
+
+// Low-pass and masking margin by bitrate, interpolated: what an encoder at
+// that rate keeps, and how far below the band energy its noise sits.
+struct RatePoint {
+  double kbps;
+  double cutoffHz;
+  double marginDb;
+};
+
+static const RatePoint kRatePoints[] = {
+  { 8, 3000, 2 }, { 32, 7000, 6 }, { 64, 11000, 10 }, { 96, 15000, 13 }, { 128, 16000, 16 },
+  { 192, 19000, 22 }, { 256, 20000, 28 }, { 320, 20500, 34 },
+};
+
+static RatePoint ratePoint(double kbps) {
+  const size_t count = sizeof(kRatePoints) / sizeof(kRatePoints[0]);
+  if (kbps <= kRatePoints[0].kbps) return kRatePoints[0];
+  for (size_t i = 1; i < count; i++) {
+    if (kbps > kRatePoints[i].kbps) continue;
+    const RatePoint& a = kRatePoints[i - 1];
+    const RatePoint& b = kRatePoints[i];
+    const double f = (kbps - a.kbps) / (b.kbps - a.kbps);
+    return { kbps, a.cutoffHz + f * (b.cutoffHz - a.cutoffHz), a.marginDb + f * (b.marginDb - a.marginDb) };
+  }
+  return kRatePoints[count - 1];
+}
+
+struct MdctTables {
+  std::vector<double> window;   // 2N sine window
+  std::vector<Complex> pre;     // e^{-i pi n / 2N}
+  std::vector<Complex> post;    // e^{-i pi n0 (k + 1/2) / N}
+  std::vector<Complex> inPre;   // e^{i pi n0 k / N}
+  std::vector<Complex> inPost;  // e^{i pi (n + n0) / 2N}
+
+  MdctTables() {
+    const size_t n = kMdctSize;
+    const double n0 = 0.5 + n / 2.0;
+    window.resize(2 * n);
+    pre.resize(2 * n);
+    inPost.resize(2 * n);
+    post.resize(n);
+    inPre.resize(n);
+    for (size_t i = 0; i < 2 * n; i++) {
+      window[i] = std::sin(kPi * (i + 0.5) / (2.0 * n));
+      pre[i] = { std::cos(kPi * i / (2.0 * n)), -std::sin(kPi * i / (2.0 * n)) };
+      inPost[i] = { std::cos(kPi * (i + n0) / (2.0 * n)), std::sin(kPi * (i + n0) / (2.0 * n)) };
+    }
+    for (size_t k = 0; k < n; k++) {
+      post[k] = { std::cos(kPi * n0 * (k + 0.5) / n), -std::sin(kPi * n0 * (k + 0.5) / n) };
+      inPre[k] = { std::cos(kPi * n0 * k / n), std::sin(kPi * n0 * k / n) };
+    }
+  }
+};
+
+static const MdctTables& mdctTables() {
+  static const MdctTables tables;
+  return tables;
+}
+
+// Codes the 2N samples of `block` (windowed in place) and leaves the
+// windowed reconstruction there, ready to overlap-add.
+static void codeFrame(std::vector<double>& block, std::vector<Complex>& scratch, std::vector<double>& coefficients,
+    const std::vector<size_t>& bandEnds, size_t cutoffBin, double margin) {
+  const MdctTables& tables = mdctTables();
+  const size_t n = kMdctSize;
+
+  scratch.resize(2 * n);
+  for (size_t i = 0; i < 2 * n; i++) {
+    const double x = block[i] * tables.window[i];
+    scratch[i] = { x * tables.pre[i].re, x * tables.pre[i].im };
+  }
+  fft(scratch, false);
+  coefficients.resize(n);
+  for (size_t k = 0; k < n; k++) {
+    coefficients[k] = scratch[k].re * tables.post[k].re - scratch[k].im * tables.post[k].im;
+  }
+
+  // Band energies, spread a little into the neighbours, set the allowed
+  // noise; a uniform quantizer with step sqrt(12 * noise) adds that much.
+  std::vector<double> energy(bandEnds.size(), 0.0);
+  size_t bandStart = 0;
+  for (size_t b = 0; b < bandEnds.size(); b++) {
+    for (size_t k = bandStart; k < bandEnds[b]; k++) energy[b] += coefficients[k] * coefficients[k];
+    if (bandEnds[b] > bandStart) energy[b] /= static_cast<double>(bandEnds[b] - bandStart);
+    bandStart = bandEnds[b];
+  }
+  bandStart = 0;
+  for (size_t b = 0; b < bandEnds.size(); b++) {
+    double masking = energy[b];
+    if (b > 0) masking = std::max(masking, 0.3 * energy[b - 1]);
+    if (b + 1 < energy.size()) masking = std::max(masking, 0.15 * energy[b + 1]);
+    const double step = std::sqrt(12.0 * masking * margin) + 1e-9;
+    for (size_t k = bandStart; k < bandEnds[b]; k++) {
+      if (k >= cutoffBin) {
+        coefficients[k] = 0.0;
+        continue;
+      }
+      const double q = std::floor(std::fabs(coefficients[k]) / step + 0.5 - kDeadZone);
+      coefficients[k] = q > 0.0 ? std::copysign(q * step, coefficients[k]) : 0.0;
+    }
+    bandStart = bandEnds[b];
+  }
+
+  std::fill(scratch.begin(), scratch.end(), Complex{ 0.0, 0.0 });
+  for (size_t k = 0; k < n; k++) scratch[k] = { coefficients[k] * tables.inPre[k].re, coefficients[k] * tables.inPre[k].im };
+  fft(scratch, true);
+  // The inverse FFT divides by 2N; the IMDCT scale is 2 / N.
+  const double scale = 4.0;
+  for (size_t i = 0; i < 2 * n; i++) {
+    const double y = scale * (scratch[i].re * tables.inPost[i].re - scratch[i].im * tables.inPost[i].im);
+    block[i] = y * tables.window[i];
+  }
+}
+
+static WavData transformCode(const WavData& input, double kbps, JobPriority priority) {
+  const size_t n = kMdctSize;
+  const size_t frames = frameCount(input);
+  const int channels = input.channels;
+  const RatePoint point = ratePoint(kbps);
+  const double binHz = input.sampleRate / (2.0 * n);
+
+  std::vector<size_t> bandEnds;
+  for (double edge : kBandEdges) {
+    const size_t end = std::min(n, static_cast<size_t>(std::ceil(edge / binHz)));
+    if (bandEnds.empty() || end > bandEnds.back()) bandEnds.push_back(end);
+    if (end == n) break;
+  }
+  const size_t cutoffBin = std::min(n, static_cast<size_t>(point.cutoffHz / binHz));
+  const double margin = std::pow(10.0, -point.marginDb / 10.0);
+
+  WavData out;
+  out.sampleRate = input.sampleRate;
+  out.channels = channels;
+  out.bitsPerSample = input.bitsPerSample;
+  out.samples.assign(input.samples.size(), 0.0f);
+
+  // Frame f covers input frames [(f - 1) N, (f + 1) N), so every sample is
+  // covered by two frames.
+  const size_t mdctFrames = frames / n + 2;
+  for (size_t parity = 0; parity < 2; parity++) {
+    const size_t tasks = (mdctFrames + 1 - parity) / 2;
+    parallelFor(tasks * channels, 1, priority, [&](size_t begin, size_t end) {
+      std::vector<double> block(2 * n);
+      std::vector<Complex> scratch;
+      std::vector<double> coefficients;
+      for (size_t task = begin; task < end; task++) {
+        const int c = static_cast<int>(task % channels);
+        const size_t f = (task / channels) * 2 + parity;
+        const long long origin = (static_cast<long long>(f) - 1) * static_cast<long long>(n);
+        for (size_t i = 0; i < 2 * n; i++) {
+          const long long at = origin + static_cast<long long>(i);
+          block[i] = at >= 0 && at < static_cast<long long>(frames) ? input.samples[static_cast<size_t>(at) * channels + c] : 0.0;
+        }
+        codeFrame(block, scratch, coefficients, bandEnds, cutoffBin, margin);
+        for (size_t i = 0; i < 2 * n; i++) {
+          const long long at = origin + static_cast<long long>(i);
+          if (at < 0 || at >= static_cast<long long>(frames)) continue;
+          out.samples[static_cast<size_t>(at) * channels + c] += static_cast<float>(block[i]);
+        }
+      }
+    });
+  }
+  return out;
+}
+
+// ----------------------------------------------------------------------------
+// Level, noise and cropping
+// ----------------------------------------------------------------------------
+
+static WavData gain(const WavData& input, double db, JobPriority priority) {
+  WavData out = input;
+  const float scale = static_cast<float>(std::pow(10.0, db / 20.0));
+  const size_t chunks = (out.samples.size() + kOutputChunk - 1) / kOutputChunk;
+  parallelFor(chunks, 16, priority, [&](size_t begin, size_t end) {
+    for (size_t i = begin * kOutputChunk; i < std::min(end * kOutputChunk, out.samples.size()); i++) out.samples[i] *= scale;
+  });
+  return out;
+}
+
+static WavData addNoise(const WavData& input, double snrDb, uint64_t seed, JobPriority priority) {
+  const size_t count = input.samples.size();
+  const size_t chunks = (count + kOutputChunk - 1) / kOutputChunk;
+  std::vector<double> energy(chunks, 0.0);
+  parallelFor(chunks, 16, priority, [&](size_t begin, size_t end) {
+    for (size_t chunk = begin; chunk < end; chunk++) {
+      for (size_t i = chunk * kOutputChunk; i < std::min((chunk + 1) * kOutputChunk, count); i++) {
+        energy[chunk] += static_cast<double>(input.samples[i]) * input.samples[i];
+      }
+    }
+  });
+  double total = 0.0;
+  for (double e : energy) total += e;
+  const double rms = count > 0 ? std::sqrt(total / count) : 0.0;
+  const double sigma = rms * std::pow(10.0, -snrDb / 20.0);
+
+  WavData out = input;
+  const uint64_t stream = splitMix(seed ^ 0x6e6f697365ULL);
+  parallelFor(chunks, 16, priority, [&](size_t begin, size_t end) {
+    for (size_t i = begin * kOutputChunk; i < std::min(end * kOutputChunk, count); i++) {
+      // Box-Muller from two hashed uniforms.
+      const double u1 = uniformAt(stream, 2 * i);
+      const double u2 = uniformAt(stream, 2 * i + 1);
+      const double normal = std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * kPi * u2);
+      out.samples[i] += static_cast<float>(sigma * normal);
+    }
+  });
+  return out;
+}
+
+static WavData crop(const WavData& input, double seconds) {
+  const size_t drop = std::min(frameCount(input), static_cast<size_t>(std::llround(seconds * input.sampleRate)));
+  WavData out;
+  out.sampleRate = input.sampleRate;
+  out.channels = input.channels;
+  out.bitsPerSample = input.bitsPerSample;
+  out.samples.assign(input.samples.begin() + drop * input.channels, input.samples.end());
+  return out;
+}
+
+WavData applyAttack(const WavData& input, const Attack& attack, uint64_t seed, JobPriority priority) {
+  if (input.channels <= 0) throw std::runtime_error("Invalid channel count");
+  switch (attack.kind) {
+    case AttackKind::Mp3: return transformCode(input, attack.value, priority);
+    case AttackKind::LowPass: return lowPass(input, attack.value, priority);
+    case AttackKind::Resample: return resampleRoundTrip(input, attack.value, priority);
+    case AttackKind::Gain: return gain(input, attack.value, priority);
+    case AttackKind::Crop: return crop(input, attack.value);
+    case AttackKind::Noise: return addNoise(input, attack.value, seed, priority);
+    case AttackKind::Speed: return speedChange(input, attack.value, priority);
+  }
+  throw std::runtime_error("Unknown attack");
+}
+
+WavData applyAttacks(const WavData& input, const std::vector<Attack>& attacks, uint64_t seed, JobPriority priority) {
+  WavData current = input;
+  for (size_t i = 0; i < attacks.size(); i++) {
+    // Each noise stage in a chain draws its own noise.
+    current = applyAttack(current, attacks[i], splitMix(seed + i), priority);
+  }
+  return current;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "scheduler.h"
+#include "wav.h"
+
+// In-process versions of what a leak goes through on its way back to us, so
+// robustness runs need neither ffmpeg nor temporary files. All of them run
+// on the shared scheduler and are deterministic for a given seed.
+//
+//   mp3:KBPS        MDCT transform coding: 2048-sample sine-window frames,
+//                   coefficients quantized per band against a masking
+//                   estimate whose margin follows the bitrate, above a
+//                   bitrate-dependent low-pass (not a bit-exact MP3 codec)
+//   lowpass:HZ      windowed-sinc low-pass
+//   resample:HZ     to HZ and back to the original rate
+//   gain:DB         scale by DB decibels (no clipping)
+//   crop:SECONDS    drop SECONDS from the start
+//   noise:SNR_DB    white noise at SNR_DB below the signal's RMS
+//   speed:FACTOR    play FACTOR times faster (pitch follows, as tape)
+
+enum class AttackKind {
+  Mp3,
+  LowPass,
+  Resample,
+  Gain,
+  Crop,
+  Noise,
+  Speed,
+};
+
+struct Attack {
+  AttackKind kind;
+  double value;
+};
+
+// "mp3:128"; throws on an unknown name or a value out of range.
+Attack parseAttack(const std::string& spec);
+// Comma separated, applied left to right: "lowpass:11000,mp3:96".
+std::vector<Attack> parseAttackChain(const std::string& specs);
+std::string attackSpec(const Attack& attack);
+
+WavData applyAttack(const WavData& input, const Attack& attack, uint64_t seed = 1,
+  JobPriority priority = JobPriority::Batch);
+WavData applyAttacks(const WavData& input, const std::vector<Attack>& attacks, uint64_t seed = 1,
+  JobPriority priority = JobPriority::Batch);
@@ -0,0 +1,115 @@
+#include "audio_file.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <istream>
+#include <iterator>
+#include <stdexcept>
+#include <system_error>
+#include <vector>
+
+#include "fd_stream.h"
+#include "flac.h"
+
+// ============================================================================
+// AUDIO FILES
+// The first bytes decide the reader; only FLAC needs more than a peek, since
+// an ID3 tag may sit in front of the stream marker.
+// ============================================================================
+
+constexpr size_t kSniffBytes = 16;
+
+AudioContainer sniffAudio(const uint8_t* data, size_t size) {
+  if (size >= 12 && std::equal(data, data + 4, "RIFF")) return AudioContainer::Wav;
+  return isFlac(data, size) ? AudioContainer::Flac : AudioContainer::Other;
+}
+
+AudioContainer sniffAudioFile(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) throw std::runtime_error("Failed to open " + path);
+  uint8_t head[kSniffBytes] = {};
+  in.read(reinterpret_cast<char*>(head), sizeof(head));
+  const size_t got = static_cast<size_t>(in.gcount());
+  const AudioContainer container = sniffAudio(head, got);
+  // ID3 fronts MP3s as well; it is FLAC only if the stream marker follows.
+  if (container == AudioContainer::Other && got >= 10 && std::equal(head, head + 3, "ID3")) {
+    const uint64_t tagSize = (uint64_t(head[6] & 0x7F) << 21) | (uint64_t(head[7] & 0x7F) << 14) |
+      (uint64_t(head[8] & 0x7F) << 7) | uint64_t(head[9] & 0x7F);
+    in.clear();
+    in.seekg(static_cast<std::streamoff>(10 + tagSize + ((head[5] & 0x10) ? 10 : 0)));
+    char marker[4] = {};
+    in.read(marker, 4);
+    if (in.gcount() == 4 && std::equal(marker, marker + 4, "fLaC")) return AudioContainer::Flac;
+  }
+  return container;
+}
+
+WavData readAudioFile(const std::string& path, JobPriority priority) {
+  if (sniffAudioFile(path) == AudioContainer::Flac) return readFlac(path, priority);
+  return readWav(path);
+}
+
+WavData readAudioFd(int fd, JobPriority priority) {
+  FdReadBuf buf(fd);
+  std::istream in(&buf);
+  // WAV streams through; FLAC (or an ID3 tag) is decoded from memory.
+  if (in.peek() == 'R') return readWav(in);
+  const std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  if (!isFlac(bytes.data(), bytes.size())) throw std::runtime_error("Expected a WAV or FLAC stream");
+  return decodeFlac(bytes.data(), bytes.size(), priority);
+}
+
+bool hasFlacExtension(const std::string& path) {
+  if (path.size() < 5) return false;
+  std::string ext = path.substr(path.size() - 5);
+  std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+  return ext == ".flac";
+}
+
+void writeAudioFile(const std::string& path, const WavData& data, JobPriority priority, const std::string& source) {
+  if (!hasFlacExtension(path)) {
+    if (!source.empty() && sniffAudioFile(source) == AudioContainer::Wav) writeWavPreserving(path, data, source);
+    else writeWav(path, data);
+    return;
+  }
+  const int depth = data.bitsPerSample >= 8 && data.bitsPerSample <= 24 ? data.bitsPerSample : 24;
+  writeFlac(path, data, depth, priority);
+}
+
+void writeAudioTargets(const std::vector<AudioTarget>& targets, const WavData& data, JobPriority priority,
+    const std::string& source) {
+  for (const AudioTarget& target : targets) {
+    const int bits = target.bitsPerSample;
+    if (target.container == AudioContainer::Wav ? bits != 0 && bits != 16 && bits != 24 && bits != 32
+        : target.container != AudioContainer::Flac || (bits != 0 && (bits < 8 || bits > 24))) {
+      throw std::runtime_error("Unsupported output target: " + target.path);
+    }
+  }
+  const bool wavSource = !source.empty() && sniffAudioFile(source) == AudioContainer::Wav;
+  auto write = [&](const AudioTarget& target) {
+    if (target.container == AudioContainer::Flac) {
+      const int depth = data.bitsPerSample >= 8 && data.bitsPerSample <= 24 ? data.bitsPerSample : 24;
+      writeFlac(target.path, data, target.bitsPerSample ? target.bitsPerSample : depth, priority);
+    } else if (target.bitsPerSample == 0 || target.bitsPerSample == 32) {
+      if (wavSource) writeWavPreserving(target.path, data, source);
+      else writeWav(target.path, data);
+    } else {
+      writeWav(target.path, data, target.bitsPerSample);
+    }
+  };
+
+  // A target that overwrites the source waits until the others have copied
+  // its metadata chunks.
+  std::vector<const AudioTarget*> parallel, last;
+  for (const AudioTarget& target : targets) {
+    std::error_code ec;
+    const bool overwrites = !source.empty() && std::filesystem::equivalent(target.path, source, ec);
+    (overwrites ? last : parallel).push_back(&target);
+  }
+  parallelFor(parallel.size(), 1, priority, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) write(*parallel[i]);
+  });
+  for (const AudioTarget* target : last) write(*target);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "scheduler.h"
+#include "wav.h"
+
+// Container dispatch for audio on disk. Reading sniffs the content (FLAC, or
+// WAV in 32-bit float or 16/24-bit PCM), so a mislabelled file still opens; writing follows the
+// extension: ".flac" writes FLAC at the source depth, capped at 24 bits
+// (float sources become 24-bit), anything else writes float WAV.
+
+enum class AudioContainer { Wav, Flac, Other };
+
+// What the file holds, by content. Other means a format only the external
+// decoder (media_decoder.h) reads.
+AudioContainer sniffAudioFile(const std::string& path);
+AudioContainer sniffAudio(const uint8_t* data, size_t size);
+
+WavData readAudioFile(const std::string& path, JobPriority priority = JobPriority::Batch);
+// WAV or FLAC from a descriptor, read to EOF without seeking.
+WavData readAudioFd(int fd, JobPriority priority = JobPriority::Batch);
+// With `source` (the file `data` was read from), a WAV written from a WAV
+// keeps the source's metadata chunks (bext, iXML, LIST, cue, ...).
+void writeAudioFile(const std::string& path, const WavData& data, JobPriority priority = JobPriority::Batch,
+  const std::string& source = std::string());
+
+// One deliverable of a sign pass. `bitsPerSample` 0 picks the default: float
+// for WAV, the source depth (capped at 24) for FLAC. WAV takes 16, 24 or 32
+// (float), FLAC 8 to 24.
+struct AudioTarget {
+  std::string path;
+  AudioContainer container = AudioContainer::Wav;
+  int bitsPerSample = 0;
+};
+
+// Writes every target from the same samples at once, one scheduler task per
+// target (FLAC targets also encode their frames in parallel). Float WAV
+// targets keep the metadata chunks of a WAV `source`.
+void writeAudioTargets(const std::vector<AudioTarget>& targets, const WavData& data, JobPriority priority,
+  const std::string& source = std::string());
+
+bool hasFlacExtension(const std::string& path);
@@ -0,0 +1,387 @@
+#include "bench.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "engine.h"
+#include "payload.h"
+
+// ============================================================================
+// BENCHMARK MATRIX
+// Sources are rendered one (profile, trial) at a time at the longest clip
+// length; shorter clips are prefixes of it. For each source the (hop,
+// strength, clip) combinations run in parallel, and inside each one the
+// attack chains run in parallel too, so the grid keeps every worker busy
+// while only one source is held in memory. Every cell slot is written by one
+// task per source, so accumulation needs no locks.
+//
+// CPU per detection cannot be read off the grid pass, where many cells share
+// the workers, so it is measured afterwards in a separate pass: the same
+// extract-vote-decode that detect() runs, repeated with nothing else on the
+// pool, timed with process CPU time (all threads). It depends on the hop and
+// the clip length, not on the content or the mark.
+// ============================================================================
+
+static std::string formatNumber(double value) {
+  char text[32];
+  std::snprintf(text, sizeof(text), "%.6g", value);
+  return text;
+}
+
+static double processCpuSeconds() {
+#if defined(_WIN32)
+  FILETIME created, exited, kernel, user;
+  if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) return 0.0;
+  auto seconds = [](const FILETIME& time) {
+    return static_cast<double>((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) * 1e-7;
+  };
+  return seconds(kernel) + seconds(user);
+#else
+  rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0.0;
+  return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+    static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#endif
+}
+
+bool parseBenchProfile(const std::string& spec, BenchProfile& profile) {
+  const size_t at = spec.find('@');
+  BenchProfile parsed;
+  if (!parseSynthProgram(spec.substr(0, at), parsed.program)) return false;
+  if (at != std::string::npos) {
+    const std::string text = spec.substr(at + 1);
+    char* end = nullptr;
+    parsed.levelDb = std::strtod(text.c_str(), &end);
+    if (text.empty() || *end != '\0' || !(parsed.levelDb >= -90.0 && parsed.levelDb <= 0.0)) return false;
+    parsed.leveled = true;
+  }
+  profile = parsed;
+  return true;
+}
+
+std::string benchProfileName(const BenchProfile& profile) {
+  std::string name = synthProgramName(profile.program);
+  if (profile.leveled) name += "@" + formatNumber(profile.levelDb);
+  return name;
+}
+
+std::vector<std::vector<Attack>> defaultBenchAttacks() {
+  return {
+    {},
+    { { AttackKind::Mp3, 128.0 } },
+    { { AttackKind::Mp3, 64.0 } },
+    { { AttackKind::LowPass, 8000.0 } },
+    { { AttackKind::Resample, 22050.0 } },
+    { { AttackKind::Noise, 20.0 } },
+  };
+}
+
+// ----------------------------------------------------------------------------
+// Sources
+// ----------------------------------------------------------------------------
+
+static uint64_t trialSeed(const BenchOptions& options, int trial) {
+  return options.seed + static_cast<uint64_t>(trial);
+}
+
+// A canonical UUID drawn from the trial seed, so runs are reproducible.
+static std::string trialSignatureId(uint64_t seed) {
+  XorShift64 rng(seed * 0x9e3779b97f4a7c15ULL + 0x5bd1e995ULL);
+  const uint64_t high = rng.next();
+  const uint64_t low = rng.next();
+  char text[40];
+  std::snprintf(text, sizeof(text), "%08x-%04x-4%03x-%04x-%012llx",
+    static_cast<unsigned>(high >> 32), static_cast<unsigned>((high >> 16) & 0xffff),
+    static_cast<unsigned>(high & 0xfff), static_cast<unsigned>(0x8000 | ((low >> 48) & 0x3fff)),
+    static_cast<unsigned long long>(low & 0xffffffffffffULL));
+  return text;
+}
+
+static WavData renderSource(const BenchOptions& options, const BenchProfile& profile, int trial, double seconds) {
+  SynthOptions synth;
+  synth.seconds = seconds;
+  synth.sampleRate = options.sampleRate;
+  synth.channels = options.channels;
+  synth.seed = trialSeed(options, trial);
+  synth.program = profile.program;
+  WavData wav = synthesizeAudio(synth, options.priority);
+  if (profile.leveled && !wav.samples.empty()) {
+    double energy = 0.0;
+    for (float sample : wav.samples) energy += static_cast<double>(sample) * sample;
+    const double rms = std::sqrt(energy / static_cast<double>(wav.samples.size()));
+    const double gain = rms > 0.0 ? std::pow(10.0, profile.levelDb / 20.0) / rms : 1.0;
+    for (float& sample : wav.samples) sample = static_cast<float>(sample * gain);
+  }
+  return wav;
+}
+
+static WavData clipPrefix(const WavData& source, double seconds) {
+  WavData clip;
+  clip.sampleRate = source.sampleRate;
+  clip.channels = source.channels;
+  const size_t frames = std::min(
+    static_cast<size_t>(seconds * source.sampleRate), source.samples.size() / source.channels);
+  clip.samples.assign(source.samples.begin(), source.samples.begin() + frames * source.channels);
+  return clip;
+}
+
+// ----------------------------------------------------------------------------
+// Scoring
+// ----------------------------------------------------------------------------
+
+// Sums block correlations per payload position (as soft voting does, but
+// over partial periods too) and counts positions whose sign disagrees with
+// the embedded bit. A position the clip never reaches counts as half an
+// error, which is what guessing would score.
+static double votedBitErrorRate(const std::vector<float>& correlations, const std::vector<uint8_t>& bitstream) {
+  std::vector<double> sums(bitstream.size(), 0.0);
+  std::vector<uint8_t> covered(bitstream.size(), 0);
+  for (size_t i = 0; i < correlations.size(); i++) {
+    sums[i % bitstream.size()] += correlations[i];
+    covered[i % bitstream.size()] = 1;
+  }
+  double errors = 0.0;
+  for (size_t i = 0; i < bitstream.size(); i++) {
+    if (!covered[i]) errors += 0.5;
+    else if ((sums[i] > 0.0) != (bitstream[i] != 0)) errors += 1.0;
+  }
+  return errors / static_cast<double>(bitstream.size());
+}
+
+static double markToSignalDb(const WavData& original, const WavData& signedClip) {
+  double signal = 0.0;
+  double mark = 0.0;
+  for (size_t i = 0; i < original.samples.size(); i++) {
+    const double difference = static_cast<double>(signedClip.samples[i]) - original.samples[i];
+    signal += static_cast<double>(original.samples[i]) * original.samples[i];
+    mark += difference * difference;
+  }
+  if (signal <= 0.0) return 0.0;
+  return 10.0 * std::log10(std::max(mark / signal, 1e-20));
+}
+
+// Within a (profile, attack chain) group, a cell is dominated when another
+// decodes at least as often with no more bit errors, strength, detection CPU
+// and audio, and is strictly better in one of them. Strength stands in for
+// audibility rather than the measured mark level, which wobbles by hundredths
+// of a dB between clips. Cells that never decoded are not on the front,
+// however cheap.
+static void markParetoFront(std::vector<BenchCell>& cells, size_t profiles, size_t clips, size_t attacks) {
+  for (size_t p = 0; p < profiles; p++) {
+    for (size_t a = 0; a < attacks; a++) {
+      std::vector<BenchCell*> group;
+      for (size_t i = 0; i < cells.size(); i++) {
+        if ((i / attacks / clips) % profiles == p && i % attacks == a) group.push_back(&cells[i]);
+      }
+      for (BenchCell* cell : group) {
+        cell->pareto = cell->decoded > 0 && std::none_of(group.begin(), group.end(), [&](const BenchCell* other) {
+          const bool noWorse = other->decodeRate() >= cell->decodeRate() &&
+            other->bitErrorRate <= cell->bitErrorRate &&
+            other->strength <= cell->strength &&
+            other->cpuSecondsPerDetection <= cell->cpuSecondsPerDetection &&
+            other->clipSeconds <= cell->clipSeconds;
+          const bool better = other->decodeRate() > cell->decodeRate() ||
+            other->bitErrorRate < cell->bitErrorRate ||
+            other->strength < cell->strength ||
+            other->cpuSecondsPerDetection < cell->cpuSecondsPerDetection ||
+            other->clipSeconds < cell->clipSeconds;
+          return other != cell && noWorse && better;
+        });
+      }
+    }
+  }
+}
+
+// ----------------------------------------------------------------------------
+// Matrix
+// ----------------------------------------------------------------------------
+
+static void validateOptions(const BenchOptions& options) {
+  if (options.hopSizes.empty() || options.strengths.empty() || options.profiles.empty() ||
+      options.clipSeconds.empty()) {
+    throw std::runtime_error("Benchmark matrix needs at least one hop size, strength, profile and clip length");
+  }
+  for (int hop : options.hopSizes) {
+    if (hop <= 0) throw std::runtime_error("Hop size must be positive");
+  }
+  for (double strength : options.strengths) {
+    if (!(strength > 0.0 && strength <= 100.0)) throw std::runtime_error("Strength must be in (0, 100]");
+  }
+  for (double seconds : options.clipSeconds) {
+    if (!(seconds > 0.0 && seconds <= 86400.0)) throw std::runtime_error("Clip length must be in (0, 86400] seconds");
+  }
+  if (options.trials < 1) throw std::runtime_error("Benchmark matrix needs at least one trial");
+  if (options.timingRuns < 1) throw std::runtime_error("Benchmark matrix needs at least one timing run");
+}
+
+// Cells are laid out hop-major (then strength, profile, clip and attack), so
+// hop h owns the h-th run of `groupCells`.
+static void timeDetections(const BenchOptions& options, std::vector<BenchCell>& cells, size_t groupCells) {
+  const double longest = *std::max_element(options.clipSeconds.begin(), options.clipSeconds.end());
+  const WavData source = renderSource(options, options.profiles.front(), 0, longest);
+  const std::vector<uint8_t> bitstream = buildBitstream(trialSignatureId(options.seed));
+
+  for (size_t h = 0; h < options.hopSizes.size(); h++) {
+    for (size_t c = 0; c < options.clipSeconds.size(); c++) {
+      const WavData clip = clipPrefix(source, options.clipSeconds[c]);
+
+      EmbedConfig embed;
+      embed.secret = options.secret;
+      embed.hopSize = options.hopSizes[h];
+      embed.priority = options.priority;
+      const double signStart = processCpuSeconds();
+      for (int run = 0; run < options.timingRuns; run++) {
+        WavData copy = clip;
+        embedWatermarkSamples(copy, bitstream, {}, embed);
+      }
+      const double signCpu = (processCpuSeconds() - signStart) / options.timingRuns;
+
+      ExtractConfig extract;
+      extract.secret = options.secret;
+      extract.hopSize = options.hopSizes[h];
+      extract.priority = options.priority;
+      const double detectStart = processCpuSeconds();
+      for (int run = 0; run < options.timingRuns; run++) {
+        const Extraction extraction = extractWatermarkSamples(clip, extract);
+        decodeBitstream(applySoftMajorityVoting(extraction.correlations));
+      }
+      const double detectCpu = (processCpuSeconds() - detectStart) / options.timingRuns;
+
+      for (size_t i = h * groupCells; i < (h + 1) * groupCells; i++) {
+        if (cells[i].clipSeconds != options.clipSeconds[c]) continue;
+        cells[i].cpuSecondsPerDetection = detectCpu;
+        cells[i].cpuSecondsPerSign = signCpu;
+      }
+    }
+  }
+}
+
+BenchReport runBenchMatrix(const BenchOptions& input) {
+  BenchOptions options = input;
+  if (options.attacks.empty()) options.attacks = defaultBenchAttacks();
+  validateOptions(options);
+
+  const auto wallStart = std::chrono::steady_clock::now();
+  const double cpuStart = processCpuSeconds();
+
+  const size_t hops = options.hopSizes.size();
+  const size_t strengths = options.strengths.size();
+  const size_t profiles = options.profiles.size();
+  const size_t clips = options.clipSeconds.size();
+  const size_t attacks = options.attacks.size();
+
+  BenchReport report;
+  report.cells.resize(hops * strengths * profiles * clips * attacks);
+  for (size_t i = 0; i < report.cells.size(); i++) {
+    BenchCell& cell = report.cells[i];
+    cell.attacks = options.attacks[i % attacks];
+    cell.clipSeconds = options.clipSeconds[(i / attacks) % clips];
+    cell.profile = options.profiles[(i / attacks / clips) % profiles];
+    cell.strength = options.strengths[(i / attacks / clips / profiles) % strengths];
+    cell.hopSize = options.hopSizes[i / attacks / clips / profiles / strengths];
+  }
+
+  // One bank per hop size serves embedding and extraction of every trial.
+  std::vector<PnBank> banks(hops);
+  for (size_t h = 0; h < hops; h++) {
+    banks[h] = buildPnBank(
+      hashSecret(options.secret), kPayloadBits, samplesPerBitFor(options.hopSizes[h]), options.priority);
+  }
+
+  const double longest = *std::max_element(options.clipSeconds.begin(), options.clipSeconds.end());
+  for (size_t p = 0; p < profiles; p++) {
+    for (int trial = 0; trial < options.trials; trial++) {
+      const WavData source = renderSource(options, options.profiles[p], trial, longest);
+      const uint64_t seed = trialSeed(options, trial);
+      const std::string signatureId = trialSignatureId(seed);
+      const std::vector<uint8_t> bitstream = buildBitstream(signatureId);
+
+      parallelFor(hops * strengths * clips, 1, options.priority, [&](size_t begin, size_t end) {
+        for (size_t task = begin; task < end; task++) {
+          const size_t c = task % clips;
+          const size_t s = (task / clips) % strengths;
+          const size_t h = task / clips / strengths;
+
+          const WavData original = clipPrefix(source, options.clipSeconds[c]);
+          WavData marked = original;
+          const size_t frames = marked.samples.size() / marked.channels;
+          embedInterleaved(marked.samples.data(), frames, marked.channels, 0, banks[h], bitstream, {},
+            options.priority, options.strengths[s]);
+          const double markDb = markToSignalDb(original, marked);
+
+          const size_t first = (((h * strengths + s) * profiles + p) * clips + c) * attacks;
+          parallelFor(attacks, 1, options.priority, [&](size_t attackBegin, size_t attackEnd) {
+            for (size_t a = attackBegin; a < attackEnd; a++) {
+              const WavData attacked = options.attacks[a].empty()
+                ? WavData()
+                : applyAttacks(marked, options.attacks[a], seed, options.priority);
+              const WavData& heard = options.attacks[a].empty() ? marked : attacked;
+              const Extraction extraction = extractInterleaved(heard.samples.data(),
+                heard.samples.size() / heard.channels, heard.channels, 0, banks[h], options.priority);
+              const DecodedPayload decoded = decodeBitstream(applySoftMajorityVoting(extraction.correlations));
+
+              BenchCell& cell = report.cells[first + a];
+              cell.trials++;
+              if (decoded.success && decoded.signatureId == signatureId) cell.decoded++;
+              cell.bitErrorRate += votedBitErrorRate(extraction.correlations, bitstream);
+              cell.bitConfidence += extraction.bitConfidence;
+              cell.markToSignalDb += markDb;
+            }
+          });
+        }
+      });
+    }
+  }
+
+  for (BenchCell& cell : report.cells) {
+    cell.bitErrorRate /= cell.trials;
+    cell.bitConfidence /= cell.trials;
+    cell.markToSignalDb /= cell.trials;
+  }
+  timeDetections(options, report.cells, strengths * profiles * clips * attacks);
+  markParetoFront(report.cells, profiles, clips, attacks);
+
+  report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+  report.cpuSeconds = processCpuSeconds() - cpuStart;
+  report.threads = schedulerInfo().threads;
+  return report;
+}
+
+std::string benchCellJson(const BenchCell& cell) {
+  std::string chain;
+  for (const Attack& attack : cell.attacks) chain += (chain.empty() ? "" : ",") + jsonString(attackSpec(attack));
+  return "{\"hopSize\":" + std::to_string(cell.hopSize) +
+    ",\"strength\":" + formatNumber(cell.strength) +
+    ",\"profile\":" + jsonString(benchProfileName(cell.profile)) +
+    ",\"attacks\":[" + chain + "]" +
+    ",\"clipSeconds\":" + formatNumber(cell.clipSeconds) +
+    ",\"trials\":" + std::to_string(cell.trials) +
+    ",\"decoded\":" + std::to_string(cell.decoded) +
+    ",\"decodeRate\":" + formatNumber(cell.decodeRate()) +
+    ",\"bitErrorRate\":" + formatNumber(cell.bitErrorRate) +
+    ",\"bitConfidence\":" + formatNumber(cell.bitConfidence) +
+    ",\"markToSignalDb\":" + formatNumber(cell.markToSignalDb) +
+    ",\"cpuSecondsPerDetection\":" + formatNumber(cell.cpuSecondsPerDetection) +
+    ",\"cpuSecondsPerSign\":" + formatNumber(cell.cpuSecondsPerSign) +
+    ",\"pareto\":" + (cell.pareto ? "true" : "false") + "}";
+}
+
+std::string benchSummaryJson(const BenchReport& report) {
+  size_t pareto = 0;
+  for (const BenchCell& cell : report.cells) pareto += cell.pareto ? 1 : 0;
+  return "{\"cells\":" + std::to_string(report.cells.size()) +
+    ",\"pareto\":" + std::to_string(pareto) +
+    ",\"seconds\":" + formatNumber(report.seconds) +
+    ",\"cpuSeconds\":" + formatNumber(report.cpuSeconds) +
+    ",\"threads\":" + std::to_string(report.threads) + "}";
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "attacks.h"
+#include "scheduler.h"
+#include "synth.h"
+
+// Robustness-versus-cost matrix: every (hop size, strength, profile, clip
+// length) is signed in-process, put through every attack chain and detected,
+// over `trials` synthetic sources per profile. Cells report how often the
+// payload came back, the bit error rate before error correction and what a
+// detection costs in CPU, and are marked when they lie on the Pareto front of
+// their (profile, attack chain) group.
+
+// Source material: a synthetic program, optionally normalized to an RMS
+// level ("music", "speech@-30").
+struct BenchProfile {
+  SynthProgram program = SynthProgram::Music;
+  bool leveled = false;
+  double levelDb = 0.0;  // RMS dBFS when leveled; otherwise the synth's own (about -20)
+};
+
+bool parseBenchProfile(const std::string& spec, BenchProfile& profile);
+std::string benchProfileName(const BenchProfile& profile);
+
+struct BenchOptions {
+  std::string secret = "musmark-bench";
+  std::vector<int> hopSizes = { 256, 512, 1024 };
+  std::vector<double> strengths = { 0.5, 1.0, 2.0, 4.0 };  // multiples of kEmbedStrength
+  std::vector<BenchProfile> profiles = { {SynthProgram::Music}, {SynthProgram::Speech}, {SynthProgram::Mixed} };
+  std::vector<std::vector<Attack>> attacks;  // one chain per entry; empty runs the default set
+  std::vector<double> clipSeconds = { 15.0, 30.0, 60.0 };
+  int trials = 2;        // sources per profile, each drawn from its own seed
+  uint64_t seed = 1;
+  int sampleRate = 44100;
+  int channels = 2;
+  int timingRuns = 3;    // isolated detections per (hop, clip) for the CPU figures
+  JobPriority priority = JobPriority::Batch;
+};
+
+// none, mp3:128, mp3:64, lowpass:8000, resample:22050, noise:20
+std::vector<std::vector<Attack>> defaultBenchAttacks();
+
+struct BenchCell {
+  int hopSize = 0;
+  double strength = 0.0;
+  BenchProfile profile;
+  std::vector<Attack> attacks;
+  double clipSeconds = 0.0;
+  int trials = 0;
+  int decoded = 0;                // trials whose payload decoded to the embedded id
+  double bitErrorRate = 0.0;      // soft-voted payload bits against the embedded ones, mean over trials
+  double bitConfidence = 0.0;     // mean over trials
+  double markToSignalDb = 0.0;    // energy added by signing relative to the source, mean over trials
+  double cpuSecondsPerDetection = 0.0;
+  double cpuSecondsPerSign = 0.0;
+  bool pareto = false;
+
+  double decodeRate() const { return trials ? static_cast<double>(decoded) / trials : 0.0; }
+};
+
+struct BenchReport {
+  std::vector<BenchCell> cells;  // hop, strength, profile, clip length, attack chain order
+  double seconds = 0.0;          // wall time of the whole matrix
+  double cpuSeconds = 0.0;       // process CPU time of the whole matrix
+  int threads = 0;
+};
+
+BenchReport runBenchMatrix(const BenchOptions& options);
+
+std::string benchCellJson(const BenchCell& cell);
+std::string benchSummaryJson(const BenchReport& report);
@@ -0,0 +1,785 @@
+#include "musmark.h"
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "audio_file.h"
+#include "engine.h"
+#include "payload.h"
+#include "scheduler.h"
+#include "sign_pipeline.h"
+#include "wav.h"
+#include "wisdom.h"
+
+// ============================================================================
+// C API
+// Exceptions never cross this boundary: every entry point runs its body
+// through guarded(), which maps the exception to a status code and keeps the
+// message for musmark_last_error().
+// ============================================================================
+
+struct musmark_key {
+  std::string secret;
+  uint64_t seed;
+  int hopSize;
+
+  // Full payload-period bank, built once on first use.
+  std::once_flag bankOnce;
+  PnBank bank;
+};
+
+struct musmark_embedder {
+  musmark_key* key;
+  int channels;
+  JobPriority priority;
+  std::vector<uint8_t> bitstream;
+  size_t blocksDone = 0;
+  std::vector<float> pending;  // input not yet covering a whole block
+  std::vector<float> ready;    // marked output not yet read
+  size_t readOffset = 0;       // samples of `ready` already handed out
+  bool finished = false;
+};
+
+struct musmark_detector {
+  musmark_key* key;
+  int channels;
+  JobPriority priority;
+  size_t blocksDone = 0;
+  std::vector<float> pending;
+  std::vector<float> correlations;
+  double confidenceSum = 0.0;
+  double bandAgreementSum = 0.0;
+};
+
+struct musmark_analysis {
+  std::vector<float> mid;
+};
+
+static thread_local std::string tlsLastError;
+
+template <typename Fn>
+static musmark_status guarded(Fn&& fn) {
+  try {
+    fn();
+    tlsLastError.clear();
+    return MUSMARK_OK;
+  } catch (const std::invalid_argument& e) {
+    tlsLastError = e.what();
+    return MUSMARK_ERROR_INVALID_ARGUMENT;
+  } catch (const std::bad_alloc&) {
+    tlsLastError = "Out of memory";
+    return MUSMARK_ERROR_OUT_OF_MEMORY;
+  } catch (const std::exception& e) {
+    tlsLastError = e.what();
+    return MUSMARK_ERROR_FAILED;
+  } catch (...) {
+    tlsLastError = "Unknown error";
+    return MUSMARK_ERROR_FAILED;
+  }
+}
+
+static void require(bool condition, const char* message) {
+  if (!condition) throw std::invalid_argument(message);
+}
+
+// Output structs are versioned by their leading `size`: fill a full local
+// copy, then hand back only as many bytes as the caller's struct has.
+template <typename T>
+static void copyOut(const T& value, T* out) {
+  require(out != nullptr, "Output struct is null");
+  require(out->size >= sizeof(size_t), "Output struct size is not set");
+  const size_t size = std::min(out->size, sizeof(T));
+  std::memcpy(out, &value, size);
+  out->size = size;
+}
+
+static void copyString(char* dest, size_t capacity, const std::string& value) {
+  const size_t n = std::min(capacity - 1, value.size());
+  std::memcpy(dest, value.data(), n);
+  dest[n] = '\0';
+}
+
+static JobPriority toPriority(musmark_priority priority) {
+  return priority == MUSMARK_PRIORITY_BATCH ? JobPriority::Batch : JobPriority::Interactive;
+}
+
+static const PnBank& keyBank(musmark_key* key) {
+  std::call_once(key->bankOnce, [key]() {
+    key->bank = buildPnBank(key->seed, kPayloadBits, samplesPerBitFor(key->hopSize), JobPriority::Interactive);
+  });
+  return key->bank;
+}
+
+static size_t samplesPerBlock(const musmark_key* key) {
+  return static_cast<size_t>(samplesPerBitFor(key->hopSize));
+}
+
+static void requireAudio(const float* samples, size_t frames, int channels) {
+  require(channels > 0, "channels must be positive");
+  require(samples != nullptr || frames == 0, "samples is null");
+}
+
+static std::vector<uint8_t> signatureBitstream(const char* signatureId) {
+  require(signatureId != nullptr && isSignatureId(signatureId), "signature_id must be a UUID string");
+  return buildBitstream(signatureId);
+}
+
+static musmark_detection makeDetection(
+  const std::vector<float>& correlations,
+  double bitConfidence,
+  double bandAgreement
+) {
+  const DecodedPayload decoded = decodeBitstream(applySoftMajorityVoting(correlations));
+  musmark_detection result{};
+  result.size = sizeof(result);
+  result.decoded = decoded.success ? 1 : 0;
+  copyString(result.signature_id, sizeof(result.signature_id), decoded.signatureId);
+  copyString(result.payload_hash, sizeof(result.payload_hash), decoded.payloadHash);
+  result.confidence = detectionConfidence(bitConfidence, bandAgreement, decoded, false);
+  result.bit_confidence = bitConfidence;
+  result.band_agreement = bandAgreement;
+  result.blocks_analyzed = correlations.size();
+  result.error_count = decoded.errorCount;
+  return result;
+}
+
+// ---------------------------------------------------------------------------
+// Runtime
+// ---------------------------------------------------------------------------
+
+int musmark_api_version(void) {
+  return MUSMARK_API_VERSION;
+}
+
+const char* musmark_last_error(void) {
+  return tlsLastError.c_str();
+}
+
+musmark_status musmark_set_threads(int threads) {
+  return guarded([&]() {
+    require(threads >= 0, "threads must be >= 0");
+    setSchedulerThreads(threads);
+  });
+}
+
+musmark_status musmark_load_wisdom(const char* path) {
+  return guarded([&]() {
+    if (!path) {
+      loadStartupWisdom();
+      return;
+    }
+    Wisdom wisdom;
+    if (!loadWisdom(path, wisdom)) throw std::runtime_error(std::string("No usable wisdom at ") + path);
+    if (!applyWisdom(wisdom)) throw std::runtime_error("Wisdom was measured on a different machine");
+  });
+}
+
+// ---------------------------------------------------------------------------
+// Keys and payloads
+// ---------------------------------------------------------------------------
+
+musmark_status musmark_key_create(const char* secret, size_t secret_length, int hop_size, musmark_key** out) {
+  return guarded([&]() {
+    require(out != nullptr, "out is null");
+    require(secret != nullptr && secret_length > 0, "secret is empty");
+    require(hop_size >= 0, "hop_size must be >= 0");
+    std::unique_ptr<musmark_key> key(new musmark_key());
+    key->secret.assign(secret, secret_length);
+    key->seed = hashSecret(key->secret);
+    key->hopSize = hop_size ? hop_size : 1024;
+    *out = key.release();
+  });
+}
+
+void musmark_key_destroy(musmark_key* key) {
+  delete key;
+}
+
+musmark_status musmark_key_warm(musmark_key* key) {
+  return guarded([&]() {
+    require(key != nullptr, "key is null");
+    keyBank(key);
+  });
+}
+
+musmark_status musmark_payload_create(const char* project_id, const char* recipient_id, musmark_payload* out) {
+  return guarded([&]() {
+    const EncodedPayload encoded = encodePayload(project_id ? project_id : "", recipient_id ? recipient_id : "");
+    musmark_payload result{};
+    result.size = sizeof(result);
+    copyString(result.signature_id, sizeof(result.signature_id), encoded.payload.signatureId);
+    copyString(result.payload_hash, sizeof(result.payload_hash), encoded.payloadHash);
+    copyString(result.timestamp, sizeof(result.timestamp), encoded.payload.timestamp);
+    copyOut(result, out);
+  });
+}
+
+// ---------------------------------------------------------------------------
+// Whole-buffer calls
+// ---------------------------------------------------------------------------
+
+musmark_status musmark_embed(
+  musmark_key* key,
+  const char* signature_id,
+  float* samples,
+  size_t frames,
+  int channels,
+  musmark_priority priority
+) {
+  return guarded([&]() {
+    require(key != nullptr, "key is null");
+    requireAudio(samples, frames, channels);
+    const std::vector<uint8_t> bitstream = signatureBitstream(signature_id);
+    embedInterleaved(samples, frames, channels, 0, keyBank(key), bitstream, {}, toPriority(priority));
+  });
+}
+
+musmark_status musmark_embed_bits(
+  musmark_key* key,
+  const uint8_t* bits,
+  size_t bit_count,
+  const uint8_t* remove_bits,
+  size_t remove_bit_count,
+  float* samples,
+  size_t frames,
+  int channels,
+  musmark_priority priority
+) {
+  return guarded([&]() {
+    require(key != nullptr, "key is null");
+    require(bits != nullptr && bit_count > 0, "bits is empty");
+    requireAudio(samples, frames, channels);
+    const std::vector<uint8_t> bitstream(bits, bits + bit_count);
+    std::vector<uint8_t> removeBits;
+    if (remove_bits) removeBits.assign(remove_bits, remove_bits + remove_bit_count);
+
+    // PN sequences depend only on the position, so any period up to the
+    // payload length can reuse the key's bank.
+    if (bit_count <= static_cast<size_t>(kPayloadBits)) {
+      embedInterleaved(samples, frames, channels, 0, keyBank(key), bitstream, removeBits, toPriority(priority));
+    } else {
+      const PnBank bank = buildPnBank(
+        key->seed, static_cast<int>(bit_count), samplesPerBitFor(key->hopSize), toPriority(priority));
+      embedInterleaved(samples, frames, channels, 0, bank, bitstream, removeBits, toPriority(priority));
+    }
+  });
+}
+
+musmark_status musmark_embed_wav_file(
+  musmark_key* key,
+  const uint8_t* bits,
+  size_t bit_count,
+  const uint8_t* remove_bits,
+  size_t remove_bit_count,
+  const char* input,
+  const char* output,
+  musmark_priority priority
+) {
+  return guarded([&]() {
+    require(key != nullptr, "key is null");
+    require(bits != nullptr && bit_count > 0, "bits is empty");
+    require(input != nullptr, "input is null");
+    require(output != nullptr, "output is null");
+    require(!hasFlacExtension(output), "output must be WAV");
+    const std::vector<uint8_t> bitstream(bits, bits + bit_count);
+    std::vector<uint8_t> removeBits;
+    if (remove_bits) removeBits.assign(remove_bits, remove_bits + remove_bit_count);
+
+    if (bit_count <= static_cast<size_t>(kPayloadBits)) {
+      embedWavFile(input, output, keyBank(key), bitstream, removeBits, toPriority(priority));
+    } else {
+      const PnBank bank = buildPnBank(
+        key->seed, static_cast<int>(bit_count), samplesPerBitFor(key->hopSize), toPriority(priority));
+      embedWavFile(input, output, bank, bitstream, removeBits, toPriority(priority));
+    }
+  });
+}
+
+musmark_status musmark_embed_bits_to_wav(
+  musmark_key* key,
+  const uint8_t* bits,
+  size_t bit_count,
+  const uint8_t* remove_bits,
+  size_t remove_bit_count,
+  musmark_audio* audio,
+  const char* output,
+  musmark_priority priority
+) {
+  return guarded([&]() {
+    require(key != nullptr, "key is null");
+    require(bits != nullptr && bit_count > 0, "bits is empty");
+    require(audio != nullptr, "audio is null");
+    require(output != nullptr, "output is null");
+    requireAudio(audio->samples, audio->frames, audio->channels);
+    const std::vector<uint8_t> bitstream(bits, bits + bit_count);
+    std::vector<uint8_t> removeBits;
+    if (remove_bits) removeBits.assign(remove_bits, remove_bits + remove_bit_count);
+
+    if (bit_count <= static_cast<size_t>(kPayloadBits)) {
+      embedIntoWavFile(audio->samples, audio->frames, audio->channels, audio->sample_rate, output, keyBank(key),
+        bitstream, removeBits, toPriority(priority));
+    } else {
+      const PnBank bank = buildPnBank(
+        key->seed, static_cast<int>(bit_count), samplesPerBitFor(key->hopSize), toPriority(priority));
+      embedIntoWavFile(audio->samples, audio->frames, audio->channels, audio->sample_rate, output, bank, bitstream,
+        removeBits, toPriority(priority));
+    }
+  });
+}
+
+musmark_status musmark_detect(
+  musmark_key* key,
+  const float* samples,
+  size_t frames,
+  int channels,
+  musmark_priority priority,
+  musmark_detection* out
+) {
+  return guarded([&]() {
+    require(key != nullptr, "key is null");
+    requireAudio(samples, frames, channels);
+    const Extraction extraction =
+      extractInterleaved(samples, frames, channels, 0, keyBank(key), toPriority(priority));
+    copyOut(makeDetection(extraction.correlations, extraction.bitConfidence, extraction.bandAgreement), out);
+  });
+}
+
+static void copyExtraction(const Extraction& extraction, musmark_extraction* out) {
+  musmark_extraction result{};
+  result.size = sizeof(result);
+  result.block_count = extraction.correlations.size();
+  result.bit_confidence = extraction.bitConfidence;
+  result.band_agreement = extraction.bandAgreement;
+  result.finished = extraction.finished ? 1 : 0;
+  result.periods_analyzed = extraction.periodsAnalyzed;
+  result.period_count = extraction.periodCount;
+  result.correlations = new float[std::max<size_t>(1, result.block_count)];
+  std::copy(extraction.correlations.begin(), extraction.correlations.end(), result.correlations);
+  try {
+    copyOut(result, out);
+  } catch (...) {
+    delete[] result.correlations;
+    throw;
+  }
+}
+
+static void copyTriage(const TriageResult& triage, musmark_triage* out) {
+  musmark_triage result{};
+  result.size = sizeof(result);
+  result.likely = triage.likely ? 1 : 0;
+  result.sync_score = triage.syncScore;
+  result.blocks_analyzed = triage.blocksAnalyzed;
+  copyOut(result, out);
+}
+
+musmark_status musmark_extract(
+  musmark_key* key,
+  const float* samples,
+  size_t frames,
+  int channels,
+  musmark_priority priority,
+  musmark_extraction* out
+) {
+  return guarded([&]() {
+    require(key != nullptr, "key is null");
+    requireAudio(samples, frames, channels);
+    copyExtraction(extractInterleaved(samples, frames, channels, 0, keyBank(key), toPriority(priority)), out);
+  });
+}
+
+static std::chrono::steady_clock::time_point deadlineAfter(uint32_t milliseconds) {
+  return std::chrono::steady_clock::now() + std::chrono::milliseconds(milliseconds);
+}
+
+musmark_status musmark_extract_until(
+  musmark_key* key,
+  const float* samples,
+  size_t frames,
+  int channels,
+  musmark_priority priority,
+  uint32_t deadline_ms,
+  musmark_extraction* out
+) {
+  return guarded([&]() {
+    const auto deadline = deadlineAfter(deadline_ms);
+    require(key != nullptr, "key is null");
+    requireAudio(samples, frames, channels);
+    const std::vector<float> mid = downmixForAnalysis(samples, frames, channels);
+    copyExtraction(extractDownmixedUntil(mid.data(), frames, keyBank(key), deadline, toPriority(priority)), out);
+  });
+}
+
+void musmark_extraction_free(musmark_extraction* extraction) {
+  if (!extraction) return;
+  delete[] extraction->correlations;
+  extraction->correlations = nullptr;
+  extraction->block_count = 0;
+}
+
+musmark_status musmark_triage_samples(
+  musmark_key* key,
+  const float* samples,
+  size_t frames,
+  int channels,
+  musmark_priority priority,
+  musmark_triage* out
+) {
+  return guarded([&]() {
+    require(key != nullptr, "key is null");
+    requireAudio(samples, frames, channels);
+    copyTriage(triageInterleaved(samples, frames, channels, keyBank(key), toPriority(priority)), out);
+  });
+}
+
+// ---------------------------------------------------------------------------
+// Analysis handles
+// ---------------------------------------------------------------------------
+
+musmark_status musmark_analysis_create(const float* samples, size_t frames, int channels, musmark_analysis** out) {
+  return guarded([&]() {
+    require(out != nullptr, "out is null");
+    requireAudio(samples, frames, channels);
+    std::unique_ptr<musmark_analysis> analysis(new musmark_analysis());
+    analysis->mid = downmixForAnalysis(samples, frames, channels);
+    *out = analysis.release();
+  });
+}
+
+void musmark_analysis_destroy(musmark_analysis* analysis) {
+  delete analysis;
+}
+
+size_t musmark_analysis_frames(const musmark_analysis* analysis) {
+  return analysis ? analysis->mid.size() : 0;
+}
+
+musmark_status musmark_analysis_detect(
+  musmark_key* key,
+  const musmark_analysis* analysis,
+  musmark_priority priority,
+  musmark_detection* out
+) {
+  return guarded([&]() {
+    require(key != nullptr && analysis != nullptr, "key or analysis is null");
+    const Extraction extraction =
+      extractDownmixed(analysis->mid.data(), analysis->mid.size(), 0, keyBank(key), toPriority(priority));
+    copyOut(makeDetection(extraction.correlations, extraction.bitConfidence, extraction.bandAgreement), out);
+  });
+}
+
+musmark_status musmark_analysis_extract(
+  musmark_key* key,
+  const musmark_analysis* analysis,
+  musmark_priority priority,
+  musmark_extraction* out
+) {
+  return guarded([&]() {
+    require(key != nullptr && analysis != nullptr, "key or analysis is null");
+    copyExtraction(
+      extractDownmixed(analysis->mid.data(), analysis->mid.size(), 0, keyBank(key), toPriority(priority)), out);
+  });
+}
+
+musmark_status musmark_analysis_extract_until(
+  musmark_key* key,
+  const musmark_analysis* analysis,
+  musmark_priority priority,
+  uint32_t deadline_ms,
+  musmark_extraction* out
+) {
+  return guarded([&]() {
+    const auto deadline = deadlineAfter(deadline_ms);
+    require(key != nullptr && analysis != nullptr, "key or analysis is null");
+    copyExtraction(
+      extractDownmixedUntil(analysis->mid.data(), analysis->mid.size(), keyBank(key), deadline, toPriority(priority)), out);
+  });
+}
+
+musmark_status musmark_analysis_triage(
+  musmark_key* key,
+  const musmark_analysis* analysis,
+  musmark_priority priority,
+  musmark_triage* out
+) {
+  return guarded([&]() {
+    require(key != nullptr && analysis != nullptr, "key or analysis is null");
+    copyTriage(triageDownmixed(analysis->mid.data(), analysis->mid.size(), keyBank(key), toPriority(priority)), out);
+  });
+}
+
+// ---------------------------------------------------------------------------
+// Streaming embedder
+// ---------------------------------------------------------------------------
+
+musmark_status musmark_embedder_create(
+  musmark_key* key,
+  const char* signature_id,
+  int channels,
+  musmark_priority priority,
+  musmark_embedder** out
+) {
+  return guarded([&]() {
+    require(key != nullptr, "key is null");
+    require(out != nullptr, "out is null");
+    require(channels > 0, "channels must be positive");
+    std::unique_ptr<musmark_embedder> embedder(new musmark_embedder());
+    embedder->key = key;
+    embedder->channels = channels;
+    embedder->priority = toPriority(priority);
+    embedder->bitstream = signatureBitstream(signature_id);
+    *out = embedder.release();
+  });
+}
+
+// Marks every whole block in `pending` and moves it to `ready`; the partial
+// tail stays pending until more audio (or finish) arrives.
+static void drainPendingBlocks(musmark_embedder* embedder) {
+  const size_t channels = embedder->channels;
+  const size_t blockFrames = samplesPerBlock(embedder->key);
+  const size_t blocks = embedder->pending.size() / channels / blockFrames;
+  if (blocks == 0) return;
+
+  const size_t frames = blocks * blockFrames;
+  embedInterleaved(embedder->pending.data(), frames, embedder->channels, embedder->blocksDone,
+    keyBank(embedder->key), embedder->bitstream, {}, embedder->priority);
+  embedder->blocksDone += blocks;
+
+  const auto split = embedder->pending.begin() + frames * channels;
+  embedder->ready.insert(embedder->ready.end(), embedder->pending.begin(), split);
+  embedder->pending.erase(embedder->pending.begin(), split);
+}
+
+musmark_status musmark_embedder_write(musmark_embedder* embedder, const float* samples, size_t frames) {
+  return guarded([&]() {
+    require(embedder != nullptr, "embedder is null");
+    require(!embedder->finished, "embedder is finished");
+    requireAudio(samples, frames, embedder->channels);
+    embedder->pending.insert(embedder->pending.end(), samples, samples + frames * embedder->channels);
+    drainPendingBlocks(embedder);
+  });
+}
+
+musmark_status musmark_embedder_finish(musmark_embedder* embedder) {
+  return guarded([&]() {
+    require(embedder != nullptr, "embedder is null");
+    if (embedder->finished) return;
+    // A trailing partial block is never marked, matching musmark_embed.
+    embedder->ready.insert(embedder->ready.end(), embedder->pending.begin(), embedder->pending.end());
+    embedder->pending.clear();
+    embedder->finished = true;
+  });
+}
+
+size_t musmark_embedder_available(const musmark_embedder* embedder) {
+  if (!embedder) return 0;
+  return (embedder->ready.size() - embedder->readOffset) / embedder->channels;
+}
+
+musmark_status musmark_embedder_read(musmark_embedder* embedder, float* out, size_t capacity, size_t* frames) {
+  return guarded([&]() {
+    require(embedder != nullptr, "embedder is null");
+    require(frames != nullptr, "frames is null");
+    require(out != nullptr || capacity == 0, "out is null");
+    const size_t channels = embedder->channels;
+    const size_t count = std::min(capacity, musmark_embedder_available(embedder));
+    std::copy_n(embedder->ready.begin() + embedder->readOffset, count * channels, out);
+    embedder->readOffset += count * channels;
+
+    // Compact once the consumed prefix dominates, keeping reads amortized O(n).
+    if (embedder->readOffset == embedder->ready.size()) {
+      embedder->ready.clear();
+      embedder->readOffset = 0;
+    } else if (embedder->readOffset > embedder->ready.size() / 2) {
+      embedder->ready.erase(embedder->ready.begin(), embedder->ready.begin() + embedder->readOffset);
+      embedder->readOffset = 0;
+    }
+    *frames = count;
+  });
+}
+
+void musmark_embedder_destroy(musmark_embedder* embedder) {
+  delete embedder;
+}
+
+// ---------------------------------------------------------------------------
+// Streaming detector
+// ---------------------------------------------------------------------------
+
+musmark_status musmark_detector_create(
+  musmark_key* key,
+  int channels,
+  musmark_priority priority,
+  musmark_detector** out
+) {
+  return guarded([&]() {
+    require(key != nullptr, "key is null");
+    require(out != nullptr, "out is null");
+    require(channels > 0, "channels must be positive");
+    std::unique_ptr<musmark_detector> detector(new musmark_detector());
+    detector->key = key;
+    detector->channels = channels;
+    detector->priority = toPriority(priority);
+    *out = detector.release();
+  });
+}
+
+musmark_status musmark_detector_write(musmark_detector* detector, const float* samples, size_t frames) {
+  return guarded([&]() {
+    require(detector != nullptr, "detector is null");
+    requireAudio(samples, frames, detector->channels);
+    detector->pending.insert(detector->pending.end(), samples, samples + frames * detector->channels);
+
+    const size_t channels = detector->channels;
+    const size_t blockFrames = samplesPerBlock(detector->key);
+    const size_t blocks = detector->pending.size() / channels / blockFrames;
+    if (blocks == 0) return;
+
+    const Extraction extraction = extractInterleaved(detector->pending.data(), blocks * blockFrames,
+      detector->channels, detector->blocksDone, keyBank(detector->key), detector->priority);
+    detector->correlations.insert(
+      detector->correlations.end(), extraction.correlations.begin(), extraction.correlations.end());
+    detector->confidenceSum += extraction.bitConfidence * extraction.blocksAnalyzed;
+    detector->bandAgreementSum += extraction.bandAgreement * extraction.blocksAnalyzed;
+    detector->blocksDone += blocks;
+    detector->pending.erase(detector->pending.begin(), detector->pending.begin() + blocks * blockFrames * channels);
+  });
+}
+
+musmark_status musmark_detector_result(musmark_detector* detector, musmark_detection* out) {
+  return guarded([&]() {
+    require(detector != nullptr, "detector is null");
+    const size_t blocks = detector->correlations.size();
+    const double bitConfidence = blocks ? detector->confidenceSum / blocks : 0.0;
+    const double bandAgreement = blocks ? detector->bandAgreementSum / blocks : 0.0;
+    copyOut(makeDetection(detector->correlations, bitConfidence, bandAgreement), out);
+  });
+}
+
+void musmark_detector_destroy(musmark_detector* detector) {
+  delete detector;
+}
+
+// ---------------------------------------------------------------------------
+// Audio files
+// ---------------------------------------------------------------------------
+
+static void copyAudio(const WavData& wav, musmark_audio* out) {
+  musmark_audio result{};
+  result.size = sizeof(result);
+  result.channels = wav.channels;
+  result.sample_rate = wav.sampleRate;
+  result.frames = wav.channels > 0 ? wav.samples.size() / wav.channels : 0;
+  result.bits_per_sample = wav.bitsPerSample;
+  result.samples = new float[std::max<size_t>(1, wav.samples.size())];
+  std::copy(wav.samples.begin(), wav.samples.end(), result.samples);
+  try {
+    copyOut(result, out);
+  } catch (...) {
+    delete[] result.samples;
+    throw;
+  }
+}
+
+// Callers built against the struct before bits_per_sample get float depth.
+static WavData toWavData(const musmark_audio* audio) {
+  requireAudio(audio->samples, audio->frames, audio->channels);
+  WavData wav{ audio->sample_rate, audio->channels,
+    std::vector<float>(audio->samples, audio->samples + audio->frames * audio->channels) };
+  if (audio->size >= offsetof(musmark_audio, bits_per_sample) + sizeof(int) && audio->bits_per_sample > 0) {
+    wav.bitsPerSample = audio->bits_per_sample;
+  }
+  return wav;
+}
+
+musmark_status musmark_wav_read(const char* path, musmark_audio* out) {
+  return guarded([&]() {
+    require(path != nullptr, "path is null");
+    copyAudio(readWav(path), out);
+  });
+}
+
+musmark_status musmark_wav_write(const char* path, const musmark_audio* audio) {
+  return guarded([&]() {
+    require(path != nullptr, "path is null");
+    require(audio != nullptr, "audio is null");
+    writeWav(path, toWavData(audio));
+  });
+}
+
+musmark_status musmark_audio_read(const char* path, musmark_priority priority, musmark_audio* out) {
+  return guarded([&]() {
+    require(path != nullptr, "path is null");
+    copyAudio(readAudioFile(path, toPriority(priority)), out);
+  });
+}
+
+musmark_status musmark_audio_write(const char* path, const musmark_audio* audio, musmark_priority priority) {
+  return guarded([&]() {
+    require(path != nullptr, "path is null");
+    require(audio != nullptr, "audio is null");
+    writeAudioFile(path, toWavData(audio), toPriority(priority));
+  });
+}
+
+musmark_status musmark_audio_write_preserving(const char* path, const musmark_audio* audio, const char* source,
+    musmark_priority priority) {
+  return guarded([&]() {
+    require(path != nullptr, "path is null");
+    require(audio != nullptr, "audio is null");
+    require(source != nullptr, "source is null");
+    writeAudioFile(path, toWavData(audio), toPriority(priority), source);
+  });
+}
+
+musmark_status musmark_audio_write_targets(const musmark_audio_target* targets, size_t count,
+    const musmark_audio* audio, const char* source, musmark_priority priority) {
+  return guarded([&]() {
+    require(targets != nullptr && count > 0, "targets is empty");
+    require(audio != nullptr, "audio is null");
+    // The caller's struct size is the array stride; a newer caller's extra
+    // fields are skipped, an older or unset size is refused.
+    const size_t stride = targets[0].size;
+    require(stride >= sizeof(musmark_audio_target), "target size is not set");
+    std::vector<AudioTarget> list(count);
+    for (size_t i = 0; i < count; i++) {
+      const musmark_audio_target& target = *reinterpret_cast<const musmark_audio_target*>(
+        reinterpret_cast<const char*>(targets) + i * stride);
+      require(target.size == stride, "target sizes differ");
+      require(target.path != nullptr, "target path is null");
+      require(target.format == MUSMARK_FORMAT_WAV || target.format == MUSMARK_FORMAT_FLAC,
+        "unknown target format");
+      list[i].path = target.path;
+      list[i].container = target.format == MUSMARK_FORMAT_FLAC ? AudioContainer::Flac : AudioContainer::Wav;
+      list[i].bitsPerSample = target.bits_per_sample;
+    }
+    writeAudioTargets(list, toWavData(audio), toPriority(priority), source ? source : "");
+  });
+}
+
+musmark_status musmark_audio_read_fd(int fd, musmark_priority priority, musmark_audio* out) {
+  return guarded([&]() {
+    require(fd >= 0, "fd is negative");
+    copyAudio(readAudioFd(fd, toPriority(priority)), out);
+  });
+}
+
+musmark_status musmark_wav_write_fd(int fd, const musmark_audio* audio) {
+  return guarded([&]() {
+    require(fd >= 0, "fd is negative");
+    require(audio != nullptr, "audio is null");
+    writeWav(fd, toWavData(audio));
+  });
+}
+
+void musmark_audio_free(musmark_audio* audio) {
+  if (!audio) return;
+  delete[] audio->samples;
+  audio->samples = nullptr;
+  audio->frames = 0;
+}
@@ -0,0 +1,781 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <direct.h>
+#include <fcntl.h>
+#include <io.h>
+#define getcwd _getcwd
+#define fileno _fileno
+#else
+#include <unistd.h>
+#endif
+
+#include "attacks.h"
+#include "audio_file.h"
+#include "bench.h"
+#include "cpu.h"
+#include "daemon.h"
+#include "engine.h"
+#include "kernels.h"
+#include "media_decoder.h"
+#include "mp3_frames.h"
+#include "payload.h"
+#include "scan.h"
+#include "scan_lease.h"
+#include "scheduler.h"
+#include "sha256.h"
+#include "sign_pipeline.h"
+#include "signature_store.h"
+#include "synth.h"
+#include "wav.h"
+#include "wisdom.h"
+
+// ============================================================================
+// musmark — standalone command line front end
+// Same engine, payload format and defaults as the Node package, without Node.
+// Audio can come from files or stdin ("-"), either as 32-bit float WAV or as
+// headerless f32le PCM (--raw --rate N --channels N); files may also be FLAC,
+// and an OUT ending in .flac is written as FLAC. detect, triage, batch and
+// scan accept compressed files too, decoded by ffmpeg (media_decoder.h). Reports are JSON on
+// stdout, or on stderr when stdout carries audio.
+// ============================================================================
+
+static const char* kUsage =
+  "usage: musmark <command> [options]\n"
+  "\n"
+  "commands:\n"
+  "  sign    -i IN -o OUT [--project ID] [--recipient ID] [--signature-id UUID]\n"
+  "  detect  -i IN\n"
+  "  triage  -i IN                 sync-only check, much cheaper than detect\n"
+  "  batch   [--mode detect|triage] FILE...   one JSON line per file; reads\n"
+  "          paths from stdin when no FILE is given\n"
+  "  scan    [--out FILE] [--checkpoint FILE] [--no-triage] PATH...\n"
+  "          walk files/directories and detect under every --secret;\n"
+  "          JSON lines to --out (default stdout), resumable via --checkpoint\n"
+  "  scan    --coord DIR [--manifest FILE] [--report FILE]\n"
+  "          share a scan with other processes through DIR (see README)\n"
+  "  merge   --coord DIR --report FILE   merge the shard results in DIR\n"
+  "  lookup  --store DIR [ID...]   stored payloads, one JSON line per id;\n"
+  "          reads ids from stdin when no ID is given\n"
+  "  serve   --socket PATH [--keys N] [--max-batch N] [--batch-window-us N]\n"
+  "          [--max-connections N]\n"
+  "          run the detection daemon on a Unix domain socket\n"
+  "  synth   -o OUT [--seconds N] [--program music|speech|mixed] [--seed N]\n"
+  "          [--silence F] [--rate N] [--channels N]\n"
+  "          reproducible synthetic program material (default 30 s of\n"
+  "          mixed stereo at 44100, 5% silence gaps)\n"
+  "  attack  -i IN -o OUT --attack LIST [--seed N]\n"
+  "          apply attacks in order: mp3:KBPS, lowpass:HZ, resample:HZ,\n"
+  "          gain:DB, crop:SECONDS, noise:SNR_DB, speed:FACTOR\n"
+  "  bench   [--hops LIST] [--strengths LIST] [--profiles LIST] [--clips LIST]\n"
+  "          [--attack LIST]... [--trials N] [--seed N]\n"
+  "          robustness-versus-cost matrix on synthetic sources; one JSON\n"
+  "          line per cell on stdout, a summary on stderr (see README)\n"
+  "\n"
+  "common options:\n"
+  "  --secret KEY      watermark key (default: $MUSMARK_SECRET);\n"
+  "                    scan accepts it more than once\n"
+  "  --hop N           hop size, must match signing (default 1024)\n"
+  "  --raw             IN/OUT are headerless f32le PCM\n"
+  "  --rate N          sample rate for --raw input; for compressed files\n"
+  "                    (MP3, Ogg, ...) the rate they are decoded at\n"
+  "                    (default 44100)\n"
+  "  --channels N      channel count for --raw input\n"
+  "  --threads N       scheduler threads (default: wisdom or all cores)\n"
+  "  --isa NAME        kernel ISA: scalar, sse4.2, avx2, avx512\n"
+  "  --store DIR       signature store: sign records payloads, detect/batch/\n"
+  "                    scan attribute decoded ids\n"
+  "\n"
+  "scan options:\n"
+  "  --key-file FILE   one secret per line, in addition to --secret\n"
+  "  --ext LIST        directory filter, comma separated (default .wav,.flac)\n"
+  "  --workers N       files analysed at once (default 4)\n"
+  "  --io-threads N    files read at once (default 2)\n"
+  "  --prefetch N      decoded files queued ahead of the workers (default 8)\n"
+  "  --shard-size N    with --coord: manifest lines per shard (default 256)\n"
+  "  --lease-seconds N with --coord: lease expiry without renewal (default 60)\n"
+  "  --worker-id ID    with --coord: lease owner name (default host-pid)\n"
+  "\n"
+  "daemon client options:\n"
+  "  --connect PATH    send sign/detect/triage to a running daemon\n"
+  "  --shm             with --connect: IN names a POSIX shm object holding\n"
+  "                    --frames N frames of f32 PCM with --channels N\n"
+  "\n"
+  "IN/OUT may be '-' for stdin/stdout.\n";
+
+struct UsageError : std::runtime_error {
+  using std::runtime_error::runtime_error;
+};
+
+struct CliOptions {
+  std::string command;
+  std::string input = "-";
+  std::string output;
+  std::string secret;
+  std::vector<std::string> secrets;  // every --secret, for scan
+  std::string projectId;
+  std::string recipientId;
+  std::string signatureId;
+  std::string mode = "detect";
+  std::vector<std::string> files;
+  int hopSize = 1024;
+  bool raw = false;
+  int rawRate = 0;
+  int rawChannels = 0;
+  int threads = -1;
+  std::string isa;
+  std::string connect;
+  bool shm = false;
+  long long shmFrames = 0;
+  std::string store;
+  SynthOptions synth;
+  std::string attacks;
+  std::vector<std::string> attackChains;  // every --attack, for bench
+  BenchOptions bench;
+  DaemonOptions daemon;
+  ScanOptions scan;
+  LeaseScanOptions lease;
+};
+
+static double parseDoubleArg(const std::string& flag, const char* value, double minValue, double maxValue) {
+  char* end = nullptr;
+  const double parsed = std::strtod(value, &end);
+  if (end == value || *end != '\0' || !(parsed >= minValue && parsed <= maxValue)) {
+    throw UsageError("Invalid value for " + flag + ": " + value);
+  }
+  return parsed;
+}
+
+static long long parseIntArg(const std::string& flag, const char* value, long long maxValue = 1 << 24) {
+  char* end = nullptr;
+  const long long parsed = std::strtoll(value, &end, 10);
+  if (end == value || *end != '\0' || parsed < 0 || parsed > maxValue) {
+    throw UsageError("Invalid value for " + flag + ": " + value);
+  }
+  return parsed;
+}
+
+static void readKeyFile(const std::string& path, std::vector<std::string>& secrets) {
+  std::ifstream in(path);
+  if (!in) throw UsageError("Failed to open key file " + path);
+  std::string line;
+  while (std::getline(in, line)) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (!line.empty()) secrets.push_back(line);
+  }
+}
+
+static std::vector<std::string> splitList(const std::string& value) {
+  std::vector<std::string> items;
+  std::stringstream stream(value);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    if (!item.empty()) items.push_back(item);
+  }
+  return items;
+}
+
+template <typename T, typename Parse>
+static std::vector<T> parseListArg(const std::string& flag, const char* value, Parse parse) {
+  std::vector<T> items;
+  for (const std::string& item : splitList(value)) items.push_back(parse(item.c_str()));
+  if (items.empty()) throw UsageError("Empty list for " + flag);
+  return items;
+}
+
+static CliOptions parseArgs(int argc, char** argv) {
+  if (argc < 2) throw UsageError("Missing command");
+  CliOptions opts;
+  opts.command = argv[1];
+
+  for (int i = 2; i < argc; i++) {
+    const std::string arg = argv[i];
+    auto value = [&]() -> const char* {
+      if (i + 1 >= argc) throw UsageError("Missing value for " + arg);
+      return argv[++i];
+    };
+
+    if (arg == "-i" || arg == "--input") opts.input = value();
+    else if (arg == "-o" || arg == "--output") opts.output = value();
+    else if (arg == "--secret") {
+      opts.secret = value();
+      opts.secrets.push_back(opts.secret);
+    }
+    else if (arg == "--key-file") readKeyFile(value(), opts.secrets);
+    else if (arg == "--project") opts.projectId = value();
+    else if (arg == "--recipient") opts.recipientId = value();
+    else if (arg == "--signature-id") opts.signatureId = value();
+    else if (arg == "--mode") opts.mode = value();
+    else if (arg == "--hop") opts.hopSize = static_cast<int>(parseIntArg(arg, value()));
+    else if (arg == "--raw") opts.raw = true;
+    else if (arg == "--rate") opts.rawRate = static_cast<int>(parseIntArg(arg, value()));
+    else if (arg == "--channels") opts.rawChannels = static_cast<int>(parseIntArg(arg, value()));
+    else if (arg == "--threads") opts.threads = static_cast<int>(parseIntArg(arg, value()));
+    else if (arg == "--isa") opts.isa = value();
+    else if (arg == "--connect") opts.connect = value();
+    else if (arg == "--shm") opts.shm = true;
+    else if (arg == "--frames") opts.shmFrames = parseIntArg(arg, value(), 1LL << 40);
+    else if (arg == "--socket") opts.daemon.socketPath = value();
+    else if (arg == "--keys") opts.daemon.keyCacheSize = parseIntArg(arg, value());
+    else if (arg == "--max-batch") opts.daemon.maxBatch = parseIntArg(arg, value());
+    else if (arg == "--max-connections") opts.daemon.maxConnections = parseIntArg(arg, value());
+    else if (arg == "--batch-window-us") opts.daemon.batchWindowMicros = static_cast<int>(parseIntArg(arg, value()));
+    else if (arg == "--store") opts.store = value();
+    else if (arg == "--out") opts.scan.outputPath = value();
+    else if (arg == "--checkpoint") opts.scan.checkpointPath = value();
+    else if (arg == "--ext") opts.scan.extensions = splitList(value());
+    else if (arg == "--workers") opts.scan.workers = parseIntArg(arg, value(), 4096);
+    else if (arg == "--io-threads") opts.scan.ioThreads = parseIntArg(arg, value(), 4096);
+    else if (arg == "--prefetch") opts.scan.prefetch = parseIntArg(arg, value(), 1 << 16);
+    else if (arg == "--no-triage") opts.scan.triage = false;
+    else if (arg == "--coord") opts.lease.directory = value();
+    else if (arg == "--manifest") opts.lease.manifestPath = value();
+    else if (arg == "--report") opts.lease.reportPath = value();
+    else if (arg == "--worker-id") opts.lease.workerId = value();
+    else if (arg == "--shard-size") opts.lease.shardSize = parseIntArg(arg, value());
+    else if (arg == "--seconds") opts.synth.seconds = parseDoubleArg(arg, value(), 0.0, 86400.0);
+    else if (arg == "--program") {
+      const std::string name = value();
+      if (!parseSynthProgram(name, opts.synth.program)) throw UsageError("Unknown program: " + name);
+    }
+    else if (arg == "--seed") opts.synth.seed = static_cast<uint64_t>(parseIntArg(arg, value(), 1LL << 62));
+    else if (arg == "--silence") opts.synth.silence = parseDoubleArg(arg, value(), 0.0, 1.0);
+    else if (arg == "--attack") {
+      opts.attackChains.push_back(value());
+      opts.attacks += (opts.attacks.empty() ? "" : ",") + opts.attackChains.back();
+    }
+    else if (arg == "--hops") {
+      opts.bench.hopSizes = parseListArg<int>(arg, value(), [&](const char* item) {
+        return static_cast<int>(parseIntArg(arg, item));
+      });
+    }
+    else if (arg == "--strengths") {
+      opts.bench.strengths = parseListArg<double>(arg, value(), [&](const char* item) {
+        return parseDoubleArg(arg, item, 1e-3, 100.0);
+      });
+    }
+    else if (arg == "--clips") {
+      opts.bench.clipSeconds = parseListArg<double>(arg, value(), [&](const char* item) {
+        return parseDoubleArg(arg, item, 0.1, 86400.0);
+      });
+    }
+    else if (arg == "--profiles") {
+      opts.bench.profiles = parseListArg<BenchProfile>(arg, value(), [&](const char* item) {
+        BenchProfile profile;
+        if (!parseBenchProfile(item, profile)) throw UsageError("Unknown profile: " + std::string(item));
+        return profile;
+      });
+    }
+    else if (arg == "--trials") opts.bench.trials = static_cast<int>(parseIntArg(arg, value(), 1 << 16));
+    else if (arg == "--lease-seconds") opts.lease.leaseSeconds = static_cast<int>(parseIntArg(arg, value()));
+    else if (arg.size() > 1 && arg[0] == '-' && arg != "-") throw UsageError("Unknown option: " + arg);
+    else opts.files.push_back(arg);
+  }
+
+  if (opts.secret.empty() && opts.secrets.empty()) {
+    const char* env = std::getenv("MUSMARK_SECRET");
+    if (env) opts.secret = env;
+  }
+  if (opts.secrets.empty() && !opts.secret.empty()) opts.secrets.push_back(opts.secret);
+  if (opts.secret.empty() && !opts.secrets.empty()) opts.secret = opts.secrets.front();
+  if (opts.secret.empty() && opts.command != "serve" && opts.command != "merge" &&
+      opts.command != "lookup" && opts.command != "synth" && opts.command != "attack" &&
+      opts.command != "bench") {
+    throw UsageError("A secret is required (--secret or MUSMARK_SECRET)");
+  }
+  if (opts.command == "serve" && opts.daemon.socketPath.empty()) throw UsageError("serve needs --socket");
+  if (opts.command == "lookup" && opts.store.empty()) throw UsageError("lookup needs --store");
+  if (opts.shm && opts.connect.empty()) throw UsageError("--shm needs --connect");
+  if (!opts.connect.empty() && opts.raw) throw UsageError("--raw is not supported with --connect; use --shm");
+  if (opts.hopSize <= 0) throw UsageError("--hop must be positive");
+  return opts;
+}
+
+static void setBinaryStdio() {
+#if defined(_WIN32)
+  _setmode(_fileno(stdin), _O_BINARY);
+  _setmode(_fileno(stdout), _O_BINARY);
+#endif
+}
+
+static WavData readInput(const std::string& path, const CliOptions& opts) {
+  if (path == "-") {
+    if (opts.raw) return readRawPcm(std::cin, opts.rawRate, opts.rawChannels);
+    return readWav(std::cin);
+  }
+  if (opts.raw) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("Failed to open " + path);
+    return readRawPcm(in, opts.rawRate, opts.rawChannels);
+  }
+  return readAudioFile(path);
+}
+
+// Detection only needs the mid signal, so compressed files are decoded
+// externally straight into it, at --rate (default 44100). Triage of an MP3
+// decodes only the frames under the sync blocks.
+static WavData readAnalysisInput(const std::string& path, const CliOptions& opts, bool triage) {
+  if (path == "-" || opts.raw || sniffAudioFile(path) != AudioContainer::Other) return readInput(path, opts);
+  const int rate = opts.rawRate > 0 ? opts.rawRate : 44100;
+  DownmixedAudio decoded = triage ? decodeForTriage(path, rate, opts.hopSize) : decodeDownmixed(path, rate);
+  return WavData{ decoded.sampleRate, 1, std::move(decoded.mid) };
+}
+
+static void writeOutput(const std::string& path, const WavData& wav, const CliOptions& opts) {
+  if (path == "-") {
+    if (opts.raw) writeRawPcm(std::cout, wav);
+    else writeWav(std::cout, wav);
+    std::cout.flush();
+    if (!std::cout) throw std::runtime_error("Failed to write audio to stdout");
+    return;
+  }
+  if (opts.raw) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out) throw std::runtime_error("Failed to open " + path);
+    writeRawPcm(out, wav);
+    return;
+  }
+  // Metadata chunks of a WAV input (bext, iXML, ...) carry over to a WAV output.
+  writeAudioFile(path, wav, JobPriority::Batch, opts.input == "-" || opts.raw ? std::string() : opts.input);
+}
+
+static std::string formatNumber(double value) {
+  char text[32];
+  std::snprintf(text, sizeof(text), "%.6g", value);
+  return text;
+}
+
+// ---------------------------------------------------------------------------
+// Commands. Each returns the JSON report for one input.
+// ---------------------------------------------------------------------------
+
+struct DetectSummary {
+  bool decoded = false;
+  std::string signatureId;
+  std::string payloadHash;
+  int confidence = 0;
+  double bitConfidence = 0.0;
+  double bandAgreement = 0.0;
+  size_t blocksAnalyzed = 0;
+  int errorCount = 0;
+  bool attributed = false;  // looked up in a signature store
+  StoredSignature stored;
+};
+
+static std::string detectJson(const std::string& path, const DetectSummary& d) {
+  return "{\"path\":" + jsonString(path) +
+    ",\"decoded\":" + (d.decoded ? "true" : "false") +
+    ",\"signatureId\":" + (d.decoded ? jsonString(d.signatureId) : "null") +
+    ",\"payloadHash\":" + (d.decoded ? jsonString(d.payloadHash) : "null") +
+    ",\"confidence\":" + std::to_string(d.confidence) +
+    (d.attributed
+      ? ",\"found\":" + std::string(d.stored.found ? "true" : "false") +
+        ",\"payload\":" + (d.stored.found ? d.stored.payloadJson : "null")
+      : "") +
+    ",\"stats\":{\"bitConfidence\":" + formatNumber(d.bitConfidence) +
+    ",\"bandAgreement\":" + formatNumber(d.bandAgreement) +
+    ",\"blocksAnalyzed\":" + std::to_string(d.blocksAnalyzed) +
+    ",\"errorCount\":" + std::to_string(d.errorCount) + "}}";
+}
+
+static std::string triageJson(const std::string& path, bool likely, double syncScore, size_t blocksAnalyzed) {
+  return "{\"path\":" + jsonString(path) +
+    ",\"likely\":" + (likely ? "true" : "false") +
+    ",\"syncScore\":" + formatNumber(syncScore) +
+    ",\"blocksAnalyzed\":" + std::to_string(blocksAnalyzed) + "}";
+}
+
+// Fills in the stored payload and the lookup term of the confidence.
+static void attribute(DetectSummary& summary, const DecodedPayload& decoded, const CliOptions& opts) {
+  if (opts.store.empty()) return;
+  summary.attributed = true;
+  if (!summary.decoded) return;
+  summary.stored = openSignatureStore(opts.store)->get(summary.signatureId);
+  if (summary.stored.found) {
+    summary.confidence = detectionConfidence(summary.bitConfidence, summary.bandAgreement, decoded, true);
+  }
+}
+
+// Mirrors detect() in src/engine.ts; the lookup term only counts with --store.
+static std::string detectReport(const std::string& path, const WavData& wav, const CliOptions& opts) {
+  ExtractConfig config;
+  config.secret = opts.secret;
+  config.hopSize = opts.hopSize;
+  const Extraction extraction = extractWatermarkSamples(wav, config);
+  const DecodedPayload decoded = decodeBitstream(applySoftMajorityVoting(extraction.correlations));
+
+  DetectSummary summary;
+  summary.decoded = decoded.success;
+  summary.signatureId = decoded.signatureId;
+  summary.payloadHash = decoded.payloadHash;
+  summary.confidence = detectionConfidence(extraction.bitConfidence, extraction.bandAgreement, decoded, false);
+  summary.bitConfidence = extraction.bitConfidence;
+  summary.bandAgreement = extraction.bandAgreement;
+  summary.blocksAnalyzed = extraction.blocksAnalyzed;
+  summary.errorCount = decoded.errorCount;
+  attribute(summary, decoded, opts);
+  return detectJson(path, summary);
+}
+
+static std::string triageReport(const std::string& path, const WavData& wav, const CliOptions& opts) {
+  ExtractConfig config;
+  config.secret = opts.secret;
+  config.hopSize = opts.hopSize;
+  const TriageResult triage = triageSamples(wav, config);
+  return triageJson(path, triage.likely, triage.syncScore, triage.blocksAnalyzed);
+}
+
+// ---------------------------------------------------------------------------
+// Daemon client. Paths are made absolute since the daemon has its own cwd;
+// stdin/stdout travel as passed descriptors.
+// ---------------------------------------------------------------------------
+
+static std::string absolutePath(const std::string& path) {
+  if (path.empty() || path[0] == '/') return path;
+  char cwd[4096];
+  if (!getcwd(cwd, sizeof(cwd))) throw std::runtime_error("getcwd failed");
+  return std::string(cwd) + "/" + path;
+}
+
+static DaemonReply daemonRequest(const CliOptions& opts, uint16_t op, const std::string& input, const std::string& signatureId) {
+  DaemonCall call;
+  call.header.op = op;
+  call.header.hop_size = static_cast<uint32_t>(opts.hopSize);
+  call.secret = opts.secret;
+  std::unique_ptr<std::FILE, int (*)(std::FILE*)> inputFile(nullptr, std::fclose);
+
+  if (opts.shm) {
+    if (opts.rawChannels <= 0 || opts.shmFrames <= 0) throw UsageError("--shm needs --channels and --frames");
+    call.header.source = MUSMARK_DAEMON_SOURCE_SHM;
+    call.header.channels = static_cast<uint32_t>(opts.rawChannels);
+    call.header.frames = static_cast<uint64_t>(opts.shmFrames);
+    call.input = input;
+  } else if (input == "-" || (op == MUSMARK_DAEMON_OP_SIGN && opts.output == "-")) {
+    call.header.source = MUSMARK_DAEMON_SOURCE_FD;
+    if (input == "-") {
+      call.fds[0] = 0;
+    } else {
+      inputFile.reset(std::fopen(input.c_str(), "rb"));
+      if (!inputFile) throw std::runtime_error("Failed to open " + input);
+      call.fds[0] = fileno(inputFile.get());
+    }
+  } else {
+    call.header.source = MUSMARK_DAEMON_SOURCE_PATH;
+    call.input = absolutePath(input);
+  }
+
+  if (op == MUSMARK_DAEMON_OP_SIGN && !opts.shm) {
+    if (opts.output == "-") call.fds[1] = 1;
+    else call.output = absolutePath(opts.output);
+  }
+  if (!signatureId.empty()) std::memcpy(call.header.signature_id, signatureId.data(), sizeof(call.header.signature_id));
+
+  DaemonReply reply = callDaemon(opts.connect, call);
+  if (reply.status != MUSMARK_DAEMON_STATUS_OK) throw std::runtime_error("daemon: " + reply.body);
+  return reply;
+}
+
+static std::string detectViaDaemon(const std::string& path, const CliOptions& opts) {
+  const DaemonReply reply = daemonRequest(opts, MUSMARK_DAEMON_OP_DETECT, path, "");
+  musmark_daemon_detect_body body{};
+  if (reply.body.size() < sizeof(body)) throw std::runtime_error("Short reply from daemon");
+  std::memcpy(&body, reply.body.data(), sizeof(body));
+
+  DetectSummary summary;
+  summary.decoded = body.decoded != 0;
+  summary.signatureId.assign(body.signature_id, sizeof(body.signature_id));
+  summary.payloadHash.assign(body.payload_hash, sizeof(body.payload_hash));
+  summary.confidence = body.confidence;
+  summary.bitConfidence = body.bit_confidence;
+  summary.bandAgreement = body.band_agreement;
+  summary.blocksAnalyzed = static_cast<size_t>(body.blocks_analyzed);
+  summary.errorCount = body.error_count;
+  DecodedPayload decoded;
+  decoded.signatureId = summary.signatureId;
+  decoded.success = summary.decoded;
+  decoded.errorCount = summary.errorCount;
+  attribute(summary, decoded, opts);
+  return detectJson(path, summary);
+}
+
+static std::string triageViaDaemon(const std::string& path, const CliOptions& opts) {
+  const DaemonReply reply = daemonRequest(opts, MUSMARK_DAEMON_OP_TRIAGE, path, "");
+  musmark_daemon_triage_body body{};
+  if (reply.body.size() < sizeof(body)) throw std::runtime_error("Short reply from daemon");
+  std::memcpy(&body, reply.body.data(), sizeof(body));
+  return triageJson(path, body.likely != 0, body.sync_score, static_cast<size_t>(body.blocks_analyzed));
+}
+
+static std::string runSign(const CliOptions& opts) {
+  if (opts.output.empty() && !opts.shm) throw UsageError("sign needs an output (-o)");
+
+  EncodedPayload encoded = encodePayload(opts.projectId, opts.recipientId);
+  if (!opts.signatureId.empty()) {
+    if (!isSignatureId(opts.signatureId)) throw UsageError("--signature-id must be a UUID");
+    encoded.payload.signatureId = opts.signatureId;
+    const std::string json = encoded.payload.toJson();
+    encoded.payloadHash = sha256Hex(json.data(), json.size());
+    encoded.bitstream = buildBitstream(opts.signatureId);
+  }
+
+  if (!opts.connect.empty()) {
+    daemonRequest(opts, MUSMARK_DAEMON_OP_SIGN, opts.input, encoded.payload.signatureId);
+  } else {
+    EmbedConfig config;
+    config.secret = opts.secret;
+    config.hopSize = opts.hopSize;
+    const bool toWavFile = !opts.shm && !opts.raw && opts.output != "-" && !hasFlacExtension(opts.output);
+    const bool fromWavFile = opts.input != "-" && !opts.raw && sniffAudioFile(opts.input) == AudioContainer::Wav;
+    if (toWavFile && fromWavFile && canPipelineSign(opts.input, opts.output)) {
+      embedWavFile(opts.input, opts.output, encoded.bitstream, {}, config);
+    } else if (toWavFile && !fromWavFile) {
+      WavData wav = readInput(opts.input, opts);
+      embedIntoWavFile(wav, opts.output, encoded.bitstream, {}, config);
+    } else {
+      WavData wav = readInput(opts.input, opts);
+      embedWatermarkSamples(wav, encoded.bitstream, {}, config);
+      writeOutput(opts.output, wav, opts);
+    }
+  }
+  if (!opts.store.empty()) {
+    openSignatureStore(opts.store)->put(encoded.payload.signatureId, encoded.payload.toJson(), encoded.payloadHash);
+  }
+
+  return "{\"outputPath\":" + jsonString(opts.output) +
+    ",\"signatureId\":" + jsonString(encoded.payload.signatureId) +
+    ",\"payloadHash\":" + jsonString(encoded.payloadHash) +
+    ",\"payload\":" + encoded.payload.toJson() + "}";
+}
+
+static std::string runBatchItem(const std::string& path, const CliOptions& opts) {
+  try {
+    if (!opts.connect.empty()) {
+      return opts.mode == "triage" ? triageViaDaemon(path, opts) : detectViaDaemon(path, opts);
+    }
+    const WavData wav = readAnalysisInput(path, opts, opts.mode == "triage");
+    return opts.mode == "triage" ? triageReport(path, wav, opts) : detectReport(path, wav, opts);
+  } catch (const std::exception& e) {
+    return "{\"path\":" + jsonString(path) + ",\"error\":" + jsonString(e.what()) + "}";
+  }
+}
+
+// Files are independent, so they are spread over the scheduler at batch
+// priority; each file's block loops nest inside and share the same workers.
+// Lines are written as files finish, not in argument order.
+static int runBatch(const CliOptions& opts) {
+  if (opts.mode != "detect" && opts.mode != "triage") {
+    throw UsageError("--mode must be detect or triage");
+  }
+  std::vector<std::string> files = opts.files;
+  if (files.empty()) {
+    std::string line;
+    while (std::getline(std::cin, line)) {
+      if (!line.empty() && line.back() == '\r') line.pop_back();
+      if (!line.empty()) files.push_back(line);
+    }
+  }
+
+  std::mutex outputMutex;
+  std::atomic<int> failures{0};
+  parallelFor(files.size(), 1, JobPriority::Batch, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const std::string report = runBatchItem(files[i], opts);
+      if (report.find("\"error\":") != std::string::npos) failures++;
+      std::lock_guard<std::mutex> lock(outputMutex);
+      std::cout << report << '\n';
+      std::cout.flush();
+    }
+  });
+  return failures.load() ? 1 : 0;
+}
+
+// Unlike batch, scan walks directories, tries several keys and can resume,
+// so it runs on its own reader/worker pipeline (see scan.cc).
+static int runScan(const CliOptions& opts) {
+  if (!opts.lease.directory.empty()) {
+    LeaseScanOptions lease = opts.lease;
+    lease.scan = opts.scan;
+    lease.scan.secrets = opts.secrets;
+    lease.scan.hopSize = opts.hopSize;
+    lease.scan.storePath = opts.store;
+    if (opts.rawRate > 0) lease.scan.sampleRate = opts.rawRate;
+    const LeaseScanSummary summary = runLeaseScan(lease);
+    std::cout << leaseScanSummaryJson(summary) << std::endl;
+    return summary.scan.failed ? 1 : 0;
+  }
+  if (opts.files.empty()) throw UsageError("scan needs at least one file or directory");
+  ScanOptions scan = opts.scan;
+  scan.inputs = opts.files;
+  scan.secrets = opts.secrets;
+  scan.hopSize = opts.hopSize;
+  if (opts.rawRate > 0) scan.sampleRate = opts.rawRate;
+  scan.storePath = opts.store;
+  if (scan.outputPath.empty()) scan.outputPath = "-";
+
+  const ScanSummary summary = scanCorpus(scan);
+  // Keep stdout clean for the records when they go there.
+  std::ostream& reportStream = scan.outputPath == "-" ? std::cerr : std::cout;
+  reportStream << scanSummaryJson(summary) << std::endl;
+  return summary.failed ? 1 : 0;
+}
+
+// Synthetic material needs no input; --rate and --channels set its format.
+static std::string runSynth(const CliOptions& opts) {
+  if (opts.output.empty()) throw UsageError("synth needs an output (-o)");
+  SynthOptions options = opts.synth;
+  if (opts.rawRate > 0) options.sampleRate = opts.rawRate;
+  if (opts.rawChannels > 0) options.channels = opts.rawChannels;
+  const WavData wav = synthesizeAudio(options);
+  writeOutput(opts.output, wav, opts);
+  return "{\"outputPath\":" + jsonString(opts.output) +
+    ",\"program\":" + jsonString(synthProgramName(options.program)) +
+    ",\"seed\":" + std::to_string(options.seed) +
+    ",\"frames\":" + std::to_string(wav.samples.size() / wav.channels) +
+    ",\"sampleRate\":" + std::to_string(wav.sampleRate) +
+    ",\"channels\":" + std::to_string(wav.channels) + "}";
+}
+
+static std::string runAttack(const CliOptions& opts) {
+  if (opts.output.empty()) throw UsageError("attack needs an output (-o)");
+  if (opts.attacks.empty()) throw UsageError("attack needs --attack");
+  const std::vector<Attack> attacks = parseAttackChain(opts.attacks);
+  const WavData input = readInput(opts.input, opts);
+  const WavData output = applyAttacks(input, attacks, opts.synth.seed);
+  writeOutput(opts.output, output, opts);
+  std::string chain;
+  for (const Attack& attack : attacks) chain += (chain.empty() ? "" : ",") + jsonString(attackSpec(attack));
+  return "{\"outputPath\":" + jsonString(opts.output) +
+    ",\"attacks\":[" + chain + "]" +
+    ",\"frames\":" + std::to_string(output.samples.size() / output.channels) +
+    ",\"sampleRate\":" + std::to_string(output.sampleRate) + "}";
+}
+
+// The matrix only reports once every source has been through it; cells go
+// to stdout one per line and the summary to stderr.
+static int runBench(const CliOptions& opts) {
+  BenchOptions options = opts.bench;
+  if (!opts.secret.empty()) options.secret = opts.secret;
+  options.seed = opts.synth.seed;
+  if (opts.rawRate > 0) options.sampleRate = opts.rawRate;
+  if (opts.rawChannels > 0) options.channels = opts.rawChannels;
+  for (const std::string& chain : opts.attackChains) {
+    options.attacks.push_back(chain == "none" ? std::vector<Attack>() : parseAttackChain(chain));
+  }
+  const BenchReport report = runBenchMatrix(options);
+  for (const BenchCell& cell : report.cells) std::cout << benchCellJson(cell) << '\n';
+  std::cout.flush();
+  std::cerr << benchSummaryJson(report) << std::endl;
+  return 0;
+}
+
+// One batched lookup for all ids, so the log is read front to back.
+static int runLookup(const CliOptions& opts) {
+  std::vector<std::string> ids = opts.files;
+  if (ids.empty()) {
+    std::string line;
+    while (std::getline(std::cin, line)) {
+      if (!line.empty() && line.back() == '\r') line.pop_back();
+      if (!line.empty()) ids.push_back(line);
+    }
+  }
+  const std::vector<StoredSignature> found = openSignatureStore(opts.store)->getMany(ids);
+  for (size_t i = 0; i < ids.size(); i++) {
+    std::cout << "{\"signatureId\":" << jsonString(ids[i])
+              << ",\"found\":" << (found[i].found ? "true" : "false")
+              << ",\"payload\":" << (found[i].found ? found[i].payloadJson : "null")
+              << ",\"payloadHash\":" << (found[i].found ? jsonString(found[i].payloadHash) : "null") << "}\n";
+  }
+  std::cout.flush();
+  return 0;
+}
+
+static void applyRuntimeOptions(const CliOptions& opts) {
+  loadStartupWisdom();
+  if (opts.threads >= 0) setSchedulerThreads(opts.threads);
+  if (!opts.isa.empty()) {
+    CpuIsa isa;
+    if (!parseCpuIsa(opts.isa, isa)) throw UsageError("Unknown ISA: " + opts.isa);
+    if (!selectKernels(isa)) throw std::runtime_error("ISA not supported on this CPU: " + opts.isa);
+  }
+}
+
+int main(int argc, char** argv) {
+  if (argc >= 2 && (std::strcmp(argv[1], "-h") == 0 || std::strcmp(argv[1], "--help") == 0)) {
+    std::fputs(kUsage, stdout);
+    return 0;
+  }
+
+  try {
+    setBinaryStdio();
+    const CliOptions opts = parseArgs(argc, argv);
+    applyRuntimeOptions(opts);
+
+    if (opts.command == "sign") {
+      const std::string report = runSign(opts);
+      // Keep stdout clean for audio when signing into a pipe.
+      std::ostream& reportStream = opts.output == "-" ? std::cerr : std::cout;
+      reportStream << report << std::endl;
+      return 0;
+    }
+    if (opts.command == "detect" || opts.command == "triage") {
+      const std::string input = opts.files.empty() ? opts.input : opts.files[0];
+      if (!opts.connect.empty()) {
+        std::cout << (opts.command == "detect" ? detectViaDaemon(input, opts) : triageViaDaemon(input, opts))
+                  << std::endl;
+        return 0;
+      }
+      const WavData wav = readAnalysisInput(input, opts, opts.command == "triage");
+      std::cout << (opts.command == "detect" ? detectReport(input, wav, opts) : triageReport(input, wav, opts))
+                << std::endl;
+      return 0;
+    }
+    if (opts.command == "batch") {
+      return runBatch(opts);
+    }
+    if (opts.command == "scan") {
+      return runScan(opts);
+    }
+    if (opts.command == "lookup") {
+      return runLookup(opts);
+    }
+    if (opts.command == "bench") {
+      return runBench(opts);
+    }
+    if (opts.command == "merge") {
+      if (opts.lease.directory.empty() || opts.lease.reportPath.empty()) throw UsageError("merge needs --coord and --report");
+      const size_t records = mergeLeaseScan(opts.lease.directory, opts.lease.reportPath);
+      std::cout << "{\"records\":" << records << "}" << std::endl;
+      return 0;
+    }
+    if (opts.command == "synth" || opts.command == "attack") {
+      const std::string report = opts.command == "synth" ? runSynth(opts) : runAttack(opts);
+      std::ostream& reportStream = opts.output == "-" ? std::cerr : std::cout;
+      reportStream << report << std::endl;
+      return 0;
+    }
+    if (opts.command == "serve") {
+      runDaemon(opts.daemon);
+      return 0;
+    }
+    throw UsageError("Unknown command: " + opts.command);
+  } catch (const UsageError& e) {
+    std::fprintf(stderr, "musmark: %s\n\n%s", e.what(), kUsage);
+    return 2;
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "musmark: %s\n", e.what());
+    return 1;
+  }
+}
@@ -0,0 +1,89 @@
+#include "cpu.h"
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define MUSMARK_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#ifdef MUSMARK_X86
+static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+#if defined(_MSC_VER)
+  int out[4];
+  __cpuidex(out, static_cast<int>(leaf), static_cast<int>(subleaf));
+  for (int i = 0; i < 4; i++) regs[i] = static_cast<uint32_t>(out[i]);
+#else
+  __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static uint64_t xgetbv0() {
+#if defined(_MSC_VER)
+  return _xgetbv(0);
+#else
+  uint32_t lo, hi;
+  __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+  return (static_cast<uint64_t>(hi) << 32) | lo;
+#endif
+}
+#endif
+
+CpuIsa detectCpuIsa() {
+#ifdef MUSMARK_X86
+  uint32_t regs[4];
+  cpuid(0, 0, regs);
+  const uint32_t maxLeaf = regs[0];
+  if (maxLeaf < 1) return CpuIsa::Scalar;
+
+  cpuid(1, 0, regs);
+  const uint32_t ecx1 = regs[2];
+  const bool sse42 = ecx1 & (1u << 20);
+  const bool osxsave = ecx1 & (1u << 27);
+  const bool avx = ecx1 & (1u << 28);
+  const bool fma = ecx1 & (1u << 12);
+  if (!sse42) return CpuIsa::Scalar;
+  if (!osxsave || !avx || maxLeaf < 7) return CpuIsa::Sse42;
+
+  // The OS must save YMM (and for AVX-512 also opmask/ZMM) state.
+  const uint64_t xcr0 = xgetbv0();
+  if ((xcr0 & 0x6) != 0x6) return CpuIsa::Sse42;
+
+  cpuid(7, 0, regs);
+  const uint32_t ebx7 = regs[1];
+  const bool avx2 = ebx7 & (1u << 5);
+  if (!avx2 || !fma) return CpuIsa::Sse42;
+
+  const bool avx512f = ebx7 & (1u << 16);
+  const bool avx512dq = ebx7 & (1u << 17);
+  const bool avx512bw = ebx7 & (1u << 30);
+  const bool avx512vl = ebx7 & (1u << 31);
+  if (avx512f && avx512dq && avx512bw && avx512vl && (xcr0 & 0xE6) == 0xE6) {
+    return CpuIsa::Avx512;
+  }
+  return CpuIsa::Avx2;
+#else
+  return CpuIsa::Scalar;
+#endif
+}
+
+const char* cpuIsaName(CpuIsa isa) {
+  switch (isa) {
+    case CpuIsa::Sse42: return "sse4.2";
+    case CpuIsa::Avx2: return "avx2";
+    case CpuIsa::Avx512: return "avx512";
+    default: return "scalar";
+  }
+}
+
+bool parseCpuIsa(const std::string& name, CpuIsa& out) {
+  if (name == "scalar") out = CpuIsa::Scalar;
+  else if (name == "sse4.2" || name == "sse42") out = CpuIsa::Sse42;
+  else if (name == "avx2") out = CpuIsa::Avx2;
+  else if (name == "avx512") out = CpuIsa::Avx512;
+  else return false;
+  return true;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <string>
+
+// Instruction set levels the hot kernels are compiled for, lowest first.
+enum class CpuIsa {
+  Scalar = 0,
+  Sse42 = 1,
+  Avx2 = 2,
+  Avx512 = 3,
+};
+
+// Highest level supported by both the CPU and the OS (XSAVE state enabled).
+CpuIsa detectCpuIsa();
+
+const char* cpuIsaName(CpuIsa isa);
+bool parseCpuIsa(const std::string& name, CpuIsa& out);
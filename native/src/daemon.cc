@@ -0,0 +1,668 @@
+#include "daemon.h"
+#include <stdexcept>
+
+#if !defined(__linux__)
+
+void runDaemon(const DaemonOptions&) {
+  throw std::runtime_error("The musmark daemon is only available on Linux");
+}
+
+DaemonReply callDaemon(const std::string&, const DaemonCall&) {
+  throw std::runtime_error("The musmark daemon is only available on Linux");
+}
+
+#else
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "audio_file.h"
+#include "musmark.h"
+#include "payload.h"
+#include "scheduler.h"
+#include "wav.h"
+
+// ============================================================================
+// DAEMON
+// Connection threads parse requests and hand them to one dispatcher, which
+// collects whatever arrives within the batch window and fans the batch out
+// over the shared scheduler. Keys stay warm in a small LRU, so a request
+// pays for reading its audio and the correlation work, nothing else.
+// ============================================================================
+
+static_assert(sizeof(musmark_daemon_request) == 80, "daemon request layout changed");
+static_assert(sizeof(musmark_daemon_response) == 16, "daemon response layout changed");
+
+constexpr uint32_t kMaxFieldLength = 4096;
+
+static void readAll(int fd, void* data, size_t size) {
+  char* bytes = static_cast<char*>(data);
+  while (size > 0) {
+    const ssize_t n = ::read(fd, bytes, size);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) throw std::runtime_error(n == 0 ? "Connection closed" : std::strerror(errno));
+    bytes += n;
+    size -= static_cast<size_t>(n);
+  }
+}
+
+static void writeAll(int fd, const void* data, size_t size) {
+  const char* bytes = static_cast<const char*>(data);
+  while (size > 0) {
+    const ssize_t n = ::send(fd, bytes, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) throw std::runtime_error(std::strerror(errno));
+    bytes += n;
+    size -= static_cast<size_t>(n);
+  }
+}
+
+// Reads exactly one request header, collecting any descriptors sent with it.
+// Returns false on a clean close before the first byte.
+static bool readHeader(int fd, musmark_daemon_request& header, int fds[2]) {
+  char* bytes = reinterpret_cast<char*>(&header);
+  size_t got = 0;
+  while (got < sizeof(header)) {
+    iovec iov{ bytes + got, sizeof(header) - got };
+    alignas(cmsghdr) char control[CMSG_SPACE(2 * sizeof(int))];
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    const ssize_t n = ::recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    if (n < 0 && errno == EINTR) continue;
+    if (n == 0 && got == 0) return false;
+    if (n <= 0) throw std::runtime_error(n == 0 ? "Connection closed" : std::strerror(errno));
+
+    for (cmsghdr* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+      if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+      const size_t count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      const int* passed = reinterpret_cast<const int*>(CMSG_DATA(c));
+      for (size_t i = 0; i < count; i++) {
+        if (fds[0] < 0) fds[0] = passed[i];
+        else if (fds[1] < 0) fds[1] = passed[i];
+        else ::close(passed[i]);
+      }
+    }
+    got += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+static std::string readField(int fd, uint32_t length) {
+  if (length > kMaxFieldLength) throw std::runtime_error("Request field too long");
+  std::string value(length, '\0');
+  if (length) readAll(fd, &value[0], length);
+  return value;
+}
+
+// ---------------------------------------------------------------------------
+// Warm keys
+// ---------------------------------------------------------------------------
+
+class KeyCache {
+ public:
+  explicit KeyCache(size_t capacity) : capacity_(std::max<size_t>(1, capacity)) {}
+
+  std::shared_ptr<musmark_key> acquire(const std::string& secret, int hopSize) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+      if (it->secret == secret && it->hopSize == hopSize) {
+        entries_.splice(entries_.begin(), entries_, it);
+        return it->key;
+      }
+    }
+    musmark_key* raw = nullptr;
+    if (musmark_key_create(secret.data(), secret.size(), hopSize, &raw) != MUSMARK_OK) {
+      throw std::invalid_argument(musmark_last_error());
+    }
+    std::shared_ptr<musmark_key> key(raw, musmark_key_destroy);
+    entries_.push_front({ secret, hopSize, key });
+    if (entries_.size() > capacity_) entries_.pop_back();
+    return key;
+  }
+
+ private:
+  struct Entry {
+    std::string secret;
+    int hopSize;
+    std::shared_ptr<musmark_key> key;
+  };
+  size_t capacity_;
+  std::mutex mutex_;
+  std::list<Entry> entries_;
+};
+
+// ---------------------------------------------------------------------------
+// Requests
+// ---------------------------------------------------------------------------
+
+// Interleaved samples from any source; SHM maps the caller's memory directly.
+struct Audio {
+  WavData wav{ 0, 0, {} };
+  float* samples = nullptr;
+  size_t frames = 0;
+  int channels = 0;
+  void* map = nullptr;
+  size_t mapSize = 0;
+
+  Audio() = default;
+  Audio(const Audio&) = delete;
+  Audio& operator=(const Audio&) = delete;
+  ~Audio() {
+    if (map) ::munmap(map, mapSize);
+  }
+};
+
+struct Job {
+  musmark_daemon_request header{};
+  std::string secret;
+  std::string input;
+  std::string output;
+  int fds[2] = { -1, -1 };
+
+  Audio audio;                       // loaded by the connection thread
+  std::shared_ptr<musmark_key> key;  // resolved by the dispatcher
+
+  int32_t status = MUSMARK_DAEMON_STATUS_OK;
+  std::string body;
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool keyed = false;
+
+  ~Job() {
+    for (int fd : fds) {
+      if (fd >= 0) ::close(fd);
+    }
+  }
+};
+
+static void check(musmark_status status) {
+  if (status == MUSMARK_ERROR_INVALID_ARGUMENT) throw std::invalid_argument(musmark_last_error());
+  if (status != MUSMARK_OK) throw std::runtime_error(musmark_last_error());
+}
+
+static void loadAudio(Job& job, bool writable, Audio& audio) {
+  switch (job.header.source) {
+    case MUSMARK_DAEMON_SOURCE_PATH:
+      audio.wav = readAudioFile(job.input);
+      break;
+    case MUSMARK_DAEMON_SOURCE_FD: {
+      if (job.fds[0] < 0) throw std::invalid_argument("FD source without a descriptor");
+      audio.wav = readWav(job.fds[0]);
+      break;
+    }
+    case MUSMARK_DAEMON_SOURCE_SHM: {
+      const int channels = static_cast<int>(job.header.channels);
+      if (channels <= 0 || job.header.frames == 0) throw std::invalid_argument("SHM source needs channels and frames");
+      // Both counts come from the client: a product that wraps would pass the
+      // size check below and map less than the engine then touches.
+      const size_t frameBytes = static_cast<size_t>(channels) * sizeof(float);
+      if (job.header.frames > SIZE_MAX / frameBytes) throw std::invalid_argument("SHM frames * channels overflows");
+      const int fd = ::shm_open(job.input.c_str(), writable ? O_RDWR : O_RDONLY, 0);
+      if (fd < 0) throw std::runtime_error("shm_open " + job.input + ": " + std::strerror(errno));
+      struct stat st{};
+      const size_t bytes = static_cast<size_t>(job.header.frames) * frameBytes;
+      if (::fstat(fd, &st) != 0 || st.st_size < 0 || static_cast<uint64_t>(st.st_size) < bytes) {
+        ::close(fd);
+        throw std::invalid_argument("Shared memory object smaller than frames * channels");
+      }
+      void* map = ::mmap(nullptr, bytes, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+      ::close(fd);
+      if (map == MAP_FAILED) throw std::runtime_error(std::string("mmap: ") + std::strerror(errno));
+      audio.map = map;
+      audio.mapSize = bytes;
+      audio.samples = static_cast<float*>(map);
+      audio.frames = job.header.frames;
+      audio.channels = channels;
+      return;
+    }
+    default:
+      throw std::invalid_argument("Unknown audio source");
+  }
+  audio.samples = audio.wav.samples.data();
+  audio.channels = audio.wav.channels;
+  audio.frames = audio.channels > 0 ? audio.wav.samples.size() / audio.channels : 0;
+}
+
+// Request handling is split so blocking I/O never runs on the dispatcher: a
+// client may be piping one request's output into another request's input.
+// Everything but the key lookup runs on the connection thread; computeJob
+// hands its block loops to the shared scheduler at the job's own priority.
+
+static void prepareJob(Job& job) {
+  const musmark_daemon_request& h = job.header;
+  if (h.op == MUSMARK_DAEMON_OP_PING) return;
+  if (h.op != MUSMARK_DAEMON_OP_DETECT && h.op != MUSMARK_DAEMON_OP_TRIAGE && h.op != MUSMARK_DAEMON_OP_SIGN) {
+    throw std::invalid_argument("Unknown op");
+  }
+  if (h.op == MUSMARK_DAEMON_OP_SIGN && !isSignatureId(std::string(h.signature_id, sizeof(h.signature_id)))) {
+    throw std::invalid_argument("SIGN needs a UUID signature_id");
+  }
+  loadAudio(job, h.op == MUSMARK_DAEMON_OP_SIGN, job.audio);
+}
+
+static void computeJob(Job& job) {
+  const musmark_daemon_request& h = job.header;
+  Audio& audio = job.audio;
+
+  if (h.op == MUSMARK_DAEMON_OP_DETECT) {
+    musmark_detection result{};
+    result.size = sizeof(result);
+    check(musmark_detect(job.key.get(), audio.samples, audio.frames, audio.channels, MUSMARK_PRIORITY_INTERACTIVE, &result));
+
+    musmark_daemon_detect_body body{};
+    body.decoded = result.decoded ? 1 : 0;
+    body.error_count = result.error_count;
+    body.confidence = result.confidence;
+    body.blocks_analyzed = result.blocks_analyzed;
+    body.bit_confidence = result.bit_confidence;
+    body.band_agreement = result.band_agreement;
+    std::memcpy(body.signature_id, result.signature_id, std::strlen(result.signature_id));
+    std::memcpy(body.payload_hash, result.payload_hash, std::strlen(result.payload_hash));
+    job.body.assign(reinterpret_cast<const char*>(&body), sizeof(body));
+  } else if (h.op == MUSMARK_DAEMON_OP_TRIAGE) {
+    musmark_triage result{};
+    result.size = sizeof(result);
+    check(musmark_triage_samples(job.key.get(), audio.samples, audio.frames, audio.channels, MUSMARK_PRIORITY_INTERACTIVE, &result));
+
+    musmark_daemon_triage_body body{};
+    body.likely = result.likely ? 1 : 0;
+    body.blocks_analyzed = result.blocks_analyzed;
+    body.sync_score = result.sync_score;
+    job.body.assign(reinterpret_cast<const char*>(&body), sizeof(body));
+  } else if (h.op == MUSMARK_DAEMON_OP_SIGN) {
+    const std::string signatureId(h.signature_id, sizeof(h.signature_id));
+    check(musmark_embed(job.key.get(), signatureId.c_str(), audio.samples, audio.frames, audio.channels, MUSMARK_PRIORITY_BATCH));
+  }
+}
+
+static void finishJob(Job& job) {
+  const musmark_daemon_request& h = job.header;
+  if (h.op != MUSMARK_DAEMON_OP_SIGN || h.source == MUSMARK_DAEMON_SOURCE_SHM) return;  // SHM is marked in place
+
+  if (!job.output.empty()) {
+    writeAudioFile(job.output, job.audio.wav, JobPriority::Batch,
+      h.source == MUSMARK_DAEMON_SOURCE_PATH ? job.input : std::string());
+  } else if (h.source == MUSMARK_DAEMON_SOURCE_FD && job.fds[1] >= 0) {
+    writeWav(job.fds[1], job.audio.wav);
+  } else {
+    throw std::invalid_argument("SIGN needs an output path or descriptor");
+  }
+}
+
+// Runs `fn`, turning exceptions into the job's status and error body.
+template <typename Fn>
+static bool recordErrors(Job& job, Fn&& fn) {
+  try {
+    fn();
+    return true;
+  } catch (const std::invalid_argument& e) {
+    job.status = MUSMARK_DAEMON_STATUS_BAD_REQUEST;
+    job.body = e.what();
+  } catch (const std::exception& e) {
+    job.status = MUSMARK_DAEMON_STATUS_FAILED;
+    job.body = e.what();
+  }
+  return false;
+}
+
+// ---------------------------------------------------------------------------
+// Key dispatcher
+// Only key lookups are batched: requests that arrive together share one
+// lookup (and at most one key build) per secret and hop size. Each request is
+// released to compute as soon as its key is ready, so a short detection never
+// waits for a long job that happened to arrive before it.
+// ---------------------------------------------------------------------------
+
+class Dispatcher {
+ public:
+  Dispatcher(const DaemonOptions& options, KeyCache& keys)
+    : options_(options), keys_(keys), thread_([this]() { loop(); }) {}
+
+  ~Dispatcher() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+  }
+
+  // Blocks until the job has its key or a lookup error in its status.
+  void resolveKey(Job& job) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queue_.push_back(&job);
+    }
+    cv_.notify_one();
+    std::unique_lock<std::mutex> lock(job.mutex);
+    job.cv.wait(lock, [&]() { return job.keyed; });
+  }
+
+ private:
+  void loop() {
+    const size_t maxBatch = std::max<size_t>(1, options_.maxBatch);
+    const auto window = std::chrono::microseconds(std::max(0, options_.batchWindowMicros));
+
+    for (;;) {
+      std::vector<Job*> batch;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+        if (stopping_ && queue_.empty()) return;
+
+        // Give concurrent clients a moment to join the batch.
+        const auto deadline = std::chrono::steady_clock::now() + window;
+        cv_.wait_until(lock, deadline, [&]() { return stopping_ || queue_.size() >= maxBatch; });
+
+        const size_t take = std::min(queue_.size(), maxBatch);
+        batch.assign(queue_.begin(), queue_.begin() + take);
+        queue_.erase(queue_.begin(), queue_.begin() + take);
+      }
+
+      // A released job belongs to its connection thread again, which may
+      // already have freed it: only the batch's own bookkeeping is read after.
+      std::vector<bool> released(batch.size(), false);
+      for (size_t i = 0; i < batch.size(); i++) {
+        if (released[i]) continue;
+        const std::string secret = batch[i]->secret;
+        const int hopSize = static_cast<int>(batch[i]->header.hop_size);
+        std::shared_ptr<musmark_key> key;
+        int32_t status = MUSMARK_DAEMON_STATUS_OK;
+        std::string error;
+        try {
+          key = keys_.acquire(secret, hopSize);
+        } catch (const std::invalid_argument& e) {
+          status = MUSMARK_DAEMON_STATUS_BAD_REQUEST;
+          error = e.what();
+        } catch (const std::exception& e) {
+          status = MUSMARK_DAEMON_STATUS_FAILED;
+          error = e.what();
+        }
+        for (size_t j = i; j < batch.size(); j++) {
+          Job& job = *batch[j];
+          if (released[j] || job.secret != secret || static_cast<int>(job.header.hop_size) != hopSize) continue;
+          job.key = key;
+          job.status = status;
+          job.body = error;
+          released[j] = true;
+          release(job);
+        }
+      }
+    }
+  }
+
+  // Notifies under the lock: the waiter may destroy the job once it sees it.
+  static void release(Job& job) {
+    std::lock_guard<std::mutex> lock(job.mutex);
+    job.keyed = true;
+    job.cv.notify_one();
+  }
+
+  const DaemonOptions& options_;
+  KeyCache& keys_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Job*> queue_;
+  bool stopping_ = false;
+  std::thread thread_;
+};
+
+static void serveConnection(int fd, Dispatcher& dispatcher) {
+  try {
+    for (;;) {
+      Job job;
+      if (!readHeader(fd, job.header, job.fds)) break;
+      if (job.header.magic != MUSMARK_DAEMON_MAGIC) throw std::runtime_error("Bad magic");
+      job.secret = readField(fd, job.header.secret_length);
+      job.input = readField(fd, job.header.input_length);
+      job.output = readField(fd, job.header.output_length);
+
+      if (recordErrors(job, [&]() { prepareJob(job); }) && job.header.op != MUSMARK_DAEMON_OP_PING) {
+        dispatcher.resolveKey(job);
+        if (job.status == MUSMARK_DAEMON_STATUS_OK && recordErrors(job, [&]() { computeJob(job); })) {
+          recordErrors(job, [&]() { finishJob(job); });
+        }
+      }
+
+      musmark_daemon_response response{};
+      response.magic = MUSMARK_DAEMON_MAGIC;
+      response.request_id = job.header.request_id;
+      response.status = job.status;
+      response.body_length = static_cast<uint32_t>(job.body.size());
+      writeAll(fd, &response, sizeof(response));
+      if (!job.body.empty()) writeAll(fd, job.body.data(), job.body.size());
+    }
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "musmark daemon: connection dropped: %s\n", e.what());
+  }
+  ::close(fd);
+}
+
+// One thread per open connection, at most `limit` of them. Past the cap the
+// accept loop stops accepting, so further clients queue in the listen
+// backlog (and are refused by the kernel once that is full).
+class ConnectionSlots {
+ public:
+  explicit ConnectionSlots(size_t limit) : limit_(std::max<size_t>(1, limit)) {}
+
+  // Waits up to `timeout` for a free slot; false when none opened up.
+  bool waitForSlot(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return freed_.wait_for(lock, timeout, [this]() { return active_ < limit_; });
+  }
+
+  void acquire() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    active_++;
+  }
+
+  void release() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      active_--;
+    }
+    freed_.notify_one();
+  }
+
+ private:
+  const size_t limit_;
+  std::mutex mutex_;
+  std::condition_variable freed_;
+  size_t active_ = 0;
+};
+
+// Only peers running as the daemon's effective user are served.
+static bool peerIsOwner(int fd) {
+  ucred peer{};
+  socklen_t length = sizeof(peer);
+  if (::getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &peer, &length) != 0 || length != sizeof(peer)) return false;
+  return peer.uid == ::geteuid();
+}
+
+// Clears the way for bind: only a socket that nobody answers on is removed.
+// A regular file, or a socket another daemon is still serving, is an error.
+static void removeStaleSocket(const std::string& path, const sockaddr_un& addr) {
+  struct stat st{};
+  if (::lstat(path.c_str(), &st) != 0) {
+    if (errno == ENOENT) return;
+    throw std::runtime_error("stat " + path + ": " + std::strerror(errno));
+  }
+  if (!S_ISSOCK(st.st_mode)) throw std::runtime_error(path + " exists and is not a socket");
+
+  const int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (probe < 0) throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+  const bool live = ::connect(probe, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0;
+  const int error = errno;
+  ::close(probe);
+  if (live) throw std::runtime_error("Another daemon is listening on " + path);
+  if (error != ECONNREFUSED) throw std::runtime_error("connect " + path + ": " + std::strerror(error));
+  if (::unlink(path.c_str()) != 0 && errno != ENOENT) {
+    throw std::runtime_error("unlink " + path + ": " + std::strerror(errno));
+  }
+}
+
+static std::atomic<bool> gStopRequested{false};
+
+static void onStopSignal(int) {
+  gStopRequested = true;
+}
+
+void runDaemon(const DaemonOptions& options) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (options.socketPath.empty() || options.socketPath.size() >= sizeof(addr.sun_path)) {
+    throw std::runtime_error("Socket path is empty or too long");
+  }
+  std::memcpy(addr.sun_path, options.socketPath.c_str(), options.socketPath.size() + 1);
+
+  removeStaleSocket(options.socketPath, addr);
+  const int listenFd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listenFd < 0) throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+  // Requests name files the daemon opens and writes as its own user, so the
+  // socket is created owner-only and peers are checked on accept as well.
+  const mode_t oldMask = ::umask(077);
+  const bool bound = ::bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+  ::umask(oldMask);
+  if (!bound || ::listen(listenFd, 128) != 0) {
+    const std::string error = std::strerror(errno);
+    ::close(listenFd);
+    throw std::runtime_error("bind " + options.socketPath + ": " + error);
+  }
+
+  struct sigaction action{};
+  action.sa_handler = onStopSignal;
+  ::sigaction(SIGINT, &action, nullptr);
+  ::sigaction(SIGTERM, &action, nullptr);
+  ::signal(SIGPIPE, SIG_IGN);
+
+  KeyCache keys(options.keyCacheSize);
+  Dispatcher dispatcher(options, keys);
+  std::fprintf(stderr, "musmark daemon: listening on %s (%d threads)\n",
+    options.socketPath.c_str(), schedulerInfo().threads);
+
+  ConnectionSlots slots(options.maxConnections);
+  while (!gStopRequested) {
+    if (!slots.waitForSlot(std::chrono::milliseconds(250))) continue;
+    pollfd pfd{ listenFd, POLLIN, 0 };
+    const int ready = ::poll(&pfd, 1, 250);
+    if (ready <= 0) continue;
+    const int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) continue;
+    if (!peerIsOwner(fd)) {
+      std::fprintf(stderr, "musmark daemon: refused a connection from another user\n");
+      ::close(fd);
+      continue;
+    }
+    slots.acquire();
+    std::thread([fd, &dispatcher, &slots]() {
+      serveConnection(fd, dispatcher);
+      slots.release();
+    }).detach();
+  }
+
+  ::close(listenFd);
+  ::unlink(options.socketPath.c_str());
+  std::fprintf(stderr, "musmark daemon: stopped\n");
+  // Connection threads still blocked on clients die with the process.
+  std::fflush(stderr);
+  std::_Exit(0);
+}
+
+// ---------------------------------------------------------------------------
+// Client
+// ---------------------------------------------------------------------------
+
+DaemonReply callDaemon(const std::string& socketPath, const DaemonCall& call) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (socketPath.size() >= sizeof(addr.sun_path)) throw std::runtime_error("Socket path too long");
+  std::memcpy(addr.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+  struct Closer {
+    int fd;
+    ~Closer() { ::close(fd); }
+  } closer{ fd };
+  if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+    throw std::runtime_error("connect " + socketPath + ": " + std::strerror(errno));
+  }
+
+  musmark_daemon_request header = call.header;
+  header.magic = MUSMARK_DAEMON_MAGIC;
+  header.secret_length = static_cast<uint32_t>(call.secret.size());
+  header.input_length = static_cast<uint32_t>(call.input.size());
+  header.output_length = static_cast<uint32_t>(call.output.size());
+
+  // The header goes out with sendmsg so descriptors ride along with it.
+  iovec iov{ &header, sizeof(header) };
+  alignas(cmsghdr) char control[CMSG_SPACE(2 * sizeof(int))];
+  msghdr msg{};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  int fds[2];
+  int fdCount = 0;
+  for (int passed : call.fds) {
+    if (passed >= 0) fds[fdCount++] = passed;
+  }
+  if (fdCount) {
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(fdCount * sizeof(int));
+    cmsghdr* c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(fdCount * sizeof(int));
+    std::memcpy(CMSG_DATA(c), fds, fdCount * sizeof(int));
+  }
+  ssize_t sent;
+  do {
+    sent = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+  } while (sent < 0 && errno == EINTR);
+  if (sent < 0) throw std::runtime_error(std::string("sendmsg: ") + std::strerror(errno));
+  if (static_cast<size_t>(sent) < sizeof(header)) {
+    writeAll(fd, reinterpret_cast<const char*>(&header) + sent, sizeof(header) - sent);
+  }
+
+  writeAll(fd, call.secret.data(), call.secret.size());
+  writeAll(fd, call.input.data(), call.input.size());
+  writeAll(fd, call.output.data(), call.output.size());
+
+  musmark_daemon_response response{};
+  readAll(fd, &response, sizeof(response));
+  if (response.magic != MUSMARK_DAEMON_MAGIC) throw std::runtime_error("Bad response from daemon");
+
+  DaemonReply reply;
+  reply.status = response.status;
+  reply.body.resize(response.body_length);
+  if (response.body_length) readAll(fd, &reply.body[0], response.body_length);
+  return reply;
+}
+
+#endif
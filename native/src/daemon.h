@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "musmark_daemon.h"
+
+// Long-running detection/signing service over a Unix domain socket; see
+// include/musmark_daemon.h for the wire format. Linux only.
+
+struct DaemonOptions {
+  std::string socketPath;
+  size_t keyCacheSize = 8;       // warm keys (PN banks) kept across requests
+  size_t maxBatch = 64;          // requests whose key lookups are coalesced
+  int batchWindowMicros = 200;   // how long the dispatcher waits to fill a batch
+  size_t maxConnections = 64;    // served at once; later ones wait in the listen backlog
+};
+
+// Serves until SIGINT/SIGTERM. Throws if the socket cannot be bound.
+void runDaemon(const DaemonOptions& options);
+
+// Client side: one request/response round trip on a fresh connection.
+struct DaemonCall {
+  musmark_daemon_request header{};
+  std::string secret;
+  std::string input;
+  std::string output;
+  int fds[2] = { -1, -1 };  // passed with the header for the FD source
+};
+
+struct DaemonReply {
+  int32_t status = MUSMARK_DAEMON_STATUS_FAILED;
+  std::string body;
+};
+
+DaemonReply callDaemon(const std::string& socketPath, const DaemonCall& call);
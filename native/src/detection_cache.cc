@@ -0,0 +1,253 @@
+#include "detection_cache.h"
+#include <algorithm>
+#include <fstream>
+#include <future>
+#include <istream>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <streambuf>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "fd_stream.h"
+#include "flac.h"
+#include "sha256.h"
+
+// ============================================================================
+// DETECTION CACHE
+// One LRU of finished extractions plus a table of extractions in flight.
+// Both live under a single mutex that is never held while extracting: the
+// first caller for a key publishes a shared_future, runs the extraction
+// unlocked and moves the result into the LRU; later callers for the same
+// key wait on that future instead of starting their own.
+// ============================================================================
+
+constexpr size_t kDefaultCapacity = 1024;
+constexpr size_t kReadChunk = 1 << 20;
+
+// Feeds the WAV or FLAC reader from a file or descriptor while hashing every
+// byte it hands out.
+class HashingStreamBuf : public std::streambuf {
+ public:
+  explicit HashingStreamBuf(const std::string& path) : buffer_(kReadChunk) {
+    auto file = std::make_unique<std::filebuf>();
+    if (!file->open(path, std::ios::in | std::ios::binary)) {
+      throw std::runtime_error("Failed to open audio file");
+    }
+    source_ = std::move(file);
+    setg(buffer_.data(), buffer_.data(), buffer_.data());
+  }
+
+  explicit HashingStreamBuf(int fd) : source_(std::make_unique<FdReadBuf>(fd)), buffer_(kReadChunk) {
+    setg(buffer_.data(), buffer_.data(), buffer_.data());
+  }
+
+  // True when the file starts like a FLAC stream. Looks at the first buffer
+  // without consuming it.
+  bool startsWithFlac() {
+    if (gptr() == egptr() && underflow() == traits_type::eof()) return false;
+    return isFlac(reinterpret_cast<const uint8_t*>(gptr()), static_cast<size_t>(egptr() - gptr()));
+  }
+
+  // Hashes whatever the reader did not consume and returns the digest.
+  std::string finish() {
+    while (underflow() != traits_type::eof()) setg(egptr(), egptr(), egptr());
+    return sha256_.hexDigest();
+  }
+
+ protected:
+  int_type underflow() override {
+    if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+    const std::streamsize n = source_->sgetn(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+    if (n <= 0) return traits_type::eof();
+    sha256_.update(buffer_.data(), static_cast<size_t>(n));
+    setg(buffer_.data(), buffer_.data(), buffer_.data() + n);
+    return traits_type::to_int_type(buffer_[0]);
+  }
+
+  // Large reads (the sample data) bypass the buffer but are hashed all the same.
+  std::streamsize xsgetn(char* out, std::streamsize count) override {
+    std::streamsize done = 0;
+    const std::streamsize buffered = std::min<std::streamsize>(count, egptr() - gptr());
+    if (buffered > 0) {
+      std::copy(gptr(), gptr() + buffered, out);
+      gbump(static_cast<int>(buffered));
+      done = buffered;
+    }
+    while (done < count) {
+      const std::streamsize n = source_->sgetn(out + done, count - done);
+      if (n <= 0) break;
+      sha256_.update(out + done, static_cast<size_t>(n));
+      done += n;
+    }
+    return done;
+  }
+
+ private:
+  std::unique_ptr<std::streambuf> source_;
+  std::vector<char> buffer_;
+  Sha256 sha256_;
+};
+
+static HashedWav readHashed(HashingStreamBuf& buf) {
+  std::istream in(&buf);
+  HashedWav result;
+  if (buf.startsWithFlac()) {
+    // FLAC is decoded from memory, so the whole file goes through the hash first.
+    const std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    result.wav = decodeFlac(bytes.data(), bytes.size());
+  } else {
+    result.wav = readWav(in);
+  }
+  result.contentHash = buf.finish();
+  return result;
+}
+
+HashedWav readAudioHashed(const std::string& path) {
+  HashingStreamBuf buf(path);
+  return readHashed(buf);
+}
+
+HashedWav readAudioHashed(int fd) {
+  HashingStreamBuf buf(fd);
+  return readHashed(buf);
+}
+
+// Read-only view of caller memory; avoids copying the buffer into a stringstream.
+class MemoryStreamBuf : public std::streambuf {
+ public:
+  MemoryStreamBuf(const void* data, size_t size) {
+    char* begin = const_cast<char*>(static_cast<const char*>(data));
+    setg(begin, begin, begin + size);
+  }
+};
+
+HashedWav readAudioHashed(const void* data, size_t size) {
+  HashedWav result;
+  if (isFlac(static_cast<const uint8_t*>(data), size)) {
+    result.wav = decodeFlac(static_cast<const uint8_t*>(data), size);
+  } else {
+    MemoryStreamBuf buf(data, size);
+    std::istream in(&buf);
+    result.wav = readWav(in);
+  }
+  result.contentHash = sha256Hex(data, size);
+  return result;
+}
+
+std::string detectionCacheKey(const std::string& contentHash, const std::string& secret, int hopSize) {
+  // The secret itself never sits in the table, only its digest.
+  return contentHash + ":" + sha256Hex(secret.data(), secret.size()) + ":" + std::to_string(hopSize);
+}
+
+// ----------------------------------------------------------------------------
+// Cache state
+// ----------------------------------------------------------------------------
+
+using ExtractionPtr = std::shared_ptr<const Extraction>;
+using Entry = std::pair<std::string, ExtractionPtr>;
+
+static std::mutex cacheMutex;
+static std::list<Entry> lru;
+static std::unordered_map<std::string, std::list<Entry>::iterator> entries;
+static std::unordered_map<std::string, std::shared_future<ExtractionPtr>> inFlight;
+static DetectionCacheStats stats = [] {
+  DetectionCacheStats initial;
+  initial.capacity = kDefaultCapacity;
+  return initial;
+}();
+
+static void evictLocked() {
+  while (lru.size() > stats.capacity) {
+    entries.erase(lru.back().first);
+    lru.pop_back();
+    stats.evictions++;
+  }
+}
+
+ExtractionPtr cachedExtraction(const std::string& key, const std::function<Extraction()>& compute) {
+  std::promise<ExtractionPtr> promise;
+  {
+    std::unique_lock<std::mutex> lock(cacheMutex);
+    const auto hit = entries.find(key);
+    if (hit != entries.end()) {
+      lru.splice(lru.begin(), lru, hit->second);
+      stats.hits++;
+      return hit->second->second;
+    }
+    const auto pending = inFlight.find(key);
+    if (pending != inFlight.end()) {
+      std::shared_future<ExtractionPtr> future = pending->second;
+      stats.coalesced++;
+      lock.unlock();
+      return future.get();
+    }
+    inFlight.emplace(key, promise.get_future().share());
+    stats.misses++;
+  }
+
+  ExtractionPtr result;
+  try {
+    result = std::make_shared<const Extraction>(compute());
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    inFlight.erase(key);
+    promise.set_exception(std::current_exception());
+    throw;
+  }
+
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  inFlight.erase(key);
+  if (stats.capacity > 0) {
+    lru.emplace_front(key, result);
+    entries[key] = lru.begin();
+    evictLocked();
+  }
+  promise.set_value(result);
+  return result;
+}
+
+ExtractionPtr findCachedExtraction(const std::string& key) {
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  const auto hit = entries.find(key);
+  if (hit == entries.end()) return nullptr;
+  lru.splice(lru.begin(), lru, hit->second);
+  stats.hits++;
+  return hit->second->second;
+}
+
+void storeCachedExtraction(const std::string& key, ExtractionPtr extraction) {
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  if (stats.capacity == 0) return;
+  const auto existing = entries.find(key);
+  if (existing != entries.end()) {
+    existing->second->second = std::move(extraction);
+    lru.splice(lru.begin(), lru, existing->second);
+    return;
+  }
+  lru.emplace_front(key, std::move(extraction));
+  entries[key] = lru.begin();
+  evictLocked();
+}
+
+void setDetectionCacheCapacity(size_t capacity) {
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  stats.capacity = capacity;
+  evictLocked();
+}
+
+void clearDetectionCache() {
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  lru.clear();
+  entries.clear();
+}
+
+DetectionCacheStats detectionCacheStats() {
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  DetectionCacheStats current = stats;
+  current.entries = lru.size();
+  return current;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include "engine.h"
+#include "wav.h"
+
+// Detection results keyed by what the audio is rather than where it lives:
+// the SHA-256 of the file bytes, the key and the extraction options. The
+// same upload submitted again costs one sequential read; concurrent
+// requests for the same content share a single extraction.
+
+struct HashedWav {
+  WavData wav;
+  std::string contentHash;  // hex SHA-256 of every byte of the file
+};
+
+// Reads (WAV or FLAC, by content) and hashes `path` in one pass. Bytes after
+// the audio are hashed too, so two files only share a hash when they are
+// identical.
+HashedWav readAudioHashed(const std::string& path);
+// Same for a pipe or other descriptor, read to EOF without seeking.
+HashedWav readAudioHashed(int fd);
+// Same for a file already in memory; `data` is only read during the call.
+HashedWav readAudioHashed(const void* data, size_t size);
+
+std::string detectionCacheKey(const std::string& contentHash, const std::string& secret, int hopSize);
+
+struct DetectionCacheStats {
+  size_t entries = 0;
+  size_t capacity = 0;
+  size_t hits = 0;
+  size_t misses = 0;     // extractions run
+  size_t coalesced = 0;  // callers that waited on another caller's extraction
+  size_t evictions = 0;
+};
+
+// Returns the cached extraction for `key`, or runs `compute` once for every
+// caller asking for `key` while it is in flight. Failures are passed to all
+// of those callers and not cached. With capacity 0 only coalescing applies.
+std::shared_ptr<const Extraction> cachedExtraction(
+  const std::string& key,
+  const std::function<Extraction()>& compute
+);
+
+// For callers that cannot wait on another request's extraction (deadline
+// bound ones): look up without coalescing, and add a result computed
+// outside cachedExtraction.
+std::shared_ptr<const Extraction> findCachedExtraction(const std::string& key);
+void storeCachedExtraction(const std::string& key, std::shared_ptr<const Extraction> extraction);
+
+// Shrinking evicts least recently used entries at once.
+void setDetectionCacheCapacity(size_t capacity);
+void clearDetectionCache();
+DetectionCacheStats detectionCacheStats();
@@ -0,0 +1,453 @@
+#include "engine.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+#include "kernels.h"
+#include "payload.h"
+
+// ============================================================================
+// SPREAD SPECTRUM CORE
+// File and N-API handling stay in the callers; everything here works on
+// planar float samples so the addon, the autotuner and other front ends share
+// one implementation.
+// ============================================================================
+
+uint64_t hashSecret(const std::string& secret) {
+  uint64_t hash = 1469598103934665603ULL;
+  for (char c : secret) {
+    hash ^= static_cast<uint64_t>(static_cast<unsigned char>(c));
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// Generates the position-dependent PN sequence for every payload bit position.
+// Each position is independent, so the bank is built in parallel.
+PnBank buildPnBank(uint64_t baseSeed, int payloadLen, int samplesPerBit, JobPriority priority) {
+  PnBank pnSequences(payloadLen, std::vector<double>(samplesPerBit));
+
+  // Hann window shared by every position
+  std::vector<double> window(samplesPerBit);
+  for (int i = 0; i < samplesPerBit; i++) {
+    window[i] = 0.5 * (1.0 - std::cos(2.0 * kPi * i / (samplesPerBit - 1)));
+  }
+
+  const KernelTable& k = kernels();
+  parallelFor(payloadLen, 1, priority, [&](size_t begin, size_t end) {
+    std::vector<double> rawPN(samplesPerBit);
+    std::vector<double> dc(samplesPerBit);
+    std::vector<double> scratch(samplesPerBit + 1);
+
+    for (size_t pos = begin; pos < end; pos++) {
+      // Unique seed for each bit position (must match between embed and extract)
+      XorShift64 prng(baseSeed ^ (static_cast<uint64_t>(pos) * 0x9e3779b97f4a7c15ULL));
+      std::vector<double>& pn = pnSequences[pos];
+
+      // Generate raw PN
+      for (int i = 0; i < samplesPerBit; i++) {
+        rawPN[i] = prng.nextDouble() * 2.0 - 1.0;
+      }
+
+      // Low-pass filter to reduce harshness
+      k.boxFilter(rawPN.data(), pn.data(), scratch.data(), samplesPerBit, 32);
+
+      // Remove DC
+      k.boxFilter(pn.data(), dc.data(), scratch.data(), samplesPerBit, 256);
+      k.subtract(pn.data(), dc.data(), samplesPerBit);
+
+      // Normalize and apply window
+      const double norm = std::sqrt(k.sumSquares(pn.data(), samplesPerBit) / samplesPerBit);
+      k.scaleByWindow(pn.data(), window.data(), norm > 1e-10 ? 1.0 / norm : 1.0, samplesPerBit);
+    }
+  });
+
+  return pnSequences;
+}
+
+void embedBlocks(
+  float* left,
+  float* right,
+  size_t frames,
+  size_t firstBlock,
+  const PnBank& bank,
+  const std::vector<uint8_t>& bitstream,
+  const std::vector<uint8_t>& removeBits,
+  JobPriority priority,
+  double strength
+) {
+  const size_t samplesPerBit = bank[0].size();
+  const double baseStrength = kEmbedStrength * strength;
+
+  // Blocks never overlap, so chunks of blocks are embedded in parallel.
+  const size_t blockCount = frames / samplesPerBit;
+  const KernelTable& k = kernels();
+  parallelFor(blockCount, schedulerChunkBlocks(), priority, [&](size_t begin, size_t end) {
+    for (size_t block = begin; block < end; block++) {
+      const size_t blockStart = block * samplesPerBit;
+      const size_t actualBitIndex = (firstBlock + block) % bitstream.size();
+      const int bit = bitstream[actualBitIndex] ? 1 : 0;
+
+      // Get the PN sequence for this bit position
+      const std::vector<double>& pnSequence = bank[actualBitIndex];
+
+      // Bipolar modulation: bit 1 = +PN, bit 0 = -PN
+      const double sign = bit ? 1.0 : -1.0;
+
+      // Calculate local signal energy for adaptive strength
+      double localEnergy = k.midEnergy(left + blockStart, right + blockStart, samplesPerBit);
+      localEnergy = std::sqrt(localEnergy / samplesPerBit);
+
+      // Adaptive strength: stronger in loud parts (masked), weaker in quiet
+      const double adaptiveStrength = baseStrength * std::clamp(localEnergy * 4.0, 0.1, 0.6);
+
+      // Handle remove bits (for re-signing): subtract the old watermark's contribution
+      double gain = sign * adaptiveStrength;
+      if (!removeBits.empty()) {
+        const double oldSign = removeBits[actualBitIndex % removeBits.size()] ? 1.0 : -1.0;
+        gain -= oldSign * adaptiveStrength;
+      }
+
+      // Apply PN sequence to audio
+      k.embedBlock(left + blockStart, right + blockStart, pnSequence.data(), gain, samplesPerBit);
+    }
+  });
+}
+
+BlockCorrelations correlateBlocks(
+  const float* left,
+  const float* right,
+  size_t frames,
+  size_t firstBlock,
+  const PnBank& bank,
+  JobPriority priority
+) {
+  const size_t samplesPerBit = bank[0].size();
+  const size_t blockCount = frames / samplesPerBit;
+
+  BlockCorrelations out;
+  out.correlations.resize(blockCount);
+  out.confidences.resize(blockCount);
+  const KernelTable& k = kernels();
+
+  // One chunk of blocks per task; results land in per-block slots so no
+  // locking is needed.
+  parallelFor(blockCount, schedulerChunkBlocks(), priority, [&](size_t begin, size_t end) {
+    for (size_t block = begin; block < end; block++) {
+      const size_t blockStart = block * samplesPerBit;
+      const std::vector<double>& pnSequence = bank[(firstBlock + block) % bank.size()];
+
+      double sums[3];
+      k.correlateBlock(left + blockStart, right + blockStart, pnSequence.data(), samplesPerBit, sums);
+      const double correlation = sums[0];
+      const double signalEnergy = sums[1];
+      const double pnEnergy = sums[2];
+
+      // Normalize correlation by signal energy for comparable values across blocks
+      double normalizedCorr = 0.0;
+      if (signalEnergy > 1e-20) {
+        normalizedCorr = correlation / std::sqrt(signalEnergy);
+      }
+      out.correlations[block] = static_cast<float>(normalizedCorr);
+
+      double conf = 0;
+      if (signalEnergy > 1e-20 && pnEnergy > 1e-20) {
+        conf = std::abs(correlation) / std::sqrt(signalEnergy * pnEnergy);
+      }
+      out.confidences[block] = static_cast<float>(std::min(1.0, conf));
+    }
+  });
+
+  return out;
+}
+
+std::vector<float> getChannelSamples(const std::vector<float>& interleaved, int channels, int channelIndex) {
+  std::vector<float> out(interleaved.size() / channels);
+  kernels().deinterleave(interleaved.data(), out.data(), out.size(), channels, channelIndex);
+  return out;
+}
+
+void writeChannelSamples(std::vector<float>& interleaved, const std::vector<float>& channelData, int channels, int channelIndex) {
+  kernels().interleave(channelData.data(), interleaved.data(), interleaved.size() / channels, channels, channelIndex);
+}
+
+// Splits the first two channels of an interleaved buffer into planar
+// left/right; mono duplicates the only channel.
+static void splitStereo(
+  const float* samples,
+  size_t frames,
+  int channels,
+  std::vector<float>& left,
+  std::vector<float>& right
+) {
+  const KernelTable& k = kernels();
+  left.resize(frames);
+  k.deinterleave(samples, left.data(), frames, channels, 0);
+  if (channels > 1) {
+    right.resize(frames);
+    k.deinterleave(samples, right.data(), frames, channels, 1);
+  } else {
+    right = left;
+  }
+}
+
+void embedInterleaved(
+  float* samples,
+  size_t frames,
+  int channels,
+  size_t firstBlock,
+  const PnBank& bank,
+  const std::vector<uint8_t>& bitstream,
+  const std::vector<uint8_t>& removeBits,
+  JobPriority priority,
+  double strength
+) {
+  if (bitstream.empty()) throw std::runtime_error("Empty bitstream");
+  if (channels <= 0) throw std::runtime_error("Invalid channel count");
+  std::vector<float> left, right;
+  splitStereo(samples, frames, channels, left, right);
+
+  embedBlocks(left.data(), right.data(), frames, firstBlock, bank, bitstream, removeBits, priority, strength);
+
+  const KernelTable& k = kernels();
+  k.interleave(left.data(), samples, frames, channels, 0);
+  if (channels > 1) {
+    k.interleave(right.data(), samples, frames, channels, 1);
+  }
+}
+
+void embedInterleavedRanges(
+  float* samples,
+  size_t frames,
+  int channels,
+  size_t firstBlock,
+  const PnBank& bank,
+  const std::vector<uint8_t>& bitstream,
+  const std::vector<uint8_t>& removeBits,
+  JobPriority priority,
+  const FrameRangeSink& done
+) {
+  if (bitstream.empty()) throw std::runtime_error("Empty bitstream");
+  if (channels <= 0) throw std::runtime_error("Invalid channel count");
+  const size_t samplesPerBit = bank[0].size();
+  const size_t blockCount = frames / samplesPerBit;
+
+  // Each chunk is split, embedded and interleaved on its own, so it is final
+  // the moment its task ends.
+  parallelFor(blockCount, schedulerChunkBlocks(), priority, [&](size_t begin, size_t end) {
+    const size_t first = begin * samplesPerBit;
+    const size_t count = (end - begin) * samplesPerBit;
+    float* chunk = samples + first * channels;
+    std::vector<float> left, right;
+    splitStereo(chunk, count, channels, left, right);
+    embedBlocks(left.data(), right.data(), count, firstBlock + begin, bank, bitstream, removeBits, priority);
+    const KernelTable& k = kernels();
+    k.interleave(left.data(), chunk, count, channels, 0);
+    if (channels > 1) {
+      k.interleave(right.data(), chunk, count, channels, 1);
+    }
+    done(first, count);
+  });
+  // The partial tail block is never marked.
+  const size_t marked = blockCount * samplesPerBit;
+  if (marked < frames) done(marked, frames - marked);
+}
+
+// The correlator only ever sees (left + right) / 2, so analysis works on that
+// one signal. Passing it as both channels reproduces the stereo sums exactly.
+std::vector<float> downmixForAnalysis(const float* samples, size_t frames, int channels) {
+  if (channels <= 0) throw std::runtime_error("Invalid channel count");
+  std::vector<float> mid(frames);
+  if (channels == 1) {
+    std::copy(samples, samples + frames, mid.begin());
+    return mid;
+  }
+  for (size_t i = 0; i < frames; i++) {
+    mid[i] = (samples[i * channels] + samples[i * channels + 1]) * 0.5f;
+  }
+  return mid;
+}
+
+Extraction extractInterleaved(
+  const float* samples,
+  size_t frames,
+  int channels,
+  size_t firstBlock,
+  const PnBank& bank,
+  JobPriority priority
+) {
+  const std::vector<float> mid = downmixForAnalysis(samples, frames, channels);
+  return extractDownmixed(mid.data(), frames, firstBlock, bank, priority);
+}
+
+Extraction extractDownmixed(
+  const float* mid,
+  size_t frames,
+  size_t firstBlock,
+  const PnBank& bank,
+  JobPriority priority
+) {
+  BlockCorrelations blocks = correlateBlocks(mid, mid, frames, firstBlock, bank, priority);
+
+  double confidenceSum = 0.0;
+  for (float conf : blocks.confidences) confidenceSum += conf;
+
+  Extraction out;
+  out.blocksAnalyzed = blocks.correlations.size();
+  out.bitConfidence = out.blocksAnalyzed ? confidenceSum / out.blocksAnalyzed : 0.0;
+  out.periodCount = (out.blocksAnalyzed + kPayloadBits - 1) / kPayloadBits;
+  out.periodsAnalyzed = out.periodCount;
+  out.correlations = std::move(blocks.correlations);
+  return out;
+}
+
+TriageResult triageInterleaved(
+  const float* samples,
+  size_t frames,
+  int channels,
+  const PnBank& bank,
+  JobPriority priority
+) {
+  const std::vector<float> mid = downmixForAnalysis(samples, frames, channels);
+  return triageDownmixed(mid.data(), frames, bank, priority);
+}
+
+TriageResult triageDownmixed(const float* mid, size_t frames, const PnBank& bank, JobPriority priority) {
+  if (bank.size() < static_cast<size_t>(kSyncBits)) throw std::runtime_error("PN bank too small for triage");
+
+  const size_t samplesPerBit = bank[0].size();
+  const size_t blockCount = frames / samplesPerBit;
+  const size_t periods = (blockCount + kPayloadBits - 1) / kPayloadBits;
+  std::vector<float> correlations(blockCount, 0.0f);
+  const KernelTable& k = kernels();
+  parallelFor(periods, 1, priority, [&](size_t begin, size_t end) {
+    for (size_t period = begin; period < end; period++) {
+      for (size_t pos = 0; pos < static_cast<size_t>(kSyncBits); pos++) {
+        const size_t block = period * kPayloadBits + pos;
+        if (block >= blockCount) break;
+        double sums[3];
+        const size_t start = block * samplesPerBit;
+        k.correlateBlock(&mid[start], &mid[start], bank[pos].data(), samplesPerBit, sums);
+        correlations[block] = sums[1] > 1e-20 ? static_cast<float>(sums[0] / std::sqrt(sums[1])) : 0.0f;
+      }
+    }
+  });
+
+  TriageResult result;
+  result.syncScore = syncScore(correlations);
+  result.blocksAnalyzed = std::min<size_t>(blockCount, periods * kSyncBits);
+  result.likely = result.syncScore >= kTriageThreshold;
+  return result;
+}
+
+// Expected mark-to-host ratio of one period, from a strided RMS per block:
+// the embed gain is clamp(4 * rms, 0.1, 0.6), the host contributes rms.
+static double periodReliability(const float* mid, size_t firstBlock, size_t blocks, size_t samplesPerBit) {
+  constexpr size_t kStride = 16;
+  double sum = 0.0;
+  for (size_t block = firstBlock; block < firstBlock + blocks; block++) {
+    const float* samples = mid + block * samplesPerBit;
+    double energy = 0.0;
+    size_t count = 0;
+    for (size_t i = 0; i < samplesPerBit; i += kStride, count++) energy += double(samples[i]) * samples[i];
+    const double rms = std::sqrt(energy / std::max<size_t>(1, count));
+    sum += std::clamp(rms * 4.0, 0.1, 0.6) / std::max(rms, 1e-4);
+  }
+  return blocks ? sum / blocks : 0.0;
+}
+
+Extraction extractDownmixedUntil(
+  const float* mid,
+  size_t frames,
+  const PnBank& bank,
+  std::chrono::steady_clock::time_point deadline,
+  JobPriority priority
+) {
+  const size_t samplesPerBit = bank[0].size();
+  const size_t blockCount = frames / samplesPerBit;
+  const size_t period = kPayloadBits;
+  const size_t fullPeriods = blockCount / period;
+  const bool hasTail = blockCount % period != 0;
+
+  // Whole periods by reliability; a partial tail (ignored by voting once two
+  // whole periods exist) goes last.
+  std::vector<std::pair<double, size_t>> order;
+  for (size_t p = 0; p < fullPeriods; p++) {
+    order.emplace_back(-periodReliability(mid, p * period, period, samplesPerBit), p);
+  }
+  std::stable_sort(order.begin(), order.end());
+  if (hasTail) order.emplace_back(0.0, fullPeriods);
+
+  std::vector<float> correlations(blockCount, 0.0f);
+  double confidenceSum = 0.0;
+  size_t blocksDone = 0;
+
+  Extraction best;
+  int bestErrors = -1;
+  size_t done = 0;
+  for (; done < order.size(); done++) {
+    if (done > 0 && std::chrono::steady_clock::now() >= deadline) break;
+    const size_t first = order[done].second * period;
+    const size_t blocks = std::min(period, blockCount - first);
+    const BlockCorrelations part = correlateBlocks(
+      mid + first * samplesPerBit, mid + first * samplesPerBit, blocks * samplesPerBit, first, bank, priority);
+    std::copy(part.correlations.begin(), part.correlations.end(), correlations.begin() + first);
+    for (float conf : part.confidences) confidenceSum += conf;
+    blocksDone += blocks;
+
+    if (done + 1 == order.size()) continue;
+    const DecodedPayload decoded = decodeBitstream(applySoftMajorityVoting(correlations));
+    if (decoded.success && (bestErrors < 0 || decoded.errorCount <= bestErrors)) {
+      bestErrors = decoded.errorCount;
+      best.correlations = correlations;
+      best.blocksAnalyzed = blocksDone;
+      best.bitConfidence = confidenceSum / blocksDone;
+      best.periodsAnalyzed = done + 1;
+    }
+  }
+
+  // Cut short, the best decode so far wins; otherwise everything counts.
+  const bool finished = done == order.size();
+  if (finished || bestErrors < 0) {
+    best.correlations = std::move(correlations);
+    best.blocksAnalyzed = blocksDone;
+    best.bitConfidence = blocksDone ? confidenceSum / blocksDone : 0.0;
+    best.periodsAnalyzed = done;
+  }
+  best.periodCount = order.size();
+  best.finished = finished;
+  return best;
+}
+
+void embedWatermarkSamples(
+  WavData& wav,
+  const std::vector<uint8_t>& bitstream,
+  const std::vector<uint8_t>& removeBits,
+  const EmbedConfig& config
+) {
+  if (bitstream.empty()) throw std::runtime_error("Empty bitstream");
+
+  // Each payload position gets its own PN sequence so the audio's natural
+  // correlation with any one PN averages out across repetitions.
+  const PnBank bank = buildPnBank(
+    hashSecret(config.secret), static_cast<int>(bitstream.size()), samplesPerBitFor(config.hopSize), config.priority);
+
+  const size_t frames = wav.samples.size() / wav.channels;
+  embedInterleaved(wav.samples.data(), frames, wav.channels, 0, bank, bitstream, removeBits, config.priority);
+}
+
+Extraction extractWatermarkSamples(const WavData& wav, const ExtractConfig& config) {
+  // The period (464 bits) is fixed by the payload structure.
+  const PnBank bank = buildPnBank(
+    hashSecret(config.secret), kPayloadBits, samplesPerBitFor(config.hopSize), config.priority);
+  const size_t frames = wav.samples.size() / wav.channels;
+  return extractInterleaved(wav.samples.data(), frames, wav.channels, 0, bank, config.priority);
+}
+
+TriageResult triageSamples(const WavData& wav, const ExtractConfig& config) {
+  // Only the sync positions are needed, which also shrinks the PN bank 7x.
+  const PnBank bank = buildPnBank(
+    hashSecret(config.secret), kSyncBits, samplesPerBitFor(config.hopSize), config.priority);
+  const size_t frames = wav.samples.size() / wav.channels;
+  return triageInterleaved(wav.samples.data(), frames, wav.channels, bank, config.priority);
+}
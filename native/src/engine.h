@@ -0,0 +1,217 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "scheduler.h"
+#include "wav.h"
+
+constexpr double kPi = 3.14159265358979323846;
+
+// Payload period in bits: sync (64) + length (16) + RS codeword ((16 + 32) bytes)
+constexpr int kPayloadBits = 64 + 16 + (16 + 32) * 8;
+
+struct XorShift64 {
+  uint64_t state;
+  explicit XorShift64(uint64_t seed) : state(seed ? seed : 0x9e3779b97f4a7c15ULL) {}
+  uint64_t next() {
+    uint64_t x = state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    state = x;
+    return x;
+  }
+  double nextDouble() {
+    return (next() >> 11) * (1.0 / 9007199254740992.0);
+  }
+  int nextInt(int maxValue) {
+    return static_cast<int>(next() % static_cast<uint64_t>(maxValue));
+  }
+};
+
+uint64_t hashSecret(const std::string& secret);
+
+// Base embedding gain (~0.7% of full scale) before the per-block adaptive
+// factor; `strength` arguments below scale it.
+constexpr double kEmbedStrength = 0.007;
+
+// One block of audio carries one payload bit.
+inline int samplesPerBitFor(int hopSize) {
+  return hopSize * 4;
+}
+
+// Position-dependent PN sequences, one per payload bit position.
+using PnBank = std::vector<std::vector<double>>;
+
+PnBank buildPnBank(uint64_t baseSeed, int payloadLen, int samplesPerBit, JobPriority priority);
+
+// Adds the watermark to planar left/right samples in place. `firstBlock` is
+// the payload block index of left[0], so a stream can be embedded window by
+// window. Pass the same pointer twice for mono. `strength` is a multiple of
+// kEmbedStrength; signing always uses 1, the benchmark matrix sweeps it.
+void embedBlocks(
+  float* left,
+  float* right,
+  size_t frames,
+  size_t firstBlock,
+  const PnBank& bank,
+  const std::vector<uint8_t>& bitstream,
+  const std::vector<uint8_t>& removeBits,
+  JobPriority priority,
+  double strength = 1.0
+);
+
+struct BlockCorrelations {
+  std::vector<float> correlations;  // normalized correlation per block
+  std::vector<float> confidences;   // |corr| / (|signal| * |pn|) per block, clamped to 1
+};
+
+// Correlates every whole block against the PN of its payload position;
+// `firstBlock` works as in embedBlocks.
+BlockCorrelations correlateBlocks(
+  const float* left,
+  const float* right,
+  size_t frames,
+  size_t firstBlock,
+  const PnBank& bank,
+  JobPriority priority
+);
+
+std::vector<float> getChannelSamples(const std::vector<float>& interleaved, int channels, int channelIndex);
+void writeChannelSamples(std::vector<float>& interleaved, const std::vector<float>& channelData, int channels, int channelIndex);
+
+// ---------------------------------------------------------------------------
+// Whole-signal entry points shared by the addon and the CLI.
+// ---------------------------------------------------------------------------
+
+struct EmbedConfig {
+  std::string secret;
+  int hopSize = 1024;
+  JobPriority priority = JobPriority::Batch;
+};
+
+// Embeds `bitstream` (repeated) into interleaved float samples in place.
+void embedWatermarkSamples(
+  WavData& wav,
+  const std::vector<uint8_t>& bitstream,
+  const std::vector<uint8_t>& removeBits,
+  const EmbedConfig& config
+);
+
+struct ExtractConfig {
+  std::string secret;
+  int hopSize = 1024;
+  JobPriority priority = JobPriority::Interactive;
+};
+
+struct Extraction {
+  std::vector<float> correlations;
+  double bitConfidence = 0.0;
+  double bandAgreement = 1.0;
+  size_t blocksAnalyzed = 0;
+  bool finished = true;        // false when a deadline cut the analysis short
+  size_t periodsAnalyzed = 0;  // payload periods correlated (a partial tail counts as one)
+  size_t periodCount = 0;
+};
+
+Extraction extractWatermarkSamples(const WavData& wav, const ExtractConfig& config);
+
+// Sync fraction at which triage reports a likely watermark (chance is ~0.5).
+constexpr double kTriageThreshold = 0.75;
+
+struct TriageResult {
+  double syncScore = 0.0;    // fraction of sync bits recovered
+  size_t blocksAnalyzed = 0;
+  bool likely = false;       // syncScore above the triage threshold
+};
+
+// Cheap pre-check: correlates only the sync positions of each payload period
+// (64 of 464 blocks) and scores the recovered sync pattern.
+TriageResult triageSamples(const WavData& wav, const ExtractConfig& config);
+
+// Interleaved-buffer variants taking a prebuilt bank, for callers that keep
+// banks warm across calls (C API keys) or feed audio in pieces. Only the
+// first two channels carry the mark; `firstBlock` works as in embedBlocks.
+void embedInterleaved(
+  float* samples,
+  size_t frames,
+  int channels,
+  size_t firstBlock,
+  const PnBank& bank,
+  const std::vector<uint8_t>& bitstream,
+  const std::vector<uint8_t>& removeBits,
+  JobPriority priority,
+  double strength = 1.0
+);
+
+// embedInterleaved that hands every finished frame range to `done` while the
+// rest is still being embedded, from scheduler threads and in no particular
+// order, so the caller can write it out (WavRangeWriter) as it completes. The
+// ranges cover [0, frames) exactly once; the samples are those embedInterleaved
+// would produce.
+using FrameRangeSink = std::function<void(size_t firstFrame, size_t frames)>;
+
+void embedInterleavedRanges(
+  float* samples,
+  size_t frames,
+  int channels,
+  size_t firstBlock,
+  const PnBank& bank,
+  const std::vector<uint8_t>& bitstream,
+  const std::vector<uint8_t>& removeBits,
+  JobPriority priority,
+  const FrameRangeSink& done
+);
+
+Extraction extractInterleaved(
+  const float* samples,
+  size_t frames,
+  int channels,
+  size_t firstBlock,
+  const PnBank& bank,
+  JobPriority priority
+);
+
+// `bank` needs at least the kSyncBits sync positions; a full payload bank works.
+TriageResult triageInterleaved(
+  const float* samples,
+  size_t frames,
+  int channels,
+  const PnBank& bank,
+  JobPriority priority
+);
+
+// The mono signal analysis runs on. Callers analysing one recording many
+// times (several keys, triage then detection) downmix once and use the
+// *Downmixed variants, which give the same results as the interleaved ones.
+std::vector<float> downmixForAnalysis(const float* samples, size_t frames, int channels);
+
+Extraction extractDownmixed(
+  const float* mid,
+  size_t frames,
+  size_t firstBlock,
+  const PnBank& bank,
+  JobPriority priority
+);
+
+TriageResult triageDownmixed(const float* mid, size_t frames, const PnBank& bank, JobPriority priority);
+
+// Anytime extraction: correlates whole payload periods in order of expected
+// watermark-to-signal ratio, quietest first (the embedder's gain floor makes
+// quiet passages carry the strongest mark), and stops before starting a
+// period once `deadline` has passed. At least one period is always done.
+// Blocks not reached are left at 0, which soft voting ignores. After every
+// period the votes are decoded. When cut short, the returned correlations
+// are those of the best decode seen (fewest corrected errors, latest on
+// ties), or everything analysed when none decoded. With time to spare the
+// correlations equal those of extractDownmixed.
+Extraction extractDownmixedUntil(
+  const float* mid,
+  size_t frames,
+  const PnBank& bank,
+  std::chrono::steady_clock::time_point deadline,
+  JobPriority priority
+);
@@ -0,0 +1,178 @@
+#include "fd_stream.h"
+#include <algorithm>
+#include <stdexcept>
+
+#if defined(_WIN32)
+
+size_t readFd(int, void*, size_t) {
+  throw std::runtime_error("File descriptor I/O is not available on Windows");
+}
+void writeFd(int, const void*, size_t) {
+  throw std::runtime_error("File descriptor I/O is not available on Windows");
+}
+bool writeFdAt(int, uint64_t, const void*, size_t) { return false; }
+int64_t fdPosition(int) { return -1; }
+void copyFdRange(int, uint64_t, int, uint64_t) {
+  throw std::runtime_error("File descriptor I/O is not available on Windows");
+}
+void preallocateFd(int, uint64_t, uint64_t) {
+  throw std::runtime_error("File descriptor I/O is not available on Windows");
+}
+OwnedFd::~OwnedFd() {}
+bool OwnedFd::close() { return false; }
+
+#else
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+
+constexpr size_t kCopyChunk = 1 << 20;
+
+static std::runtime_error fdError(const std::string& what) {
+  return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+size_t readFd(int fd, void* buffer, size_t size) {
+  for (;;) {
+    const ssize_t n = ::read(fd, buffer, size);
+    if (n >= 0) return static_cast<size_t>(n);
+    if (errno != EINTR) throw fdError("Reading audio failed");
+  }
+}
+
+void writeFd(int fd, const void* data, size_t size) {
+  const char* p = static_cast<const char*>(data);
+  while (size > 0) {
+    const ssize_t n = ::write(fd, p, size);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) throw fdError("Writing audio failed");
+    p += n;
+    size -= static_cast<size_t>(n);
+  }
+}
+
+bool writeFdAt(int fd, uint64_t offset, const void* data, size_t size) {
+  if (fdPosition(fd) < 0) return false;
+  const char* p = static_cast<const char*>(data);
+  while (size > 0) {
+    const ssize_t n = ::pwrite(fd, p, size, static_cast<off_t>(offset));
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) throw fdError("Writing audio failed");
+    p += n;
+    offset += static_cast<uint64_t>(n);
+    size -= static_cast<size_t>(n);
+  }
+  return true;
+}
+
+int64_t fdPosition(int fd) {
+  const off_t at = ::lseek(fd, 0, SEEK_CUR);
+  return at < 0 ? -1 : static_cast<int64_t>(at);
+}
+
+OwnedFd::~OwnedFd() {
+  if (fd >= 0) ::close(fd);
+}
+
+bool OwnedFd::close() {
+  const int descriptor = fd;
+  fd = -1;
+  return descriptor < 0 || ::close(descriptor) == 0;
+}
+
+// Errors that mean "this kernel or filesystem pair cannot do it", as opposed
+// to a failing disk.
+static bool unsupportedCopy(int error) {
+  return error == ENOSYS || error == EXDEV || error == EINVAL || error == EOPNOTSUPP || error == EBADF;
+}
+
+void copyFdRange(int in, uint64_t offset, int out, uint64_t size) {
+  off_t at = static_cast<off_t>(offset);
+#if defined(__linux__)
+  bool kernelCopy = true;
+  while (size > 0 && kernelCopy) {
+    const ssize_t n = ::copy_file_range(in, &at, out, nullptr, static_cast<size_t>(std::min<uint64_t>(size, kCopyChunk)), 0);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0 && unsupportedCopy(errno)) break;
+    if (n < 0) throw fdError("Copying audio metadata failed");
+    if (n == 0) throw std::runtime_error("Copying audio metadata failed: unexpected end of file");
+    size -= static_cast<uint64_t>(n);
+  }
+  while (size > 0 && kernelCopy) {
+    const ssize_t n = ::sendfile(out, in, &at, static_cast<size_t>(std::min<uint64_t>(size, kCopyChunk)));
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0 && unsupportedCopy(errno)) {
+      kernelCopy = false;
+      break;
+    }
+    if (n < 0) throw fdError("Copying audio metadata failed");
+    if (n == 0) throw std::runtime_error("Copying audio metadata failed: unexpected end of file");
+    size -= static_cast<uint64_t>(n);
+  }
+#endif
+  std::vector<char> buffer(static_cast<size_t>(std::min<uint64_t>(size, kCopyChunk)));
+  while (size > 0) {
+    const ssize_t n = ::pread(in, buffer.data(), static_cast<size_t>(std::min<uint64_t>(size, buffer.size())), at);
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) throw fdError("Copying audio metadata failed");
+    if (n == 0) throw std::runtime_error("Copying audio metadata failed: unexpected end of file");
+    writeFd(out, buffer.data(), static_cast<size_t>(n));
+    at += n;
+    size -= static_cast<uint64_t>(n);
+  }
+}
+
+void preallocateFd(int fd, uint64_t offset, uint64_t size) {
+  if (size == 0) return;
+#if defined(__linux__)
+  for (;;) {
+    if (::fallocate(fd, 0, static_cast<off_t>(offset), static_cast<off_t>(size)) == 0) return;
+    if (errno == EINTR) continue;
+    if (errno != EOPNOTSUPP && errno != ENOSYS) throw fdError("Preallocating output failed");
+    break;
+  }
+#endif
+  struct stat info{};
+  if (::fstat(fd, &info) != 0) throw fdError("Preallocating output failed");
+  const uint64_t end = offset + size;
+  if (static_cast<uint64_t>(info.st_size) < end && ::ftruncate(fd, static_cast<off_t>(end)) != 0) {
+    throw fdError("Preallocating output failed");
+  }
+}
+
+#endif
+
+FdReadBuf::FdReadBuf(int fd, size_t bufferSize) : fd_(fd), buffer_(bufferSize) {
+  setg(buffer_.data(), buffer_.data(), buffer_.data());
+}
+
+FdReadBuf::int_type FdReadBuf::underflow() {
+  if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+  const size_t n = readFd(fd_, buffer_.data(), buffer_.size());
+  if (n == 0) return traits_type::eof();
+  setg(buffer_.data(), buffer_.data(), buffer_.data() + n);
+  return traits_type::to_int_type(buffer_[0]);
+}
+
+std::streamsize FdReadBuf::xsgetn(char* out, std::streamsize count) {
+  std::streamsize done = std::min<std::streamsize>(count, egptr() - gptr());
+  if (done > 0) {
+    std::copy(gptr(), gptr() + done, out);
+    gbump(static_cast<int>(done));
+  }
+  while (done < count) {
+    const size_t n = readFd(fd_, out + done, static_cast<size_t>(count - done));
+    if (n == 0) break;
+    done += static_cast<std::streamsize>(n);
+  }
+  return done;
+}
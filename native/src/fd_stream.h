@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <streambuf>
+#include <vector>
+
+// Raw file descriptor I/O for audio that arrives on a pipe, a socket or a
+// descriptor handed over by a parent process. Reads never seek; writes only
+// seek to patch a header when the descriptor turns out to be a regular file.
+// Descriptors stay owned by the caller. Not available on Windows.
+
+// Reads up to `size` bytes, retrying on EINTR; 0 only at end of stream.
+size_t readFd(int fd, void* buffer, size_t size);
+// Writes all of `data`, retrying short writes and EINTR.
+void writeFd(int fd, const void* data, size_t size);
+// Writes at an absolute offset without moving the file position. False when
+// the descriptor cannot seek (pipes, sockets, terminals).
+bool writeFdAt(int fd, uint64_t offset, const void* data, size_t size);
+// Current offset, or -1 when the descriptor cannot seek.
+int64_t fdPosition(int fd);
+// Appends `size` bytes of `in` starting at `offset` to `out` at its current
+// position. The kernel moves the bytes (copy_file_range, or sendfile across
+// filesystems that refuse it); read/write is the last resort.
+void copyFdRange(int in, uint64_t offset, int out, uint64_t size);
+// Reserves [offset, offset + size) on disk, growing the file to cover it, so
+// positional writes into it later neither fragment the file nor run out of
+// space halfway. Filesystems that cannot reserve get a sparse extension.
+void preallocateFd(int fd, uint64_t offset, uint64_t size);
+
+// Closes the descriptor it holds, if any, on destruction.
+struct OwnedFd {
+  int fd;
+  explicit OwnedFd(int descriptor = -1) : fd(descriptor) {}
+  ~OwnedFd();
+  OwnedFd(const OwnedFd&) = delete;
+  OwnedFd& operator=(const OwnedFd&) = delete;
+  // Closes now and reports failure, which for written files can mean lost data.
+  bool close();
+};
+
+// Input streambuf over a descriptor, so the std::istream readers take pipes.
+class FdReadBuf : public std::streambuf {
+ public:
+  explicit FdReadBuf(int fd, size_t bufferSize = 1 << 16);
+
+ protected:
+  int_type underflow() override;
+  // Large reads (sample data) go straight into the caller's buffer.
+  std::streamsize xsgetn(char* out, std::streamsize count) override;
+
+ private:
+  int fd_;
+  std::vector<char> buffer_;
+};
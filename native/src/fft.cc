@@ -1,4 +1,5 @@
 #include "fft.h"
+#include "kernels.h"
 #include <cmath>
 
 constexpr double kPi = 3.14159265358979323846;
@@ -25,32 +26,16 @@ void fft(std::vector<Complex>& data, bool inverse) {
   const size_t n = data.size();
   bitReverse(data);
 
+  // Twiddles are computed directly per stage (no recurrence drift) and the
+  // butterflies run through the ISA-dispatched kernel.
+  std::vector<Complex> twiddles(n / 2);
   for (size_t len = 2; len <= n; len <<= 1) {
     const double ang = 2 * kPi / static_cast<double>(len) * (inverse ? 1.0 : -1.0);
-    const double wlen_re = std::cos(ang);
-    const double wlen_im = std::sin(ang);
-
-    for (size_t i = 0; i < n; i += len) {
-      double w_re = 1.0;
-      double w_im = 0.0;
-      for (size_t j = 0; j < len / 2; j++) {
-        Complex u = data[i + j];
-        Complex v = {
-          data[i + j + len / 2].re * w_re - data[i + j + len / 2].im * w_im,
-          data[i + j + len / 2].re * w_im + data[i + j + len / 2].im * w_re
-        };
-
-        data[i + j].re = u.re + v.re;
-        data[i + j].im = u.im + v.im;
-        data[i + j + len / 2].re = u.re - v.re;
-        data[i + j + len / 2].im = u.im - v.im;
-
-        const double next_re = w_re * wlen_re - w_im * wlen_im;
-        const double next_im = w_re * wlen_im + w_im * wlen_re;
-        w_re = next_re;
-        w_im = next_im;
-      }
+    for (size_t j = 0; j < len / 2; j++) {
+      twiddles[j].re = std::cos(ang * static_cast<double>(j));
+      twiddles[j].im = std::sin(ang * static_cast<double>(j));
     }
+    kernels().fftButterflies(data.data(), n, len, twiddles.data());
   }
 
   if (inverse) {
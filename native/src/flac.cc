@@ -0,0 +1,951 @@
+#include "flac.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// ============================================================================
+// FLAC
+// Decoder: after the metadata, the frame area is cut into byte ranges, one
+// task each. A task finds the first frame in its range by sync code, header
+// CRC-8 and frame CRC-16, then decodes frames back to back until it crosses
+// into the next range. Frame headers carry their sample position, so each
+// frame lands directly in its slot of the output. Neighbouring ranges must
+// meet exactly at a frame boundary, which catches a false sync match.
+//
+// Encoder: fixed 4096-sample blocks. Per frame the stereo mode is chosen
+// from order-2 residual estimates, then each subframe takes the cheapest of
+// constant, verbatim, fixed orders 0-4 and quantized LPC (orders 4 and 8),
+// with partitioned Rice coding. Batches of frames are encoded in parallel
+// and written in order; STREAMINFO is patched once sizes are known.
+// ============================================================================
+
+constexpr uint32_t kEncodeBlockSize = 4096;
+constexpr int kMaxLpcOrder = 32;
+constexpr int kEncodeLpcOrders[] = { 4, 8 };
+constexpr int kMaxPartitionOrder = 8;
+constexpr size_t kEncodeBatchFrames = 256;
+constexpr size_t kMinDecodeRange = 1 << 20;
+// Smallest possible frame: a 6-byte header, one constant subframe byte per
+// channel and the CRC-16. Bounds how many samples a file can really hold.
+constexpr size_t kMinFrameBytes = 9;
+
+// ----------------------------------------------------------------------------
+// CRCs and bit I/O
+// ----------------------------------------------------------------------------
+
+struct CrcTables {
+  uint8_t crc8[256];
+  uint16_t crc16[256];
+  CrcTables() {
+    for (int i = 0; i < 256; i++) {
+      uint8_t c8 = static_cast<uint8_t>(i);
+      for (int b = 0; b < 8; b++) c8 = static_cast<uint8_t>((c8 & 0x80) ? (c8 << 1) ^ 0x07 : c8 << 1);
+      crc8[i] = c8;
+      uint16_t c16 = static_cast<uint16_t>(i << 8);
+      for (int b = 0; b < 8; b++) c16 = static_cast<uint16_t>((c16 & 0x8000) ? (c16 << 1) ^ 0x8005 : c16 << 1);
+      crc16[i] = c16;
+    }
+  }
+};
+
+static const CrcTables& crcTables() {
+  static const CrcTables tables;
+  return tables;
+}
+
+static uint8_t crc8(const uint8_t* data, size_t size) {
+  const CrcTables& t = crcTables();
+  uint8_t crc = 0;
+  for (size_t i = 0; i < size; i++) crc = t.crc8[crc ^ data[i]];
+  return crc;
+}
+
+static uint16_t crc16(const uint8_t* data, size_t size) {
+  const CrcTables& t = crcTables();
+  uint16_t crc = 0;
+  for (size_t i = 0; i < size; i++) crc = static_cast<uint16_t>((crc << 8) ^ t.crc16[(crc >> 8) ^ data[i]]);
+  return crc;
+}
+
+static int countLeadingZeros(uint64_t value) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanReverse64(&index, value);
+  return 63 - static_cast<int>(index);
+#else
+  return __builtin_clzll(value);
+#endif
+}
+
+static void invalid(const char* what) {
+  throw std::runtime_error(std::string("Invalid FLAC file: ") + what);
+}
+
+// MSB-first reader over one frame. Reads past the end throw, so a corrupt
+// frame never runs off the buffer.
+class BitReader {
+ public:
+  BitReader(const uint8_t* data, size_t size) : data_(data), size_(size) {}
+
+  uint32_t read(int bits) {
+    if (bits == 0) return 0;
+    require(bits);
+    const uint32_t value = static_cast<uint32_t>(peek() >> (64 - bits));
+    position_ += bits;
+    return value;
+  }
+
+  int32_t readSigned(int bits) {
+    if (bits == 0) return 0;
+    const uint32_t value = read(bits);
+    return static_cast<int32_t>(value << (32 - bits)) >> (32 - bits);
+  }
+
+  uint32_t readUnary() {
+    uint32_t zeros = 0;
+    for (;;) {
+      const uint64_t window = peek();
+      const int valid = 64 - static_cast<int>(position_ & 7);
+      if (window != 0) {
+        const int leading = countLeadingZeros(window);
+        if (leading < valid) {
+          require(leading + 1);
+          position_ += leading + 1;
+          return zeros + static_cast<uint32_t>(leading);
+        }
+      }
+      require(valid);
+      position_ += valid;
+      zeros += static_cast<uint32_t>(valid);
+    }
+  }
+
+  void alignToByte() { position_ = (position_ + 7) & ~static_cast<size_t>(7); }
+  size_t bytePosition() const { return position_ >> 3; }
+
+ private:
+  // The next 57-64 bits, left aligned, zero past the end.
+  uint64_t peek() const {
+    const size_t byte = position_ >> 3;
+    uint64_t value = 0;
+    if (byte + 8 <= size_) {
+      for (int i = 0; i < 8; i++) value = (value << 8) | data_[byte + i];
+    } else {
+      for (size_t i = 0; i < 8; i++) value = (value << 8) | (byte + i < size_ ? data_[byte + i] : 0);
+    }
+    return value << (position_ & 7);
+  }
+
+  void require(int bits) const {
+    if (position_ + static_cast<size_t>(bits) > size_ * 8) invalid("frame overruns the file");
+  }
+
+  const uint8_t* data_;
+  size_t size_;
+  size_t position_ = 0;
+};
+
+class BitWriter {
+ public:
+  explicit BitWriter(std::vector<uint8_t>& out) : out_(out) {}
+
+  void write(uint32_t value, int bits) {
+    if (bits == 0) return;
+    const uint64_t mask = bits == 32 ? 0xFFFFFFFFull : ((1ull << bits) - 1);
+    accumulator_ = (accumulator_ << bits) | (value & mask);
+    pending_ += bits;
+    while (pending_ >= 8) {
+      pending_ -= 8;
+      out_.push_back(static_cast<uint8_t>(accumulator_ >> pending_));
+    }
+  }
+
+  void writeSigned(int32_t value, int bits) { write(static_cast<uint32_t>(value), bits); }
+
+  void writeRice(uint32_t value, int parameter) {
+    uint32_t zeros = value >> parameter;
+    while (zeros >= 32) {
+      write(0, 32);
+      zeros -= 32;
+    }
+    write(1, static_cast<int>(zeros) + 1);
+    write(value, parameter);
+  }
+
+  void align() {
+    if (pending_) write(0, 8 - pending_);
+  }
+
+ private:
+  std::vector<uint8_t>& out_;
+  uint64_t accumulator_ = 0;
+  int pending_ = 0;
+};
+
+// ----------------------------------------------------------------------------
+// Decoder
+// ----------------------------------------------------------------------------
+
+struct StreamInfo {
+  uint32_t minBlock = 0;
+  uint32_t maxBlock = 0;
+  uint32_t sampleRate = 0;
+  int channels = 0;
+  int bitsPerSample = 0;
+  uint64_t totalSamples = 0;  // 0 when the encoder did not know it
+};
+
+struct FrameHeader {
+  uint32_t blockSize = 0;
+  int assignment = 0;
+  int bitsPerSample = 0;
+  uint64_t firstSample = 0;
+  size_t headerBytes = 0;
+};
+
+// Length of an ID3v2 tag at `data`, 0 if there is none.
+static size_t id3Length(const uint8_t* data, size_t size) {
+  if (size < 10 || std::memcmp(data, "ID3", 3) != 0) return 0;
+  const size_t tagSize = (size_t(data[6] & 0x7F) << 21) | (size_t(data[7] & 0x7F) << 14) |
+    (size_t(data[8] & 0x7F) << 7) | size_t(data[9] & 0x7F);
+  return 10 + tagSize + ((data[5] & 0x10) ? 10 : 0);
+}
+
+bool isFlac(const uint8_t* data, size_t size) {
+  const size_t start = id3Length(data, size);
+  return start + 4 <= size && std::memcmp(data + start, "fLaC", 4) == 0;
+}
+
+// Parses the frame header at `data`. False when these bytes are not a frame
+// header of this stream, which is how the range scan rejects lookalikes.
+static bool parseFrameHeader(const uint8_t* data, size_t size, const StreamInfo& info, FrameHeader& out) {
+  static const int kDepths[8] = { 0, 8, 12, 0, 16, 20, 24, 32 };
+
+  if (size < 6 || data[0] != 0xFF || (data[1] & 0xFE) != 0xF8) return false;
+  const bool variable = (data[1] & 1) != 0;
+  const int blockCode = data[2] >> 4;
+  const int rateCode = data[2] & 15;
+  const int assignment = data[3] >> 4;
+  const int depthCode = (data[3] >> 1) & 7;
+  if (blockCode == 0 || rateCode == 15 || assignment > 10 || depthCode == 3 || (data[3] & 1)) return false;
+
+  size_t p = 4;
+  const uint8_t lead = data[p++];
+  uint64_t number;
+  int extra;
+  if (!(lead & 0x80)) { number = lead; extra = 0; }
+  else if ((lead & 0xE0) == 0xC0) { number = lead & 0x1F; extra = 1; }
+  else if ((lead & 0xF0) == 0xE0) { number = lead & 0x0F; extra = 2; }
+  else if ((lead & 0xF8) == 0xF0) { number = lead & 0x07; extra = 3; }
+  else if ((lead & 0xFC) == 0xF8) { number = lead & 0x03; extra = 4; }
+  else if ((lead & 0xFE) == 0xFC) { number = lead & 0x01; extra = 5; }
+  else if (lead == 0xFE) { number = 0; extra = 6; }
+  else return false;
+  if (p + extra + 4 > size) return false;
+  for (int i = 0; i < extra; i++) {
+    const uint8_t b = data[p++];
+    if ((b & 0xC0) != 0x80) return false;
+    number = (number << 6) | (b & 0x3F);
+  }
+
+  uint32_t blockSize;
+  if (blockCode == 1) blockSize = 192;
+  else if (blockCode <= 5) blockSize = 576u << (blockCode - 2);
+  else if (blockCode == 6) blockSize = data[p++] + 1u;
+  else if (blockCode == 7) { blockSize = ((data[p] << 8) | data[p + 1]) + 1u; p += 2; }
+  else blockSize = 256u << (blockCode - 8);
+
+  if (rateCode == 12) p += 1;
+  else if (rateCode == 13 || rateCode == 14) p += 2;
+
+  if (p >= size || crc8(data, p) != data[p]) return false;
+  p++;
+
+  const int depth = depthCode == 0 ? info.bitsPerSample : kDepths[depthCode];
+  const int channels = assignment < 8 ? assignment + 1 : 2;
+  if (channels != info.channels || depth != info.bitsPerSample) return false;
+  if (info.maxBlock && blockSize > info.maxBlock) return false;
+
+  out.blockSize = blockSize;
+  out.assignment = assignment;
+  out.bitsPerSample = depth;
+  out.firstSample = variable ? number : number * info.maxBlock;
+  out.headerBytes = p;
+  return true;
+}
+
+static void decodeResidual(BitReader& in, uint32_t blockSize, int order, int32_t* out) {
+  const uint32_t method = in.read(2);
+  if (method > 1) invalid("reserved residual coding method");
+  const int parameterBits = method == 0 ? 4 : 5;
+  const uint32_t escape = method == 0 ? 15 : 31;
+  const int partitionOrder = static_cast<int>(in.read(4));
+  const uint32_t partitionSize = blockSize >> partitionOrder;
+  if ((partitionSize << partitionOrder) != blockSize || partitionSize < static_cast<uint32_t>(order)) {
+    invalid("bad residual partition order");
+  }
+
+  for (uint32_t partition = 0; partition < (1u << partitionOrder); partition++) {
+    const uint32_t count = partitionSize - (partition == 0 ? order : 0);
+    const uint32_t parameter = in.read(parameterBits);
+    if (parameter == escape) {
+      const int bits = static_cast<int>(in.read(5));
+      for (uint32_t i = 0; i < count; i++) *out++ = in.readSigned(bits);
+      continue;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+      const uint32_t value = (in.readUnary() << parameter) | in.read(static_cast<int>(parameter));
+      *out++ = static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+    }
+  }
+}
+
+static void restoreFixed(int32_t* x, uint32_t n, int order) {
+  for (uint32_t i = order; i < n; i++) {
+    int64_t prediction = 0;
+    switch (order) {
+      case 1: prediction = x[i - 1]; break;
+      case 2: prediction = 2 * int64_t(x[i - 1]) - x[i - 2]; break;
+      case 3: prediction = 3 * int64_t(x[i - 1]) - 3 * int64_t(x[i - 2]) + x[i - 3]; break;
+      case 4: prediction = 4 * int64_t(x[i - 1]) - 6 * int64_t(x[i - 2]) + 4 * int64_t(x[i - 3]) - x[i - 4]; break;
+      default: break;
+    }
+    x[i] = static_cast<int32_t>(x[i] + prediction);
+  }
+}
+
+static void decodeSubframe(BitReader& in, uint32_t n, int depth, int32_t* out) {
+  if (in.read(1)) invalid("subframe padding bit set");
+  const uint32_t type = in.read(6);
+  int wasted = 0;
+  if (in.read(1)) wasted = static_cast<int>(in.readUnary()) + 1;
+  depth -= wasted;
+  if (depth <= 0) invalid("wasted bits exceed sample depth");
+
+  if (type == 0) {
+    std::fill(out, out + n, in.readSigned(depth));
+  } else if (type == 1) {
+    for (uint32_t i = 0; i < n; i++) out[i] = in.readSigned(depth);
+  } else if (type >= 8 && type <= 12) {
+    const int order = static_cast<int>(type - 8);
+    if (static_cast<uint32_t>(order) > n) invalid("predictor order exceeds block size");
+    for (int i = 0; i < order; i++) out[i] = in.readSigned(depth);
+    decodeResidual(in, n, order, out + order);
+    restoreFixed(out, n, order);
+  } else if (type >= 32) {
+    const int order = static_cast<int>(type - 31);
+    if (static_cast<uint32_t>(order) > n) invalid("predictor order exceeds block size");
+    for (int i = 0; i < order; i++) out[i] = in.readSigned(depth);
+    const int precision = static_cast<int>(in.read(4)) + 1;
+    if (precision == 16) invalid("reserved LPC precision");
+    const int shift = in.readSigned(5);
+    if (shift < 0) invalid("negative LPC shift");
+    int32_t coefs[kMaxLpcOrder];
+    for (int i = 0; i < order; i++) coefs[i] = in.readSigned(precision);
+    decodeResidual(in, n, order, out + order);
+    for (uint32_t i = order; i < n; i++) {
+      int64_t sum = 0;
+      for (int j = 0; j < order; j++) sum += int64_t(coefs[j]) * out[i - j - 1];
+      out[i] = static_cast<int32_t>(out[i] + (sum >> shift));
+    }
+  } else {
+    invalid("reserved subframe type");
+  }
+
+  if (wasted) {
+    for (uint32_t i = 0; i < n; i++) out[i] = static_cast<int32_t>(static_cast<uint32_t>(out[i]) << wasted);
+  }
+}
+
+// Decodes the frame at data[offset] into planar `samples`. Returns the
+// offset just past the frame; throws if it is not a valid frame.
+static size_t decodeFrame(
+  const uint8_t* data,
+  size_t size,
+  size_t offset,
+  const StreamInfo& info,
+  FrameHeader& header,
+  std::vector<int32_t>& samples
+) {
+  if (!parseFrameHeader(data + offset, size - offset, info, header)) invalid("bad frame header");
+  const uint32_t n = header.blockSize;
+  const int channels = info.channels;
+  samples.resize(static_cast<size_t>(channels) * n);
+
+  BitReader in(data + offset + header.headerBytes, size - offset - header.headerBytes);
+  for (int ch = 0; ch < channels; ch++) {
+    // The side channel needs one extra bit.
+    const bool side = (header.assignment == 8 && ch == 1) || (header.assignment == 9 && ch == 0) ||
+      (header.assignment == 10 && ch == 1);
+    decodeSubframe(in, n, header.bitsPerSample + (side ? 1 : 0), &samples[static_cast<size_t>(ch) * n]);
+  }
+  in.alignToByte();
+  const size_t end = offset + header.headerBytes + in.bytePosition();
+  if (end + 2 > size) invalid("frame overruns the file");
+  if (crc16(data + offset, end - offset) != ((data[end] << 8) | data[end + 1])) invalid("frame CRC mismatch");
+
+  int32_t* a = samples.data();
+  int32_t* b = samples.data() + n;
+  switch (header.assignment) {
+    case 8:  // left, side
+      for (uint32_t i = 0; i < n; i++) b[i] = a[i] - b[i];
+      break;
+    case 9:  // side, right
+      for (uint32_t i = 0; i < n; i++) a[i] += b[i];
+      break;
+    case 10:  // mid, side
+      for (uint32_t i = 0; i < n; i++) {
+        const int64_t mid = (int64_t(a[i]) * 2) | (b[i] & 1);
+        a[i] = static_cast<int32_t>((mid + b[i]) >> 1);
+        b[i] = static_cast<int32_t>((mid - b[i]) >> 1);
+      }
+      break;
+    default:
+      break;
+  }
+  return end + 2;
+}
+
+static size_t parseMetadata(const uint8_t* data, size_t size, StreamInfo& info) {
+  // Some taggers put an ID3v2 tag in front of the stream.
+  size_t p = id3Length(data, size);
+  if (p + 4 > size || std::memcmp(data + p, "fLaC", 4) != 0) invalid("missing fLaC marker");
+  p += 4;
+
+  bool haveInfo = false;
+  for (bool last = false; !last;) {
+    if (p + 4 > size) invalid("truncated metadata");
+    last = (data[p] & 0x80) != 0;
+    const int type = data[p] & 0x7F;
+    const size_t length = (size_t(data[p + 1]) << 16) | (size_t(data[p + 2]) << 8) | data[p + 3];
+    p += 4;
+    if (p + length > size) invalid("truncated metadata");
+    if (type == 0) {
+      if (length < 34) invalid("short STREAMINFO");
+      BitReader in(data + p, length);
+      info.minBlock = in.read(16);
+      info.maxBlock = in.read(16);
+      in.read(24);
+      in.read(24);
+      info.sampleRate = in.read(20);
+      info.channels = static_cast<int>(in.read(3)) + 1;
+      info.bitsPerSample = static_cast<int>(in.read(5)) + 1;
+      info.totalSamples = (uint64_t(in.read(4)) << 32) | in.read(32);
+      haveInfo = true;
+    }
+    p += length;
+  }
+  if (!haveInfo) invalid("missing STREAMINFO");
+  if (info.bitsPerSample < 4 || info.bitsPerSample > 24) {
+    throw std::runtime_error("Only FLAC streams of 4 to 24 bits are supported");
+  }
+  if (info.sampleRate == 0) invalid("zero sample rate");
+  return p;
+}
+
+struct DecodeRange {
+  size_t begin = 0;
+  size_t limit = 0;
+  size_t firstFrame = SIZE_MAX;  // offset of the first frame decoded
+  size_t end = 0;                // offset after the last frame decoded
+  uint64_t samples = 0;
+  std::vector<float> buffered;   // only when the total length is unknown
+};
+
+WavData decodeFlac(const uint8_t* data, size_t size, JobPriority priority) {
+  StreamInfo info;
+  const size_t audioStart = parseMetadata(data, size, info);
+  const int channels = info.channels;
+  const float scale = 1.0f / static_cast<float>(1u << (info.bitsPerSample - 1));
+  // STREAMINFO's length is only trusted up to what the frames could encode;
+  // a larger claim decodes through the growing path instead.
+  const size_t audioBytes = size - audioStart;
+  const uint64_t plausibleSamples = uint64_t(audioBytes / kMinFrameBytes + 1) * (info.maxBlock ? info.maxBlock : 65535);
+  const bool direct = info.totalSamples > 0 && info.totalSamples <= plausibleSamples;
+
+  WavData out{ static_cast<int>(info.sampleRate), channels, {} };
+  out.bitsPerSample = info.bitsPerSample;
+  if (direct) out.samples.resize(info.totalSamples * channels);
+
+  // Ranges are several times the largest possible frame, so each contains
+  // at least one frame start.
+  const size_t frameBound = std::max<size_t>(kMinDecodeRange, size_t(info.maxBlock ? info.maxBlock : 65536) * channels * 8);
+  const size_t wanted = std::max<size_t>(1, size_t(schedulerInfo().threads) * 4);
+  const size_t rangeCount = std::max<size_t>(1, std::min(wanted, audioBytes / frameBound));
+  std::vector<DecodeRange> ranges(rangeCount);
+  for (size_t i = 0; i < rangeCount; i++) {
+    ranges[i].begin = audioStart + audioBytes * i / rangeCount;
+    ranges[i].limit = audioStart + audioBytes * (i + 1) / rangeCount;
+  }
+
+  parallelFor(rangeCount, 1, priority, [&](size_t first, size_t last) {
+    std::vector<int32_t> planar;
+    FrameHeader header;
+    for (size_t r = first; r < last; r++) {
+      DecodeRange& range = ranges[r];
+      auto emit = [&](const FrameHeader& frame) {
+        const uint32_t n = frame.blockSize;
+        float* dest;
+        if (direct) {
+          if (frame.firstSample + n > info.totalSamples) invalid("frame beyond the stream length");
+          dest = &out.samples[frame.firstSample * channels];
+        } else {
+          range.buffered.resize(range.buffered.size() + size_t(n) * channels);
+          dest = &range.buffered[range.buffered.size() - size_t(n) * channels];
+        }
+        for (int ch = 0; ch < channels; ch++) {
+          const int32_t* src = &planar[size_t(ch) * n];
+          for (uint32_t i = 0; i < n; i++) dest[size_t(i) * channels + ch] = static_cast<float>(src[i]) * scale;
+        }
+        range.samples += n;
+      };
+
+      // First frame: the stream start, or the first offset that decodes.
+      size_t pos = range.begin;
+      if (range.begin == range.limit) continue;
+      if (r == 0) {
+        pos = decodeFrame(data, size, range.begin, info, header, planar);
+        range.firstFrame = range.begin;
+        emit(header);
+      } else {
+        for (; pos < range.limit; pos++) {
+          if (data[pos] != 0xFF || pos + 1 >= size || (data[pos + 1] & 0xFE) != 0xF8) continue;
+          try {
+            const size_t next = decodeFrame(data, size, pos, info, header, planar);
+            range.firstFrame = pos;
+            emit(header);
+            pos = next;
+            break;
+          } catch (const std::runtime_error&) {
+            continue;
+          }
+        }
+      }
+      if (range.firstFrame == SIZE_MAX) continue;
+
+      // Then frame after frame until one starts in the next range. Bytes
+      // that are not a frame (a trailing tag) end the stream.
+      while (pos < range.limit && pos + 1 < size && data[pos] == 0xFF && (data[pos + 1] & 0xFE) == 0xF8) {
+        pos = decodeFrame(data, size, pos, info, header, planar);
+        emit(header);
+      }
+      range.end = pos;
+    }
+  });
+
+  uint64_t decoded = 0;
+  const DecodeRange* previous = nullptr;
+  for (const DecodeRange& range : ranges) {
+    if (range.firstFrame == SIZE_MAX) continue;
+    if (previous && previous->end != range.firstFrame) invalid("frame sync lost");
+    decoded += range.samples;
+    previous = &range;
+  }
+  if (direct && decoded != info.totalSamples) invalid("stream is truncated");
+  if (!direct) {
+    out.samples.reserve(decoded * channels);
+    for (const DecodeRange& range : ranges) {
+      out.samples.insert(out.samples.end(), range.buffered.begin(), range.buffered.end());
+    }
+  }
+  return out;
+}
+
+WavData readFlac(const std::string& path, JobPriority priority) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) throw std::runtime_error("Failed to open FLAC file");
+  const std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  return decodeFlac(bytes.data(), bytes.size(), priority);
+}
+
+// ----------------------------------------------------------------------------
+// Encoder
+// ----------------------------------------------------------------------------
+
+// One way to code a subframe, with its size in bits.
+struct SubframePlan {
+  enum Kind { Constant, Verbatim, Fixed, Lpc } kind = Verbatim;
+  int order = 0;
+  int precision = 0;
+  int shift = 0;
+  int32_t coefs[kMaxLpcOrder] = {};
+  std::vector<int32_t> residual;
+  int partitionOrder = 0;
+  std::vector<int> parameters;
+  uint64_t bits = 0;
+};
+
+static uint32_t zigzag(int32_t value) {
+  return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+// Picks the partition order and Rice parameters for `residual` (samples
+// order..n-1 of the block). Returns the estimated size in bits.
+static uint64_t planResidual(const std::vector<int32_t>& residual, uint32_t n, int order, SubframePlan& plan) {
+  int maxOrder = 0;
+  while (maxOrder < kMaxPartitionOrder && (n % (2u << maxOrder)) == 0 && (n >> (maxOrder + 1)) > uint32_t(order)) maxOrder++;
+
+  // Sums per finest partition, merged pairwise for coarser orders.
+  const uint32_t finest = 1u << maxOrder;
+  std::vector<uint64_t> sums(finest, 0);
+  const uint32_t finestSize = n >> maxOrder;
+  for (size_t i = 0; i < residual.size(); i++) sums[(i + order) / finestSize] += zigzag(residual[i]);
+
+  uint64_t best = UINT64_MAX;
+  for (int po = maxOrder; po >= 0; po--) {
+    const uint32_t partitions = 1u << po;
+    const uint32_t size = n >> po;
+    uint64_t bits = 0;
+    std::vector<int> parameters(partitions);
+    bool wide = false;
+    for (uint32_t p = 0; p < partitions; p++) {
+      const uint64_t sum = sums[p];
+      const uint64_t count = size - (p == 0 ? order : 0);
+      int bestK = 0;
+      uint64_t bestBits = UINT64_MAX;
+      for (int k = 0; k <= 30; k++) {
+        const uint64_t estimate = count * (k + 1) + (sum >> k);
+        if (estimate < bestBits) {
+          bestBits = estimate;
+          bestK = k;
+        }
+        if ((sum >> k) == 0) break;
+      }
+      parameters[p] = bestK;
+      wide = wide || bestK > 14;
+      bits += bestBits;
+    }
+    bits += 6 + uint64_t(partitions) * (wide ? 5 : 4);
+    if (bits < best) {
+      best = bits;
+      plan.partitionOrder = po;
+      plan.parameters = std::move(parameters);
+    }
+    for (uint32_t p = 0; p < partitions / 2; p++) sums[p] = sums[2 * p] + sums[2 * p + 1];
+  }
+  return best;
+}
+
+static void fixedResidual(const int32_t* x, uint32_t n, int order, std::vector<int32_t>& out) {
+  out.resize(n - order);
+  for (uint32_t i = order; i < n; i++) {
+    int64_t prediction = 0;
+    switch (order) {
+      case 1: prediction = x[i - 1]; break;
+      case 2: prediction = 2 * int64_t(x[i - 1]) - x[i - 2]; break;
+      case 3: prediction = 3 * int64_t(x[i - 1]) - 3 * int64_t(x[i - 2]) + x[i - 3]; break;
+      case 4: prediction = 4 * int64_t(x[i - 1]) - 6 * int64_t(x[i - 2]) + 4 * int64_t(x[i - 3]) - x[i - 4]; break;
+      default: break;
+    }
+    out[i - order] = static_cast<int32_t>(x[i] - prediction);
+  }
+}
+
+// Levinson-Durbin on a Welch-windowed autocorrelation; lpc[k] holds the
+// order k+1 predictor, x[i] ~ sum_j lpc[k][j] * x[i - 1 - j].
+static int computeLpc(const int32_t* x, uint32_t n, int maxOrder, double lpc[][kMaxLpcOrder]) {
+  std::vector<double> windowed(n);
+  const double half = (n - 1) / 2.0;
+  const double denom = (n + 1) / 2.0;
+  for (uint32_t i = 0; i < n; i++) {
+    const double t = (i - half) / denom;
+    windowed[i] = x[i] * (1.0 - t * t);
+  }
+  double autoc[kMaxLpcOrder + 1];
+  for (int lag = 0; lag <= maxOrder; lag++) {
+    double sum = 0.0;
+    for (uint32_t i = lag; i < n; i++) sum += windowed[i] * windowed[i - lag];
+    autoc[lag] = sum;
+  }
+  if (autoc[0] <= 0.0) return 0;
+
+  double a[kMaxLpcOrder] = {};
+  double error = autoc[0];
+  int orders = 0;
+  for (int i = 0; i < maxOrder; i++) {
+    double acc = autoc[i + 1];
+    for (int j = 0; j < i; j++) acc -= a[j] * autoc[i - j];
+    const double k = acc / error;
+    double previous[kMaxLpcOrder];
+    std::copy(a, a + i, previous);
+    a[i] = k;
+    for (int j = 0; j < i; j++) a[j] = previous[j] - k * previous[i - 1 - j];
+    error *= 1.0 - k * k;
+    std::copy(a, a + i + 1, lpc[i]);
+    orders = i + 1;
+    if (error <= 0.0) break;
+  }
+  return orders;
+}
+
+static bool quantizeLpc(const double* lpc, int order, int precision, int32_t* coefs, int& shift) {
+  double cmax = 0.0;
+  for (int i = 0; i < order; i++) cmax = std::max(cmax, std::fabs(lpc[i]));
+  if (cmax <= 0.0) return false;
+  int exponent;
+  std::frexp(cmax, &exponent);
+  shift = std::min(15, precision - 1 - exponent);
+  if (shift < 0) return false;
+  const int32_t qmax = (1 << (precision - 1)) - 1;
+  const int32_t qmin = -(1 << (precision - 1));
+  double error = 0.0;
+  for (int i = 0; i < order; i++) {
+    error += lpc[i] * (1 << shift);
+    const int32_t q = std::clamp(static_cast<int32_t>(std::lround(error)), qmin, qmax);
+    error -= q;
+    coefs[i] = q;
+  }
+  return true;
+}
+
+static bool lpcResidual(const int32_t* x, uint32_t n, const SubframePlan& plan, std::vector<int32_t>& out) {
+  out.resize(n - plan.order);
+  for (uint32_t i = plan.order; i < n; i++) {
+    int64_t sum = 0;
+    for (int j = 0; j < plan.order; j++) sum += int64_t(plan.coefs[j]) * x[i - j - 1];
+    const int64_t residual = int64_t(x[i]) - (sum >> plan.shift);
+    if (residual > (1 << 30) || residual < -(1 << 30)) return false;
+    out[i - plan.order] = static_cast<int32_t>(residual);
+  }
+  return true;
+}
+
+static SubframePlan planSubframe(const int32_t* x, uint32_t n, int depth) {
+  SubframePlan best;
+  best.kind = SubframePlan::Verbatim;
+  best.bits = 8 + uint64_t(n) * depth;
+
+  if (std::all_of(x, x + n, [&](int32_t v) { return v == x[0]; })) {
+    best.kind = SubframePlan::Constant;
+    best.bits = 8 + depth;
+    return best;
+  }
+
+  SubframePlan candidate;
+  for (int order = 0; order <= 4 && uint32_t(order) < n; order++) {
+    candidate.kind = SubframePlan::Fixed;
+    candidate.order = order;
+    fixedResidual(x, n, order, candidate.residual);
+    candidate.bits = 8 + uint64_t(order) * depth + planResidual(candidate.residual, n, order, candidate);
+    if (candidate.bits < best.bits) std::swap(best, candidate);
+  }
+
+  double lpc[kMaxLpcOrder][kMaxLpcOrder];
+  const int available = computeLpc(x, n, kEncodeLpcOrders[1], lpc);
+  const int precision = depth <= 16 ? 12 : 15;
+  for (int order : kEncodeLpcOrders) {
+    if (order > available || uint32_t(order) >= n) continue;
+    candidate.kind = SubframePlan::Lpc;
+    candidate.order = order;
+    candidate.precision = precision;
+    if (!quantizeLpc(lpc[order - 1], order, precision, candidate.coefs, candidate.shift)) continue;
+    if (!lpcResidual(x, n, candidate, candidate.residual)) continue;
+    candidate.bits = 8 + uint64_t(order) * depth + 4 + 5 + uint64_t(order) * precision +
+      planResidual(candidate.residual, n, order, candidate);
+    if (candidate.bits < best.bits) std::swap(best, candidate);
+  }
+  return best;
+}
+
+static void writeSubframe(BitWriter& out, const int32_t* x, uint32_t n, int depth, const SubframePlan& plan) {
+  switch (plan.kind) {
+    case SubframePlan::Constant:
+      out.write(0, 8);
+      out.writeSigned(x[0], depth);
+      return;
+    case SubframePlan::Verbatim:
+      out.write(1 << 1, 8);
+      for (uint32_t i = 0; i < n; i++) out.writeSigned(x[i], depth);
+      return;
+    case SubframePlan::Fixed:
+      out.write((8 + plan.order) << 1, 8);
+      break;
+    case SubframePlan::Lpc:
+      out.write((32 + plan.order - 1) << 1, 8);
+      break;
+  }
+  for (int i = 0; i < plan.order; i++) out.writeSigned(x[i], depth);
+  if (plan.kind == SubframePlan::Lpc) {
+    out.write(plan.precision - 1, 4);
+    out.writeSigned(plan.shift, 5);
+    for (int i = 0; i < plan.order; i++) out.writeSigned(plan.coefs[i], plan.precision);
+  }
+
+  const bool wide = std::any_of(plan.parameters.begin(), plan.parameters.end(), [](int k) { return k > 14; });
+  out.write(wide ? 1 : 0, 2);
+  out.write(plan.partitionOrder, 4);
+  const uint32_t size = n >> plan.partitionOrder;
+  size_t i = 0;
+  for (size_t p = 0; p < plan.parameters.size(); p++) {
+    const int k = plan.parameters[p];
+    out.write(k, wide ? 5 : 4);
+    const uint32_t count = size - (p == 0 ? plan.order : 0);
+    for (uint32_t j = 0; j < count; j++) out.writeRice(zigzag(plan.residual[i++]), k);
+  }
+}
+
+static void writeUtf8(std::vector<uint8_t>& out, uint64_t value) {
+  if (value < 0x80) {
+    out.push_back(static_cast<uint8_t>(value));
+    return;
+  }
+  int extra = value < 0x800 ? 1 : value < 0x10000 ? 2 : value < 0x200000 ? 3 : value < 0x4000000 ? 4 : value < 0x80000000ull ? 5 : 6;
+  static const uint8_t kLead[7] = { 0x00, 0xC0, 0xE0, 0xF0, 0xF8, 0xFC, 0xFE };
+  out.push_back(static_cast<uint8_t>(kLead[extra] | (extra == 6 ? 0 : value >> (6 * extra))));
+  for (int i = extra - 1; i >= 0; i--) out.push_back(static_cast<uint8_t>(0x80 | ((value >> (6 * i)) & 0x3F)));
+}
+
+static int depthCode(int depth) {
+  switch (depth) {
+    case 8: return 1;
+    case 12: return 2;
+    case 16: return 4;
+    case 20: return 5;
+    case 24: return 6;
+    default: return 0;
+  }
+}
+
+static void encodeFrame(const WavData& data, int depth, uint64_t frameIndex, std::vector<uint8_t>& out) {
+  static const uint32_t kRates[12] = { 0, 88200, 176400, 192000, 8000, 16000, 22050, 24000, 32000, 44100, 48000, 96000 };
+  const int channels = data.channels;
+  const uint64_t totalFrames = data.samples.size() / channels;
+  const uint64_t first = frameIndex * kEncodeBlockSize;
+  const uint32_t n = static_cast<uint32_t>(std::min<uint64_t>(kEncodeBlockSize, totalFrames - first));
+
+  // Quantize to planar integers.
+  const double scale = double(1u << (depth - 1));
+  const double high = scale - 1;
+  std::vector<std::vector<int32_t>> planar(channels, std::vector<int32_t>(n));
+  for (uint32_t i = 0; i < n; i++) {
+    const float* frame = &data.samples[(first + i) * channels];
+    for (int ch = 0; ch < channels; ch++) {
+      const double v = std::floor(double(frame[ch]) * scale + 0.5);
+      planar[ch][i] = static_cast<int32_t>(std::clamp(v, -scale, high));
+    }
+  }
+
+  // Stereo: pick the pair with the smallest order-2 residual.
+  int assignment = channels - 1;
+  std::vector<int32_t> mid, side;
+  if (channels == 2) {
+    mid.resize(n);
+    side.resize(n);
+    for (uint32_t i = 0; i < n; i++) {
+      const int32_t l = planar[0][i], r = planar[1][i];
+      mid[i] = (l + r) >> 1;
+      side[i] = l - r;
+    }
+    auto cost = [n](const std::vector<int32_t>& x) {
+      uint64_t sum = 0;
+      for (uint32_t i = 2; i < n; i++) sum += std::llabs(int64_t(x[i]) - 2 * int64_t(x[i - 1]) + x[i - 2]);
+      return sum;
+    };
+    const uint64_t l = cost(planar[0]), r = cost(planar[1]), m = cost(mid), s = cost(side);
+    const uint64_t options[4] = { l + r, l + s, s + r, m + s };
+    const int best = int(std::min_element(options, options + 4) - options);
+    assignment = best == 0 ? 1 : 7 + best;
+  }
+
+  const size_t headerStart = out.size();
+  out.push_back(0xFF);
+  out.push_back(0xF8);
+  const int rateIndex = int(std::find(kRates + 1, kRates + 12, uint32_t(data.sampleRate)) - kRates);
+  int rateCode = rateIndex < 12 ? rateIndex : 0;
+  if (!rateCode && data.sampleRate % 1000 == 0 && data.sampleRate / 1000 <= 255) rateCode = 12;
+  else if (!rateCode && data.sampleRate <= 65535) rateCode = 13;
+  const int blockCode = n == kEncodeBlockSize ? 12 : n <= 256 ? 6 : 7;
+  out.push_back(static_cast<uint8_t>((blockCode << 4) | rateCode));
+  out.push_back(static_cast<uint8_t>((assignment << 4) | (depthCode(depth) << 1)));
+  writeUtf8(out, frameIndex);
+  if (blockCode == 6) out.push_back(static_cast<uint8_t>(n - 1));
+  if (blockCode == 7) {
+    out.push_back(static_cast<uint8_t>((n - 1) >> 8));
+    out.push_back(static_cast<uint8_t>(n - 1));
+  }
+  if (rateCode == 12) out.push_back(static_cast<uint8_t>(data.sampleRate / 1000));
+  if (rateCode == 13) {
+    out.push_back(static_cast<uint8_t>(data.sampleRate >> 8));
+    out.push_back(static_cast<uint8_t>(data.sampleRate));
+  }
+  out.push_back(crc8(&out[headerStart], out.size() - headerStart));
+
+  BitWriter bits(out);
+  auto emit = [&](const std::vector<int32_t>& x, int channelDepth) {
+    writeSubframe(bits, x.data(), n, channelDepth, planSubframe(x.data(), n, channelDepth));
+  };
+  switch (assignment) {
+    case 8: emit(planar[0], depth); emit(side, depth + 1); break;
+    case 9: emit(side, depth + 1); emit(planar[1], depth); break;
+    case 10: emit(mid, depth); emit(side, depth + 1); break;
+    default:
+      for (int ch = 0; ch < channels; ch++) emit(planar[ch], depth);
+      break;
+  }
+  bits.align();
+  const uint16_t crc = crc16(&out[headerStart], out.size() - headerStart);
+  out.push_back(static_cast<uint8_t>(crc >> 8));
+  out.push_back(static_cast<uint8_t>(crc));
+}
+
+static std::vector<uint8_t> streamInfoBlock(const WavData& data, int depth, uint32_t minFrame, uint32_t maxFrame) {
+  std::vector<uint8_t> block = { 0x80, 0, 0, 34 };  // last metadata block, STREAMINFO, 34 bytes
+  BitWriter out(block);
+  const uint64_t total = data.samples.size() / data.channels;
+  out.write(kEncodeBlockSize, 16);
+  out.write(kEncodeBlockSize, 16);
+  out.write(minFrame, 24);
+  out.write(maxFrame, 24);
+  out.write(static_cast<uint32_t>(data.sampleRate), 20);
+  out.write(static_cast<uint32_t>(data.channels - 1), 3);
+  out.write(static_cast<uint32_t>(depth - 1), 5);
+  out.write(static_cast<uint32_t>(total >> 32), 4);
+  out.write(static_cast<uint32_t>(total), 32);
+  for (int i = 0; i < 4; i++) out.write(0, 32);  // MD5 not computed
+  return block;
+}
+
+void writeFlac(const std::string& path, const WavData& data, int bitsPerSample, JobPriority priority) {
+  if (bitsPerSample < 8 || bitsPerSample > 24) throw std::invalid_argument("FLAC output supports 8 to 24 bits");
+  if (data.channels <= 0 || data.channels > 8) throw std::invalid_argument("FLAC supports 1 to 8 channels");
+  if (data.sampleRate <= 0 || data.sampleRate >= (1 << 20)) throw std::invalid_argument("Sample rate not representable in FLAC");
+
+  std::ofstream out(path, std::ios::binary);
+  if (!out) throw std::runtime_error("Failed to open output FLAC file");
+  out.write("fLaC", 4);
+  const std::vector<uint8_t> placeholder = streamInfoBlock(data, bitsPerSample, 0, 0);
+  out.write(reinterpret_cast<const char*>(placeholder.data()), placeholder.size());
+
+  const uint64_t totalFrames = data.samples.size() / data.channels;
+  const uint64_t frameCount = (totalFrames + kEncodeBlockSize - 1) / kEncodeBlockSize;
+  uint32_t minFrame = UINT32_MAX, maxFrame = 0;
+  std::vector<std::vector<uint8_t>> encoded(kEncodeBatchFrames);
+  for (uint64_t batch = 0; batch < frameCount; batch += kEncodeBatchFrames) {
+    const size_t count = static_cast<size_t>(std::min<uint64_t>(kEncodeBatchFrames, frameCount - batch));
+    parallelFor(count, 1, priority, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; i++) {
+        encoded[i].clear();
+        encodeFrame(data, bitsPerSample, batch + i, encoded[i]);
+      }
+    });
+    for (size_t i = 0; i < count; i++) {
+      out.write(reinterpret_cast<const char*>(encoded[i].data()), encoded[i].size());
+      minFrame = std::min(minFrame, static_cast<uint32_t>(encoded[i].size()));
+      maxFrame = std::max(maxFrame, static_cast<uint32_t>(encoded[i].size()));
+    }
+  }
+
+  const std::vector<uint8_t> info = streamInfoBlock(data, bitsPerSample, frameCount ? minFrame : 0, maxFrame);
+  out.seekp(4);
+  out.write(reinterpret_cast<const char*>(info.data()), info.size());
+  if (!out.flush()) throw std::runtime_error("Failed to write FLAC file");
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "scheduler.h"
+#include "wav.h"
+
+// Native FLAC codec, so FLAC masters are signed in one in-process pass
+// instead of a decode / sign / encode round trip through temporary WAVs.
+// Decoding splits the stream at frame boundaries (sync code plus header
+// and frame CRCs) and decodes the pieces in parallel on the shared
+// scheduler, straight into the interleaved float buffer. Encoding compresses
+// batches of frames in parallel. Integer depths of 8 to 24 bits.
+
+bool isFlac(const uint8_t* data, size_t size);
+
+// `bitsPerSample` of the result is the stream's depth.
+WavData decodeFlac(const uint8_t* data, size_t size, JobPriority priority = JobPriority::Batch);
+WavData readFlac(const std::string& path, JobPriority priority = JobPriority::Batch);
+
+// Samples are rounded and clipped to `bitsPerSample` (8 to 24).
+void writeFlac(const std::string& path, const WavData& data, int bitsPerSample, JobPriority priority = JobPriority::Batch);
@@ -0,0 +1,229 @@
+#include "float_codec.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+// ============================================================================
+// FLOAT CODEC
+// Byte-plane shuffle plus an LZ4-style block codec. The token format is
+// LZ4's: a byte of literal length (high nibble) and match length minus 4
+// (low nibble), each continued with 255-runs, then the literals and a
+// little-endian 16-bit offset. Every block is self-contained, so blocks are
+// the unit of parallelism both ways.
+// ============================================================================
+
+constexpr size_t kBlockFloats = 1 << 16;  // 256 KiB of samples per block
+constexpr int kHashBits = 14;
+constexpr size_t kMinMatch = 4;
+constexpr size_t kLastLiterals = 5;       // the tail is always literal
+constexpr size_t kMatchSearchLimit = 12;  // no match may start this close to the end
+constexpr size_t kMaxOffset = 65535;
+constexpr size_t kWideCopy = 16;
+
+static uint32_t read32(const uint8_t* p) {
+  uint32_t v;
+  std::memcpy(&v, p, 4);
+  return v;
+}
+
+static uint32_t hashSequence(uint32_t sequence) {
+  return (sequence * 2654435761u) >> (32 - kHashBits);
+}
+
+static void writeLength(std::vector<uint8_t>& out, size_t length) {
+  while (length >= 255) {
+    out.push_back(255);
+    length -= 255;
+  }
+  out.push_back(static_cast<uint8_t>(length));
+}
+
+static void emitSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literalCount, size_t offset,
+    size_t matchLength) {
+  const size_t matchCode = matchLength - kMinMatch;
+  out.push_back(static_cast<uint8_t>((std::min<size_t>(literalCount, 15) << 4) | std::min<size_t>(matchCode, 15)));
+  if (literalCount >= 15) writeLength(out, literalCount - 15);
+  out.insert(out.end(), literals, literals + literalCount);
+  out.push_back(static_cast<uint8_t>(offset & 0xFF));
+  out.push_back(static_cast<uint8_t>(offset >> 8));
+  if (matchCode >= 15) writeLength(out, matchCode - 15);
+}
+
+static void emitLastLiterals(std::vector<uint8_t>& out, const uint8_t* literals, size_t literalCount) {
+  out.push_back(static_cast<uint8_t>(std::min<size_t>(literalCount, 15) << 4));
+  if (literalCount >= 15) writeLength(out, literalCount - 15);
+  out.insert(out.end(), literals, literals + literalCount);
+}
+
+static std::vector<uint8_t> lzCompress(const uint8_t* src, size_t size) {
+  std::vector<uint8_t> out;
+  out.reserve(size + size / 255 + 16);
+  std::vector<uint32_t> table(size_t(1) << kHashBits, 0);
+
+  size_t anchor = 0;
+  size_t ip = 0;
+  if (size > kMatchSearchLimit) {
+    const size_t limit = size - kMatchSearchLimit;
+    size_t misses = 0;
+    while (ip < limit) {
+      const uint32_t sequence = read32(src + ip);
+      const uint32_t h = hashSequence(sequence);
+      // Positions are stored plus one so that zero means empty.
+      const size_t candidate = table[h];
+      table[h] = static_cast<uint32_t>(ip + 1);
+      if (candidate == 0 || ip - (candidate - 1) > kMaxOffset || read32(src + candidate - 1) != sequence) {
+        // Incompressible stretches (mantissa noise) are skipped faster.
+        ip += 1 + (misses++ >> 6);
+        continue;
+      }
+      const size_t ref = candidate - 1;
+      size_t length = kMinMatch;
+      const size_t matchEnd = size - kLastLiterals;
+      while (ip + length < matchEnd && src[ref + length] == src[ip + length]) length++;
+      emitSequence(out, src + anchor, ip - anchor, ip - ref, length);
+      ip += length;
+      anchor = ip;
+      misses = 0;
+    }
+  }
+  emitLastLiterals(out, src + anchor, size - anchor);
+  return out;
+}
+
+static size_t readLength(const uint8_t*& p, const uint8_t* end, size_t nibble) {
+  size_t length = nibble;
+  if (nibble != 15) return length;
+  for (;;) {
+    if (p >= end) throw std::runtime_error("Corrupt compressed audio");
+    const uint8_t b = *p++;
+    length += b;
+    if (b != 255) return length;
+  }
+}
+
+static void lzDecompress(const uint8_t* src, size_t size, uint8_t* dst, size_t dstSize) {
+  const uint8_t* p = src;
+  const uint8_t* end = src + size;
+  size_t op = 0;
+  for (;;) {
+    if (p >= end) throw std::runtime_error("Corrupt compressed audio");
+    const uint8_t token = *p++;
+    const size_t literals = readLength(p, end, token >> 4);
+    if (literals > static_cast<size_t>(end - p) || literals > dstSize - op) {
+      throw std::runtime_error("Corrupt compressed audio");
+    }
+    // Short literal runs are copied as one 16-byte move when both sides have
+    // the room; the excess is overwritten by what follows.
+    if (literals <= kWideCopy && end - p >= static_cast<ptrdiff_t>(kWideCopy) && dstSize - op >= kWideCopy) {
+      std::memcpy(dst + op, p, kWideCopy);
+    } else {
+      std::memcpy(dst + op, p, literals);
+    }
+    p += literals;
+    op += literals;
+    if (p == end) break;  // the last sequence has no match
+
+    if (end - p < 2) throw std::runtime_error("Corrupt compressed audio");
+    const size_t offset = size_t(p[0]) | (size_t(p[1]) << 8);
+    p += 2;
+    const size_t length = readLength(p, end, token & 0x0F) + kMinMatch;
+    if (offset == 0 || offset > op || length > dstSize - op) throw std::runtime_error("Corrupt compressed audio");
+    const uint8_t* from = dst + op - offset;
+    if (offset >= kWideCopy && dstSize - op >= length + kWideCopy) {
+      for (size_t i = 0; i < length; i += kWideCopy) std::memcpy(dst + op + i, from + i, kWideCopy);
+    } else if (offset >= length) {
+      std::memcpy(dst + op, from, length);
+    } else if (offset == 1) {
+      std::memset(dst + op, *from, length);
+    } else {
+      // Matches may overlap their own output (runs), so copy forwards.
+      for (size_t i = 0; i < length; i++) dst[op + i] = from[i];
+    }
+    op += length;
+  }
+  if (op != dstSize) throw std::runtime_error("Corrupt compressed audio");
+}
+
+// Byte b of float i goes to plane b, position i.
+static void shuffleBytes(const float* samples, size_t count, uint8_t* planes) {
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(samples);
+  for (size_t i = 0; i < count; i++) {
+    for (size_t b = 0; b < 4; b++) planes[b * count + i] = bytes[i * 4 + b];
+  }
+}
+
+static void unshuffleBytes(const uint8_t* const planes[4], size_t count, float* samples) {
+  for (size_t i = 0; i < count; i++) {
+    const uint32_t word = uint32_t(planes[0][i]) | (uint32_t(planes[1][i]) << 8) | (uint32_t(planes[2][i]) << 16) |
+      (uint32_t(planes[3][i]) << 24);
+    std::memcpy(samples + i, &word, 4);
+  }
+}
+
+CompressedFloats compressFloats(const float* samples, size_t count, JobPriority priority) {
+  const size_t blocks = (count + kBlockFloats - 1) / kBlockFloats;
+  std::vector<std::vector<uint8_t>> encoded(blocks * 4);
+  std::vector<uint8_t> stored(blocks * 4, 0);
+  parallelFor(blocks, 1, priority, [&](size_t begin, size_t end) {
+    std::vector<uint8_t> planes;
+    for (size_t block = begin; block < end; block++) {
+      const size_t first = block * kBlockFloats;
+      const size_t n = std::min(kBlockFloats, count - first);
+      planes.resize(n * 4);
+      shuffleBytes(samples + first, n, planes.data());
+      for (size_t b = 0; b < 4; b++) {
+        const uint8_t* plane = planes.data() + b * n;
+        std::vector<uint8_t>& out = encoded[block * 4 + b];
+        out = lzCompress(plane, n);
+        if (out.size() >= n) {
+          out.assign(plane, plane + n);
+          stored[block * 4 + b] = 1;
+        }
+      }
+    }
+  });
+
+  CompressedFloats out;
+  out.count = count;
+  out.stored = std::move(stored);
+  size_t total = 0;
+  for (const auto& stream : encoded) total += stream.size();
+  out.data.reserve(total);
+  for (const auto& stream : encoded) {
+    out.streamStarts.push_back(out.data.size());
+    out.data.insert(out.data.end(), stream.begin(), stream.end());
+  }
+  out.streamStarts.push_back(out.data.size());
+  return out;
+}
+
+void decompressFloats(const CompressedFloats& compressed, float* out, JobPriority priority) {
+  const size_t blocks = (compressed.count + kBlockFloats - 1) / kBlockFloats;
+  if (compressed.stored.size() != blocks * 4 || compressed.streamStarts.size() != blocks * 4 + 1) {
+    throw std::runtime_error("Corrupt compressed audio");
+  }
+  parallelFor(blocks, 1, priority, [&](size_t begin, size_t end) {
+    std::vector<uint8_t> scratch;
+    for (size_t block = begin; block < end; block++) {
+      const size_t first = block * kBlockFloats;
+      const size_t n = std::min(kBlockFloats, compressed.count - first);
+      scratch.resize(n * 4);
+      // Stored planes are read where they lie; only coded ones are expanded.
+      const uint8_t* planes[4];
+      for (size_t b = 0; b < 4; b++) {
+        const size_t stream = block * 4 + b;
+        const uint8_t* src = compressed.data.data() + compressed.streamStarts[stream];
+        const size_t size = compressed.streamStarts[stream + 1] - compressed.streamStarts[stream];
+        if (compressed.stored[stream]) {
+          if (size != n) throw std::runtime_error("Corrupt compressed audio");
+          planes[b] = src;
+        } else {
+          lzDecompress(src, size, scratch.data() + b * n, n);
+          planes[b] = scratch.data() + b * n;
+        }
+      }
+      unshuffleBytes(planes, n, out + first);
+    }
+  });
+}
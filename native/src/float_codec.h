@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "scheduler.h"
+
+// Lossless compression of float sample buffers for keeping decoded audio in
+// RAM. The samples are cut into independent blocks; in each, the four bytes
+// of every float are regrouped into four byte planes (so the sign/exponent
+// bytes of neighbouring samples sit together and repeat) and each plane goes
+// through an LZ4-style byte codec (greedy hash-table matcher, 64 KiB window,
+// literal/match tokens). A plane that does not shrink, typically the low
+// mantissa bytes, is stored as is and costs a copy to restore.
+// Blocks compress and decompress in parallel on the shared scheduler.
+
+struct CompressedFloats {
+  size_t count = 0;                // floats
+  std::vector<uint8_t> data;        // four plane streams per block, back to back
+  std::vector<size_t> streamStarts; // offset of each stream in `data`, plus the end
+  std::vector<uint8_t> stored;      // 1 where a stream is kept uncompressed
+
+  size_t compressedBytes() const { return data.size(); }
+};
+
+CompressedFloats compressFloats(const float* samples, size_t count, JobPriority priority = JobPriority::Batch);
+// `out` holds `compressed.count` floats. Throws on corrupt input.
+void decompressFloats(const CompressedFloats& compressed, float* out, JobPriority priority = JobPriority::Batch);
@@ -0,0 +1,65 @@
+#include "kernels.h"
+#include <atomic>
+#include <cstdlib>
+
+// Baseline build of the kernels, compiled with the default target flags.
+#define KERNEL_ISA CpuIsa::Scalar
+#include "kernels_impl.h"
+
+const KernelTable* kernelsScalar() {
+  return &kKernelTable;
+}
+
+static const KernelTable* tableFor(CpuIsa isa) {
+  switch (isa) {
+    case CpuIsa::Sse42: return kernelsSse42();
+    case CpuIsa::Avx2: return kernelsAvx2();
+    case CpuIsa::Avx512: return kernelsAvx512();
+    default: return kernelsScalar();
+  }
+}
+
+// Best compiled table not above `limit`.
+static const KernelTable* bestTable(CpuIsa limit) {
+  for (int level = static_cast<int>(limit); level > 0; level--) {
+    if (const KernelTable* table = tableFor(static_cast<CpuIsa>(level))) return table;
+  }
+  return kernelsScalar();
+}
+
+static const KernelTable* initialTable() {
+  CpuIsa limit = detectCpuIsa();
+  // MUSMARK_ISA can only lower the level; asking for more than the CPU has
+  // would fault on the first vector instruction.
+  CpuIsa requested;
+  if (const char* env = std::getenv("MUSMARK_ISA")) {
+    if (parseCpuIsa(env, requested) && requested < limit) limit = requested;
+  }
+  return bestTable(limit);
+}
+
+static std::atomic<const KernelTable*>& activeTable() {
+  static std::atomic<const KernelTable*> table{ initialTable() };
+  return table;
+}
+
+const KernelTable& kernels() {
+  return *activeTable().load(std::memory_order_acquire);
+}
+
+bool selectKernels(CpuIsa isa) {
+  if (isa > detectCpuIsa()) return false;
+  const KernelTable* table = tableFor(isa);
+  if (!table) return false;
+  activeTable().store(table, std::memory_order_release);
+  return true;
+}
+
+std::vector<CpuIsa> availableKernelIsas() {
+  std::vector<CpuIsa> isas;
+  const CpuIsa limit = detectCpuIsa();
+  for (int level = 0; level <= static_cast<int>(limit); level++) {
+    if (tableFor(static_cast<CpuIsa>(level))) isas.push_back(static_cast<CpuIsa>(level));
+  }
+  return isas;
+}
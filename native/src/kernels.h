@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "cpu.h"
+#include "fft.h"
+
+// Hot inner loops of the engine. Every entry is compiled once per ISA level
+// (kernels_impl.h included from kernels_<isa>.cc with matching -m flags) and
+// the best table for the running CPU is picked at load time.
+struct KernelTable {
+  CpuIsa isa;
+
+  // PN shaping: out[i] = mean of in[i - halfWidth .. i + halfWidth], truncated
+  // at the edges. `scratch` must hold n + 1 doubles.
+  void (*boxFilter)(const double* in, double* out, double* scratch, int n, int halfWidth);
+  // pn[i] = (pn[i] - dc[i]) for the DC removal stage.
+  void (*subtract)(double* pn, const double* dc, int n);
+  double (*sumSquares)(const double* x, int n);
+  // pn[i] *= scale * window[i]
+  void (*scaleByWindow)(double* pn, const double* window, double scale, int n);
+
+  // Energy of the mid signal (left + right) / 2 over one block.
+  double (*midEnergy)(const float* left, const float* right, size_t n);
+  // left[i] += pn[i] * gain; right[i] += pn[i] * gain
+  void (*embedBlock)(float* left, float* right, const double* pn, double gain, size_t n);
+  // out = { sum(mid * pn), sum(mid^2), sum(pn^2) }
+  void (*correlateBlock)(const float* left, const float* right, const double* pn, size_t n, double out[3]);
+
+  // Format conversion between interleaved frames and one planar channel.
+  void (*deinterleave)(const float* interleaved, float* channel, size_t frames, int channels, int channelIndex);
+  void (*interleave)(const float* channel, float* interleaved, size_t frames, int channels, int channelIndex);
+
+  // One radix-2 pass of length `len` over data[0..n), twiddles[j] = w^j.
+  void (*fftButterflies)(Complex* data, size_t n, size_t len, const Complex* twiddles);
+};
+
+// Table selected at load time (MUSMARK_ISA overrides the CPUID choice).
+const KernelTable& kernels();
+
+// Switches the active table; fails when the CPU or build lacks `isa`.
+bool selectKernels(CpuIsa isa);
+
+// ISA levels compiled into this build and supported by the running CPU.
+std::vector<CpuIsa> availableKernelIsas();
+
+// Per-ISA tables, null when not compiled for this architecture.
+const KernelTable* kernelsScalar();
+const KernelTable* kernelsSse42();
+const KernelTable* kernelsAvx2();
+const KernelTable* kernelsAvx512();
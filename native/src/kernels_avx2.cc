@@ -0,0 +1,16 @@
+// AVX2+FMA build of the hot kernels. binding.gyp compiles this file in its own
+// target with the matching -m flags; on other architectures it is empty.
+#include "kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define KERNEL_ISA CpuIsa::Avx2
+#include "kernels_impl.h"
+
+const KernelTable* kernelsAvx2() {
+  return &kKernelTable;
+}
+#else
+const KernelTable* kernelsAvx2() {
+  return nullptr;
+}
+#endif
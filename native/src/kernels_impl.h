@@ -0,0 +1,145 @@
+// Kernel bodies shared by every ISA variant. Included once per kernels_*.cc,
+// each compiled with its own target flags, so the compiler vectorizes the same
+// loops for SSE4.2, AVX2 or AVX-512.
+//
+// Keep this file free of std:: templates and other inline library code: those
+// are emitted as weak symbols, and the linker could keep an AVX-512 copy that
+// the scalar path then calls on an older CPU.
+//
+// The including file defines KERNEL_ISA before including this header.
+
+#include "kernels.h"
+
+#ifdef MUSMARK_OPENMP_SIMD
+#define KERNEL_SIMD_REDUCE(...) _Pragma(KERNEL_STRINGIFY(omp simd reduction(+ : __VA_ARGS__)))
+#define KERNEL_SIMD _Pragma("omp simd")
+#define KERNEL_STRINGIFY(x) #x
+#else
+#define KERNEL_SIMD_REDUCE(...)
+#define KERNEL_SIMD
+#endif
+
+namespace {
+
+void boxFilterKernel(const double* in, double* out, double* scratch, int n, int halfWidth) {
+  // Running sums turn the O(n * width) window into O(n).
+  scratch[0] = 0.0;
+  for (int i = 0; i < n; i++) scratch[i + 1] = scratch[i] + in[i];
+  for (int i = 0; i < n; i++) {
+    const int lo = i - halfWidth < 0 ? 0 : i - halfWidth;
+    const int hi = i + halfWidth >= n ? n - 1 : i + halfWidth;
+    out[i] = (scratch[hi + 1] - scratch[lo]) / static_cast<double>(hi - lo + 1);
+  }
+}
+
+void subtractKernel(double* pn, const double* dc, int n) {
+  KERNEL_SIMD
+  for (int i = 0; i < n; i++) pn[i] -= dc[i];
+}
+
+double sumSquaresKernel(const double* x, int n) {
+  double sum = 0.0;
+  KERNEL_SIMD_REDUCE(sum)
+  for (int i = 0; i < n; i++) sum += x[i] * x[i];
+  return sum;
+}
+
+void scaleByWindowKernel(double* pn, const double* window, double scale, int n) {
+  KERNEL_SIMD
+  for (int i = 0; i < n; i++) pn[i] *= scale * window[i];
+}
+
+double midEnergyKernel(const float* left, const float* right, size_t n) {
+  double energy = 0.0;
+  KERNEL_SIMD_REDUCE(energy)
+  for (size_t i = 0; i < n; i++) {
+    const double sample = static_cast<double>(left[i] + right[i]) * 0.5;
+    energy += sample * sample;
+  }
+  return energy;
+}
+
+void embedBlockKernel(float* left, float* right, const double* pn, double gain, size_t n) {
+  if (left == right) {
+    KERNEL_SIMD
+    for (size_t i = 0; i < n; i++) left[i] += static_cast<float>(pn[i] * gain);
+    return;
+  }
+  KERNEL_SIMD
+  for (size_t i = 0; i < n; i++) {
+    const float delta = static_cast<float>(pn[i] * gain);
+    left[i] += delta;
+    right[i] += delta;
+  }
+}
+
+void correlateBlockKernel(const float* left, const float* right, const double* pn, size_t n, double out[3]) {
+  double correlation = 0.0;
+  double signalEnergy = 0.0;
+  double pnEnergy = 0.0;
+  KERNEL_SIMD_REDUCE(correlation, signalEnergy, pnEnergy)
+  for (size_t i = 0; i < n; i++) {
+    const double sample = static_cast<double>(left[i] + right[i]) * 0.5;
+    correlation += sample * pn[i];
+    signalEnergy += sample * sample;
+    pnEnergy += pn[i] * pn[i];
+  }
+  out[0] = correlation;
+  out[1] = signalEnergy;
+  out[2] = pnEnergy;
+}
+
+void deinterleaveKernel(const float* interleaved, float* channel, size_t frames, int channels, int channelIndex) {
+  if (channels == 2) {
+    const float* src = interleaved + channelIndex;
+    KERNEL_SIMD
+    for (size_t i = 0; i < frames; i++) channel[i] = src[i * 2];
+    return;
+  }
+  for (size_t i = 0; i < frames; i++) channel[i] = interleaved[i * channels + channelIndex];
+}
+
+void interleaveKernel(const float* channel, float* interleaved, size_t frames, int channels, int channelIndex) {
+  if (channels == 2) {
+    float* dst = interleaved + channelIndex;
+    KERNEL_SIMD
+    for (size_t i = 0; i < frames; i++) dst[i * 2] = channel[i];
+    return;
+  }
+  for (size_t i = 0; i < frames; i++) interleaved[i * channels + channelIndex] = channel[i];
+}
+
+void fftButterfliesKernel(Complex* data, size_t n, size_t len, const Complex* twiddles) {
+  const size_t half = len / 2;
+  for (size_t i = 0; i < n; i += len) {
+    Complex* a = data + i;
+    Complex* b = data + i + half;
+    KERNEL_SIMD
+    for (size_t j = 0; j < half; j++) {
+      const double vRe = b[j].re * twiddles[j].re - b[j].im * twiddles[j].im;
+      const double vIm = b[j].re * twiddles[j].im + b[j].im * twiddles[j].re;
+      const double uRe = a[j].re;
+      const double uIm = a[j].im;
+      a[j].re = uRe + vRe;
+      a[j].im = uIm + vIm;
+      b[j].re = uRe - vRe;
+      b[j].im = uIm - vIm;
+    }
+  }
+}
+
+const KernelTable kKernelTable = {
+  KERNEL_ISA,
+  boxFilterKernel,
+  subtractKernel,
+  sumSquaresKernel,
+  scaleByWindowKernel,
+  midEnergyKernel,
+  embedBlockKernel,
+  correlateBlockKernel,
+  deinterleaveKernel,
+  interleaveKernel,
+  fftButterfliesKernel,
+};
+
+}  // namespace
@@ -0,0 +1,16 @@
+// SSE4.2 build of the hot kernels. binding.gyp compiles this file in its own
+// target with the matching -m flags; on other architectures it is empty.
+#include "kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define KERNEL_ISA CpuIsa::Sse42
+#include "kernels_impl.h"
+
+const KernelTable* kernelsSse42() {
+  return &kKernelTable;
+}
+#else
+const KernelTable* kernelsSse42() {
+  return nullptr;
+}
+#endif
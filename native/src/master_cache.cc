@@ -0,0 +1,212 @@
+#include "master_cache.h"
+#include <cstdlib>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "detection_cache.h"
+#include "float_codec.h"
+
+// ============================================================================
+// MASTER CACHE
+// Two tables under one mutex: file identities to content hashes, and an LRU
+// of compressed masters by content hash. Reads, compression and
+// decompression all run unlocked; a miss publishes a shared_future under the
+// file's identity so that concurrent requests for the same file wait for
+// the one read, as the detection cache does for extractions.
+// ============================================================================
+
+struct Master {
+  int sampleRate = 0;
+  int channels = 0;
+  int bitsPerSample = 32;
+  CompressedFloats samples;
+};
+
+using MasterPtr = std::shared_ptr<const Master>;
+
+struct Entry {
+  std::string contentHash;
+  MasterPtr master;
+  std::vector<std::string> identities;  // files known to hold this content
+};
+
+// Device, inode, size and modification time; empty when `path` cannot be
+// stat'ed, in which case the read reports the error.
+static std::string fileIdentity(const std::string& path) {
+#if defined(_WIN32)
+  struct _stat64 info{};
+  if (_stat64(path.c_str(), &info) != 0) return "";
+  return path + ":" + std::to_string(info.st_size) + ":" + std::to_string(info.st_mtime);
+#else
+  struct stat info{};
+  if (::stat(path.c_str(), &info) != 0) return "";
+#if defined(__APPLE__)
+  const long long mtimeNs = static_cast<long long>(info.st_mtimespec.tv_sec) * 1000000000LL + info.st_mtimespec.tv_nsec;
+#else
+  const long long mtimeNs = static_cast<long long>(info.st_mtim.tv_sec) * 1000000000LL + info.st_mtim.tv_nsec;
+#endif
+  return std::to_string(info.st_dev) + ":" + std::to_string(info.st_ino) + ":" + std::to_string(info.st_size) + ":" +
+    std::to_string(mtimeNs);
+#endif
+}
+
+static size_t defaultCapacity() {
+  if (const char* env = std::getenv("MUSMARK_MASTER_CACHE_MB")) {
+    const long long megabytes = std::atoll(env);
+    if (megabytes > 0) return static_cast<size_t>(megabytes) << 20;
+  }
+  return 0;
+}
+
+static WavData decompressMaster(const Master& master, JobPriority priority) {
+  WavData wav;
+  wav.sampleRate = master.sampleRate;
+  wav.channels = master.channels;
+  wav.bitsPerSample = master.bitsPerSample;
+  wav.samples.resize(master.samples.count);
+  decompressFloats(master.samples, wav.samples.data(), priority);
+  return wav;
+}
+
+// ----------------------------------------------------------------------------
+// Cache state
+// ----------------------------------------------------------------------------
+
+static std::mutex cacheMutex;
+static std::list<Entry> lru;
+static std::unordered_map<std::string, std::list<Entry>::iterator> byHash;
+static std::unordered_map<std::string, std::string> hashByIdentity;
+static std::unordered_map<std::string, std::shared_future<MasterPtr>> inFlight;
+static MasterCacheStats stats = [] {
+  MasterCacheStats initial;
+  initial.capacityBytes = defaultCapacity();
+  return initial;
+}();
+
+static void dropBackLocked() {
+  const Entry& victim = lru.back();
+  for (const std::string& identity : victim.identities) hashByIdentity.erase(identity);
+  stats.bytes -= victim.master->samples.compressedBytes();
+  stats.rawBytes -= victim.master->samples.count * sizeof(float);
+  byHash.erase(victim.contentHash);
+  lru.pop_back();
+}
+
+static void evictLocked() {
+  while (!lru.empty() && stats.bytes > stats.capacityBytes) {
+    dropBackLocked();
+    stats.evictions++;
+  }
+}
+
+static void storeLocked(const std::string& contentHash, const std::string& identity, MasterPtr master) {
+  const size_t size = master->samples.compressedBytes();
+  if (size > stats.capacityBytes) return;
+  auto existing = byHash.find(contentHash);
+  if (existing == byHash.end()) {
+    lru.push_front({ contentHash, std::move(master), {} });
+    existing = byHash.emplace(contentHash, lru.begin()).first;
+    stats.bytes += size;
+    stats.rawBytes += lru.front().master->samples.count * sizeof(float);
+  } else {
+    lru.splice(lru.begin(), lru, existing->second);
+  }
+  if (!identity.empty()) {
+    hashByIdentity[identity] = contentHash;
+    existing->second->identities.push_back(identity);
+  }
+  evictLocked();
+}
+
+bool masterCacheEnabled() {
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  return stats.capacityBytes > 0;
+}
+
+WavData readMasterCached(const std::string& path, JobPriority priority) {
+  const std::string identity = fileIdentity(path);
+  std::promise<MasterPtr> promise;
+  {
+    std::unique_lock<std::mutex> lock(cacheMutex);
+    if (!identity.empty()) {
+      const auto known = hashByIdentity.find(identity);
+      if (known != hashByIdentity.end()) {
+        const auto hit = byHash.find(known->second);
+        lru.splice(lru.begin(), lru, hit->second);
+        stats.hits++;
+        const MasterPtr master = hit->second->master;
+        lock.unlock();
+        return decompressMaster(*master, priority);
+      }
+      const auto pending = inFlight.find(identity);
+      if (pending != inFlight.end()) {
+        std::shared_future<MasterPtr> future = pending->second;
+        stats.coalesced++;
+        lock.unlock();
+        return decompressMaster(*future.get(), priority);
+      }
+      inFlight.emplace(identity, promise.get_future().share());
+    }
+    stats.misses++;
+  }
+
+  HashedWav file;
+  MasterPtr master;
+  try {
+    file = readAudioHashed(path);
+    auto compressed = std::make_shared<Master>();
+    compressed->sampleRate = file.wav.sampleRate;
+    compressed->channels = file.wav.channels;
+    compressed->bitsPerSample = file.wav.bitsPerSample;
+    compressed->samples = compressFloats(file.wav.samples.data(), file.wav.samples.size(), priority);
+    master = std::move(compressed);
+  } catch (...) {
+    if (!identity.empty()) {
+      std::lock_guard<std::mutex> lock(cacheMutex);
+      inFlight.erase(identity);
+      promise.set_exception(std::current_exception());
+    }
+    throw;
+  }
+
+  // A file rewritten while it was read must not be matched to what was read.
+  const bool unchanged = !identity.empty() && fileIdentity(path) == identity;
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  if (!identity.empty()) {
+    inFlight.erase(identity);
+    promise.set_value(master);
+  }
+  storeLocked(file.contentHash, unchanged ? identity : "", std::move(master));
+  return std::move(file.wav);
+}
+
+void setMasterCacheCapacity(size_t bytes) {
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  stats.capacityBytes = bytes;
+  evictLocked();
+}
+
+void clearMasterCache() {
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  lru.clear();
+  byHash.clear();
+  hashByIdentity.clear();
+  stats.bytes = 0;
+  stats.rawBytes = 0;
+}
+
+MasterCacheStats masterCacheStats() {
+  std::lock_guard<std::mutex> lock(cacheMutex);
+  MasterCacheStats current = stats;
+  current.entries = lru.size();
+  return current;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include "scheduler.h"
+#include "wav.h"
+
+// Decoded masters kept in RAM for signing servers that mark the same titles
+// over and over. Entries are keyed by the SHA-256 of the file bytes, so one
+// master reachable under several paths is held once, and stored compressed
+// (float_codec.h), so a hit costs a parallel decompression instead of a read
+// and a decode. A path is matched to its content by device, inode, size and
+// modification time; a file that changes is read again. The LRU is bounded
+// by compressed bytes and is off (capacity 0) unless configured or
+// $MUSMARK_MASTER_CACHE_MB is set.
+
+struct MasterCacheStats {
+  size_t entries = 0;
+  size_t bytes = 0;          // compressed size of all entries
+  size_t rawBytes = 0;       // their decoded size
+  size_t capacityBytes = 0;
+  size_t hits = 0;
+  size_t misses = 0;         // reads from storage
+  size_t coalesced = 0;      // callers that waited on another caller's read
+  size_t evictions = 0;
+};
+
+bool masterCacheEnabled();
+
+// The decoded samples of the WAV or FLAC file at `path`, from the cache when
+// the file is there; otherwise read, returned and added. Concurrent misses
+// on one file share a single read. A master larger than the capacity is
+// returned but not kept.
+WavData readMasterCached(const std::string& path, JobPriority priority = JobPriority::Batch);
+
+// Shrinking evicts least recently used masters at once.
+void setMasterCacheCapacity(size_t bytes);
+void clearMasterCache();
+MasterCacheStats masterCacheStats();
@@ -0,0 +1,391 @@
+#include "media_decoder.h"
+#include <stdexcept>
+
+#if defined(_WIN32)
+
+DownmixedAudio decodeDownmixed(const std::string&, int) {
+  throw std::runtime_error("Decoding compressed audio is not available on Windows");
+}
+
+DownmixedAudio decodeDownmixed(const void*, size_t, int) {
+  throw std::runtime_error("Decoding compressed audio is not available on Windows");
+}
+
+#else
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sha256.h"
+
+extern char** environ;
+
+// ============================================================================
+// MEDIA DECODER
+// ffmpeg writes 32-bit float WAV to a pipe. Its header carries placeholder
+// sizes (the muxer cannot seek back), so the data chunk is read to EOF. The
+// child's stderr is drained alongside stdout so it can never block on a full
+// pipe, and its tail becomes the error message if decoding fails.
+// ============================================================================
+
+constexpr size_t kPipeChunk = 1 << 18;
+constexpr size_t kHashChunk = 1 << 20;
+constexpr size_t kErrorTail = 2048;
+
+static std::runtime_error systemError(const std::string& what) {
+  return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+struct Pipe {
+  int read = -1;
+  int write = -1;
+  Pipe() {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0) throw systemError("pipe failed");
+    read = fds[0];
+    write = fds[1];
+  }
+  ~Pipe() {
+    closeRead();
+    closeWrite();
+  }
+  void closeRead() {
+    if (read >= 0) ::close(read);
+    read = -1;
+  }
+  void closeWrite() {
+    if (write >= 0) ::close(write);
+    write = -1;
+  }
+};
+
+// A decoder child that is killed and reaped unless wait() reaped it first.
+class Child {
+ public:
+  Child(const std::vector<std::string>& args, Pipe* input, Pipe& output, Pipe& errors) {
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (input) posix_spawn_file_actions_adddup2(&actions, input->read, 0);
+    else posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, output.write, 1);
+    posix_spawn_file_actions_adddup2(&actions, errors.write, 2);
+
+    std::vector<char*> argv;
+    for (const std::string& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+    const int rc = posix_spawnp(&pid_, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (rc != 0) {
+      pid_ = -1;
+      throw std::runtime_error("Cannot run " + args[0] + " (" + std::strerror(rc) +
+        "); install ffmpeg or set MUSMARK_FFMPEG to decode compressed audio");
+    }
+  }
+
+  ~Child() {
+    if (pid_ <= 0) return;
+    kill(pid_, SIGKILL);
+    int status;
+    while (waitpid(pid_, &status, 0) < 0 && errno == EINTR) {}
+  }
+
+  // Exit status, or -1 if the child died from a signal.
+  int wait() {
+    int status = 0;
+    while (waitpid(pid_, &status, 0) < 0) {
+      if (errno != EINTR) throw systemError("waitpid failed");
+    }
+    pid_ = -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+  }
+
+ private:
+  pid_t pid_ = -1;
+};
+
+// stdout of the child, read while keeping the tail of its stderr.
+class ChildOutput {
+ public:
+  ChildOutput(int out, int err) : out_(out), err_(err) {}
+
+  // Returns 0 at end of stream.
+  size_t read(char* buffer, size_t size) {
+    for (;;) {
+      pollfd fds[2] = { { out_, POLLIN, 0 }, { err_, POLLIN, 0 } };
+      const int ready = poll(fds, err_ >= 0 ? 2 : 1, -1);
+      if (ready < 0) {
+        if (errno == EINTR) continue;
+        throw systemError("poll failed");
+      }
+      if (err_ >= 0 && fds[1].revents) drainErrors(false);
+      if (fds[0].revents) {
+        const ssize_t n = ::read(out_, buffer, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) throw systemError("Reading the decoder failed");
+        return static_cast<size_t>(n);
+      }
+    }
+  }
+
+  void readExact(char* buffer, size_t size) {
+    while (size > 0) {
+      const size_t n = read(buffer, size);
+      if (n == 0) throw std::runtime_error("Decoder output ended early");
+      buffer += n;
+      size -= n;
+    }
+  }
+
+  void skip(uint64_t size) {
+    char scratch[4096];
+    while (size > 0) {
+      const size_t n = static_cast<size_t>(std::min<uint64_t>(size, sizeof(scratch)));
+      readExact(scratch, n);
+      size -= n;
+    }
+  }
+
+  // Reads stderr to EOF (after stdout ended) or just what is available.
+  void drainErrors(bool toEnd) {
+    char text[4096];
+    while (err_ >= 0) {
+      const ssize_t n = ::read(err_, text, sizeof(text));
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) {
+        err_ = -1;
+        return;
+      }
+      errors_.append(text, static_cast<size_t>(n));
+      if (errors_.size() > kErrorTail) errors_.erase(0, errors_.size() - kErrorTail);
+      if (!toEnd) return;
+    }
+  }
+
+  std::string errors() const {
+    std::string text = errors_;
+    while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back()))) text.pop_back();
+    std::replace(text.begin(), text.end(), '\n', ' ');
+    return text;
+  }
+
+ private:
+  int out_;
+  int err_;
+  std::string errors_;
+};
+
+static uint32_t le32(const char* p) {
+  const auto* b = reinterpret_cast<const uint8_t*>(p);
+  return uint32_t(b[0]) | (uint32_t(b[1]) << 8) | (uint32_t(b[2]) << 16) | (uint32_t(b[3]) << 24);
+}
+
+static uint16_t le16(const char* p) {
+  const auto* b = reinterpret_cast<const uint8_t*>(p);
+  return static_cast<uint16_t>(b[0] | (b[1] << 8));
+}
+
+// Parses the streamed header up to the data chunk; returns the channel count.
+static int readStreamHeader(ChildOutput& in, int expectedRate) {
+  char riff[12];
+  in.readExact(riff, sizeof(riff));
+  if (std::memcmp(riff, "RIFF", 4) != 0 || std::memcmp(riff + 8, "WAVE", 4) != 0) {
+    throw std::runtime_error("Decoder did not produce WAV");
+  }
+  int channels = 0;
+  for (;;) {
+    char header[8];
+    in.readExact(header, sizeof(header));
+    const uint32_t size = le32(header + 4);
+    if (std::memcmp(header, "data", 4) == 0) break;
+    if (std::memcmp(header, "fmt ", 4) != 0) {
+      in.skip(size + (size & 1));
+      continue;
+    }
+    if (size < 16 || size > 64) throw std::runtime_error("Unexpected decoder format chunk");
+    char fmt[64];
+    in.readExact(fmt, size + (size & 1));
+    const uint16_t tag = le16(fmt);
+    channels = le16(fmt + 2);
+    const uint32_t rate = le32(fmt + 4);
+    const uint16_t bits = le16(fmt + 14);
+    if ((tag != 3 && tag != 0xFFFE) || bits != 32 || channels <= 0 || rate != static_cast<uint32_t>(expectedRate)) {
+      throw std::runtime_error("Unexpected decoder output format");
+    }
+  }
+  if (channels == 0) throw std::runtime_error("Decoder output has no format chunk");
+  return channels;
+}
+
+// Decodes whatever the child produces into `out`, then checks its exit.
+static void readDecoded(Child& child, Pipe& output, Pipe& errors, int sampleRate, DownmixedAudio& out) {
+  output.closeWrite();
+  errors.closeWrite();
+  ChildOutput in(output.read, errors.read);
+  try {
+    out.sampleRate = sampleRate;
+    out.channels = readStreamHeader(in, sampleRate);
+    const size_t frameBytes = size_t(out.channels) * sizeof(float);
+    std::vector<char> buffer(kPipeChunk);
+    size_t have = 0;
+    for (;;) {
+      const size_t n = in.read(buffer.data() + have, buffer.size() - have);
+      if (n == 0) break;
+      have += n;
+      const size_t frames = have / frameBytes;
+      const size_t first = out.mid.size();
+      out.mid.resize(first + frames);
+      for (size_t i = 0; i < frames; i++) {
+        const char* frame = buffer.data() + i * frameBytes;
+        float left, right;
+        std::memcpy(&left, frame, sizeof(float));
+        if (out.channels == 1) {
+          out.mid[first + i] = left;
+          continue;
+        }
+        std::memcpy(&right, frame + sizeof(float), sizeof(float));
+        out.mid[first + i] = (left + right) * 0.5f;
+      }
+      const size_t used = frames * frameBytes;
+      std::memmove(buffer.data(), buffer.data() + used, have - used);
+      have -= used;
+    }
+  } catch (const std::exception&) {
+    // Closing stdout stops a decoder that is still writing. One that failed
+    // on its own explains it better than a short stream does.
+    output.closeRead();
+    in.drainErrors(true);
+    if (child.wait() != 0) throw std::runtime_error("ffmpeg could not decode the file: " + in.errors());
+    throw;
+  }
+  in.drainErrors(true);
+  if (child.wait() != 0) throw std::runtime_error("ffmpeg could not decode the file: " + in.errors());
+}
+
+static std::vector<std::string> decoderArgs(const std::string& input, int sampleRate, bool fromStdin) {
+  const char* program = std::getenv("MUSMARK_FFMPEG");
+  std::vector<std::string> args = { program && *program ? program : "ffmpeg" };
+  if (!fromStdin) args.push_back("-nostdin");
+  const std::vector<std::string> rest = {
+    "-hide_banner", "-loglevel", "error",
+    "-i", input,
+    "-map", "0:a:0",
+    "-c:a", "pcm_f32le",
+    "-ar", std::to_string(sampleRate),
+    "-f", "wav", "pipe:1",
+  };
+  args.insert(args.end(), rest.begin(), rest.end());
+  return args;
+}
+
+static void requireRate(int sampleRate) {
+  if (sampleRate <= 0) throw std::invalid_argument("Sample rate must be positive");
+}
+
+DownmixedAudio decodeDownmixed(const std::string& path, int sampleRate) {
+  requireRate(sampleRate);
+  {
+    std::ifstream probe(path, std::ios::binary);
+    if (!probe) throw std::runtime_error("Failed to open " + path);
+  }
+  Pipe output, errors;
+  // "file:" keeps ffmpeg from reading a path like "x:y" as a protocol.
+  Child child(decoderArgs("file:" + path, sampleRate, false), nullptr, output, errors);
+
+  // The child reads the file itself; hashing it here meanwhile costs one
+  // more read of pages that are already cached.
+  std::string hash;
+  std::exception_ptr hashError;
+  std::thread hasher([&]() {
+    try {
+      std::ifstream in(path, std::ios::binary);
+      std::vector<char> chunk(kHashChunk);
+      Sha256 sha;
+      while (in.read(chunk.data(), chunk.size()) || in.gcount() > 0) sha.update(chunk.data(), static_cast<size_t>(in.gcount()));
+      hash = sha.hexDigest();
+    } catch (...) {
+      hashError = std::current_exception();
+    }
+  });
+
+  DownmixedAudio out;
+  try {
+    readDecoded(child, output, errors, sampleRate, out);
+  } catch (...) {
+    hasher.join();
+    throw;
+  }
+  hasher.join();
+  if (hashError) std::rethrow_exception(hashError);
+  out.contentHash = std::move(hash);
+  return out;
+}
+
+// Writes `data` to the child's stdin, hashing it on the way. A decoder that
+// stops reading early (EPIPE) is not an error here; its exit status decides.
+static void feedDecoder(int fd, const uint8_t* data, size_t size, std::string& hash) {
+  sigset_t pipeSignal;
+  sigemptyset(&pipeSignal);
+  sigaddset(&pipeSignal, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &pipeSignal, nullptr);
+
+  Sha256 sha;
+  sha.update(data, size);
+  hash = sha.hexDigest();
+
+  while (size > 0) {
+    const ssize_t n = ::write(fd, data, std::min(size, kPipeChunk));
+    if (n < 0 && errno == EINTR) continue;
+    if (n < 0) {
+      if (errno == EPIPE) {
+        // Consume the SIGPIPE this thread raised so it never reaches the process.
+        const timespec zero = { 0, 0 };
+        sigtimedwait(&pipeSignal, nullptr, &zero);
+      }
+      break;
+    }
+    data += n;
+    size -= static_cast<size_t>(n);
+  }
+  ::close(fd);
+}
+
+DownmixedAudio decodeDownmixed(const void* data, size_t size, int sampleRate) {
+  requireRate(sampleRate);
+  Pipe input, output, errors;
+  Child child(decoderArgs("pipe:0", sampleRate, true), &input, output, errors);
+  input.closeRead();
+
+  std::string hash;
+  const int fd = input.write;
+  input.write = -1;  // the feeder closes it when done
+  std::thread feeder(feedDecoder, fd, static_cast<const uint8_t*>(data), size, std::ref(hash));
+
+  DownmixedAudio out;
+  try {
+    readDecoded(child, output, errors, sampleRate, out);
+  } catch (...) {
+    feeder.join();
+    throw;
+  }
+  feeder.join();
+  out.contentHash = std::move(hash);
+  return out;
+}
+
+#endif
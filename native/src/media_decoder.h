@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Compressed leaks (MP3, Ogg Vorbis/Opus, AAC, anything without a native
+// reader) are decoded by an ffmpeg child process whose float output is read
+// from a pipe and reduced to the mid signal as it arrives. Detection of such
+// a file is one streaming pass: no temporary WAV, and the interleaved
+// samples are never held in memory. The program is "ffmpeg" on PATH unless
+// $MUSMARK_FFMPEG names another one. Not available on Windows.
+
+struct DownmixedAudio {
+  int sampleRate = 0;
+  int channels = 0;          // of the decoded stream, before the downmix
+  std::vector<float> mid;    // (L + R) / 2, or the only channel
+  std::string contentHash;   // hex SHA-256 of the file bytes
+};
+
+// Decodes at `sampleRate`, resampling if the file has another rate, so a
+// leak re-encoded at 48 kHz still lines up with a 44.1 kHz signing.
+DownmixedAudio decodeDownmixed(const std::string& path, int sampleRate);
+// Same for a file in memory, fed to the decoder through its stdin; formats
+// that need seeking (MP4 with the index at the end) must come as a path.
+DownmixedAudio decodeDownmixed(const void* data, size_t size, int sampleRate);
@@ -0,0 +1,257 @@
+#include "mp3_frames.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include "engine.h"
+#include "payload.h"
+
+// ============================================================================
+// MP3 FRAME INDEX
+// Layer III frames are self-delimiting: the 4-byte header gives the frame
+// length, and the first field of the side info (main_data_begin) says how
+// far back into earlier frames this frame's Huffman data starts (the bit
+// reservoir). That is all a windowed decode needs. A run of frames decoded
+// on its own yields exactly one frame of samples per frame; the first frames
+// of a run are wrong (missing reservoir bytes, missing filterbank overlap)
+// and are dropped, so each run starts early enough that every kept frame
+// decodes exactly as it does in a full decode.
+// ============================================================================
+
+// Frames decoded ahead of a window for the overlap-add and synthesis
+// filterbank state, before the reservoir frames of the first of them.
+constexpr size_t kOverlapFrames = 2;
+
+// Samples ffmpeg drops after the encoder delay of a LAME tag (the decoder's
+// own delay).
+constexpr size_t kDecoderDelay = 529;
+
+size_t Mp3Index::timelineFrames() const {
+  const size_t decoded = frames.size() * static_cast<size_t>(samplesPerFrame);
+  const size_t dropped = leadingSkip + trailingPadding;
+  return decoded > dropped ? decoded - dropped : 0;
+}
+
+// Length of an ID3v2 tag at `data`, 0 if there is none.
+static size_t id3Length(const uint8_t* data, size_t size) {
+  if (size < 10 || std::memcmp(data, "ID3", 3) != 0) return 0;
+  const size_t tagSize = (size_t(data[6] & 0x7F) << 21) | (size_t(data[7] & 0x7F) << 14) |
+    (size_t(data[8] & 0x7F) << 7) | size_t(data[9] & 0x7F);
+  return 10 + tagSize + ((data[5] & 0x10) ? 10 : 0);
+}
+
+static uint32_t readBe32(const uint8_t* p) {
+  return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+struct FrameHeader {
+  int version = 0;     // 1 = MPEG-1, 2 = MPEG-2, 25 = MPEG-2.5
+  int sampleRate = 0;
+  int channels = 0;
+  int samplesPerFrame = 0;
+  uint32_t size = 0;
+  uint32_t sideStart = 0;  // bytes of header and CRC
+  uint32_t sideInfo = 0;   // bytes of header, CRC and side info
+};
+
+static bool parseFrameHeader(const uint8_t* data, size_t size, FrameHeader& out) {
+  static const int kBitrates[2][16] = {
+    { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 },
+    { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },
+  };
+  static const int kRates[3] = { 44100, 48000, 32000 };
+
+  if (size < 4 || data[0] != 0xFF || (data[1] & 0xE0) != 0xE0) return false;
+  const int versionBits = (data[1] >> 3) & 3;
+  if (versionBits == 1 || ((data[1] >> 1) & 3) != 1) return false;  // reserved, or not layer III
+  const int bitrateIndex = data[2] >> 4;
+  const int rateIndex = (data[2] >> 2) & 3;
+  // Free format has no length in the header; such files take the full decode.
+  if (bitrateIndex == 0 || bitrateIndex == 15 || rateIndex == 3) return false;
+
+  const bool mpeg1 = versionBits == 3;
+  out.version = mpeg1 ? 1 : versionBits == 2 ? 2 : 25;
+  out.sampleRate = kRates[rateIndex] / (mpeg1 ? 1 : versionBits == 2 ? 2 : 4);
+  out.channels = (data[3] >> 6) == 3 ? 1 : 2;
+  out.samplesPerFrame = mpeg1 ? 1152 : 576;
+  const int bitrate = kBitrates[mpeg1 ? 0 : 1][bitrateIndex] * 1000;
+  out.size = static_cast<uint32_t>((mpeg1 ? 144 : 72) * bitrate / out.sampleRate + ((data[2] >> 1) & 1));
+  const uint32_t sideInfo = mpeg1 ? (out.channels == 1 ? 17 : 32) : (out.channels == 1 ? 9 : 17);
+  out.sideStart = (data[1] & 1) ? 4 : 6;
+  out.sideInfo = out.sideStart + sideInfo;
+  return out.size > out.sideInfo;
+}
+
+// Trailing tags that may follow the last frame.
+static bool isTrailer(const uint8_t* data, size_t size) {
+  return (size >= 3 && std::memcmp(data, "TAG", 3) == 0) ||
+    (size >= 8 && std::memcmp(data, "APETAGEX", 8) == 0) ||
+    (size >= 6 && std::memcmp(data, "LYRICS", 6) == 0);
+}
+
+// Reads the Xing/Info header of the first frame, if any. False for headers
+// whose effect on the decoded timeline is unknown here: VBRI, or Xing from
+// an encoder that wrote no LAME tag.
+static bool readInfoFrame(const uint8_t* frame, const FrameHeader& header, bool& isInfo, Mp3Index& out) {
+  isInfo = false;
+  if (header.size >= 40 && std::memcmp(frame + 36, "VBRI", 4) == 0) return false;
+  const uint8_t* tag = frame + header.sideInfo;
+  const uint8_t* end = frame + header.size;
+  if (end - tag < 8 || (std::memcmp(tag, "Xing", 4) != 0 && std::memcmp(tag, "Info", 4) != 0)) return true;
+  isInfo = true;
+
+  const uint32_t flags = readBe32(tag + 4);
+  const uint8_t* lame = tag + 8 + ((flags & 1) ? 4 : 0) + ((flags & 2) ? 4 : 0) + ((flags & 4) ? 100 : 0) +
+    ((flags & 8) ? 4 : 0);
+  if (end - lame < 24) return false;
+  if (std::memcmp(lame, "LAME", 4) != 0 && std::memcmp(lame, "Lavf", 4) != 0 && std::memcmp(lame, "Lavc", 4) != 0) {
+    return false;
+  }
+  const size_t delay = (size_t(lame[21]) << 4) | (lame[22] >> 4);
+  out.leadingSkip = delay + kDecoderDelay;
+  // The padding counts from the encoder's view; the decoder delay moves it.
+  const size_t padding = (size_t(lame[22] & 0x0F) << 8) | lame[23];
+  out.trailingPadding = padding > kDecoderDelay ? padding - kDecoderDelay : 0;
+  return true;
+}
+
+bool indexMp3(const uint8_t* data, size_t size, Mp3Index& out) {
+  out = Mp3Index{};
+  size_t pos = id3Length(data, size);
+  FrameHeader first;
+  if (pos >= size || !parseFrameHeader(data + pos, size - pos, first)) return false;
+  out.sampleRate = first.sampleRate;
+  out.channels = first.channels;
+  out.samplesPerFrame = first.samplesPerFrame;
+
+  if (pos + first.size <= size) {
+    bool isInfo = false;
+    if (!readInfoFrame(data + pos, first, isInfo, out)) return false;
+    if (isInfo) pos += first.size;
+  }
+
+  while (pos < size) {
+    FrameHeader header;
+    if (!parseFrameHeader(data + pos, size - pos, header)) {
+      if (isTrailer(data + pos, size - pos)) break;
+      return false;
+    }
+    if (header.version != first.version || header.sampleRate != first.sampleRate ||
+        header.channels != first.channels) {
+      return false;
+    }
+    // A truncated last frame is left out; it only covers the final samples.
+    if (pos + header.size > size) break;
+    const uint8_t* side = data + pos + header.sideStart;
+    Mp3Frame frame;
+    frame.offset = pos;
+    frame.size = header.size;
+    frame.mainDataBegin = header.version == 1 ? (uint32_t(side[0]) << 1) | (side[1] >> 7) : side[0];
+    frame.payload = header.size - header.sideInfo;
+    out.frames.push_back(frame);
+    pos += header.size;
+  }
+  return !out.frames.empty();
+}
+
+// ----------------------------------------------------------------------------
+// Windowed decode
+// ----------------------------------------------------------------------------
+
+// Frames [begin, end) are decoded in one piece; those before `keepFrom` only
+// prime the decoder.
+struct FrameRun {
+  size_t begin = 0;
+  size_t end = 0;
+  size_t keepFrom = 0;
+};
+
+// First frame to decode so that frame `keep` comes out exact.
+static size_t runStart(const Mp3Index& index, size_t keep) {
+  size_t start = keep > kOverlapFrames ? keep - kOverlapFrames : 0;
+  size_t needed = index.frames[start].mainDataBegin;
+  while (needed > 0 && start > 0) {
+    --start;
+    needed -= std::min<size_t>(needed, index.frames[start].payload);
+  }
+  return start;
+}
+
+static std::vector<FrameRun> syncWindowRuns(const Mp3Index& index, int hopSize) {
+  const size_t samplesPerBit = static_cast<size_t>(samplesPerBitFor(hopSize));
+  const size_t period = samplesPerBit * kPayloadBits;
+  const size_t window = samplesPerBit * kSyncBits;
+  const size_t spf = static_cast<size_t>(index.samplesPerFrame);
+  const size_t total = index.timelineFrames();
+
+  std::vector<FrameRun> runs;
+  for (size_t start = 0; start < total; start += period) {
+    const size_t stop = std::min(start + window, total);
+    const size_t keep = (start + index.leadingSkip) / spf;
+    const size_t last = std::min((stop - 1 + index.leadingSkip) / spf, index.frameCount() - 1);
+    const size_t begin = runStart(index, keep);
+    if (!runs.empty() && begin <= runs.back().end) {
+      runs.back().end = std::max(runs.back().end, last + 1);
+    } else {
+      runs.push_back(FrameRun{ begin, last + 1, keep });
+    }
+  }
+  return runs;
+}
+
+bool decodeMp3SyncWindows(const uint8_t* data, size_t size, const Mp3Index& index, int hopSize,
+    DownmixedAudio& out) {
+  const std::vector<FrameRun> runs = syncWindowRuns(index, hopSize);
+  std::vector<uint8_t> stream;
+  size_t decodedFrames = 0;
+  for (const FrameRun& run : runs) {
+    const size_t from = index.frames[run.begin].offset;
+    const Mp3Frame& last = index.frames[run.end - 1];
+    if (last.offset + last.size > size) return false;
+    stream.insert(stream.end(), data + from, data + last.offset + last.size);
+    decodedFrames += run.end - run.begin;
+  }
+
+  const DownmixedAudio decoded = decodeDownmixed(stream.data(), stream.size(), index.sampleRate);
+  const size_t spf = static_cast<size_t>(index.samplesPerFrame);
+  if (decoded.mid.size() != decodedFrames * spf) return false;
+
+  out = DownmixedAudio{};
+  out.sampleRate = index.sampleRate;
+  out.channels = decoded.channels;
+  out.mid.assign(index.timelineFrames(), 0.0f);
+  const long long total = static_cast<long long>(out.mid.size());
+  size_t source = 0;
+  for (const FrameRun& run : runs) {
+    for (size_t frame = run.begin; frame < run.end; ++frame, source += spf) {
+      if (frame < run.keepFrom) continue;
+      // Timeline position of this frame's first sample after the decoder's
+      // leading skip; the first and last frames are partly cut off.
+      const long long at = static_cast<long long>(frame * spf) - static_cast<long long>(index.leadingSkip);
+      const long long from = std::max(at, 0LL);
+      const long long to = std::min(at + static_cast<long long>(spf), total);
+      if (from < to) {
+        std::copy(decoded.mid.begin() + static_cast<long long>(source) + (from - at),
+          decoded.mid.begin() + static_cast<long long>(source) + (to - at), out.mid.begin() + from);
+      }
+    }
+  }
+  return true;
+}
+
+DownmixedAudio decodeForTriage(const std::string& path, int sampleRate, int hopSize) {
+  {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) throw std::runtime_error("Failed to open " + path);
+    const std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    Mp3Index index;
+    DownmixedAudio windows;
+    if (indexMp3(bytes.data(), bytes.size(), index) && index.sampleRate == sampleRate &&
+        decodeMp3SyncWindows(bytes.data(), bytes.size(), index, hopSize, windows)) {
+      return windows;
+    }
+  }
+  // Resampled or not MP3: only the full decode lines the blocks up.
+  return decodeDownmixed(path, sampleRate);
+}
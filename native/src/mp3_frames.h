@@ -0,0 +1,50 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "media_decoder.h"
+
+// MPEG-1/2/2.5 layer III frame index built from frame headers and the
+// main_data_begin field of the side info, without decoding any audio.
+// Triage only correlates the sync blocks at the start of each payload
+// period, about 1/7 of the timeline, so with the index it can hand the
+// decoder just the frames under those blocks (plus the frames their bit
+// reservoir and filterbank overlap depend on) instead of the whole file.
+
+struct Mp3Frame {
+  size_t offset = 0;
+  uint32_t size = 0;
+  uint32_t mainDataBegin = 0;  // bytes of this frame's data in earlier frames
+  uint32_t payload = 0;        // bytes after header, CRC and side info
+};
+
+struct Mp3Index {
+  int sampleRate = 0;
+  int channels = 0;
+  int samplesPerFrame = 0;
+  std::vector<Mp3Frame> frames;  // audio frames only (no Xing/Info frame)
+  // Samples the decoder drops at the start and end (LAME tag delay + 529
+  // and padding), so indices match a full decode of the file.
+  size_t leadingSkip = 0;
+  size_t trailingPadding = 0;
+  size_t frameCount() const { return frames.size(); }
+  size_t timelineFrames() const;
+};
+
+// False when `data` is not a layer III stream this index can place
+// exactly: free format, a VBRI header, an Xing header without a LAME
+// tag, or junk between frames.
+bool indexMp3(const uint8_t* data, size_t size, Mp3Index& out);
+
+// Decodes only the sync-block windows of every payload period for hop size
+// `hopSize` into a full-length mid signal (zero elsewhere), through the
+// external decoder, at the file's own rate. False if the decoder did not
+// return one frame of samples per frame, so the windows cannot be placed.
+bool decodeMp3SyncWindows(const uint8_t* data, size_t size, const Mp3Index& index, int hopSize,
+  DownmixedAudio& out);
+
+// Triage input for a file the external decoder reads: the sync windows when
+// it is an MP3 at `sampleRate`, otherwise the full decode. contentHash is
+// left empty on the windowed path.
+DownmixedAudio decodeForTriage(const std::string& path, int sampleRate, int hopSize);
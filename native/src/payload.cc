@@ -0,0 +1,286 @@
+#include "payload.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <random>
+#include "engine.h"
+#include "reed_solomon.h"
+#include "sha256.h"
+
+const uint8_t kSyncPattern[kSyncBits] = {
+  1,0,1,0,1,1,0,1,  0,1,0,1,0,0,1,0,
+  1,1,1,0,0,1,1,0,  0,1,1,0,0,0,1,1,
+  1,0,0,1,1,0,1,0,  0,1,1,1,0,0,1,0,
+  1,0,1,1,0,1,0,0,  1,1,0,0,1,0,1,1,
+};
+
+std::vector<uint8_t> uuidToBytes(const std::string& uuid) {
+  std::string hex;
+  for (char c : uuid) {
+    if (c != '-') hex.push_back(c);
+  }
+  std::vector<uint8_t> bytes(16, 0);
+  for (size_t i = 0; i < 16 && i * 2 + 1 < hex.size(); i++) {
+    bytes[i] = static_cast<uint8_t>(std::stoi(hex.substr(i * 2, 2), nullptr, 16));
+  }
+  return bytes;
+}
+
+static std::string bytesToUuid(const std::vector<uint8_t>& bytes) {
+  char hex[33];
+  for (int i = 0; i < 16; i++) std::snprintf(hex + i * 2, 3, "%02x", bytes[i]);
+  const std::string h(hex, 32);
+  return h.substr(0, 8) + "-" + h.substr(8, 4) + "-" + h.substr(12, 4) + "-" + h.substr(16, 4) + "-" + h.substr(20, 12);
+}
+
+static std::vector<uint8_t> bytesToBits(const std::vector<uint8_t>& bytes) {
+  std::vector<uint8_t> bits(bytes.size() * 8);
+  for (size_t i = 0; i < bytes.size(); i++) {
+    for (int b = 0; b < 8; b++) bits[i * 8 + b] = (bytes[i] >> (7 - b)) & 1;
+  }
+  return bits;
+}
+
+static std::vector<uint8_t> bitsToBytes(const std::vector<uint8_t>& bits) {
+  const size_t byteCount = (bits.size() + 7) / 8;
+  std::vector<uint8_t> bytes(byteCount);
+  for (size_t i = 0; i < byteCount; i++) {
+    int value = 0;
+    for (int b = 0; b < 8; b++) {
+      const size_t idx = i * 8 + b;
+      value = (value << 1) | (idx < bits.size() ? bits[idx] & 1 : 0);
+    }
+    bytes[i] = static_cast<uint8_t>(value);
+  }
+  return bytes;
+}
+
+static std::vector<uint8_t> interleaveBits(const std::vector<uint8_t>& bits, int depth) {
+  if (depth <= 1) return bits;
+  const size_t rows = depth;
+  const size_t cols = (bits.size() + rows - 1) / rows;
+  std::vector<uint8_t> padded(rows * cols, 0);
+  std::copy(bits.begin(), bits.end(), padded.begin());
+
+  std::vector<uint8_t> interleaved(rows * cols);
+  size_t idx = 0;
+  for (size_t c = 0; c < cols; c++) {
+    for (size_t r = 0; r < rows; r++) interleaved[idx++] = padded[r * cols + c];
+  }
+  interleaved.resize(bits.size());
+  return interleaved;
+}
+
+static std::vector<uint8_t> deinterleaveBits(const std::vector<uint8_t>& bits, int depth) {
+  if (depth <= 1) return bits;
+  const size_t rows = depth;
+  const size_t cols = (bits.size() + rows - 1) / rows;
+  std::vector<uint8_t> padded(rows * cols, 0);
+  std::copy(bits.begin(), bits.end(), padded.begin());
+
+  std::vector<uint8_t> deinterleaved(rows * cols);
+  size_t idx = 0;
+  for (size_t c = 0; c < cols; c++) {
+    for (size_t r = 0; r < rows; r++) deinterleaved[r * cols + c] = padded[idx++];
+  }
+  deinterleaved.resize(bits.size());
+  return deinterleaved;
+}
+
+static std::vector<uint8_t> numberToBits(int value, int bitCount) {
+  std::vector<uint8_t> bits(bitCount);
+  for (int i = 0; i < bitCount; i++) bits[bitCount - 1 - i] = (value >> i) & 1;
+  return bits;
+}
+
+static int bitsToNumber(const uint8_t* bits, size_t count) {
+  int value = 0;
+  for (size_t i = 0; i < count; i++) value = (value << 1) | (bits[i] & 1);
+  return value;
+}
+
+static int findSync(const std::vector<uint8_t>& data) {
+  int bestMatch = 0;
+  int bestIndex = -1;
+  for (int i = 0; i + kSyncBits <= static_cast<int>(data.size()); i++) {
+    int matches = 0;
+    for (int j = 0; j < kSyncBits; j++) {
+      if (data[i + j] == kSyncPattern[j]) matches++;
+    }
+    if (matches > bestMatch) {
+      bestMatch = matches;
+      bestIndex = i;
+    }
+    if (static_cast<double>(matches) / kSyncBits >= 0.85) return i;
+  }
+  if (static_cast<double>(bestMatch) / kSyncBits >= 0.6) return bestIndex;
+  return -1;
+}
+
+std::string generateUuidV4() {
+  std::random_device device;
+  std::vector<uint8_t> bytes(16);
+  for (size_t i = 0; i < 16; i += 4) {
+    const uint32_t r = device();
+    for (size_t j = 0; j < 4; j++) bytes[i + j] = static_cast<uint8_t>(r >> (8 * j));
+  }
+  bytes[6] = (bytes[6] & 0x0f) | 0x40;
+  bytes[8] = (bytes[8] & 0x3f) | 0x80;
+  return bytesToUuid(bytes);
+}
+
+std::string currentIsoTimestamp() {
+  const auto now = std::chrono::system_clock::now();
+  const std::time_t seconds = std::chrono::system_clock::to_time_t(now);
+  const long millis = static_cast<long>(
+    std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count() % 1000);
+  std::tm utc{};
+#if defined(_WIN32)
+  gmtime_s(&utc, &seconds);
+#else
+  gmtime_r(&seconds, &utc);
+#endif
+  // Room for every field at its widest (six ints and a long), not just for
+  // the 24 characters a real date takes, so the compiler can prove no
+  // truncation.
+  char text[96];
+  std::snprintf(text, sizeof(text), "%04d-%02d-%02dT%02d:%02d:%02d.%03ldZ",
+    utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday, utc.tm_hour, utc.tm_min, utc.tm_sec, millis);
+  return text;
+}
+
+std::string jsonString(const std::string& value) {
+  std::string out = "\"";
+  for (unsigned char c : value) {
+    switch (c) {
+      case '"': out += "\\\""; break;
+      case '\\': out += "\\\\"; break;
+      case '\b': out += "\\b"; break;
+      case '\f': out += "\\f"; break;
+      case '\n': out += "\\n"; break;
+      case '\r': out += "\\r"; break;
+      case '\t': out += "\\t"; break;
+      default:
+        if (c < 0x20) {
+          char escaped[8];
+          std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+          out += escaped;
+        } else {
+          out.push_back(static_cast<char>(c));
+        }
+    }
+  }
+  out.push_back('"');
+  return out;
+}
+
+std::string WatermarkPayload::toJson() const {
+  return "{\"signature_id\":" + jsonString(signatureId) +
+    ",\"project_id\":" + jsonString(projectId) +
+    ",\"recipient_identifier\":" + jsonString(recipientIdentifier) +
+    ",\"timestamp\":" + jsonString(timestamp) + "}";
+}
+
+bool isSignatureId(const std::string& value) {
+  if (value.size() != 36) return false;
+  for (size_t i = 0; i < value.size(); i++) {
+    const bool dash = i == 8 || i == 13 || i == 18 || i == 23;
+    if (dash ? value[i] != '-' : !std::isxdigit(static_cast<unsigned char>(value[i]))) return false;
+  }
+  return true;
+}
+
+std::vector<uint8_t> buildBitstream(const std::string& signatureId) {
+  const std::vector<uint8_t> payloadBytes = uuidToBytes(signatureId);
+  const std::vector<uint8_t> encoded = rsEncode(payloadBytes, kParityBytes);
+  const std::vector<uint8_t> interleaved = interleaveBits(bytesToBits(encoded), kInterleaveDepth);
+  const std::vector<uint8_t> lengthBits = numberToBits(static_cast<int>(payloadBytes.size()), 16);
+
+  std::vector<uint8_t> bitstream(kSyncPattern, kSyncPattern + kSyncBits);
+  bitstream.insert(bitstream.end(), lengthBits.begin(), lengthBits.end());
+  bitstream.insert(bitstream.end(), interleaved.begin(), interleaved.end());
+  return bitstream;
+}
+
+EncodedPayload encodePayload(const std::string& projectId, const std::string& recipientIdentifier) {
+  EncodedPayload encoded;
+  encoded.payload.signatureId = generateUuidV4();
+  encoded.payload.projectId = projectId;
+  encoded.payload.recipientIdentifier = recipientIdentifier;
+  encoded.payload.timestamp = currentIsoTimestamp();
+  const std::string json = encoded.payload.toJson();
+  encoded.payloadHash = sha256Hex(json.data(), json.size());
+  encoded.bitstream = buildBitstream(encoded.payload.signatureId);
+  return encoded;
+}
+
+DecodedPayload decodeBitstream(const std::vector<uint8_t>& bitstream) {
+  const int syncIndex = findSync(bitstream);
+  if (syncIndex < 0) return { "", "", false, 0 };
+
+  const size_t start = syncIndex + kSyncBits;
+  const size_t lengthEnd = std::min(bitstream.size(), start + 16);
+  const int payloadLength = bitsToNumber(bitstream.data() + start, lengthEnd - start);
+
+  const size_t expectedCodewordBits = static_cast<size_t>(payloadLength + kParityBytes) * 8;
+  const size_t bitsStart = std::min(bitstream.size(), start + 16);
+  const size_t bitsEnd = std::min(bitstream.size(), bitsStart + expectedCodewordBits);
+  const std::vector<uint8_t> payloadBits(bitstream.begin() + bitsStart, bitstream.begin() + bitsEnd);
+  const std::vector<uint8_t> codeword = bitsToBytes(deinterleaveBits(payloadBits, kInterleaveDepth));
+
+  const RsDecodeResult rs = rsDecode(codeword, kParityBytes);
+  if (!rs.corrected) return { "", "", false, rs.errorCount };
+
+  if (payloadLength == 16 && rs.data.size() >= 16) {
+    const std::vector<uint8_t> payloadBytes(rs.data.begin(), rs.data.begin() + 16);
+    return { bytesToUuid(payloadBytes), sha256Hex(payloadBytes.data(), payloadBytes.size()), true, rs.errorCount };
+  }
+
+  return { "", "", false, rs.errorCount };
+}
+
+int detectionConfidence(double bitConfidence, double bandAgreement, const DecodedPayload& decoded, bool found) {
+  if (!decoded.success) return 0;
+  const double bitRecoveryRatio = std::max(0.0, 1.0 - decoded.errorCount / 32.0);
+  return static_cast<int>(std::round(
+    100 * (0.35 * bitConfidence + 0.2 * bandAgreement + 0.2 * bitRecoveryRatio + 0.15 + 0.1 * (found ? 1 : 0))));
+}
+
+std::vector<uint8_t> applySoftMajorityVoting(const std::vector<float>& correlations) {
+  const size_t period = kPayloadBits;
+  const size_t repetitions = correlations.size() / period;
+
+  if (repetitions < 2) {
+    std::vector<uint8_t> result(correlations.size());
+    for (size_t i = 0; i < correlations.size(); i++) result[i] = correlations[i] > 0 ? 1 : 0;
+    return result;
+  }
+
+  // float sums on purpose: the TS version accumulates in a Float32Array
+  std::vector<float> positionSums(period, 0.0f);
+  for (size_t r = 0; r < repetitions; r++) {
+    for (size_t i = 0; i < period; i++) positionSums[i] += correlations[r * period + i];
+  }
+
+  std::vector<uint8_t> result(period);
+  for (size_t i = 0; i < period; i++) result[i] = positionSums[i] > 0 ? 1 : 0;
+  return result;
+}
+
+double syncScore(const std::vector<float>& correlations) {
+  if (correlations.empty()) return 0.0;
+  std::vector<float> sums(kSyncBits, 0.0f);
+  for (size_t i = 0; i < correlations.size(); i++) {
+    const size_t position = i % kPayloadBits;
+    if (position < static_cast<size_t>(kSyncBits)) sums[position] += correlations[i];
+  }
+  const size_t covered = std::min<size_t>(kSyncBits, correlations.size());
+  int matches = 0;
+  for (size_t i = 0; i < covered; i++) {
+    if ((sums[i] > 0 ? 1 : 0) == kSyncPattern[i]) matches++;
+  }
+  return static_cast<double>(matches) / kSyncBits;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Native port of src/payload.ts and src/bitUtils.ts for front ends that run
+// without Node (CLI, C API). Bitstreams must match the TypeScript encoder.
+
+constexpr int kSyncBits = 64;
+constexpr int kParityBytes = 32;
+constexpr int kInterleaveDepth = 8;
+
+extern const uint8_t kSyncPattern[kSyncBits];
+
+struct WatermarkPayload {
+  std::string signatureId;
+  std::string projectId;
+  std::string recipientIdentifier;
+  std::string timestamp;  // ISO-8601 UTC, millisecond precision
+
+  // Same key order and escaping as JSON.stringify on the TS payload object.
+  std::string toJson() const;
+};
+
+struct EncodedPayload {
+  WatermarkPayload payload;
+  std::string payloadHash;  // SHA-256 of payload.toJson()
+  std::vector<uint8_t> bitstream;
+};
+
+std::string generateUuidV4();
+std::string currentIsoTimestamp();
+std::string jsonString(const std::string& value);
+
+// True for a canonical 8-4-4-4-12 hex UUID string.
+bool isSignatureId(const std::string& value);
+// The 16 bytes of a canonical UUID string.
+std::vector<uint8_t> uuidToBytes(const std::string& uuid);
+
+std::vector<uint8_t> buildBitstream(const std::string& signatureId);
+EncodedPayload encodePayload(const std::string& projectId, const std::string& recipientIdentifier);
+
+struct DecodedPayload {
+  std::string signatureId;  // empty when decoding failed
+  std::string payloadHash;  // SHA-256 of the 16 payload bytes
+  bool success;
+  int errorCount;
+};
+
+DecodedPayload decodeBitstream(const std::vector<uint8_t>& bitstream);
+
+// 0-100 score used by detect(); `found` is whether the id matched a stored
+// signature (front ends without a store pass false).
+int detectionConfidence(double bitConfidence, double bandAgreement, const DecodedPayload& decoded, bool found);
+
+// Sums correlations per payload position across repetitions and slices.
+std::vector<uint8_t> applySoftMajorityVoting(const std::vector<float>& correlations);
+
+// Fraction of the sync pattern recovered from correlations of the first
+// kSyncBits positions of each period (block-aligned input assumed).
+double syncScore(const std::vector<float>& correlations);
@@ -0,0 +1,266 @@
+#include "psychoacoustic.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include "engine.h"
+
+// ============================================================================
+// PSYCHOACOUSTIC MASKING MODEL - ISO/IEC 11172-3 (MPEG-1 Audio Layer III)
+// Makes watermark truly imperceptible by embedding only in masked frequencies
+// ============================================================================
+
+// Convert frequency (Hz) to Bark scale (critical band rate)
+static double freqToBark(double freq) {
+  return 13.0 * std::atan(0.00076 * freq) + 3.5 * std::atan(std::pow(freq / 7500.0, 2.0));
+}
+
+// Calculate absolute threshold of hearing (ATH) in dB SPL
+// Based on ISO 226 equal-loudness contours
+static double absoluteThresholdOfHearing(double freqHz) {
+  const double f = freqHz / 1000.0;
+  if (f < 0.02) return 100.0;
+  if (f > 20.0) return 100.0;
+  // Terhardt formula approximation
+  return 3.64 * std::pow(f, -0.8) 
+       - 6.5 * std::exp(-0.6 * std::pow(f - 3.3, 2.0))
+       + 0.001 * std::pow(f, 4.0);
+}
+
+// Calculate spreading function for frequency masking (in dB)
+// Masking spreads from a masker to nearby frequencies in Bark scale
+static double spreadingFunction(double deltaBark) {
+  const double absD = std::abs(deltaBark);
+  if (absD > 8.0) return -100.0; // No masking effect beyond 8 Bark
+  
+  // Asymmetric spreading: upward masking is stronger
+  if (deltaBark >= 0) {
+    // Upward spread (masker affects higher frequencies more)
+    return 15.81 + 7.5 * (deltaBark + 0.474) 
+         - 17.5 * std::sqrt(1.0 + std::pow(deltaBark + 0.474, 2.0));
+  } else {
+    // Downward spread (masker affects lower frequencies less)
+    return 15.81 + 7.5 * (deltaBark + 0.474) 
+         - 17.5 * std::sqrt(1.0 + std::pow(deltaBark + 0.474, 2.0))
+         + 8.0 * std::abs(deltaBark); // Extra attenuation
+  }
+}
+
+// Calculate masking threshold for each bin using psychoacoustic model
+std::vector<double> calculateMaskingThreshold(
+  const std::vector<Complex>& fft,
+  int sampleRate
+) {
+  const int n = static_cast<int>(fft.size());
+  const int halfN = n / 2;
+  const double binFreqStep = static_cast<double>(sampleRate) / n;
+  
+  std::vector<double> powerSpectrum(halfN);
+  std::vector<double> powerDB(halfN);
+  std::vector<double> barkFreq(halfN);
+  std::vector<double> maskingThreshold(halfN, -100.0);
+  
+  // Calculate power spectrum and convert to dB
+  for (int i = 0; i < halfN; i++) {
+    const double mag = std::hypot(fft[i].re, fft[i].im);
+    powerSpectrum[i] = mag * mag;
+    // Convert to dB with small epsilon to avoid log(0)
+    powerDB[i] = 10.0 * std::log10(std::max(powerSpectrum[i], 1e-20));
+    barkFreq[i] = freqToBark(i * binFreqStep);
+  }
+  
+  // Find tonal maskers (local peaks in spectrum)
+  std::vector<int> maskerBins;
+  std::vector<double> maskerPower;
+  
+  for (int i = 2; i < halfN - 2; i++) {
+    // Check if local maximum (peak)
+    if (powerDB[i] > powerDB[i-1] && powerDB[i] > powerDB[i+1] &&
+        powerDB[i] > powerDB[i-2] + 6.0 && powerDB[i] > powerDB[i+2] + 6.0 &&
+        powerDB[i] > -40.0) { // Only consider significant peaks
+      maskerBins.push_back(i);
+      // Combine energy from surrounding bins for tonal masker
+      double combinedPower = powerSpectrum[i-1] + powerSpectrum[i] + powerSpectrum[i+1];
+      maskerPower.push_back(10.0 * std::log10(std::max(combinedPower, 1e-20)));
+    }
+  }
+  
+  // Calculate global masking threshold for each bin
+  for (int i = 1; i < halfN; i++) {
+    double freq = i * binFreqStep;
+    double bark = barkFreq[i];
+    
+    // Start with absolute threshold of hearing
+    double threshold = absoluteThresholdOfHearing(freq);
+    
+    // Add contribution from each masker
+    double maskerContribution = -100.0;
+    for (size_t m = 0; m < maskerBins.size(); m++) {
+      double maskerBark = barkFreq[maskerBins[m]];
+      double deltaBark = bark - maskerBark;
+      
+      // Spreading function determines how much masking spreads
+      double spread = spreadingFunction(deltaBark);
+      
+      // Tonal masking offset (tonal maskers are less effective at masking noise)
+      const double tonalOffset = -6.025 - 0.275 * maskerBark;
+      
+      // Individual masking threshold from this masker
+      double individualMask = maskerPower[m] + spread + tonalOffset;
+      
+      // Combine using power addition in linear domain
+      if (individualMask > maskerContribution) {
+        maskerContribution = 10.0 * std::log10(
+          std::pow(10.0, maskerContribution / 10.0) + 
+          std::pow(10.0, individualMask / 10.0)
+        );
+      }
+    }
+    
+    // Final threshold is the higher of ATH and masker contribution
+    maskingThreshold[i] = std::max(threshold, maskerContribution);
+  }
+  
+  return maskingThreshold;
+}
+
+// Ultra-transparent watermarking using smooth, continuous phase modulation
+// Avoids clicks by using very gradual changes across frequency bins
+void applyWatermarkToFrame(
+  std::vector<Complex>& fftL,
+  std::vector<Complex>& fftR,
+  int bit,
+  uint64_t seed,
+  double embedStrength,
+  int sampleRate
+) {
+  const int n = static_cast<int>(fftL.size());
+  const int halfN = n / 2;
+  
+  // MICRO-EMBEDDING: Spread tiny changes across MANY bins
+  // This prevents any single bin from having a noticeable change
+  const double binFreqStep = static_cast<double>(sampleRate) / n;
+  const int minBin = std::max(20, static_cast<int>(2500.0 / binFreqStep));
+  const int maxBin = std::min(halfN - 10, static_cast<int>(5000.0 / binFreqStep));
+  
+  if (maxBin <= minBin + 20) return;
+  
+  // Ultra-micro phase delta - almost imperceptible
+  const double microPhaseDelta = embedStrength * 0.005; // Extremely tiny
+  
+  XorShift64 prng(seed);
+  
+  // Apply smooth, gradual phase shifts using a cosine envelope
+  // This prevents clicks by ensuring smooth transitions
+  const int binRange = maxBin - minBin;
+  
+  for (int i = 0; i < binRange; i++) {
+    const int bin = minBin + i;
+    
+    // Cosine window to smooth the phase changes (no abrupt edges)
+    const double windowPos = static_cast<double>(i) / static_cast<double>(binRange - 1);
+    const double smoothWindow = 0.5 * (1.0 - std::cos(2.0 * kPi * windowPos));
+    
+    // Get magnitude (we preserve this exactly)
+    const double magL = std::hypot(fftL[bin].re, fftL[bin].im);
+    const double magR = std::hypot(fftR[bin].re, fftR[bin].im);
+    
+    // Skip silent bins
+    if (magL < 1e-10 && magR < 1e-10) continue;
+    
+    // Deterministic sign based on bin and seed (consistent across frames)
+    const double sign = ((prng.next() % 2) == 0) ? 1.0 : -1.0;
+    
+    // Scale by magnitude - louder bins can hide more
+    const double magScale = std::min(1.0, std::sqrt(magL * magL + magR * magR) * 10.0);
+    
+    // Final phase shift: tiny, smooth, magnitude-scaled
+    const double phaseShift = sign * microPhaseDelta * smoothWindow * magScale * (bit ? 1.0 : -1.0);
+    
+    const double phaseL = std::atan2(fftL[bin].im, fftL[bin].re);
+    const double phaseR = std::atan2(fftR[bin].im, fftR[bin].re);
+    
+    // Apply phase shift to stereo difference (less audible than direct)
+    const double newPhaseL = phaseL + phaseShift * 0.3;
+    const double newPhaseR = phaseR - phaseShift * 0.3;
+    
+    // Reconstruct with EXACT original magnitude
+    fftL[bin].re = magL * std::cos(newPhaseL);
+    fftL[bin].im = magL * std::sin(newPhaseL);
+    fftR[bin].re = magR * std::cos(newPhaseR);
+    fftR[bin].im = magR * std::sin(newPhaseR);
+    
+    // Mirror for real signal
+    const int mirror = n - bin;
+    if (mirror > 0 && mirror < n && mirror != bin) {
+      fftL[mirror].re = fftL[bin].re;
+      fftL[mirror].im = -fftL[bin].im;
+      fftR[mirror].re = fftR[bin].re;
+      fftR[mirror].im = -fftR[bin].im;
+    }
+  }
+}
+
+// Extract watermark using smooth phase detection (matches embedding)
+int extractBitFromFrame(
+  const std::vector<Complex>& fftL,
+  const std::vector<Complex>& fftR,
+  uint64_t seed,
+  [[maybe_unused]] double embedStrength,  // mirrors applyWatermarkToFrame; detection is by phase sign alone
+  double& bitConfidence,
+  double& bandAgreement,
+  int sampleRate
+) {
+  const int n = static_cast<int>(fftL.size());
+  const int halfN = n / 2;
+  
+  const double binFreqStep = static_cast<double>(sampleRate) / n;
+  const int minBin = std::max(20, static_cast<int>(2500.0 / binFreqStep));
+  const int maxBin = std::min(halfN - 10, static_cast<int>(5000.0 / binFreqStep));
+  
+  if (maxBin <= minBin + 20) {
+    bitConfidence = 0.0;
+    bandAgreement = 0.0;
+    return 0;
+  }
+
+  XorShift64 prng(seed);
+  double phaseSum = 0.0;
+  double weightSum = 0.0;
+  int validBins = 0;
+  const int binRange = maxBin - minBin;
+
+  for (int i = 0; i < binRange; i++) {
+    const int bin = minBin + i;
+    
+    const double magL = std::hypot(fftL[bin].re, fftL[bin].im);
+    const double magR = std::hypot(fftR[bin].re, fftR[bin].im);
+    
+    if (magL < 1e-10 && magR < 1e-10) continue;
+    
+    const double sign = ((prng.next() % 2) == 0) ? 1.0 : -1.0;
+    
+    const double phaseL = std::atan2(fftL[bin].im, fftL[bin].re);
+    const double phaseR = std::atan2(fftR[bin].im, fftR[bin].re);
+    
+    double phaseDiff = phaseL - phaseR;
+    while (phaseDiff > kPi) phaseDiff -= 2.0 * kPi;
+    while (phaseDiff < -kPi) phaseDiff += 2.0 * kPi;
+    
+    // Weight by magnitude (louder = more reliable)
+    const double weight = std::sqrt(magL * magL + magR * magR);
+    phaseSum += sign * phaseDiff * weight;
+    weightSum += weight;
+    validBins++;
+  }
+
+  bandAgreement = validBins > 0 ? static_cast<double>(validBins) / static_cast<double>(binRange) : 0.0;
+  
+  if (weightSum > 1e-10) {
+    const double avgPhase = phaseSum / weightSum;
+    bitConfidence = std::min(1.0, std::abs(avgPhase) * 100.0);
+    return avgPhase >= 0 ? 1 : 0;
+  }
+  
+  bitConfidence = 0.0;
+  return 0;
+}
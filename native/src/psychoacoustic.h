@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "fft.h"
+
+// Frequency-domain phase watermark with an MPEG-1 style masking model. Not
+// used by the spread-spectrum path; kept for experiments.
+
+std::vector<double> calculateMaskingThreshold(const std::vector<Complex>& fft, int sampleRate);
+
+void applyWatermarkToFrame(
+  std::vector<Complex>& fftL,
+  std::vector<Complex>& fftR,
+  int bit,
+  uint64_t seed,
+  double embedStrength,
+  int sampleRate = 44100
+);
+
+int extractBitFromFrame(
+  const std::vector<Complex>& fftL,
+  const std::vector<Complex>& fftR,
+  uint64_t seed,
+  double embedStrength,
+  double& bitConfidence,
+  double& bandAgreement,
+  int sampleRate = 44100
+);
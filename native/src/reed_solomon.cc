@@ -0,0 +1,181 @@
+#include "reed_solomon.h"
+#include <algorithm>
+#include <stdexcept>
+
+constexpr int kGfSize = 256;
+constexpr int kPrimitivePoly = 0x11d;
+
+struct GfTables {
+  uint8_t exp[kGfSize * 2];
+  uint8_t log[kGfSize];
+
+  GfTables() {
+    int x = 1;
+    log[0] = 0;
+    for (int i = 0; i < kGfSize - 1; i++) {
+      exp[i] = static_cast<uint8_t>(x);
+      log[x] = static_cast<uint8_t>(i);
+      x <<= 1;
+      if (x & 0x100) x ^= kPrimitivePoly;
+    }
+    for (int i = kGfSize - 1; i < kGfSize * 2; i++) {
+      exp[i] = exp[i - (kGfSize - 1)];
+    }
+  }
+};
+
+static const GfTables kGf;
+
+using Poly = std::vector<int>;
+
+static int gfMul(int a, int b) {
+  if (a == 0 || b == 0) return 0;
+  return kGf.exp[kGf.log[a] + kGf.log[b]];
+}
+
+static int gfDiv(int a, int b) {
+  if (a == 0) return 0;
+  if (b == 0) throw std::runtime_error("Division by zero");
+  return kGf.exp[(kGf.log[a] + (kGfSize - 1) - kGf.log[b]) % (kGfSize - 1)];
+}
+
+static int gfPow(int a, int power) {
+  return kGf.exp[(kGf.log[a] * power) % (kGfSize - 1)];
+}
+
+static Poly polyScale(const Poly& p, int x) {
+  Poly result(p.size());
+  for (size_t i = 0; i < p.size(); i++) result[i] = gfMul(p[i], x);
+  return result;
+}
+
+// Right-aligned addition; missing leading coefficients count as zero.
+static Poly polyAdd(const Poly& p, const Poly& q) {
+  const size_t length = std::max(p.size(), q.size());
+  Poly result(length, 0);
+  for (size_t i = 0; i < length; i++) {
+    const int a = i + p.size() >= length ? p[i + p.size() - length] : 0;
+    const int b = i + q.size() >= length ? q[i + q.size() - length] : 0;
+    result[i] = a ^ b;
+  }
+  return result;
+}
+
+static Poly polyMul(const Poly& p, const Poly& q) {
+  Poly result(p.size() + q.size() - 1, 0);
+  for (size_t i = 0; i < p.size(); i++) {
+    for (size_t j = 0; j < q.size(); j++) {
+      result[i + j] ^= gfMul(p[i], q[j]);
+    }
+  }
+  return result;
+}
+
+static int polyEval(const Poly& p, int x) {
+  if (p.empty()) return 0;
+  int y = p[0];
+  for (size_t i = 1; i < p.size(); i++) {
+    y = gfMul(y, x) ^ p[i];
+  }
+  return y;
+}
+
+static Poly rsGeneratorPoly(int nsym) {
+  Poly g{ 1 };
+  for (int i = 0; i < nsym; i++) {
+    g = polyMul(g, { 1, gfPow(2, i) });
+  }
+  return g;
+}
+
+std::vector<uint8_t> rsEncode(const std::vector<uint8_t>& data, int nsym) {
+  const Poly gen = rsGeneratorPoly(nsym);
+  Poly msg(data.size() + nsym, 0);
+  for (size_t i = 0; i < data.size(); i++) msg[i] = data[i];
+
+  for (size_t i = 0; i < data.size(); i++) {
+    const int coef = msg[i];
+    if (coef != 0) {
+      for (size_t j = 0; j < gen.size(); j++) {
+        msg[i + j] ^= gfMul(gen[j], coef);
+      }
+    }
+  }
+
+  std::vector<uint8_t> codeword(data);
+  for (size_t i = data.size(); i < msg.size(); i++) codeword.push_back(static_cast<uint8_t>(msg[i]));
+  return codeword;
+}
+
+static std::vector<uint8_t> dataPart(const std::vector<uint8_t>& codeword, int nsym) {
+  const size_t length = codeword.size() > static_cast<size_t>(nsym) ? codeword.size() - nsym : 0;
+  return std::vector<uint8_t>(codeword.begin(), codeword.begin() + length);
+}
+
+RsDecodeResult rsDecode(const std::vector<uint8_t>& codeword, int nsym) {
+  Poly msg(codeword.begin(), codeword.end());
+  Poly synd(nsym, 0);
+  bool hasError = false;
+
+  for (int i = 0; i < nsym; i++) {
+    const int s = polyEval(msg, gfPow(2, i));
+    synd[i] = s;
+    if (s != 0) hasError = true;
+  }
+
+  if (!hasError) {
+    return { dataPart(codeword, nsym), true, 0 };
+  }
+
+  Poly errLoc{ 1 };
+  Poly oldLoc{ 1 };
+  for (int i = 0; i < nsym; i++) {
+    int delta = synd[i];
+    for (size_t j = 1; j < errLoc.size(); j++) {
+      // Syndromes before index 0 contribute nothing (undefined in the TS port).
+      if (static_cast<int>(j) > i) continue;
+      delta ^= gfMul(errLoc[errLoc.size() - 1 - j], synd[i - j]);
+    }
+    oldLoc.push_back(0);
+    if (delta != 0) {
+      if (oldLoc.size() > errLoc.size()) {
+        Poly newLoc = polyScale(oldLoc, delta);
+        oldLoc = polyScale(errLoc, gfDiv(1, delta));
+        errLoc = newLoc;
+      }
+      errLoc = polyAdd(errLoc, polyScale(oldLoc, delta));
+    }
+  }
+
+  std::vector<size_t> errPositions;
+  for (size_t i = 0; i < msg.size(); i++) {
+    if (polyEval(errLoc, gfPow(2, static_cast<int>(i))) == 0) {
+      errPositions.push_back(msg.size() - 1 - i);
+    }
+  }
+
+  if (errPositions.empty() || errPositions.size() > static_cast<size_t>(nsym)) {
+    return { dataPart(codeword, nsym), false, static_cast<int>(errPositions.size()) };
+  }
+
+  Poly syndPoly{ 0 };
+  syndPoly.insert(syndPoly.end(), synd.begin(), synd.end());
+  Poly errLocRev(errLoc.rbegin(), errLoc.rend());
+  Poly errEval = polyMul(syndPoly, errLocRev);
+  errEval.erase(errEval.begin(), errEval.end() - std::min<size_t>(errEval.size(), nsym));
+
+  for (size_t pos : errPositions) {
+    const int xi = gfPow(2, static_cast<int>(msg.size() - 1 - pos));
+    int errLocPrime = 1;
+    for (size_t j = 1; j < errLoc.size(); j += 2) {
+      errLocPrime ^= gfMul(errLoc[errLoc.size() - 1 - j], gfPow(xi, static_cast<int>(j)));
+    }
+    const int y = polyEval(errEval, xi);
+    const int magnitude = gfDiv(gfMul(y, xi), errLocPrime);
+    msg[pos] ^= magnitude;
+  }
+
+  std::vector<uint8_t> data;
+  for (size_t i = 0; i + nsym < msg.size(); i++) data.push_back(static_cast<uint8_t>(msg[i]));
+  return { data, true, static_cast<int>(errPositions.size()) };
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+// Native port of src/reedSolomon.ts (GF(2^8), primitive polynomial 0x11d).
+// Both implementations must stay bit-for-bit identical.
+
+std::vector<uint8_t> rsEncode(const std::vector<uint8_t>& data, int nsym);
+
+struct RsDecodeResult {
+  std::vector<uint8_t> data;
+  bool corrected;
+  int errorCount;
+};
+
+RsDecodeResult rsDecode(const std::vector<uint8_t>& codeword, int nsym);
@@ -0,0 +1,448 @@
+#include "scan.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "audio_file.h"
+#include "engine.h"
+#include "media_decoder.h"
+#include "payload.h"
+#include "scheduler.h"
+#include "signature_store.h"
+#include "wav.h"
+
+// ============================================================================
+// CORPUS SCAN
+// Three stages joined by bounded queues: one walker thread lists files,
+// `ioThreads` readers decode them, `workers` analysts run triage and, when a
+// key's sync pattern shows up, full detection. The block loops of each file
+// still fan out over the shared scheduler, so a few workers keep every core
+// busy while the readers hide disk latency. Queue bounds cap memory at
+// roughly (workers + prefetch) decoded files.
+//
+// Resume: finished paths are held back and appended to the checkpoint only
+// after an fsync of the output that covers their records, every
+// kCheckpointSyncInterval records and at the end. A checkpointed path thus
+// always has its record on disk, even across a power loss; a crash repeats
+// at most the records since the last sync, so consumers should treat `path`
+// as the key.
+// ============================================================================
+
+namespace fs = std::filesystem;
+
+constexpr size_t kCheckpointSyncInterval = 64;
+
+template <typename T>
+class BoundedQueue {
+ public:
+  explicit BoundedQueue(size_t capacity) : capacity_(std::max<size_t>(1, capacity)) {}
+
+  // Returns false once the queue is closed.
+  bool push(T item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    notFull_.wait(lock, [&]() { return closed_ || items_.size() < capacity_; });
+    if (closed_) return false;
+    items_.push_back(std::move(item));
+    notEmpty_.notify_one();
+    return true;
+  }
+
+  // Returns false when the queue is closed and drained.
+  bool pop(T& item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    notEmpty_.wait(lock, [&]() { return closed_ || !items_.empty(); });
+    if (items_.empty()) return false;
+    item = std::move(items_.front());
+    items_.pop_front();
+    notFull_.notify_one();
+    return true;
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    notEmpty_.notify_all();
+    notFull_.notify_all();
+  }
+
+ private:
+  size_t capacity_;
+  std::mutex mutex_;
+  std::condition_variable notEmpty_;
+  std::condition_variable notFull_;
+  std::deque<T> items_;
+  bool closed_ = false;
+};
+
+struct ScanItem {
+  std::string path;
+  WavData wav;
+  std::string error;
+};
+
+static std::string formatNumber(double value) {
+  char text[32];
+  std::snprintf(text, sizeof(text), "%.6g", value);
+  return text;
+}
+
+static std::string lowercase(std::string value) {
+  std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) {
+    return static_cast<char>(std::tolower(c));
+  });
+  return value;
+}
+
+static bool hasExtension(const fs::path& path, const std::vector<std::string>& extensions) {
+  if (extensions.empty()) return true;
+  const std::string ext = lowercase(path.extension().string());
+  for (const std::string& wanted : extensions) {
+    if (ext == lowercase(wanted)) return true;
+  }
+  return false;
+}
+
+static void syncFile(std::FILE* file) {
+  std::fflush(file);
+#if defined(_WIN32)
+  _commit(_fileno(file));
+#else
+  fsync(fileno(file));
+#endif
+}
+
+// Only newline-terminated lines count: a torn final write is redone.
+static std::unordered_set<std::string> loadCheckpoint(const std::string& path) {
+  std::unordered_set<std::string> done;
+  std::ifstream in(path, std::ios::binary);
+  if (!in) return done;
+  const std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  size_t start = 0;
+  for (size_t newline = text.find('\n'); newline != std::string::npos; newline = text.find('\n', start)) {
+    if (newline > start) done.insert(text.substr(start, newline - start));
+    start = newline + 1;
+  }
+  return done;
+}
+
+// Appending to a file whose last record was cut short would glue the next
+// record onto it.
+static bool endsWithPartialLine(const std::string& path) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in || in.tellg() <= 0) return false;
+  in.seekg(-1, std::ios::end);
+  return in.get() != '\n';
+}
+
+// ---------------------------------------------------------------------------
+// Output: JSONL records plus the checkpoint, written under one lock.
+// ---------------------------------------------------------------------------
+
+class ScanWriter {
+ public:
+  ScanWriter(const ScanOptions& options, bool resuming, const ScanCallback& onResult) : onResult_(onResult) {
+    if (options.outputPath == "-") {
+      output_ = stdout;
+    } else if (!options.outputPath.empty()) {
+      const bool partial = resuming && endsWithPartialLine(options.outputPath);
+      output_ = std::fopen(options.outputPath.c_str(), resuming ? "ab" : "wb");
+      if (!output_) throw std::runtime_error("Failed to open " + options.outputPath);
+      ownsOutput_ = true;
+      if (partial) std::fputc('\n', output_);
+    }
+    if (!options.checkpointPath.empty()) {
+      const bool partial = endsWithPartialLine(options.checkpointPath);
+      checkpoint_ = std::fopen(options.checkpointPath.c_str(), "ab");
+      if (!checkpoint_) {
+        close();
+        throw std::runtime_error("Failed to open " + options.checkpointPath);
+      }
+      if (partial) std::fputc('\n', checkpoint_);
+    }
+  }
+
+  ~ScanWriter() { close(); }
+
+  void write(const std::string& path, const std::string& record) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (output_) {
+      std::fwrite(record.data(), 1, record.size(), output_);
+      std::fputc('\n', output_);
+      std::fflush(output_);
+    }
+    if (onResult_) onResult_(record);
+    if (checkpoint_) {
+      unsynced_.push_back(path);
+      if (unsynced_.size() >= kCheckpointSyncInterval) syncCheckpoint();
+    }
+  }
+
+  void finish() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (checkpoint_) syncCheckpoint();
+    else if (ownsOutput_) syncFile(output_);
+  }
+
+ private:
+  // The kernel may write a file's pages in any order relative to another
+  // file's, so the output is made durable before any of its paths are
+  // checkpointed.
+  void syncCheckpoint() {
+    if (ownsOutput_) syncFile(output_);
+    for (const std::string& path : unsynced_) {
+      std::fwrite(path.data(), 1, path.size(), checkpoint_);
+      std::fputc('\n', checkpoint_);
+    }
+    syncFile(checkpoint_);
+    unsynced_.clear();
+  }
+
+  void close() {
+    if (ownsOutput_ && output_) std::fclose(output_);
+    if (checkpoint_) std::fclose(checkpoint_);
+    output_ = nullptr;
+    checkpoint_ = nullptr;
+  }
+
+  const ScanCallback& onResult_;
+  std::mutex mutex_;
+  std::FILE* output_ = nullptr;
+  bool ownsOutput_ = false;
+  std::FILE* checkpoint_ = nullptr;
+  std::vector<std::string> unsynced_;  // finished paths whose records are not yet synced
+};
+
+// ---------------------------------------------------------------------------
+// Analysis
+// ---------------------------------------------------------------------------
+
+static std::string errorRecord(const std::string& path, const std::string& message) {
+  return "{\"path\":" + jsonString(path) + ",\"error\":" + jsonString(message) + "}";
+}
+
+// Keys are tried in order; the first one that decodes wins. With triage on,
+// a key only pays for full correlation when its sync pattern is present.
+// With a store, decoded ids are attributed in place.
+static std::string analyse(
+  const ScanItem& item,
+  const std::vector<PnBank>& keys,
+  bool triage,
+  SignatureStore* store,
+  ScanSummary& counts
+) {
+  const WavData& wav = item.wav;
+  if (wav.channels <= 0) throw std::runtime_error("Invalid channel count");
+  const size_t frames = wav.samples.size() / static_cast<size_t>(wav.channels);
+  // Every key analyses the same downmix, so it is made once per file.
+  const std::vector<float> mid = downmixForAnalysis(wav.samples.data(), frames, wav.channels);
+
+  double bestSync = 0.0;
+  bool ranDetection = false;
+  for (size_t k = 0; k < keys.size(); k++) {
+    if (triage) {
+      const TriageResult check = triageDownmixed(mid.data(), frames, keys[k], JobPriority::Batch);
+      bestSync = std::max(bestSync, check.syncScore);
+      if (!check.likely) continue;
+    }
+    ranDetection = true;
+    const Extraction extraction = extractDownmixed(mid.data(), frames, 0, keys[k], JobPriority::Batch);
+    const DecodedPayload decoded = decodeBitstream(applySoftMajorityVoting(extraction.correlations));
+    if (!triage) bestSync = std::max(bestSync, syncScore(extraction.correlations));
+    if (!decoded.success) continue;
+
+    counts.decoded++;
+    std::string attribution;
+    bool found = false;
+    if (store) {
+      const StoredSignature stored = store->get(decoded.signatureId);
+      found = stored.found;
+      attribution = ",\"found\":" + std::string(found ? "true" : "false") +
+        ",\"payload\":" + (found ? stored.payloadJson : "null");
+    }
+    return "{\"path\":" + jsonString(item.path) +
+      ",\"decoded\":true,\"key\":" + std::to_string(k) +
+      ",\"signatureId\":" + jsonString(decoded.signatureId) +
+      ",\"payloadHash\":" + jsonString(decoded.payloadHash) +
+      ",\"confidence\":" + std::to_string(detectionConfidence(extraction.bitConfidence, extraction.bandAgreement, decoded, found)) +
+      attribution +
+      ",\"syncScore\":" + formatNumber(syncScore(extraction.correlations)) +
+      ",\"stats\":{\"bitConfidence\":" + formatNumber(extraction.bitConfidence) +
+      ",\"bandAgreement\":" + formatNumber(extraction.bandAgreement) +
+      ",\"blocksAnalyzed\":" + std::to_string(extraction.blocksAnalyzed) +
+      ",\"errorCount\":" + std::to_string(decoded.errorCount) + "}}";
+  }
+
+  if (!ranDetection) counts.rejected++;
+  return "{\"path\":" + jsonString(item.path) +
+    ",\"decoded\":false,\"key\":null,\"signatureId\":null,\"payloadHash\":null,\"confidence\":0" +
+    (store ? ",\"found\":false,\"payload\":null" : "") +
+    ",\"syncScore\":" + formatNumber(bestSync) + "}";
+}
+
+// ---------------------------------------------------------------------------
+// Pipeline
+// ---------------------------------------------------------------------------
+
+std::vector<PnBank> buildScanKeys(const ScanOptions& options) {
+  if (options.secrets.empty()) throw std::invalid_argument("At least one key is required");
+  if (options.hopSize <= 0) throw std::invalid_argument("hopSize must be positive");
+  std::vector<PnBank> keys;
+  for (const std::string& secret : options.secrets) {
+    keys.push_back(buildPnBank(hashSecret(secret), kPayloadBits, samplesPerBitFor(options.hopSize), JobPriority::Batch));
+  }
+  return keys;
+}
+
+ScanSummary scanCorpus(const ScanOptions& options, const ScanCallback& onResult) {
+  return scanCorpus(options, buildScanKeys(options), onResult);
+}
+
+ScanSummary scanCorpus(const ScanOptions& options, const std::vector<PnBank>& keys, const ScanCallback& onResult) {
+  if (options.inputs.empty()) throw std::invalid_argument("No inputs to scan");
+  if (keys.empty()) throw std::invalid_argument("At least one key is required");
+  const auto started = std::chrono::steady_clock::now();
+
+  const std::shared_ptr<SignatureStore> store =
+    options.storePath.empty() ? nullptr : openSignatureStore(options.storePath);
+  std::unordered_set<std::string> done;
+  if (!options.checkpointPath.empty()) done = loadCheckpoint(options.checkpointPath);
+  ScanWriter writer(options, !done.empty(), onResult);
+
+  BoundedQueue<std::string> paths(std::max<size_t>(64, options.prefetch * 4));
+  BoundedQueue<ScanItem> loaded(options.prefetch);
+  std::mutex countsMutex;
+  ScanSummary summary;
+
+  auto finishItem = [&](const std::string& path, const std::string& record, const ScanSummary& counts) {
+    writer.write(path, record);
+    std::lock_guard<std::mutex> lock(countsMutex);
+    summary.scanned++;
+    summary.decoded += counts.decoded;
+    summary.rejected += counts.rejected;
+    summary.failed += counts.failed;
+  };
+  auto fail = [&](const std::string& path, const std::string& message) {
+    ScanSummary counts;
+    counts.failed = 1;
+    finishItem(path, errorRecord(path, message), counts);
+  };
+  auto stopped = [&]() { return options.stop && options.stop->load(); };
+  auto offer = [&](const std::string& path) {
+    if (stopped()) return false;
+    if (done.count(path)) {
+      std::lock_guard<std::mutex> lock(countsMutex);
+      summary.skipped++;
+      return true;
+    }
+    return paths.push(path);
+  };
+
+  std::thread walker([&]() {
+    for (const std::string& input : options.inputs) {
+      std::error_code ec;
+      if (!fs::is_directory(input, ec)) {
+        if (!offer(input)) break;
+        continue;
+      }
+      fs::recursive_directory_iterator it(input, fs::directory_options::skip_permission_denied, ec);
+      if (ec) {
+        fail(input, ec.message());
+        continue;
+      }
+      for (fs::recursive_directory_iterator end; it != end; it.increment(ec)) {
+        if (ec) {
+          fail(input, ec.message());
+          break;
+        }
+        std::error_code typeError;
+        if (!it->is_regular_file(typeError) || !hasExtension(it->path(), options.extensions)) continue;
+        if (!offer(it->path().string())) break;
+      }
+    }
+    paths.close();
+  });
+
+  const size_t readerCount = std::max<size_t>(1, options.ioThreads);
+  std::atomic<size_t> readersLeft{readerCount};
+  std::vector<std::thread> readers;
+  for (size_t r = 0; r < readerCount; r++) {
+    readers.emplace_back([&]() {
+      std::string path;
+      while (paths.pop(path)) {
+        if (stopped()) continue;
+        ScanItem item;
+        item.path = path;
+        try {
+          if (sniffAudioFile(path) == AudioContainer::Other) {
+            DownmixedAudio decoded = decodeDownmixed(path, options.sampleRate);
+            item.wav = WavData{ decoded.sampleRate, 1, std::move(decoded.mid) };
+          } else {
+            item.wav = readAudioFile(path);
+          }
+        } catch (const std::exception& e) {
+          item.error = e.what();
+        }
+        if (!loaded.push(std::move(item))) break;
+      }
+      if (--readersLeft == 0) loaded.close();
+    });
+  }
+
+  std::vector<std::thread> workers;
+  for (size_t w = 0; w < std::max<size_t>(1, options.workers); w++) {
+    workers.emplace_back([&]() {
+      ScanItem item;
+      while (loaded.pop(item)) {
+        if (stopped()) continue;
+        if (!item.error.empty()) {
+          fail(item.path, item.error);
+          continue;
+        }
+        ScanSummary counts;
+        std::string record;
+        try {
+          record = analyse(item, keys, options.triage, store.get(), counts);
+        } catch (const std::exception& e) {
+          fail(item.path, e.what());
+          continue;
+        }
+        finishItem(item.path, record, counts);
+      }
+    });
+  }
+
+  walker.join();
+  for (std::thread& reader : readers) reader.join();
+  for (std::thread& worker : workers) worker.join();
+  writer.finish();
+
+  summary.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+  return summary;
+}
+
+std::string scanSummaryJson(const ScanSummary& summary) {
+  return "{\"scanned\":" + std::to_string(summary.scanned) +
+    ",\"skipped\":" + std::to_string(summary.skipped) +
+    ",\"decoded\":" + std::to_string(summary.decoded) +
+    ",\"rejected\":" + std::to_string(summary.rejected) +
+    ",\"failed\":" + std::to_string(summary.failed) +
+    ",\"seconds\":" + formatNumber(summary.seconds) + "}";
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+#include "engine.h"
+
+// Bulk detection over a corpus of audio files: a walker feeds paths to reader
+// threads, which keep `prefetch` decoded files queued ahead of the analysis
+// workers. Results are written as JSON lines in completion order.
+
+struct ScanOptions {
+  std::vector<std::string> inputs;    // files and/or directories (walked recursively)
+  std::vector<std::string> secrets;   // every key is tried on every file
+  int hopSize = 1024;
+  std::string outputPath;             // JSONL; "-" for stdout, empty for none
+  std::string checkpointPath;         // finished paths; existing entries are skipped
+  std::vector<std::string> extensions = { ".wav", ".flac" };  // directory filter, case-insensitive
+  size_t workers = 4;                 // files analysed at once
+  size_t ioThreads = 2;               // files read at once
+  size_t prefetch = 8;                // decoded files waiting for a worker
+  bool triage = true;                 // sync-only check before full detection
+  int sampleRate = 44100;             // decode rate for compressed files (MP3, Ogg, ...)
+  std::string storePath;              // signature store used to attribute decoded ids
+  const std::atomic<bool>* stop = nullptr;  // once true, unfinished files are dropped
+};
+
+struct ScanSummary {
+  size_t scanned = 0;   // files analysed by this run
+  size_t skipped = 0;   // already listed in the checkpoint
+  size_t decoded = 0;   // a signature id was recovered under some key
+  size_t rejected = 0;  // every key failed triage, so no full detection ran
+  size_t failed = 0;    // unreadable or invalid files
+  double seconds = 0.0;
+};
+
+// Receives every JSONL record as it is written. Calls are serialized.
+using ScanCallback = std::function<void(const std::string& line)>;
+
+ScanSummary scanCorpus(const ScanOptions& options, const ScanCallback& onResult = nullptr);
+
+// For callers running many scans with the same keys: one PN bank per secret,
+// built once and passed to each scan.
+std::vector<PnBank> buildScanKeys(const ScanOptions& options);
+ScanSummary scanCorpus(const ScanOptions& options, const std::vector<PnBank>& keys, const ScanCallback& onResult);
+
+std::string scanSummaryJson(const ScanSummary& summary);
@@ -0,0 +1,395 @@
+#include "scan_lease.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "payload.h"
+
+// ============================================================================
+// LEASED SCAN
+// Everything lives under <directory>/job, which the first process builds in
+// a private directory and publishes with one rename, so nobody ever sees a
+// half-written job:
+//
+//   job/manifest            copy of the manifest, one path per line
+//   job/pending/shard-N     unclaimed shards ("first count")
+//   job/leased/shard-N@W    shard claimed by worker W; mtime is the heartbeat
+//   job/done/shard-N        finished shards
+//   job/results/shard-N@W.jsonl
+//
+// Every state change is a rename, which is atomic on POSIX filesystems and
+// NFS: of several processes renaming the same file exactly one succeeds, the
+// rest get ENOENT and move on. The holder touches its lease every third of
+// the lease time; a lease whose mtime is older than that may be renamed to a
+// new owner. The old owner notices on its next touch and drops the shard.
+// Results are published before the lease is retired, so a shard can end up
+// scanned twice but never lost; the merge keeps one record per path.
+//
+// Lease ages compare mtimes written by different machines, so their clocks
+// must agree to well within the lease time.
+// ============================================================================
+
+namespace fs = std::filesystem;
+
+using FileClock = fs::file_time_type::clock;
+
+static fs::path jobPath(const std::string& directory) {
+  return fs::path(directory) / "job";
+}
+
+static std::string shardName(size_t index) {
+  char name[32];
+  std::snprintf(name, sizeof(name), "shard-%06zu", index);
+  return name;
+}
+
+static std::string sanitizeWorkerId(std::string id) {
+  for (char& c : id) {
+    if (c == '@' || c == '/' || c == '\\' || c == '.') c = '_';
+  }
+  return id.empty() ? "worker" : id;
+}
+
+static std::string defaultWorkerId() {
+  char host[256] = "host";
+#if defined(_WIN32)
+  const char* name = std::getenv("COMPUTERNAME");
+  if (name) std::snprintf(host, sizeof(host), "%s", name);
+  const long pid = static_cast<long>(_getpid());
+#else
+  if (gethostname(host, sizeof(host)) != 0) std::snprintf(host, sizeof(host), "host");
+  host[sizeof(host) - 1] = '\0';
+  const long pid = static_cast<long>(getpid());
+#endif
+  return sanitizeWorkerId(std::string(host) + "-" + std::to_string(pid));
+}
+
+static std::vector<std::string> readLines(const fs::path& path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) throw std::runtime_error("Failed to open " + path.string());
+  std::vector<std::string> lines;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (!line.empty()) lines.push_back(line);
+  }
+  return lines;
+}
+
+static void writeText(const fs::path& path, const std::string& text) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out << text;
+  out.flush();
+  if (!out) throw std::runtime_error("Failed to write " + path.string());
+}
+
+static bool touch(const fs::path& path) {
+  std::error_code ec;
+  fs::last_write_time(path, FileClock::now(), ec);
+  return !ec;
+}
+
+static std::vector<std::string> listNames(const fs::path& directory) {
+  std::vector<std::string> names;
+  std::error_code ec;
+  for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+    names.push_back(it->path().filename().string());
+  }
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+// ---------------------------------------------------------------------------
+// Job setup
+// ---------------------------------------------------------------------------
+
+static void ensureJob(const LeaseScanOptions& options, const std::string& workerId) {
+  const fs::path job = jobPath(options.directory);
+  if (fs::exists(job / "manifest")) return;
+  if (options.manifestPath.empty()) throw std::invalid_argument("No job in " + options.directory + " and no manifest given");
+  if (options.shardSize == 0) throw std::invalid_argument("shardSize must be positive");
+
+  const std::vector<std::string> paths = readLines(options.manifestPath);
+  const fs::path staging = fs::path(options.directory) / (".init-" + workerId);
+  fs::create_directories(options.directory);
+  fs::remove_all(staging);
+  for (const char* sub : { "pending", "leased", "done", "results" }) fs::create_directories(staging / sub);
+
+  std::string manifest;
+  for (const std::string& path : paths) manifest += path + "\n";
+  writeText(staging / "manifest", manifest);
+  for (size_t first = 0, index = 0; first < paths.size(); first += options.shardSize, index++) {
+    const size_t count = std::min(options.shardSize, paths.size() - first);
+    writeText(staging / "pending" / shardName(index), std::to_string(first) + " " + std::to_string(count) + "\n");
+  }
+
+  // Losing this race is fine: another process published the same job.
+  std::error_code ec;
+  fs::rename(staging, job, ec);
+  if (ec) {
+    fs::remove_all(staging);
+    if (!fs::exists(job / "manifest")) throw std::runtime_error("Failed to create job in " + options.directory + ": " + ec.message());
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Claiming
+// ---------------------------------------------------------------------------
+
+struct Lease {
+  std::string shard;  // shard-N
+  fs::path path;      // job/leased/shard-N@W
+  bool reclaimed = false;
+};
+
+static bool takeLease(const fs::path& from, const fs::path& job, const std::string& shard, const std::string& workerId, Lease& lease) {
+  const fs::path to = job / "leased" / (shard + "@" + workerId);
+  std::error_code ec;
+  fs::rename(from, to, ec);
+  if (ec) return false;
+  // rename keeps the old mtime; refresh it before anyone judges it stale.
+  if (!touch(to)) return false;
+  lease.shard = shard;
+  lease.path = to;
+  return true;
+}
+
+// Workers start at different offsets so they do not all race for the same
+// first shard.
+static bool claimPending(const fs::path& job, const std::string& workerId, size_t offset, Lease& lease) {
+  const std::vector<std::string> names = listNames(job / "pending");
+  for (size_t i = 0; i < names.size(); i++) {
+    const std::string& name = names[(offset + i) % names.size()];
+    if (takeLease(job / "pending" / name, job, name, workerId, lease)) return true;
+  }
+  return false;
+}
+
+static bool reclaimExpired(const fs::path& job, const std::string& workerId, int leaseSeconds, Lease& lease) {
+  for (const std::string& name : listNames(job / "leased")) {
+    const fs::path path = job / "leased" / name;
+    std::error_code ec;
+    const auto modified = fs::last_write_time(path, ec);
+    if (ec || FileClock::now() - modified < std::chrono::seconds(leaseSeconds)) continue;
+    const std::string shard = name.substr(0, name.find('@'));
+    if (takeLease(path, job, shard, workerId, lease)) {
+      lease.reclaimed = true;
+      return true;
+    }
+  }
+  return false;
+}
+
+static bool jobComplete(const fs::path& job) {
+  return listNames(job / "pending").empty() && listNames(job / "leased").empty();
+}
+
+// Touches the lease until stopped; flags `lost` if the lease disappears.
+class Heartbeat {
+ public:
+  Heartbeat(const fs::path& lease, int leaseSeconds, std::atomic<bool>& lost)
+    : thread_([this, lease, leaseSeconds, &lost]() {
+        const auto interval = std::chrono::milliseconds(std::max(100, leaseSeconds * 1000 / 3));
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!cv_.wait_for(lock, interval, [&]() { return done_; })) {
+          if (!touch(lease)) {
+            lost = true;
+            return;
+          }
+        }
+      }) {}
+
+  ~Heartbeat() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+  }
+
+ private:
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool done_ = false;
+  std::thread thread_;
+};
+
+// ---------------------------------------------------------------------------
+// Scan loop
+// ---------------------------------------------------------------------------
+
+static void addCounts(ScanSummary& total, const ScanSummary& part) {
+  total.scanned += part.scanned;
+  total.decoded += part.decoded;
+  total.rejected += part.rejected;
+  total.failed += part.failed;
+}
+
+LeaseScanSummary runLeaseScan(const LeaseScanOptions& options, const ScanCallback& onResult) {
+  if (options.directory.empty()) throw std::invalid_argument("A coordination directory is required");
+  if (options.leaseSeconds <= 0) throw std::invalid_argument("leaseSeconds must be positive");
+  const auto started = std::chrono::steady_clock::now();
+  const std::string workerId = options.workerId.empty() ? defaultWorkerId() : sanitizeWorkerId(options.workerId);
+
+  ensureJob(options, workerId);
+  const fs::path job = jobPath(options.directory);
+  const std::vector<std::string> manifest = readLines(job / "manifest");
+  const std::vector<PnBank> keys = buildScanKeys(options.scan);
+  const size_t offset = std::hash<std::string>()(workerId);
+  const auto poll = std::chrono::milliseconds(std::min(2000, std::max(100, options.leaseSeconds * 250)));
+
+  LeaseScanSummary summary;
+  while (true) {
+    Lease lease;
+    if (!claimPending(job, workerId, offset, lease) && !reclaimExpired(job, workerId, options.leaseSeconds, lease)) {
+      if (jobComplete(job)) break;
+      // Other workers hold live leases; wait in case one of them dies.
+      std::this_thread::sleep_for(poll);
+      continue;
+    }
+
+    size_t first = 0, count = 0;
+    {
+      std::ifstream in(lease.path);
+      in >> first >> count;
+    }
+    if (first > manifest.size()) first = manifest.size();
+    count = std::min(count, manifest.size() - first);
+
+    const std::string resultName = lease.shard + "@" + workerId;
+    const fs::path staged = job / "results" / ("." + resultName + ".tmp");
+    std::atomic<bool> lost{false};
+    ScanOptions scan = options.scan;
+    scan.inputs.assign(manifest.begin() + first, manifest.begin() + first + count);
+    scan.outputPath = staged.string();
+    scan.checkpointPath.clear();
+    scan.stop = &lost;
+
+    ScanSummary part;
+    {
+      Heartbeat heartbeat(lease.path, options.leaseSeconds, lost);
+      if (!scan.inputs.empty()) part = scanCorpus(scan, keys, onResult);
+      else writeText(staged, "");
+    }
+
+    std::error_code ec;
+    if (lost || !fs::exists(lease.path)) {
+      fs::remove(staged, ec);
+      summary.lost++;
+      continue;
+    }
+    fs::rename(staged, job / "results" / (resultName + ".jsonl"), ec);
+    if (ec) throw std::runtime_error("Failed to publish " + resultName + ": " + ec.message());
+    fs::rename(lease.path, job / "done" / lease.shard, ec);
+    addCounts(summary.scan, part);
+    summary.shards++;
+    if (lease.reclaimed) summary.reclaimed++;
+  }
+
+  summary.complete = true;
+  if (!options.reportPath.empty()) mergeLeaseScan(options.directory, options.reportPath);
+  summary.scan.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+  return summary;
+}
+
+// ---------------------------------------------------------------------------
+// Merge
+// ---------------------------------------------------------------------------
+
+// The JSON-encoded path at the start of a record, quotes included. Records
+// come from jsonString(), so comparing encoded forms needs no unescaping.
+static bool encodedPath(const std::string& line, std::string& out) {
+  static const std::string prefix = "{\"path\":\"";
+  if (line.compare(0, prefix.size(), prefix) != 0) return false;
+  for (size_t i = prefix.size(); i < line.size(); i++) {
+    if (line[i] == '\\') {
+      i++;
+    } else if (line[i] == '"') {
+      out = line.substr(prefix.size() - 1, i - prefix.size() + 2);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Duplicates come from shards scanned twice; prefer the most informative.
+static int recordRank(const std::string& line) {
+  if (line.find("\"error\":") != std::string::npos) return 0;
+  if (line.find("\"decoded\":true") != std::string::npos) return 2;
+  return 1;
+}
+
+size_t mergeLeaseScan(const std::string& directory, const std::string& reportPath) {
+  const fs::path job = jobPath(directory);
+  const std::vector<std::string> manifest = readLines(job / "manifest");
+
+  std::unordered_map<std::string, size_t> slots;
+  std::vector<std::string> records(manifest.size());
+  std::vector<int> ranks(manifest.size(), -1);
+  for (size_t i = 0; i < manifest.size(); i++) slots.emplace(jsonString(manifest[i]), i);
+
+  for (const std::string& name : listNames(job / "results")) {
+    if (name.size() < 6 || name.compare(name.size() - 6, 6, ".jsonl") != 0) continue;
+    for (const std::string& line : readLines(job / "results" / name)) {
+      std::string key;
+      if (!encodedPath(line, key)) continue;
+      // Directories listed in the manifest expand to paths of their own.
+      auto slot = slots.find(key);
+      if (slot == slots.end()) {
+        slot = slots.emplace(key, records.size()).first;
+        records.emplace_back();
+        ranks.push_back(-1);
+      }
+      const int rank = recordRank(line);
+      if (rank > ranks[slot->second]) {
+        ranks[slot->second] = rank;
+        records[slot->second] = line;
+      }
+    }
+  }
+
+  std::string report;
+  size_t written = 0;
+  for (const std::string& record : records) {
+    if (record.empty()) continue;
+    report += record + "\n";
+    written++;
+  }
+
+  // Several workers may merge at once; each publishes a complete file.
+  const fs::path staged = fs::path(reportPath + "." + defaultWorkerId() + ".tmp");
+  writeText(staged, report);
+  std::error_code ec;
+  fs::rename(staged, reportPath, ec);
+  if (ec) {
+    fs::remove(staged, ec);
+    throw std::runtime_error("Failed to write " + reportPath);
+  }
+  return written;
+}
+
+std::string leaseScanSummaryJson(const LeaseScanSummary& summary) {
+  std::string scan = scanSummaryJson(summary.scan);
+  return "{\"shards\":" + std::to_string(summary.shards) +
+    ",\"reclaimed\":" + std::to_string(summary.reclaimed) +
+    ",\"lost\":" + std::to_string(summary.lost) +
+    ",\"complete\":" + (summary.complete ? "true" : "false") +
+    "," + scan.substr(1);
+}
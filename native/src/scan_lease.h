@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include "scan.h"
+
+// Corpus scan shared by any number of processes, on one or many machines,
+// through a coordination directory on a shared filesystem. No process is
+// special: the first to arrive splits the manifest into shards, every process
+// then claims shards by renaming lease files, and whoever finds the last
+// shard done writes the merged report.
+
+struct LeaseScanOptions {
+  ScanOptions scan;              // keys and pipeline settings; inputs/output/checkpoint unused
+  std::string directory;         // coordination directory
+  std::string manifestPath;      // one file path per line; only needed by the first process
+  std::string workerId;          // defaults to host-pid
+  size_t shardSize = 256;        // manifest lines per shard
+  int leaseSeconds = 60;         // a lease not renewed for this long may be reclaimed
+  std::string reportPath;        // merged, deduplicated JSONL written once every shard is done
+};
+
+struct LeaseScanSummary {
+  size_t shards = 0;      // shards this process completed
+  size_t reclaimed = 0;   // of which were taken over from expired leases
+  size_t lost = 0;        // shards given up because another process reclaimed them
+  bool complete = false;  // every shard of the job is done
+  ScanSummary scan;       // totals over the files this process scanned
+};
+
+// Claims and scans shards until none is left, waiting on live leases of
+// other processes so that shards of crashed ones are reclaimed.
+LeaseScanSummary runLeaseScan(const LeaseScanOptions& options, const ScanCallback& onResult = nullptr);
+
+// Writes one record per manifest path from the shard results found in
+// `directory`, in manifest order. Returns the number of records written.
+size_t mergeLeaseScan(const std::string& directory, const std::string& reportPath);
+
+std::string leaseScanSummaryJson(const LeaseScanSummary& summary);
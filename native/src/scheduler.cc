@@ -0,0 +1,403 @@
+#include "scheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+// ============================================================================
+// SHARED WORK-STEALING SCHEDULER
+// One pool per process. Every addon call splits its block loop into chunks and
+// submits them here instead of spawning threads, so concurrent calls share the
+// cores instead of oversubscribing them.
+// ============================================================================
+
+struct TaskGroup {
+  std::mutex mutex;
+  std::condition_variable done;
+  size_t remaining = 0;
+  std::exception_ptr error;
+  bool workerWaits = false;           // a pool worker waits in helpUntilDone
+  std::atomic<bool> finished{false};  // set for those waiters only
+};
+
+struct Task {
+  const std::function<void(size_t, size_t)>* fn;
+  size_t begin;
+  size_t end;
+  TaskGroup* group;
+};
+
+struct WorkerQueue {
+  std::mutex mutex;
+  std::deque<Task> tasks[kJobPriorityCount];
+};
+
+class WorkStealingPool;
+
+static thread_local WorkStealingPool* tlsPool = nullptr;
+static thread_local int tlsWorkerIndex = -1;
+
+class WorkStealingPool {
+ public:
+  explicit WorkStealingPool(int threads) {
+    for (int i = 0; i < threads; i++) {
+      queues_.push_back(std::make_unique<WorkerQueue>());
+    }
+    for (int i = 0; i < threads; i++) {
+      threads_.emplace_back([this, i] { workerLoop(i); });
+    }
+  }
+
+  ~WorkStealingPool() {
+    {
+      std::lock_guard<std::mutex> lock(sleepMutex_);
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& t : threads_) t.join();
+  }
+
+  int size() const { return static_cast<int>(queues_.size()); }
+
+  void submit(const std::vector<Task>& tasks, JobPriority priority) {
+    const int p = static_cast<int>(priority);
+    const int n = size();
+    // Workers push onto their own deque (LIFO, cache friendly); external
+    // callers spread chunks round-robin so every worker has local work.
+    const bool local = tlsPool == this && tlsWorkerIndex >= 0;
+    size_t cursor = local ? static_cast<size_t>(tlsWorkerIndex) : submitCursor_.fetch_add(1);
+    // Count before publishing: a worker may pop (and decrement) a chunk the
+    // moment its queue is unlocked.
+    pending_[p].fetch_add(tasks.size());
+    for (const Task& task : tasks) {
+      WorkerQueue& q = *queues_[cursor % n];
+      {
+        std::lock_guard<std::mutex> lock(q.mutex);
+        q.tasks[p].push_back(task);
+      }
+      if (!local) cursor++;
+    }
+    {
+      std::lock_guard<std::mutex> lock(sleepMutex_);
+    }
+    wake_.notify_all();
+  }
+
+  // Runs at most one chunk; returns false when nothing was runnable.
+  bool runOne(int self) {
+    Task task{};
+    if (!tryPop(self, task)) return false;
+    execute(task);
+    return true;
+  }
+
+  // A worker waiting on a nested job keeps executing chunks meanwhile, and
+  // sleeps with the idle workers when there are none until either its job
+  // finishes or more work is submitted.
+  void helpUntilDone(TaskGroup& group, int self) {
+    while (!group.finished.load()) {
+      if (runOne(self)) continue;
+      std::unique_lock<std::mutex> lock(sleepMutex_);
+      wake_.wait(lock, [this, &group] { return group.finished.load() || hasPending(); });
+    }
+  }
+
+ private:
+  bool tryPop(int self, Task& out) {
+    const int n = size();
+    for (int p = 0; p < kJobPriorityCount; p++) {
+      if (pending_[p].load() == 0) continue;
+      // Own deque from the back, then steal from the front of the others.
+      if (self >= 0) {
+        WorkerQueue& own = *queues_[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks[p].empty()) {
+          out = own.tasks[p].back();
+          own.tasks[p].pop_back();
+          pending_[p].fetch_sub(1);
+          return true;
+        }
+      }
+      const int start = self >= 0 ? self + 1 : 0;
+      for (int k = 0; k < n; k++) {
+        WorkerQueue& victim = *queues_[(start + k) % n];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks[p].empty()) {
+          out = victim.tasks[p].front();
+          victim.tasks[p].pop_front();
+          pending_[p].fetch_sub(1);
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  void execute(const Task& task) {
+    std::exception_ptr error;
+    try {
+      (*task.fn)(task.begin, task.end);
+    } catch (...) {
+      error = std::current_exception();
+    }
+    TaskGroup& group = *task.group;
+    {
+      std::lock_guard<std::mutex> lock(group.mutex);
+      if (error && !group.error) group.error = error;
+      if (--group.remaining > 0) return;
+      if (!group.workerWaits) {
+        group.done.notify_all();
+        return;
+      }
+    }
+    // A helping worker does not take the group's mutex, so the flag is set
+    // only after it is released; the group may be gone right after.
+    group.finished.store(true);
+    {
+      std::lock_guard<std::mutex> lock(sleepMutex_);
+    }
+    wake_.notify_all();
+  }
+
+  bool hasPending() const {
+    for (int p = 0; p < kJobPriorityCount; p++) {
+      if (pending_[p].load() > 0) return true;
+    }
+    return false;
+  }
+
+  void workerLoop(int index) {
+    tlsPool = this;
+    tlsWorkerIndex = index;
+    while (true) {
+      if (runOne(index)) continue;
+      std::unique_lock<std::mutex> lock(sleepMutex_);
+      wake_.wait(lock, [this] { return stopping_ || hasPending(); });
+      if (stopping_ && !hasPending()) return;
+    }
+  }
+
+  std::vector<std::unique_ptr<WorkerQueue>> queues_;
+  std::vector<std::thread> threads_;
+  std::atomic<size_t> pending_[kJobPriorityCount] = {};
+  std::atomic<size_t> submitCursor_{0};
+  std::mutex sleepMutex_;
+  std::condition_variable wake_;
+  bool stopping_ = false;
+};
+
+// ----------------------------------------------------------------------------
+// CPU quota. Limits can sit on any ancestor of the process's own cgroup (a
+// container's slice, a systemd unit, a nested child), so the hierarchy is
+// walked from /proc/self/cgroup up to the mount root and the tightest quota
+// wins. Paths missing under the mount (e.g. outside a cgroup namespace) are
+// simply skipped.
+// ----------------------------------------------------------------------------
+
+// Whole CPUs allowed by quota/period, or 0 when unlimited or unreadable.
+static int cpusForQuota(long quota, long period) {
+  if (quota <= 0 || period <= 0) return 0;
+  return std::max(1, static_cast<int>(std::ceil(static_cast<double>(quota) / period)));
+}
+
+static int tighterLimit(int a, int b) {
+  if (a == 0) return b;
+  if (b == 0) return a;
+  return std::min(a, b);
+}
+
+// Calls visit(dir) for mount + path and every ancestor up to mount itself.
+template <typename Visit>
+static void walkCgroup(const std::string& mount, std::string path, Visit visit) {
+  while (!path.empty() && path.back() == '/') path.pop_back();
+  while (true) {
+    visit(mount + path);
+    if (path.empty()) return;
+    const size_t slash = path.rfind('/');
+    path.erase(slash == std::string::npos ? 0 : slash);
+  }
+}
+
+static int cgroupV2Limit(const std::string& path) {
+  int limit = 0;
+  walkCgroup("/sys/fs/cgroup", path, [&](const std::string& dir) {
+    std::ifstream file(dir + "/cpu.max");
+    std::string quotaText;
+    long period = 0;
+    if (!(file >> quotaText >> period) || quotaText == "max") return;
+    limit = tighterLimit(limit, cpusForQuota(std::atol(quotaText.c_str()), period));
+  });
+  return limit;
+}
+
+static int cgroupV1Limit(const std::string& path) {
+  int limit = 0;
+  for (const char* mount : { "/sys/fs/cgroup/cpu", "/sys/fs/cgroup/cpu,cpuacct" }) {
+    walkCgroup(mount, path, [&](const std::string& dir) {
+      std::ifstream quotaFile(dir + "/cpu.cfs_quota_us");
+      std::ifstream periodFile(dir + "/cpu.cfs_period_us");
+      long quota = -1;
+      long period = 0;
+      if (!(quotaFile >> quota) || !(periodFile >> period)) return;
+      limit = tighterLimit(limit, cpusForQuota(quota, period));
+    });
+    if (limit > 0) break;
+  }
+  return limit;
+}
+
+// Returns the number of whole CPUs the process's cgroup hierarchy allows
+// (v2 first, then the v1 cpu controller), or 0 when unlimited.
+static int cgroupCpuLimit() {
+  std::ifstream self("/proc/self/cgroup");
+  std::string v2Path;
+  std::string v1Path;
+  bool haveV2 = false;
+  bool haveV1 = false;
+  std::string line;
+  // Lines are "hierarchy-id:controller-list:path"; v2 is "0::path".
+  while (std::getline(self, line)) {
+    const size_t first = line.find(':');
+    const size_t second = first == std::string::npos ? first : line.find(':', first + 1);
+    if (second == std::string::npos) continue;
+    const std::string controllers = line.substr(first + 1, second - first - 1);
+    const std::string path = line.substr(second + 1);
+    if (line.compare(0, first, "0") == 0 && controllers.empty()) {
+      v2Path = path;
+      haveV2 = true;
+      continue;
+    }
+    std::istringstream list(controllers);
+    std::string controller;
+    while (std::getline(list, controller, ',')) {
+      if (controller == "cpu") {
+        v1Path = path;
+        haveV1 = true;
+      }
+    }
+  }
+  if (!self.is_open()) haveV2 = haveV1 = true;  // no procfs: still check the mount roots
+
+  int limit = 0;
+  if (haveV2) limit = cgroupV2Limit(v2Path);
+  if (limit == 0 && haveV1) limit = cgroupV1Limit(v1Path);
+  return limit;
+}
+
+int hardwareThreadCount() {
+  int count = static_cast<int>(std::thread::hardware_concurrency());
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    count = CPU_COUNT(&set);
+  }
+#endif
+  return std::max(1, count);
+}
+
+static int defaultThreadCount() {
+  if (const char* env = std::getenv("MUSMARK_THREADS")) {
+    const int requested = std::atoi(env);
+    if (requested > 0) return requested;
+  }
+  int threads = hardwareThreadCount();
+  const int limit = cgroupCpuLimit();
+  if (limit > 0) threads = std::min(threads, limit);
+  return threads;
+}
+
+static std::mutex gPoolMutex;
+static std::shared_ptr<WorkStealingPool> gPool;
+static std::atomic<int> gChunkBlocks{8};
+
+static std::shared_ptr<WorkStealingPool> acquirePool() {
+  std::lock_guard<std::mutex> lock(gPoolMutex);
+  if (!gPool) gPool = std::make_shared<WorkStealingPool>(defaultThreadCount());
+  return gPool;
+}
+
+void parallelFor(
+  size_t count,
+  size_t grain,
+  JobPriority priority,
+  const std::function<void(size_t, size_t)>& fn
+) {
+  if (count == 0) return;
+  grain = std::max<size_t>(1, grain);
+  if (count <= grain) {
+    fn(0, count);
+    return;
+  }
+
+  // Nested calls from a worker stay on that worker's pool; the outer caller
+  // already keeps it alive.
+  std::shared_ptr<WorkStealingPool> holder;
+  WorkStealingPool* pool = tlsPool;
+  if (!pool) {
+    holder = acquirePool();
+    pool = holder.get();
+  }
+
+  TaskGroup group;
+  std::vector<Task> tasks;
+  tasks.reserve((count + grain - 1) / grain);
+  for (size_t begin = 0; begin < count; begin += grain) {
+    tasks.push_back({ &fn, begin, std::min(count, begin + grain), &group });
+  }
+  group.remaining = tasks.size();
+  group.workerWaits = tlsPool == pool && tlsWorkerIndex >= 0;
+  pool->submit(tasks, priority);
+
+  if (group.workerWaits) {
+    pool->helpUntilDone(group, tlsWorkerIndex);
+  } else {
+    std::unique_lock<std::mutex> lock(group.mutex);
+    group.done.wait(lock, [&group] { return group.remaining == 0; });
+  }
+
+  if (group.error) std::rethrow_exception(group.error);
+}
+
+void setSchedulerThreads(int threads) {
+  std::shared_ptr<WorkStealingPool> previous;
+  {
+    std::lock_guard<std::mutex> lock(gPoolMutex);
+    previous = std::move(gPool);
+    gPool = std::make_shared<WorkStealingPool>(threads > 0 ? threads : defaultThreadCount());
+  }
+  // In-flight jobs hold their own reference; the old pool joins once they drain.
+}
+
+void setSchedulerChunkBlocks(int blocks) {
+  gChunkBlocks.store(std::max(1, blocks));
+}
+
+int schedulerChunkBlocks() {
+  return gChunkBlocks.load();
+}
+
+SchedulerInfo schedulerInfo() {
+  std::shared_ptr<WorkStealingPool> pool = acquirePool();
+  return { pool->size(), hardwareThreadCount(), cgroupCpuLimit(), gChunkBlocks.load() };
+}
+
+JobPriority parsePriority(const std::string& name, JobPriority fallback) {
+  if (name == "interactive") return JobPriority::Interactive;
+  if (name == "batch") return JobPriority::Batch;
+  return fallback;
+}
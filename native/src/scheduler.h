@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <functional>
+#include <string>
+
+// Priority classes for work submitted to the shared scheduler.
+// Workers always drain Interactive chunks before touching Batch chunks, so a
+// detect() request preempts background signing at chunk granularity.
+enum class JobPriority {
+  Interactive = 0,
+  Batch = 1,
+};
+
+constexpr int kJobPriorityCount = 2;
+
+struct SchedulerInfo {
+  int threads;
+  int hardwareThreads;
+  int cgroupLimit;  // 0 when no CPU quota applies
+  int chunkBlocks;
+};
+
+// Runs fn(begin, end) over [0, count) split into chunks of `grain` items on
+// the process-wide work-stealing pool and blocks until every chunk finished.
+// The first exception thrown by any chunk is rethrown in the caller.
+void parallelFor(
+  size_t count,
+  size_t grain,
+  JobPriority priority,
+  const std::function<void(size_t, size_t)>& fn
+);
+
+// Resizes the shared pool. 0 restores the default (cgroup/affinity aware).
+void setSchedulerThreads(int threads);
+// Number of blocks handed to a worker per task.
+void setSchedulerChunkBlocks(int blocks);
+int schedulerChunkBlocks();
+
+SchedulerInfo schedulerInfo();
+// CPUs this process may run on (affinity mask), ignoring cgroup quotas.
+int hardwareThreadCount();
+JobPriority parsePriority(const std::string& name, JobPriority fallback);
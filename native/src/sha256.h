@@ -0,0 +1,24 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Incremental SHA-256, used for payload hashes that must match the ones the
+// TypeScript layer computes with node:crypto.
+class Sha256 {
+ public:
+  Sha256();
+  void update(const void* data, size_t size);
+  void finish(uint8_t digest[32]);
+  std::string hexDigest();
+
+ private:
+  void compress(const uint8_t block[64]);
+
+  uint32_t state_[8];
+  uint8_t buffer_[64];
+  size_t bufferSize_;
+  uint64_t totalBytes_;
+};
+
+std::string sha256Hex(const void* data, size_t size);
@@ -0,0 +1,551 @@
+#include "sign_pipeline.h"
+#include <stdexcept>
+
+#include "audio_file.h"
+#include "wav.h"
+
+#if defined(_WIN32)
+
+bool canPipelineSign(const std::string&, const std::string&) {
+  return false;
+}
+
+PipelineStats embedWavFile(const std::string&, const std::string&, const PnBank&, const std::vector<uint8_t>&,
+    const std::vector<uint8_t>&, JobPriority) {
+  throw std::runtime_error("Pipelined signing is not available on Windows");
+}
+
+PipelineStats embedWavFile(const std::string&, const std::string&, const std::vector<uint8_t>&,
+    const std::vector<uint8_t>&, const EmbedConfig&) {
+  throw std::runtime_error("Pipelined signing is not available on Windows");
+}
+
+void embedIntoWavFile(float* samples, size_t frames, int channels, int sampleRate, const std::string& output,
+    const PnBank& bank, const std::vector<uint8_t>& bitstream, const std::vector<uint8_t>& removeBits,
+    JobPriority priority) {
+  embedInterleaved(samples, frames, channels, 0, bank, bitstream, removeBits, priority);
+  writeWav(output, WavData{ sampleRate, channels, std::vector<float>(samples, samples + frames * channels) });
+}
+
+#else
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define MUSMARK_HAVE_IO_URING 1
+#endif
+
+#include "fd_stream.h"
+
+// ============================================================================
+// SIGN PIPELINE
+// The caller's thread embeds; an I/O queue reads ahead and writes behind.
+// Each ring slot holds one window and is in exactly one state at a time
+// (free, reading, loaded, writing), so a slot is reused for window N+K only
+// after window N has reached the disk. Windows are whole blocks, and blocks
+// are embedded independently, which is what makes the result identical to
+// a whole-file embed.
+// ============================================================================
+
+constexpr size_t kRingSlots = 4;
+constexpr size_t kWindowBytes = 4 << 20;
+constexpr size_t kBufferAlign = 4096;
+
+struct IoRequest {
+  bool write = false;
+  int fd = -1;
+  char* data = nullptr;
+  size_t size = 0;
+  uint64_t offset = 0;
+  size_t slot = 0;
+};
+
+// Completes whole requests: short transfers are continued internally.
+class IoQueue {
+ public:
+  virtual ~IoQueue() = default;
+  virtual void submit(const IoRequest& request) = 0;
+  // Blocks until a request finishes and returns its slot; throws its error.
+  virtual size_t complete() = 0;
+};
+
+static std::runtime_error ioError(const IoRequest& request, int error) {
+  return std::runtime_error(std::string(request.write ? "Writing" : "Reading") + " audio failed: " +
+    std::strerror(error));
+}
+
+// ----------------------------------------------------------------------------
+// io_uring
+// ----------------------------------------------------------------------------
+
+#if defined(MUSMARK_HAVE_IO_URING)
+
+class IoUringQueue : public IoQueue {
+ public:
+  // Null when the kernel has no io_uring or refuses it (seccomp, sysctl).
+  static std::unique_ptr<IoUringQueue> create(unsigned entries) {
+    io_uring_params params{};
+    const int fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) return nullptr;
+    std::unique_ptr<IoUringQueue> queue(new IoUringQueue(fd));
+    if (!queue->map(params)) return nullptr;
+    return queue;
+  }
+
+  ~IoUringQueue() override {
+    // The kernel may still be reading into or out of the caller's buffers.
+    while (inFlight_ > 0) {
+      if (!reap(true)) break;
+    }
+    if (sqes_) ::munmap(sqes_, sqesSize_);
+    if (cqRing_ && cqRing_ != sqRing_) ::munmap(cqRing_, cqRingSize_);
+    if (sqRing_) ::munmap(sqRing_, sqRingSize_);
+    ::close(fd_);
+  }
+
+  void submit(const IoRequest& request) override {
+    Pending& pending = pending_[request.slot % kRingSlots];
+    pending.request = request;
+    pending.done = 0;
+    push(pending);
+  }
+
+  size_t complete() override {
+    for (;;) {
+      io_uring_cqe cqe;
+      if (!next(cqe)) {
+        enter(0, 1, IORING_ENTER_GETEVENTS);
+        continue;
+      }
+      inFlight_--;
+      Pending& pending = pending_[cqe.user_data % kRingSlots];
+      if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+        push(pending);
+        continue;
+      }
+      if (cqe.res < 0) throw ioError(pending.request, -cqe.res);
+      if (cqe.res == 0) throw std::runtime_error("Reading audio failed: unexpected end of file");
+      pending.done += static_cast<size_t>(cqe.res);
+      if (pending.done < pending.request.size) {
+        push(pending);
+        continue;
+      }
+      return pending.request.slot;
+    }
+  }
+
+ private:
+  struct Pending {
+    IoRequest request;
+    size_t done = 0;
+    iovec vector{};  // must live until the kernel consumes the request
+  };
+
+  explicit IoUringQueue(int fd) : fd_(fd) {}
+
+  bool map(const io_uring_params& params) {
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single) sqRingSize_ = cqRingSize_ = std::max(sqRingSize_, cqRingSize_);
+
+    void* sq = ::mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+    if (sq == MAP_FAILED) return false;
+    sqRing_ = static_cast<char*>(sq);
+    if (single) {
+      cqRing_ = sqRing_;
+    } else {
+      void* cq = ::mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+      if (cq == MAP_FAILED) return false;
+      cqRing_ = static_cast<char*>(cq);
+    }
+    sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = ::mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) return false;
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    sqTail_ = reinterpret_cast<unsigned*>(sqRing_ + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<unsigned*>(sqRing_ + params.sq_off.ring_mask);
+    sqArray_ = reinterpret_cast<unsigned*>(sqRing_ + params.sq_off.array);
+    cqHead_ = reinterpret_cast<unsigned*>(cqRing_ + params.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cqRing_ + params.cq_off.tail);
+    cqMask_ = *reinterpret_cast<unsigned*>(cqRing_ + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cqRing_ + params.cq_off.cqes);
+    return true;
+  }
+
+  // Queues the unfinished part of a request and hands it to the kernel.
+  void push(Pending& pending) {
+    const IoRequest& request = pending.request;
+    pending.vector.iov_base = request.data + pending.done;
+    pending.vector.iov_len = request.size - pending.done;
+
+    const unsigned tail = *sqTail_;
+    const unsigned index = tail & sqMask_;
+    io_uring_sqe& sqe = sqes_[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = request.write ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe.fd = request.fd;
+    sqe.addr = reinterpret_cast<uint64_t>(&pending.vector);
+    sqe.len = 1;
+    sqe.off = request.offset + pending.done;
+    sqe.user_data = request.slot;
+    sqArray_[index] = index;
+    __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+    inFlight_++;
+    enter(1, 0, 0);
+  }
+
+  bool next(io_uring_cqe& out) {
+    const unsigned head = *cqHead_;
+    if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) return false;
+    out = cqes_[head & cqMask_];
+    __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  // Drops one completion during teardown; false if the ring is unusable.
+  bool reap(bool wait) {
+    io_uring_cqe cqe;
+    while (!next(cqe)) {
+      if (!wait || ::syscall(__NR_io_uring_enter, fd_, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0) {
+        if (errno != EINTR) return false;
+      }
+    }
+    inFlight_--;
+    return true;
+  }
+
+  void enter(unsigned submit, unsigned wait, unsigned flags) {
+    while (::syscall(__NR_io_uring_enter, fd_, submit, wait, flags, nullptr, 0) < 0) {
+      if (errno != EINTR && errno != EAGAIN) throw std::runtime_error(std::string("io_uring_enter failed: ") + std::strerror(errno));
+    }
+  }
+
+  int fd_;
+  char* sqRing_ = nullptr;
+  char* cqRing_ = nullptr;
+  io_uring_sqe* sqes_ = nullptr;
+  size_t sqRingSize_ = 0;
+  size_t cqRingSize_ = 0;
+  size_t sqesSize_ = 0;
+  unsigned* sqTail_ = nullptr;
+  unsigned sqMask_ = 0;
+  unsigned* sqArray_ = nullptr;
+  unsigned* cqHead_ = nullptr;
+  unsigned* cqTail_ = nullptr;
+  unsigned cqMask_ = 0;
+  io_uring_cqe* cqes_ = nullptr;
+  size_t inFlight_ = 0;
+  Pending pending_[kRingSlots];
+};
+
+#endif
+
+// ----------------------------------------------------------------------------
+// Thread fallback
+// ----------------------------------------------------------------------------
+
+// One reader and one writer thread, so a slow write never holds up the next
+// read.
+class ThreadIoQueue : public IoQueue {
+ public:
+  ThreadIoQueue() {
+    reader_ = std::thread([this]() { serve(reads_); });
+    writer_ = std::thread([this]() { serve(writes_); });
+  }
+
+  ~ThreadIoQueue() override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    work_.notify_all();
+    reader_.join();
+    writer_.join();
+  }
+
+  void submit(const IoRequest& request) override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      (request.write ? writes_ : reads_).push_back(request);
+    }
+    work_.notify_all();
+  }
+
+  size_t complete() override {
+    std::unique_lock<std::mutex> lock(mutex_);
+    finished_.wait(lock, [this]() { return !done_.empty(); });
+    const Done done = done_.front();
+    done_.pop_front();
+    if (done.error) std::rethrow_exception(done.error);
+    return done.slot;
+  }
+
+ private:
+  struct Done {
+    size_t slot;
+    std::exception_ptr error;
+  };
+
+  // Runs queued requests until stopped; requests still queued then are dropped.
+  void serve(std::deque<IoRequest>& queue) {
+    for (;;) {
+      IoRequest request;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        work_.wait(lock, [&]() { return stopping_ || !queue.empty(); });
+        if (stopping_) return;
+        request = queue.front();
+        queue.pop_front();
+      }
+      std::exception_ptr error;
+      try {
+        transfer(request);
+      } catch (...) {
+        error = std::current_exception();
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_.push_back({ request.slot, error });
+      }
+      finished_.notify_one();
+    }
+  }
+
+  static void transfer(const IoRequest& request) {
+    size_t done = 0;
+    while (done < request.size) {
+      const off_t at = static_cast<off_t>(request.offset + done);
+      const ssize_t n = request.write ? ::pwrite(request.fd, request.data + done, request.size - done, at)
+                                      : ::pread(request.fd, request.data + done, request.size - done, at);
+      if (n < 0 && errno == EINTR) continue;
+      if (n < 0) throw ioError(request, errno);
+      if (n == 0) throw std::runtime_error("Reading audio failed: unexpected end of file");
+      done += static_cast<size_t>(n);
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable work_;
+  std::condition_variable finished_;
+  std::deque<IoRequest> reads_;
+  std::deque<IoRequest> writes_;
+  std::deque<Done> done_;
+  bool stopping_ = false;
+  std::thread reader_;
+  std::thread writer_;
+};
+
+static std::unique_ptr<IoQueue> openIoQueue(bool& ioUring) {
+#if defined(MUSMARK_HAVE_IO_URING)
+  const char* setting = std::getenv("MUSMARK_IO_URING");
+  if (!setting || std::strcmp(setting, "0") != 0) {
+    if (std::unique_ptr<IoUringQueue> queue = IoUringQueue::create(2 * kRingSlots)) {
+      ioUring = true;
+      return queue;
+    }
+  }
+#endif
+  ioUring = false;
+  return std::make_unique<ThreadIoQueue>();
+}
+
+// ----------------------------------------------------------------------------
+// Pipeline
+// ----------------------------------------------------------------------------
+
+struct AlignedBuffer {
+  char* data = nullptr;
+  explicit AlignedBuffer(size_t size) {
+    void* memory = nullptr;
+    if (posix_memalign(&memory, kBufferAlign, std::max(size, kBufferAlign)) != 0) throw std::bad_alloc();
+    data = static_cast<char*>(memory);
+  }
+  ~AlignedBuffer() { std::free(data); }
+  AlignedBuffer(const AlignedBuffer&) = delete;
+  AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+};
+
+bool canPipelineSign(const std::string& input, const std::string& output) {
+  if (hasFlacExtension(output)) return false;
+  try {
+    if (sniffAudioFile(input) != AudioContainer::Wav) return false;
+    readWavLayout(input);
+    return true;
+  } catch (const std::exception&) {
+    return false;
+  }
+}
+
+// Output descriptor with everything but the samples already in place.
+static int openOutput(const std::string& input, const std::string& output, int in, const WavLayout& layout) {
+  std::error_code ec;
+  if (std::filesystem::equivalent(input, output, ec)) {
+    // In place: only the samples change.
+    const int out = ::open(output.c_str(), O_WRONLY | O_CLOEXEC);
+    if (out < 0) throw std::runtime_error("Failed to open output WAV file");
+    return out;
+  }
+  OwnedFd out(::open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+  if (out.fd < 0) throw std::runtime_error("Failed to open output WAV file");
+
+  struct stat info{};
+  if (::fstat(in, &info) != 0) throw std::runtime_error("Failed to open WAV file");
+  const uint64_t dataEnd = layout.dataOffset + layout.dataSize;
+  const uint64_t fileSize = static_cast<uint64_t>(info.st_size);
+  copyFdRange(in, 0, out.fd, layout.dataOffset);
+  preallocateFd(out.fd, layout.dataOffset, layout.dataSize);
+  if (fileSize > dataEnd) {
+    if (::lseek(out.fd, static_cast<off_t>(dataEnd), SEEK_SET) < 0) throw std::runtime_error("Failed to seek output WAV file");
+    copyFdRange(in, dataEnd, out.fd, fileSize - dataEnd);
+  }
+  const int descriptor = out.fd;
+  out.fd = -1;
+  return descriptor;
+}
+
+PipelineStats embedWavFile(
+  const std::string& input,
+  const std::string& output,
+  const PnBank& bank,
+  const std::vector<uint8_t>& bitstream,
+  const std::vector<uint8_t>& removeBits,
+  JobPriority priority
+) {
+  if (bitstream.empty()) throw std::runtime_error("Empty bitstream");
+  const WavLayout layout = readWavLayout(input);
+  OwnedFd in(::open(input.c_str(), O_RDONLY | O_CLOEXEC));
+  if (in.fd < 0) throw std::runtime_error("Failed to open WAV file");
+  OwnedFd out(openOutput(input, output, in.fd, layout));
+
+  const size_t channels = static_cast<size_t>(layout.channels);
+  const size_t frameBytes = channels * sizeof(float);
+  const size_t samplesPerBit = bank[0].size();
+  const size_t blockBytes = samplesPerBit * frameBytes;
+  const size_t windowFrames = std::max<size_t>(1, kWindowBytes / blockBytes) * samplesPerBit;
+  const size_t totalFrames = static_cast<size_t>(layout.dataSize / frameBytes);
+  const size_t windowCount = (totalFrames + windowFrames - 1) / windowFrames;
+
+  // Declared before the queue so the kernel is done with them before they go.
+  std::vector<std::unique_ptr<AlignedBuffer>> buffers;
+  for (size_t i = 0; i < std::min(kRingSlots, windowCount); i++) {
+    buffers.push_back(std::make_unique<AlignedBuffer>(windowFrames * frameBytes));
+  }
+  PipelineStats stats;
+  stats.windows = windowCount;
+  std::unique_ptr<IoQueue> queue = openIoQueue(stats.ioUring);
+
+  enum class Slot { Free, Reading, Loaded, Writing };
+  Slot state[kRingSlots] = { Slot::Free, Slot::Free, Slot::Free, Slot::Free };
+  auto request = [&](size_t window, bool write) {
+    const size_t first = window * windowFrames;
+    const size_t frames = std::min(windowFrames, totalFrames - first);
+    IoRequest r;
+    r.write = write;
+    r.fd = write ? out.fd : in.fd;
+    r.data = buffers[window % kRingSlots]->data;
+    r.size = frames * frameBytes;
+    r.offset = layout.dataOffset + first * frameBytes;
+    r.slot = window % kRingSlots;
+    queue->submit(r);
+  };
+  auto settle = [&](size_t slot) {
+    state[slot] = state[slot] == Slot::Reading ? Slot::Loaded : Slot::Free;
+  };
+
+  size_t nextRead = 0;
+  auto readAhead = [&](size_t current) {
+    while (nextRead < windowCount && nextRead < current + kRingSlots && state[nextRead % kRingSlots] == Slot::Free) {
+      state[nextRead % kRingSlots] = Slot::Reading;
+      request(nextRead++, false);
+    }
+  };
+
+  for (size_t window = 0; window < windowCount; window++) {
+    const size_t slot = window % kRingSlots;
+    readAhead(window);
+    while (state[slot] != Slot::Loaded) {
+      settle(queue->complete());
+      readAhead(window);
+    }
+    const size_t first = window * windowFrames;
+    const size_t frames = std::min(windowFrames, totalFrames - first);
+    embedInterleaved(reinterpret_cast<float*>(buffers[slot]->data), frames, static_cast<int>(channels),
+      first / samplesPerBit, bank, bitstream, removeBits, priority);
+    state[slot] = Slot::Writing;
+    request(window, true);
+  }
+  for (size_t slot = 0; slot < kRingSlots; slot++) {
+    while (state[slot] == Slot::Writing) settle(queue->complete());
+  }
+  queue.reset();
+  if (!out.close()) throw std::runtime_error("Failed to write output WAV file");
+  return stats;
+}
+
+PipelineStats embedWavFile(
+  const std::string& input,
+  const std::string& output,
+  const std::vector<uint8_t>& bitstream,
+  const std::vector<uint8_t>& removeBits,
+  const EmbedConfig& config
+) {
+  if (bitstream.empty()) throw std::runtime_error("Empty bitstream");
+  const PnBank bank = buildPnBank(
+    hashSecret(config.secret), static_cast<int>(bitstream.size()), samplesPerBitFor(config.hopSize), config.priority);
+  return embedWavFile(input, output, bank, bitstream, removeBits, config.priority);
+}
+
+void embedIntoWavFile(
+  float* samples,
+  size_t frames,
+  int channels,
+  int sampleRate,
+  const std::string& output,
+  const PnBank& bank,
+  const std::vector<uint8_t>& bitstream,
+  const std::vector<uint8_t>& removeBits,
+  JobPriority priority
+) {
+  WavRangeWriter writer(output, sampleRate, channels, frames);
+  embedInterleavedRanges(samples, frames, channels, 0, bank, bitstream, removeBits, priority,
+    [&](size_t first, size_t count) { writer.write(first, samples + first * channels, count); });
+  writer.finish();
+}
+
+#endif
+
+void embedIntoWavFile(
+  WavData& wav,
+  const std::string& output,
+  const std::vector<uint8_t>& bitstream,
+  const std::vector<uint8_t>& removeBits,
+  const EmbedConfig& config
+) {
+  if (bitstream.empty()) throw std::runtime_error("Empty bitstream");
+  if (wav.channels <= 0) throw std::runtime_error("Invalid channel count");
+  const PnBank bank = buildPnBank(
+    hashSecret(config.secret), static_cast<int>(bitstream.size()), samplesPerBitFor(config.hopSize), config.priority);
+  embedIntoWavFile(wav.samples.data(), wav.samples.size() / wav.channels, wav.channels, wav.sampleRate, output, bank,
+    bitstream, removeBits, config.priority);
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "engine.h"
+
+// Signing a float WAV file into a float WAV file without holding it in
+// memory: the samples move through a small ring of aligned window buffers,
+// and reading window N+1, embedding window N and writing window N-1 overlap,
+// so throughput is bounded by the slower of the disk and the embedder rather
+// than their sum. On Linux the reads and writes go through io_uring (raw
+// syscalls, no liburing); where io_uring is unavailable or refused, or when
+// $MUSMARK_IO_URING is "0", two I/O threads issue pread/pwrite instead.
+// Every chunk other than the samples is copied from the input unchanged,
+// and signing a file onto itself rewrites only its samples. The output is
+// identical to reading, embedding and writing the whole file. Not available
+// on Windows.
+
+// True when `input` is a 32-bit float WAV and `output` is not FLAC, i.e. the
+// pipeline can take the job; everything else goes through the whole-file
+// path.
+bool canPipelineSign(const std::string& input, const std::string& output);
+
+struct PipelineStats {
+  size_t windows = 0;
+  bool ioUring = false;  // false when the thread fallback ran
+};
+
+PipelineStats embedWavFile(
+  const std::string& input,
+  const std::string& output,
+  const PnBank& bank,
+  const std::vector<uint8_t>& bitstream,
+  const std::vector<uint8_t>& removeBits,
+  JobPriority priority
+);
+
+// Same with the bank built from `config`, as embedWatermarkSamples does.
+PipelineStats embedWavFile(
+  const std::string& input,
+  const std::string& output,
+  const std::vector<uint8_t>& bitstream,
+  const std::vector<uint8_t>& removeBits,
+  const EmbedConfig& config
+);
+
+// For audio already in memory (decoded FLAC, a stream): embeds the samples
+// in place and writes them as float WAV to `output`, each finished block
+// range going to its offset in the preallocated file from the thread that
+// embedded it, so writing overlaps embedding. On Windows the file is written
+// once embedding is done.
+void embedIntoWavFile(
+  float* samples,
+  size_t frames,
+  int channels,
+  int sampleRate,
+  const std::string& output,
+  const PnBank& bank,
+  const std::vector<uint8_t>& bitstream,
+  const std::vector<uint8_t>& removeBits,
+  JobPriority priority
+);
+
+void embedIntoWavFile(
+  WavData& wav,
+  const std::string& output,
+  const std::vector<uint8_t>& bitstream,
+  const std::vector<uint8_t>& removeBits,
+  const EmbedConfig& config
+);
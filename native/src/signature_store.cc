@@ -0,0 +1,520 @@
+#include "signature_store.h"
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+#if defined(_WIN32)
+
+SignatureStore::SignatureStore(const std::string&) {
+  throw std::runtime_error("The signature store is not available on Windows");
+}
+SignatureStore::~SignatureStore() {}
+void SignatureStore::put(const std::string&, const std::string&, const std::string&) {}
+StoredSignature SignatureStore::get(const std::string&) { return {}; }
+std::vector<StoredSignature> SignatureStore::getMany(const std::vector<std::string>& ids) {
+  return std::vector<StoredSignature>(ids.size());
+}
+size_t SignatureStore::size() { return 0; }
+
+std::shared_ptr<SignatureStore> openSignatureStore(const std::string& directory) {
+  return std::make_shared<SignatureStore>(directory);
+}
+
+#else
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "payload.h"
+
+// ============================================================================
+// SIGNATURE STORE
+// signatures.log is the source of truth: records are only ever appended,
+// each with a checksum, and synced before put() returns. signatures.idx maps
+// id -> log offset with linear probing at a load factor of at most 1/2; it
+// remembers how much of the log it covers (moved only after the slots below
+// it are synced), so records appended by a process
+// that died before indexing them are replayed by the next writer, and a
+// missing or damaged index is rebuilt from the log.
+//
+// Writers serialize on an exclusive flock of the log. Readers never lock:
+// a slot publishes its id before its offset, so a probe sees either an
+// empty slot or a complete one. Growing the index writes a new file, renames
+// it into place and marks the old mapping retired, which tells readers in
+// other processes to remap.
+// ============================================================================
+
+namespace fs = std::filesystem;
+
+constexpr char kIndexMagic[8] = { 'M', 'M', 'S', 'I', 'D', 'X', '1', '\0' };
+constexpr uint32_t kRecordMagic = 0x5253534d;  // "MSSR"
+constexpr uint64_t kMinCapacity = 1024;
+
+struct IndexHeader {
+  char magic[8];
+  uint64_t capacity;       // slots, power of two
+  uint64_t count;          // distinct ids
+  uint64_t indexedLength;  // log bytes reflected in the slots
+  uint32_t retired;        // set on the old file once a grown index replaced it
+  uint32_t reserved;
+  uint64_t pad[3];
+};
+
+struct IndexSlot {
+  uint8_t id[16];
+  uint64_t offset;  // log offset + 1; 0 = empty
+};
+
+struct RecordHeader {
+  uint32_t magic;
+  uint32_t length;  // payload JSON bytes following the header
+  uint8_t id[16];
+  char payloadHash[64];
+  uint32_t checksum;
+  uint32_t reserved;
+};
+
+static_assert(sizeof(IndexHeader) == 64, "index header layout changed");
+static_assert(sizeof(IndexSlot) == 24, "index slot layout changed");
+static_assert(sizeof(RecordHeader) == 96, "record header layout changed");
+
+struct LogEntry {
+  uint8_t id[16];
+  uint64_t offset;
+};
+
+static uint32_t recordChecksum(const RecordHeader& header, const char* body) {
+  uint32_t hash = 2166136261u;
+  auto mix = [&](const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) hash = (hash ^ bytes[i]) * 16777619u;
+  };
+  mix(header.id, sizeof(header.id));
+  mix(header.payloadHash, sizeof(header.payloadHash));
+  mix(body, header.length);
+  return hash;
+}
+
+static uint64_t slotHash(const uint8_t* id) {
+  uint64_t hi, lo;
+  std::memcpy(&hi, id, 8);
+  std::memcpy(&lo, id + 8, 8);
+  uint64_t h = hi ^ (lo * 0x9e3779b97f4a7c15ULL);
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return h;
+}
+
+static IndexHeader* headerOf(uint8_t* map) {
+  return reinterpret_cast<IndexHeader*>(map);
+}
+
+static IndexSlot* slotsOf(uint8_t* map) {
+  return reinterpret_cast<IndexSlot*>(map + sizeof(IndexHeader));
+}
+
+static void insertSlot(uint8_t* map, const uint8_t* id, uint64_t offset) {
+  IndexHeader* header = headerOf(map);
+  IndexSlot* slots = slotsOf(map);
+  const uint64_t mask = header->capacity - 1;
+  for (uint64_t i = slotHash(id) & mask;; i = (i + 1) & mask) {
+    IndexSlot& slot = slots[i];
+    if (__atomic_load_n(&slot.offset, __ATOMIC_ACQUIRE) == 0) {
+      std::memcpy(slot.id, id, sizeof(slot.id));
+      __atomic_store_n(&slot.offset, offset + 1, __ATOMIC_RELEASE);
+      header->count++;
+      return;
+    }
+    if (std::memcmp(slot.id, id, sizeof(slot.id)) == 0) {
+      __atomic_store_n(&slot.offset, offset + 1, __ATOMIC_RELEASE);
+      return;
+    }
+  }
+}
+
+// Moves indexedLength to `length` once the slots written for the records
+// below it are on disk. Otherwise writeback could persist the header first,
+// and after a crash replay would start past records no slot points to.
+static void publishIndexedLength(uint8_t* map, size_t size, uint64_t length) {
+  IndexHeader* header = headerOf(map);
+  if (header->indexedLength == length) return;
+  if (msync(map, size, MS_SYNC) != 0) {
+    throw std::runtime_error(std::string("Signature store index sync failed: ") + std::strerror(errno));
+  }
+  header->indexedLength = length;
+}
+
+static bool preadAll(int fd, void* data, size_t size, uint64_t offset) {
+  uint8_t* bytes = static_cast<uint8_t*>(data);
+  while (size > 0) {
+    const ssize_t n = pread(fd, bytes, size, static_cast<off_t>(offset));
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    bytes += n;
+    size -= static_cast<size_t>(n);
+    offset += static_cast<uint64_t>(n);
+  }
+  return true;
+}
+
+static void pwriteAll(int fd, const void* data, size_t size, uint64_t offset) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  while (size > 0) {
+    const ssize_t n = pwrite(fd, bytes, size, static_cast<off_t>(offset));
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) throw std::runtime_error(std::string("Signature store write failed: ") + std::strerror(errno));
+    bytes += n;
+    size -= static_cast<size_t>(n);
+    offset += static_cast<uint64_t>(n);
+  }
+}
+
+static void syncFd(int fd) {
+#if defined(__APPLE__)
+  const int rc = fsync(fd);
+#else
+  const int rc = fdatasync(fd);
+#endif
+  if (rc != 0) throw std::runtime_error(std::string("Signature store sync failed: ") + std::strerror(errno));
+}
+
+static uint64_t fileSize(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) != 0) throw std::runtime_error(std::string("Signature store stat failed: ") + std::strerror(errno));
+  return static_cast<uint64_t>(st.st_size);
+}
+
+// Collects valid records from `from` on and returns where they end; what
+// follows, if anything, is a torn append or damage (see cutTornTail).
+static uint64_t scanLog(int fd, uint64_t from, std::vector<LogEntry>& entries) {
+  const uint64_t size = fileSize(fd);
+  uint64_t offset = from;
+  std::string body;
+  while (offset + sizeof(RecordHeader) <= size) {
+    RecordHeader header;
+    if (!preadAll(fd, &header, sizeof(header), offset) || header.magic != kRecordMagic) break;
+    if (offset + sizeof(header) + header.length > size) break;
+    body.resize(header.length);
+    if (!preadAll(fd, &body[0], header.length, offset + sizeof(header))) break;
+    if (recordChecksum(header, body.data()) != header.checksum) break;
+    LogEntry entry;
+    std::memcpy(entry.id, header.id, sizeof(entry.id));
+    entry.offset = offset;
+    entries.push_back(entry);
+    offset += sizeof(header) + header.length;
+  }
+  return offset;
+}
+
+// True when the bytes from `end` on can only be an append that was cut short:
+// too few for a header, one record that runs to or past EOF, or the zeros of
+// an extension whose data never reached the disk. Each put() appends a single
+// record, so a crash leaves at most one such record behind.
+static bool isTornTail(int fd, uint64_t end) {
+  const uint64_t size = fileSize(fd);
+  if (size - end < sizeof(RecordHeader)) return true;
+  RecordHeader header;
+  if (preadAll(fd, &header, sizeof(header), end) && header.magic == kRecordMagic &&
+      end + sizeof(header) + header.length >= size) {
+    return true;
+  }
+  std::vector<uint8_t> chunk(1 << 16);
+  for (uint64_t offset = end; offset < size; offset += chunk.size()) {
+    const size_t n = static_cast<size_t>(std::min<uint64_t>(chunk.size(), size - offset));
+    if (!preadAll(fd, chunk.data(), n, offset)) return false;
+    if (std::any_of(chunk.begin(), chunk.begin() + n, [](uint8_t b) { return b != 0; })) return false;
+  }
+  return true;
+}
+
+// Cuts the log back to `end`, the last valid record, when what follows is a
+// torn append. Anything else is damage in the middle of the log: truncating
+// would drop every valid record after it, so the store refuses to open.
+static void cutTornTail(int fd, uint64_t end) {
+  if (fileSize(fd) <= end) return;
+  if (!isTornTail(fd, end)) {
+    throw std::runtime_error("Signature store log is corrupt at offset " + std::to_string(end) +
+      "; valid records may follow, so it was left untouched");
+  }
+  if (ftruncate(fd, static_cast<off_t>(end)) != 0) {
+    throw std::runtime_error(std::string("Signature store truncate failed: ") + std::strerror(errno));
+  }
+}
+
+class FileLock {
+ public:
+  FileLock(int fd, int operation) : fd_(fd) {
+    while (flock(fd_, operation) != 0) {
+      if (errno != EINTR) throw std::runtime_error(std::string("Signature store lock failed: ") + std::strerror(errno));
+    }
+  }
+  ~FileLock() { flock(fd_, LOCK_UN); }
+
+ private:
+  int fd_;
+};
+
+// ---------------------------------------------------------------------------
+// Index files
+// ---------------------------------------------------------------------------
+
+static std::string logPath(const std::string& directory) {
+  return (fs::path(directory) / "signatures.log").string();
+}
+
+static std::string indexPath(const std::string& directory) {
+  return (fs::path(directory) / "signatures.idx").string();
+}
+
+void SignatureStore::unmapIndex() {
+  if (map_) munmap(map_, mapSize_);
+  if (indexFd_ >= 0) close(indexFd_);
+  map_ = nullptr;
+  mapSize_ = 0;
+  indexFd_ = -1;
+}
+
+// Maps whatever index file is current; false if it is missing or invalid.
+bool SignatureStore::mapIndex() {
+  unmapIndex();
+  const int fd = open(indexPath(directory_).c_str(), O_RDWR | O_CLOEXEC);
+  if (fd < 0) return false;
+  const uint64_t size = fileSize(fd);
+  void* map = size >= sizeof(IndexHeader)
+    ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+    : MAP_FAILED;
+  if (map == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
+  const IndexHeader* header = static_cast<const IndexHeader*>(map);
+  const bool valid = std::memcmp(header->magic, kIndexMagic, sizeof(kIndexMagic)) == 0 &&
+    header->capacity >= kMinCapacity && (header->capacity & (header->capacity - 1)) == 0 &&
+    size == sizeof(IndexHeader) + header->capacity * sizeof(IndexSlot) && !header->retired;
+  if (!valid) {
+    munmap(map, size);
+    close(fd);
+    return false;
+  }
+  indexFd_ = fd;
+  map_ = static_cast<uint8_t*>(map);
+  mapSize_ = size;
+  return true;
+}
+
+// Writes a fresh index, from the whole log or from the current slots, and
+// renames it into place. Caller holds the log lock.
+void SignatureStore::rebuildIndex(uint64_t capacity, bool fromLog) {
+  std::vector<LogEntry> entries;
+  uint64_t indexedLength = 0;
+  if (fromLog) {
+    indexedLength = scanLog(logFd_, 0, entries);
+    cutTornTail(logFd_, indexedLength);
+  } else {
+    const IndexHeader* header = headerOf(map_);
+    const IndexSlot* slots = slotsOf(map_);
+    for (uint64_t i = 0; i < header->capacity; i++) {
+      if (slots[i].offset == 0) continue;
+      LogEntry entry;
+      std::memcpy(entry.id, slots[i].id, sizeof(entry.id));
+      entry.offset = slots[i].offset - 1;
+      entries.push_back(entry);
+    }
+    indexedLength = header->indexedLength;
+  }
+  while (capacity < kMinCapacity || capacity < entries.size() * 2 + 2) capacity *= 2;
+
+  const std::string finalPath = indexPath(directory_);
+  const std::string tempPath = finalPath + ".tmp." + std::to_string(getpid());
+  const int fd = open(tempPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) throw std::runtime_error("Failed to create " + tempPath);
+  const size_t size = sizeof(IndexHeader) + capacity * sizeof(IndexSlot);
+  void* map = ftruncate(fd, static_cast<off_t>(size)) == 0
+    ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+    : MAP_FAILED;
+  if (map == MAP_FAILED) {
+    close(fd);
+    unlink(tempPath.c_str());
+    throw std::runtime_error("Failed to map " + tempPath);
+  }
+
+  uint8_t* fresh = static_cast<uint8_t*>(map);
+  IndexHeader* header = headerOf(fresh);
+  std::memcpy(header->magic, kIndexMagic, sizeof(kIndexMagic));
+  header->capacity = capacity;
+  header->indexedLength = indexedLength;
+  for (const LogEntry& entry : entries) insertSlot(fresh, entry.id, entry.offset);
+  msync(fresh, size, MS_SYNC);
+
+  if (rename(tempPath.c_str(), finalPath.c_str()) != 0) {
+    munmap(fresh, size);
+    close(fd);
+    unlink(tempPath.c_str());
+    throw std::runtime_error("Failed to install " + finalPath);
+  }
+  if (map_) __atomic_store_n(&headerOf(map_)->retired, 1u, __ATOMIC_RELEASE);
+  unmapIndex();
+  indexFd_ = fd;
+  map_ = fresh;
+  mapSize_ = size;
+}
+
+// Indexes records past indexedLength and cuts off a torn tail. Caller holds
+// the log lock, so no append is in flight.
+void SignatureStore::replayLog() {
+  IndexHeader* header = headerOf(map_);
+  std::vector<LogEntry> entries;
+  const uint64_t end = scanLog(logFd_, header->indexedLength, entries);
+  cutTornTail(logFd_, end);
+  for (const LogEntry& entry : entries) insert(entry.id, entry.offset);
+  publishIndexedLength(map_, mapSize_, end);
+}
+
+void SignatureStore::insert(const uint8_t* id, uint64_t offset) {
+  const IndexHeader* header = headerOf(map_);
+  if ((header->count + 1) * 2 > header->capacity) rebuildIndex(header->capacity * 2, false);
+  insertSlot(map_, id, offset);
+}
+
+// True when another process grew the index or appended records it has not
+// indexed yet (it died, or is appending right now).
+bool SignatureStore::isStale() {
+  const IndexHeader* header = headerOf(map_);
+  return __atomic_load_n(&header->retired, __ATOMIC_ACQUIRE) != 0 || fileSize(logFd_) > header->indexedLength;
+}
+
+void SignatureStore::catchUp() {
+  FileLock lock(logFd_, LOCK_EX);
+  if (headerOf(map_)->retired && !mapIndex()) rebuildIndex(kMinCapacity, true);
+  replayLog();
+}
+
+uint64_t SignatureStore::probe(const uint8_t* id) const {
+  const IndexHeader* header = headerOf(map_);
+  const IndexSlot* slots = slotsOf(map_);
+  const uint64_t mask = header->capacity - 1;
+  for (uint64_t i = slotHash(id) & mask;; i = (i + 1) & mask) {
+    const uint64_t offset = __atomic_load_n(&slots[i].offset, __ATOMIC_ACQUIRE);
+    if (offset == 0) return 0;
+    if (std::memcmp(slots[i].id, id, sizeof(slots[i].id)) == 0) return offset;
+  }
+}
+
+StoredSignature SignatureStore::readRecord(uint64_t offset, const uint8_t* id) const {
+  StoredSignature result;
+  RecordHeader header;
+  if (!preadAll(logFd_, &header, sizeof(header), offset)) return result;
+  if (header.magic != kRecordMagic || std::memcmp(header.id, id, sizeof(header.id)) != 0) return result;
+  result.payloadJson.resize(header.length);
+  if (!preadAll(logFd_, &result.payloadJson[0], header.length, offset + sizeof(header))) return StoredSignature();
+  result.payloadHash.assign(header.payloadHash, sizeof(header.payloadHash));
+  result.found = true;
+  return result;
+}
+
+// ---------------------------------------------------------------------------
+// Public interface
+// ---------------------------------------------------------------------------
+
+SignatureStore::SignatureStore(const std::string& directory) : directory_(directory) {
+  fs::create_directories(directory);
+  logFd_ = open(logPath(directory).c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (logFd_ < 0) throw std::runtime_error("Failed to open " + logPath(directory));
+  try {
+    FileLock lock(logFd_, LOCK_EX);
+    if (!mapIndex()) rebuildIndex(kMinCapacity, true);
+    replayLog();
+  } catch (...) {
+    unmapIndex();
+    close(logFd_);
+    throw;
+  }
+}
+
+SignatureStore::~SignatureStore() {
+  unmapIndex();
+  if (logFd_ >= 0) close(logFd_);
+}
+
+void SignatureStore::put(const std::string& signatureId, const std::string& payloadJson, const std::string& payloadHash) {
+  if (!isSignatureId(signatureId)) throw std::invalid_argument("Invalid signature id: " + signatureId);
+  if (payloadHash.size() != 64) throw std::invalid_argument("payloadHash must be a SHA-256 hex digest");
+
+  RecordHeader header{};
+  header.magic = kRecordMagic;
+  header.length = static_cast<uint32_t>(payloadJson.size());
+  const std::vector<uint8_t> id = uuidToBytes(signatureId);
+  std::memcpy(header.id, id.data(), sizeof(header.id));
+  std::memcpy(header.payloadHash, payloadHash.data(), sizeof(header.payloadHash));
+  header.checksum = recordChecksum(header, payloadJson.data());
+  std::string record(reinterpret_cast<const char*>(&header), sizeof(header));
+  record += payloadJson;
+
+  std::unique_lock<std::shared_mutex> guard(mutex_);
+  FileLock lock(logFd_, LOCK_EX);
+  if (headerOf(map_)->retired && !mapIndex()) rebuildIndex(kMinCapacity, true);
+  replayLog();
+  const uint64_t offset = headerOf(map_)->indexedLength;
+  pwriteAll(logFd_, record.data(), record.size(), offset);
+  syncFd(logFd_);
+  insert(header.id, offset);
+  publishIndexedLength(map_, mapSize_, offset + record.size());
+}
+
+StoredSignature SignatureStore::get(const std::string& signatureId) {
+  return getMany({ signatureId })[0];
+}
+
+std::vector<StoredSignature> SignatureStore::getMany(const std::vector<std::string>& signatureIds) {
+  bool stale;
+  {
+    std::shared_lock<std::shared_mutex> guard(mutex_);
+    stale = isStale();
+  }
+  if (stale) {
+    std::unique_lock<std::shared_mutex> guard(mutex_);
+    catchUp();
+  }
+
+  std::shared_lock<std::shared_mutex> guard(mutex_);
+  std::vector<std::pair<uint64_t, size_t>> hits;
+  std::vector<std::vector<uint8_t>> ids(signatureIds.size());
+  for (size_t i = 0; i < signatureIds.size(); i++) {
+    if (!isSignatureId(signatureIds[i])) continue;
+    ids[i] = uuidToBytes(signatureIds[i]);
+    const uint64_t offset = probe(ids[i].data());
+    if (offset) hits.emplace_back(offset - 1, i);
+  }
+  std::sort(hits.begin(), hits.end());
+
+  std::vector<StoredSignature> results(signatureIds.size());
+  for (const auto& hit : hits) results[hit.second] = readRecord(hit.first, ids[hit.second].data());
+  return results;
+}
+
+size_t SignatureStore::size() {
+  std::shared_lock<std::shared_mutex> guard(mutex_);
+  return static_cast<size_t>(headerOf(map_)->count);
+}
+
+std::shared_ptr<SignatureStore> openSignatureStore(const std::string& directory) {
+  static std::mutex registryMutex;
+  static std::map<std::string, std::shared_ptr<SignatureStore>> registry;
+  const std::string key = fs::weakly_canonical(fs::absolute(directory)).string();
+  std::lock_guard<std::mutex> lock(registryMutex);
+  std::shared_ptr<SignatureStore>& store = registry[key];
+  if (!store) store = std::make_shared<SignatureStore>(directory);
+  return store;
+}
+
+#endif
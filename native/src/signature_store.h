@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+// Embedded signature database: an append-only log of payload records plus a
+// memory-mapped open-addressing index keyed by the 16 signature-id bytes.
+// sign() appends, detect() and scans look ids up without leaving the
+// process. Several processes may share one store directory. POSIX only.
+
+struct StoredSignature {
+  bool found = false;
+  std::string payloadJson;  // as written by sign()
+  std::string payloadHash;
+};
+
+class SignatureStore {
+ public:
+  // Opens `directory`, creating it if needed.
+  explicit SignatureStore(const std::string& directory);
+  ~SignatureStore();
+  SignatureStore(const SignatureStore&) = delete;
+  SignatureStore& operator=(const SignatureStore&) = delete;
+
+  // Durable on return. A later put of the same id supersedes earlier ones.
+  void put(const std::string& signatureId, const std::string& payloadJson, const std::string& payloadHash);
+
+  StoredSignature get(const std::string& signatureId);
+  // Results in input order; log reads are issued in file order.
+  std::vector<StoredSignature> getMany(const std::vector<std::string>& signatureIds);
+
+  size_t size();
+
+ private:
+  bool mapIndex();
+  void unmapIndex();
+  void rebuildIndex(uint64_t capacity, bool fromLog);
+  void replayLog();
+  void insert(const uint8_t* id, uint64_t offset);
+  bool isStale();
+  void catchUp();
+  uint64_t probe(const uint8_t* id) const;
+  StoredSignature readRecord(uint64_t offset, const uint8_t* id) const;
+
+  std::string directory_;
+  int logFd_ = -1;
+  int indexFd_ = -1;
+  uint8_t* map_ = nullptr;
+  size_t mapSize_ = 0;
+  std::shared_mutex mutex_;
+};
+
+// One shared instance per directory, so every caller in the process reuses
+// the same descriptors and mapping.
+std::shared_ptr<SignatureStore> openSignatureStore(const std::string& directory);
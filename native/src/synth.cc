@@ -0,0 +1,336 @@
+#include "synth.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+#include "engine.h"
+
+// ============================================================================
+// SYNTHETIC PROGRAM MATERIAL
+// A section is planned as a list of voices (a set of partials and/or a noise
+// source under one envelope and pan) from a generator seeded with the seed
+// and the section index. Chunks of output render the voices that overlap
+// them; oscillators are complex phasors started at the chunk's phase, and
+// noise is a hash of the frame index, so nothing carries from one chunk to
+// the next.
+// ============================================================================
+
+constexpr double kSectionSeconds = 0.5;
+constexpr uint64_t kPhraseSections = 8;
+constexpr size_t kChunkFrames = 1 << 15;
+constexpr double kReleaseSeconds = 0.01;
+constexpr double kNoiseFloor = 0.002;  // about -54 dBFS under everything but silence
+constexpr double kSpeechShare = 0.4;   // of phrases in mixed programs
+constexpr double kProgramLevel = 1.6;  // about -20 dBFS RMS, peaks near -6 dBFS
+
+struct Voice {
+  size_t start = 0;  // absolute frame
+  size_t length = 0;
+  bool syllable = false;  // sin^2 over the length; otherwise attack, then exponential decay
+  double attackFrames = 1.0;
+  double decay = 1.0;     // per frame
+  double pan = 0.5;       // 0 = first channel, 1 = last
+  std::vector<std::pair<double, double>> partials;  // radians per frame, amplitude
+  double noise = 0.0;
+  bool bright = false;    // differenced noise (fricatives, hats) instead of smoothed
+  uint64_t noiseSeed = 0;
+};
+
+static uint64_t splitMix(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+static uint64_t mixSeed(uint64_t seed, uint64_t stream, uint64_t index) {
+  return splitMix(seed ^ splitMix(stream ^ splitMix(index)));
+}
+
+// Uniform in [-1, 1), a pure function of (seed, index).
+static double whiteAt(uint64_t seed, uint64_t index) {
+  return static_cast<double>(splitMix(seed ^ splitMix(index)) >> 11) * (2.0 / 9007199254740992.0) - 1.0;
+}
+
+static double uniform(XorShift64& rng, double low, double high) {
+  return low + (high - low) * rng.nextDouble();
+}
+
+static double midiToHz(double note) {
+  return 440.0 * std::pow(2.0, (note - 69.0) / 12.0);
+}
+
+// ----------------------------------------------------------------------------
+// Section plans
+// ----------------------------------------------------------------------------
+
+struct SectionContext {
+  const SynthOptions& options;
+  size_t sectionFrames;
+  size_t totalFrames;
+};
+
+static void addHarmonics(Voice& voice, double f0, int count, double amplitude, double brightness, int sampleRate) {
+  double level = amplitude;
+  for (int k = 1; k <= count; k++) {
+    const double hz = f0 * k;
+    if (hz >= 0.45 * sampleRate) break;
+    voice.partials.push_back({ 2.0 * kPi * hz / sampleRate, level / k });
+    level *= brightness;
+  }
+}
+
+static double decayPerFrame(double seconds, int sampleRate) {
+  return std::exp(-1.0 / (seconds * sampleRate));
+}
+
+static void planMusic(const SectionContext& ctx, uint64_t section, XorShift64& rng, XorShift64& phrase,
+    std::vector<Voice>& voices) {
+  const int rate = ctx.options.sampleRate;
+  const size_t start = section * ctx.sectionFrames;
+  const size_t end = std::min(start + ctx.sectionFrames, ctx.totalFrames);
+
+  static const int kMajor[] = { 0, 2, 4, 5, 7, 9, 11 };
+  static const int kMinor[] = { 0, 2, 3, 5, 7, 8, 10 };
+  const double root = 40 + phrase.nextInt(12);
+  const int* scale = phrase.nextInt(2) == 0 ? kMajor : kMinor;
+  const double brightness = uniform(phrase, 0.55, 0.85);
+
+  const int degree = rng.nextInt(7);
+  const int notes = 3 + rng.nextInt(2);
+  for (int n = 0; n < notes; n++) {
+    const int step = degree + 2 * n;
+    Voice note;
+    note.start = start;
+    note.length = end - start;
+    note.attackFrames = uniform(rng, 0.003, 0.03) * rate;
+    note.decay = decayPerFrame(uniform(rng, 0.3, 1.5), rate);
+    note.pan = uniform(rng, 0.2, 0.8);
+    addHarmonics(note, midiToHz(root + 24 + scale[step % 7] + 12 * (step / 7)), 10, 0.07, brightness, rate);
+    voices.push_back(std::move(note));
+  }
+
+  Voice bass;
+  bass.start = start;
+  bass.length = end - start;
+  bass.attackFrames = 0.01 * rate;
+  bass.decay = decayPerFrame(0.4, rate);
+  addHarmonics(bass, midiToHz(root + scale[degree]), 4, 0.12, 0.5, rate);
+  voices.push_back(std::move(bass));
+
+  // A kick or snare on the beat and a hat on the off-beat.
+  if (rng.nextDouble() < 0.8) {
+    Voice drum;
+    drum.start = start;
+    drum.length = std::min<size_t>(static_cast<size_t>(0.2 * rate), end - start);
+    drum.attackFrames = 0.001 * rate;
+    drum.decay = decayPerFrame(0.04, rate);
+    drum.noise = 0.2;
+    drum.bright = section % 2 == 1;
+    drum.noiseSeed = mixSeed(ctx.options.seed, 1, section);
+    voices.push_back(std::move(drum));
+  }
+  const size_t offBeat = start + ctx.sectionFrames / 2;
+  if (offBeat < end && rng.nextDouble() < 0.7) {
+    Voice hat;
+    hat.start = offBeat;
+    hat.length = std::min<size_t>(static_cast<size_t>(0.08 * rate), end - offBeat);
+    hat.attackFrames = 0.0005 * rate;
+    hat.decay = decayPerFrame(0.015, rate);
+    hat.pan = uniform(rng, 0.3, 0.7);
+    hat.noise = 0.05;
+    hat.bright = true;
+    hat.noiseSeed = mixSeed(ctx.options.seed, 2, section);
+    voices.push_back(std::move(hat));
+  }
+}
+
+static void planSpeech(const SectionContext& ctx, uint64_t section, XorShift64& rng, XorShift64& phrase,
+    std::vector<Voice>& voices) {
+  const int rate = ctx.options.sampleRate;
+  const double speakerF0 = uniform(phrase, 95.0, 220.0);
+  const double pan = uniform(phrase, 0.4, 0.6);
+  const size_t start = section * ctx.sectionFrames;
+  const size_t end = std::min(start + ctx.sectionFrames, ctx.totalFrames);
+  const size_t slot = ctx.sectionFrames / 2;
+
+  for (size_t s = 0; s < 2; s++) {
+    Voice syllable;
+    syllable.start = start + s * slot + static_cast<size_t>(uniform(rng, 0.0, 0.1) * slot);
+    if (syllable.start >= end) break;
+    syllable.length = std::min<size_t>(static_cast<size_t>(uniform(rng, 0.6, 0.9) * slot), end - syllable.start);
+    syllable.syllable = true;
+    syllable.pan = pan;
+    if (rng.nextDouble() < 0.2) {
+      syllable.noise = 0.06;
+      syllable.bright = true;
+      syllable.noiseSeed = mixSeed(ctx.options.seed, 3, section * 2 + s);
+    } else {
+      // Harmonics of the voice weighted by three formant resonances.
+      const double f0 = speakerF0 * uniform(rng, 0.9, 1.15);
+      const double formants[3] = { uniform(rng, 300.0, 800.0), uniform(rng, 900.0, 2400.0), uniform(rng, 2500.0, 3200.0) };
+      const double widths[3] = { 90.0, 120.0, 160.0 };
+      const double gains[3] = { 1.0, 0.6, 0.3 };
+      for (int k = 1; f0 * k < std::min(4000.0, 0.45 * rate); k++) {
+        const double hz = f0 * k;
+        double weight = 0.05;
+        for (int f = 0; f < 3; f++) {
+          const double x = (hz - formants[f]) / widths[f];
+          weight += gains[f] * std::exp(-0.5 * x * x);
+        }
+        syllable.partials.push_back({ 2.0 * kPi * hz / rate, 0.12 * weight / std::sqrt(static_cast<double>(k)) });
+      }
+    }
+    voices.push_back(std::move(syllable));
+  }
+}
+
+static std::vector<Voice> planSection(const SectionContext& ctx, uint64_t section) {
+  std::vector<Voice> voices;
+  XorShift64 rng(mixSeed(ctx.options.seed, 0, section));
+  if (rng.nextDouble() < ctx.options.silence) return voices;
+
+  const uint64_t phraseIndex = section / kPhraseSections;
+  XorShift64 phrase(mixSeed(ctx.options.seed, 4, phraseIndex));
+  bool speech = ctx.options.program == SynthProgram::Speech;
+  if (ctx.options.program == SynthProgram::Mixed) speech = phrase.nextDouble() < kSpeechShare;
+  if (speech) {
+    planSpeech(ctx, section, rng, phrase, voices);
+  } else {
+    planMusic(ctx, section, rng, phrase, voices);
+  }
+  return voices;
+}
+
+// ----------------------------------------------------------------------------
+// Rendering
+// ----------------------------------------------------------------------------
+
+static std::vector<double> panGains(double pan, int channels) {
+  std::vector<double> gains(channels, 1.0);
+  if (channels == 1) return gains;
+  for (int c = 0; c < channels; c++) {
+    const double distance = std::fabs(pan - static_cast<double>(c) / (channels - 1));
+    gains[c] = std::cos(0.5 * kPi * std::min(1.0, distance));
+  }
+  return gains;
+}
+
+// Adds the part of `voice` inside [first, first + frames) to `out`, which
+// holds those frames interleaved.
+static void renderVoice(const Voice& voice, size_t first, size_t frames, int channels, float* out,
+    std::vector<double>& sum, double releaseFrames) {
+  const size_t from = std::max(first, voice.start);
+  const size_t to = std::min(first + frames, voice.start + voice.length);
+  if (from >= to) return;
+  const size_t n = to - from;
+  const size_t t0 = from - voice.start;
+
+  sum.assign(n, 0.0);
+  for (const auto& partial : voice.partials) {
+    const double w = partial.first;
+    double re = std::cos(w * t0);
+    double im = std::sin(w * t0);
+    const double rotRe = std::cos(w);
+    const double rotIm = std::sin(w);
+    for (size_t i = 0; i < n; i++) {
+      sum[i] += partial.second * im;
+      const double nextRe = re * rotRe - im * rotIm;
+      im = re * rotIm + im * rotRe;
+      re = nextRe;
+    }
+  }
+  if (voice.noise > 0.0) {
+    const uint64_t at = voice.start + t0;
+    double previous = whiteAt(voice.noiseSeed, at - 1);
+    double older = whiteAt(voice.noiseSeed, at - 2);
+    for (size_t i = 0; i < n; i++) {
+      const double white = whiteAt(voice.noiseSeed, at + i);
+      sum[i] += voice.noise * (voice.bright ? 0.5 * (white - previous) : (white + previous + older) / 3.0);
+      older = previous;
+      previous = white;
+    }
+  }
+
+  double decay = std::pow(voice.decay, static_cast<double>(t0));
+  const std::vector<double> gains = panGains(voice.pan, channels);
+  for (size_t i = 0; i < n; i++) {
+    const double t = static_cast<double>(t0 + i);
+    double envelope;
+    if (voice.syllable) {
+      const double s = std::sin(kPi * t / voice.length);
+      envelope = s * s;
+    } else {
+      envelope = std::min(1.0, t / voice.attackFrames) * decay;
+      decay *= voice.decay;
+      envelope *= std::min(1.0, (static_cast<double>(voice.length) - t) / releaseFrames);
+    }
+    const double value = kProgramLevel * sum[i] * envelope;
+    float* frame = out + (from - first + i) * channels;
+    for (int c = 0; c < channels; c++) frame[c] += static_cast<float>(value * gains[c]);
+  }
+}
+
+bool parseSynthProgram(const std::string& name, SynthProgram& program) {
+  if (name == "music") program = SynthProgram::Music;
+  else if (name == "speech") program = SynthProgram::Speech;
+  else if (name == "mixed") program = SynthProgram::Mixed;
+  else return false;
+  return true;
+}
+
+const char* synthProgramName(SynthProgram program) {
+  switch (program) {
+    case SynthProgram::Music: return "music";
+    case SynthProgram::Speech: return "speech";
+    case SynthProgram::Mixed: return "mixed";
+  }
+  return "mixed";
+}
+
+WavData synthesizeAudio(const SynthOptions& options, JobPriority priority) {
+  if (!(options.seconds >= 0.0)) throw std::runtime_error("Synthetic audio length must not be negative");
+  if (options.sampleRate < 8000 || options.sampleRate > 384000) throw std::runtime_error("Unsupported sample rate");
+  if (options.channels < 1 || options.channels > 32) throw std::runtime_error("Unsupported channel count");
+
+  WavData wav;
+  wav.sampleRate = options.sampleRate;
+  wav.channels = options.channels;
+  const size_t frames = static_cast<size_t>(std::llround(options.seconds * options.sampleRate));
+  wav.samples.assign(frames * options.channels, 0.0f);
+
+  const SectionContext ctx{ options, static_cast<size_t>(kSectionSeconds * options.sampleRate), frames };
+  const double releaseFrames = kReleaseSeconds * options.sampleRate;
+  const size_t chunks = (frames + kChunkFrames - 1) / kChunkFrames;
+  parallelFor(chunks, 1, priority, [&](size_t begin, size_t end) {
+    std::vector<double> sum;
+    for (size_t chunk = begin; chunk < end; chunk++) {
+      const size_t first = chunk * kChunkFrames;
+      const size_t count = std::min(kChunkFrames, frames - first);
+      float* out = wav.samples.data() + first * options.channels;
+
+      const uint64_t firstSection = first / ctx.sectionFrames;
+      const uint64_t lastSection = (first + count - 1) / ctx.sectionFrames;
+      for (uint64_t section = firstSection; section <= lastSection; section++) {
+        const std::vector<Voice> voices = planSection(ctx, section);
+        if (voices.empty()) continue;  // a silence gap: digital zero, no noise floor
+        for (const Voice& voice : voices) renderVoice(voice, first, count, options.channels, out, sum, releaseFrames);
+
+        // Smoothed noise floor, independent per channel.
+        const size_t from = std::max<size_t>(first, section * ctx.sectionFrames);
+        const size_t to = std::min<size_t>(first + count, (section + 1) * ctx.sectionFrames);
+        for (int c = 0; c < options.channels; c++) {
+          const uint64_t seed = mixSeed(options.seed, 5, static_cast<uint64_t>(c));
+          double previous = whiteAt(seed, from - 1);
+          for (size_t i = from; i < to; i++) {
+            const double white = whiteAt(seed, i);
+            out[(i - first) * options.channels + c] += static_cast<float>(kNoiseFloor * 0.5 * (white + previous));
+            previous = white;
+          }
+        }
+      }
+    }
+  });
+  return wav;
+}
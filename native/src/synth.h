@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include "scheduler.h"
+#include "wav.h"
+
+// Reproducible synthetic program material for benchmarks and robustness
+// runs that should not depend on real recordings. The signal is laid out in
+// half-second sections; each section is music (a decaying chord over a bass
+// note with a drum hit), speech (two voiced or unvoiced syllables shaped by
+// formants) or a silence gap, drawn from the seed and the section index
+// alone. Every sample is a function of (seed, position), so the output is
+// identical whatever the thread count or chunking, and any length can be
+// generated in parallel.
+
+enum class SynthProgram {
+  Music,
+  Speech,
+  Mixed,  // phrases of music and speech alternating at random
+};
+
+struct SynthOptions {
+  double seconds = 30.0;
+  int sampleRate = 44100;
+  int channels = 2;
+  uint64_t seed = 1;
+  SynthProgram program = SynthProgram::Mixed;
+  double silence = 0.05;  // fraction of sections that are silence gaps
+};
+
+bool parseSynthProgram(const std::string& name, SynthProgram& program);
+const char* synthProgramName(SynthProgram program);
+
+WavData synthesizeAudio(const SynthOptions& options, JobPriority priority = JobPriority::Batch);
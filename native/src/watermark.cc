@@ -1,315 +1,480 @@
 #include <napi.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
 #include <vector>
 #include <string>
-#include <cmath>
-#include <algorithm>
-#include <array>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <utility>
 
-constexpr double kPi = 3.14159265358979323846;
+#include "musmark.h"
+#include "attacks.h"
+#include "audio_file.h"
+#include "detection_cache.h"
+#include "master_cache.h"
+#include "media_decoder.h"
+#include "mp3_frames.h"
+#include "scan.h"
+#include "scan_lease.h"
+#include "scheduler.h"
+#include "signature_store.h"
+#include "sign_pipeline.h"
+#include "synth.h"
 #include "wav.h"
-#include "fft.h"
+#include "kernels.h"
+#include "cpu.h"
+#include "wisdom.h"
 
 // ============================================================================
-// PSYCHOACOUSTIC MASKING MODEL - ISO/IEC 11172-3 (MPEG-1 Audio Layer III)
-// Makes watermark truly imperceptible by embedding only in masked frequencies
+// N-API front end over libmusmark
+// Embedding and extraction go through the C API in musmark.h; this file only
+// converts JS arguments and results and runs the calls off the event loop.
 // ============================================================================
 
-struct XorShift64 {
-  uint64_t state;
-  explicit XorShift64(uint64_t seed) : state(seed ? seed : 0x9e3779b97f4a7c15ULL) {}
-  uint64_t next() {
-    uint64_t x = state;
-    x ^= x << 13;
-    x ^= x >> 7;
-    x ^= x << 17;
-    state = x;
-    return x;
-  }
-  double nextDouble() {
-    return (next() >> 11) * (1.0 / 9007199254740992.0);
+// One deliverable of a sign() with several outputs.
+struct OutputTarget {
+  std::string path;
+  musmark_audio_format format;
+  int bitsPerSample;
+};
+
+// Everything the embed job needs, copied out of the JS arguments on the main
+// thread so the work itself can run off the event loop.
+struct EmbedRequest {
+  std::string inputPath;
+  std::string outputPath;
+  std::vector<OutputTarget> targets;  // set instead of outputPath for several outputs
+  std::vector<uint8_t> bitstream;
+  std::vector<uint8_t> removeBits;
+  int sampleRate;
+  int channels;
+  int blockSize;
+  int hopSize;
+  std::string secret;
+  double embedStrength;
+  double rotationSeconds;
+  JobPriority priority;
+};
+
+// A recording opened with openAudio(): downmixed once, then shared by every
+// extract and triage call that is handed it.
+struct OpenedAudio {
+  std::shared_ptr<musmark_analysis> analysis;
+  std::string contentHash;
+  std::string cacheHash;  // contentHash, plus the decode rate for lossy files
+  int sampleRate = 0;
+  int channels = 0;
+  size_t frames = 0;
+};
+
+// What JS holds. close() drops the audio early; calls already queued keep
+// their own reference.
+struct AudioHandleBox {
+  std::shared_ptr<const OpenedAudio> audio;
+};
+
+struct ExtractRequest {
+  std::string inputPath;
+  std::shared_ptr<const OpenedAudio> audio;  // used instead of inputPath when set
+  int sampleRate;
+  int channels;
+  int blockSize;
+  int hopSize;
+  std::string secret;
+  double embedStrength;
+  JobPriority priority;
+  bool cache;
+  bool hasDeadline = false;  // anytime extraction, set from deadlineMs
+  std::chrono::steady_clock::time_point deadline;
+};
+
+struct ExtractOutput {
+  std::vector<uint8_t> bits;
+  std::vector<float> correlations;
+  double bitConfidence;
+  double bandAgreement;
+  size_t blocksAnalyzed;
+  bool finished;
+  size_t periodsAnalyzed;
+  size_t periodCount;
+};
+
+static void check(musmark_status status) {
+  if (status != MUSMARK_OK) throw std::runtime_error(musmark_last_error());
+}
+
+// A key holds the PN bank for one secret (~15 MB at the default hop size),
+// so the few most recently used are kept warm across calls.
+constexpr size_t kKeyCacheSize = 4;
+
+static std::shared_ptr<musmark_key> acquireKey(const std::string& secret, int hopSize) {
+  using Entry = std::pair<std::pair<std::string, int>, std::shared_ptr<musmark_key>>;
+  static std::mutex mutex;
+  static std::list<Entry> cache;
+
+  std::lock_guard<std::mutex> lock(mutex);
+  for (auto it = cache.begin(); it != cache.end(); ++it) {
+    if (it->first.first == secret && it->first.second == hopSize) {
+      cache.splice(cache.begin(), cache, it);
+      return it->second;
+    }
   }
-  int nextInt(int maxValue) {
-    return static_cast<int>(next() % static_cast<uint64_t>(maxValue));
+
+  musmark_key* raw = nullptr;
+  check(musmark_key_create(secret.data(), secret.size(), hopSize, &raw));
+  std::shared_ptr<musmark_key> key(raw, musmark_key_destroy);
+  cache.emplace_front(std::make_pair(secret, hopSize), key);
+  if (cache.size() > kKeyCacheSize) cache.pop_back();
+  return key;
+}
+
+struct AudioFile {
+  musmark_audio audio{};
+  AudioFile() { audio.size = sizeof(audio); }
+  ~AudioFile() { musmark_audio_free(&audio); }
+};
+
+struct ExtractionResult {
+  musmark_extraction extraction{};
+  ExtractionResult() { extraction.size = sizeof(extraction); }
+  ~ExtractionResult() { musmark_extraction_free(&extraction); }
+};
+
+static musmark_priority toCPriority(JobPriority priority) {
+  return priority == JobPriority::Batch ? MUSMARK_PRIORITY_BATCH : MUSMARK_PRIORITY_INTERACTIVE;
+}
+
+// WAV or FLAC; FLAC frames are decoded in parallel at the request's priority.
+static void readAudio(const std::string& path, int sampleRate, int channels, JobPriority priority, AudioFile& file) {
+  check(musmark_audio_read(path.c_str(), toCPriority(priority), &file.audio));
+  if (file.audio.sample_rate != sampleRate || file.audio.channels != channels) {
+    throw std::runtime_error("Unexpected audio format");
   }
+}
+
+// The master being signed: read through the C API, or taken from the master
+// cache when that is enabled, in which case `cached` owns the samples and
+// `view` describes them.
+struct SigningSource {
+  AudioFile file;
+  WavData cached{};
+  musmark_audio view{};
+  musmark_audio* audio = &file.audio;
 };
 
-static uint64_t hashSecret(const std::string& secret) {
-  uint64_t hash = 1469598103934665603ULL;
-  for (char c : secret) {
-    hash ^= static_cast<uint64_t>(static_cast<unsigned char>(c));
-    hash *= 1099511628211ULL;
-  }
-  return hash;
-}
-
-// Convert frequency (Hz) to Bark scale (critical band rate)
-static double freqToBark(double freq) {
-  return 13.0 * std::atan(0.00076 * freq) + 3.5 * std::atan(std::pow(freq / 7500.0, 2.0));
-}
-
-// Calculate absolute threshold of hearing (ATH) in dB SPL
-// Based on ISO 226 equal-loudness contours
-static double absoluteThresholdOfHearing(double freqHz) {
-  const double f = freqHz / 1000.0;
-  if (f < 0.02) return 100.0;
-  if (f > 20.0) return 100.0;
-  // Terhardt formula approximation
-  return 3.64 * std::pow(f, -0.8) 
-       - 6.5 * std::exp(-0.6 * std::pow(f - 3.3, 2.0))
-       + 0.001 * std::pow(f, 4.0);
-}
-
-// Calculate spreading function for frequency masking (in dB)
-// Masking spreads from a masker to nearby frequencies in Bark scale
-static double spreadingFunction(double deltaBark) {
-  const double absD = std::abs(deltaBark);
-  if (absD > 8.0) return -100.0; // No masking effect beyond 8 Bark
-  
-  // Asymmetric spreading: upward masking is stronger
-  if (deltaBark >= 0) {
-    // Upward spread (masker affects higher frequencies more)
-    return 15.81 + 7.5 * (deltaBark + 0.474) 
-         - 17.5 * std::sqrt(1.0 + std::pow(deltaBark + 0.474, 2.0));
+static void readSigningSource(const EmbedRequest& req, SigningSource& source) {
+  if (!masterCacheEnabled()) {
+    readAudio(req.inputPath, req.sampleRate, req.channels, req.priority, source.file);
+    return;
+  }
+  source.cached = readMasterCached(req.inputPath, req.priority);
+  if (source.cached.sampleRate != req.sampleRate || source.cached.channels != req.channels) {
+    throw std::runtime_error("Unexpected audio format");
+  }
+  source.view.size = sizeof(source.view);
+  source.view.samples = source.cached.samples.data();
+  source.view.frames = source.cached.samples.size() / source.cached.channels;
+  source.view.channels = source.cached.channels;
+  source.view.sample_rate = source.cached.sampleRate;
+  source.view.bits_per_sample = source.cached.bitsPerSample;
+  source.audio = &source.view;
+}
+
+// Several deliverables cost one read and one embed; the encodes run in
+// parallel from the marked samples.
+static void runEmbedTargets(const EmbedRequest& req) {
+  SigningSource source;
+  readSigningSource(req, source);
+  musmark_audio& audio = *source.audio;
+  const std::shared_ptr<musmark_key> key = acquireKey(req.secret, req.hopSize);
+  check(musmark_embed_bits(key.get(), req.bitstream.data(), req.bitstream.size(),
+    req.removeBits.empty() ? nullptr : req.removeBits.data(), req.removeBits.size(),
+    audio.samples, audio.frames, audio.channels, toCPriority(req.priority)));
+
+  std::vector<musmark_audio_target> targets;
+  for (const OutputTarget& target : req.targets) {
+    targets.push_back({ sizeof(musmark_audio_target), target.path.c_str(), target.format, target.bitsPerSample });
+  }
+  check(musmark_audio_write_targets(targets.data(), targets.size(), &audio, req.inputPath.c_str(),
+    toCPriority(req.priority)));
+}
+
+static void runEmbed(const EmbedRequest& req) {
+  if (!req.targets.empty()) {
+    runEmbedTargets(req);
+    return;
+  }
+  const std::shared_ptr<musmark_key> key = acquireKey(req.secret, req.hopSize);
+  // Float WAV to WAV streams through the file without loading it, unless the
+  // master cache is on: a cached master is cheaper than storage.
+  if (!masterCacheEnabled() && canPipelineSign(req.inputPath, req.outputPath)) {
+    const WavLayout layout = readWavLayout(req.inputPath);
+    if (layout.sampleRate != req.sampleRate || layout.channels != req.channels) {
+      throw std::runtime_error("Unexpected audio format");
+    }
+    check(musmark_embed_wav_file(key.get(), req.bitstream.data(), req.bitstream.size(),
+      req.removeBits.empty() ? nullptr : req.removeBits.data(), req.removeBits.size(),
+      req.inputPath.c_str(), req.outputPath.c_str(), toCPriority(req.priority)));
+    return;
+  }
+
+  SigningSource source;
+  readSigningSource(req, source);
+  musmark_audio& audio = *source.audio;
+  // Nothing to carry over from a FLAC source into a WAV output, so the blocks
+  // are written as they are marked.
+  if (!hasFlacExtension(req.outputPath) && sniffAudioFile(req.inputPath) != AudioContainer::Wav) {
+    check(musmark_embed_bits_to_wav(key.get(), req.bitstream.data(), req.bitstream.size(),
+      req.removeBits.empty() ? nullptr : req.removeBits.data(), req.removeBits.size(),
+      &audio, req.outputPath.c_str(), toCPriority(req.priority)));
+    return;
+  }
+  check(musmark_embed_bits(key.get(), req.bitstream.data(), req.bitstream.size(),
+    req.removeBits.empty() ? nullptr : req.removeBits.data(), req.removeBits.size(),
+    audio.samples, audio.frames, audio.channels, toCPriority(req.priority)));
+
+  // A ".flac" output keeps the source depth, a WAV one the source's metadata chunks.
+  check(musmark_audio_write_preserving(req.outputPath.c_str(), &audio, req.inputPath.c_str(),
+    toCPriority(req.priority)));
+}
+
+static Extraction toExtraction(const musmark_extraction& extraction) {
+  Extraction out;
+  out.correlations.assign(extraction.correlations, extraction.correlations + extraction.block_count);
+  out.blocksAnalyzed = extraction.block_count;
+  out.bitConfidence = extraction.bit_confidence;
+  out.bandAgreement = extraction.band_agreement;
+  out.finished = extraction.finished != 0;
+  out.periodsAnalyzed = extraction.periods_analyzed;
+  out.periodCount = extraction.period_count;
+  return out;
+}
+
+// Time left until the request's deadline, which counts from the JS call so
+// that waiting in the queue is part of the budget.
+static uint32_t remainingMs(const ExtractRequest& req) {
+  const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+    req.deadline - std::chrono::steady_clock::now()).count();
+  return left > 0 ? static_cast<uint32_t>(left) : 0;
+}
+
+static Extraction extractSamples(const ExtractRequest& req, const float* samples, size_t frames, int channels) {
+  const std::shared_ptr<musmark_key> key = acquireKey(req.secret, req.hopSize);
+  ExtractionResult result;
+  if (req.hasDeadline) {
+    check(musmark_extract_until(key.get(), samples, frames, channels, toCPriority(req.priority), remainingMs(req),
+      &result.extraction));
   } else {
-    // Downward spread (masker affects lower frequencies less)
-    return 15.81 + 7.5 * (deltaBark + 0.474) 
-         - 17.5 * std::sqrt(1.0 + std::pow(deltaBark + 0.474, 2.0))
-         + 8.0 * std::abs(deltaBark); // Extra attenuation
+    check(musmark_extract(key.get(), samples, frames, channels, toCPriority(req.priority), &result.extraction));
   }
+  return toExtraction(result.extraction);
 }
 
-// Calculate masking threshold for each bin using psychoacoustic model
-static std::vector<double> calculateMaskingThreshold(
-  const std::vector<Complex>& fft,
-  int sampleRate
+static Extraction extractOpened(const ExtractRequest& req, const OpenedAudio& audio) {
+  const std::shared_ptr<musmark_key> key = acquireKey(req.secret, req.hopSize);
+  ExtractionResult result;
+  if (req.hasDeadline) {
+    check(musmark_analysis_extract_until(key.get(), audio.analysis.get(), toCPriority(req.priority), remainingMs(req),
+      &result.extraction));
+  } else {
+    check(musmark_analysis_extract(key.get(), audio.analysis.get(), toCPriority(req.priority), &result.extraction));
+  }
+  return toExtraction(result.extraction);
+}
+
+// A deadline-bound request cannot wait on someone else's full extraction,
+// and a result it cut short must not be served to anyone later.
+static std::shared_ptr<const Extraction> cachedFor(
+  const ExtractRequest& req,
+  const std::string& key,
+  const std::function<Extraction()>& compute
 ) {
-  const int n = static_cast<int>(fft.size());
-  const int halfN = n / 2;
-  const double binFreqStep = static_cast<double>(sampleRate) / n;
-  
-  std::vector<double> powerSpectrum(halfN);
-  std::vector<double> powerDB(halfN);
-  std::vector<double> barkFreq(halfN);
-  std::vector<double> maskingThreshold(halfN, -100.0);
-  
-  // Calculate power spectrum and convert to dB
-  for (int i = 0; i < halfN; i++) {
-    const double mag = std::hypot(fft[i].re, fft[i].im);
-    powerSpectrum[i] = mag * mag;
-    // Convert to dB with small epsilon to avoid log(0)
-    powerDB[i] = 10.0 * std::log10(std::max(powerSpectrum[i], 1e-20));
-    barkFreq[i] = freqToBark(i * binFreqStep);
-  }
-  
-  // Find tonal maskers (local peaks in spectrum)
-  std::vector<int> maskerBins;
-  std::vector<double> maskerPower;
-  
-  for (int i = 2; i < halfN - 2; i++) {
-    // Check if local maximum (peak)
-    if (powerDB[i] > powerDB[i-1] && powerDB[i] > powerDB[i+1] &&
-        powerDB[i] > powerDB[i-2] + 6.0 && powerDB[i] > powerDB[i+2] + 6.0 &&
-        powerDB[i] > -40.0) { // Only consider significant peaks
-      maskerBins.push_back(i);
-      // Combine energy from surrounding bins for tonal masker
-      double combinedPower = powerSpectrum[i-1] + powerSpectrum[i] + powerSpectrum[i+1];
-      maskerPower.push_back(10.0 * std::log10(std::max(combinedPower, 1e-20)));
-    }
-  }
-  
-  // Calculate global masking threshold for each bin
-  for (int i = 1; i < halfN; i++) {
-    double freq = i * binFreqStep;
-    double bark = barkFreq[i];
-    
-    // Start with absolute threshold of hearing
-    double threshold = absoluteThresholdOfHearing(freq);
-    
-    // Add contribution from each masker
-    double maskerContribution = -100.0;
-    for (size_t m = 0; m < maskerBins.size(); m++) {
-      double maskerBark = barkFreq[maskerBins[m]];
-      double deltaBark = bark - maskerBark;
-      
-      // Spreading function determines how much masking spreads
-      double spread = spreadingFunction(deltaBark);
-      
-      // Tonal masking offset (tonal maskers are less effective at masking noise)
-      const double tonalOffset = -6.025 - 0.275 * maskerBark;
-      
-      // Individual masking threshold from this masker
-      double individualMask = maskerPower[m] + spread + tonalOffset;
-      
-      // Combine using power addition in linear domain
-      if (individualMask > maskerContribution) {
-        maskerContribution = 10.0 * std::log10(
-          std::pow(10.0, maskerContribution / 10.0) + 
-          std::pow(10.0, individualMask / 10.0)
-        );
-      }
+  if (!req.hasDeadline) return cachedExtraction(key, compute);
+  if (std::shared_ptr<const Extraction> hit = findCachedExtraction(key)) return hit;
+  auto result = std::make_shared<const Extraction>(compute());
+  if (result->finished) storeCachedExtraction(key, result);
+  return result;
+}
+
+// Decoded lossy audio depends on the rate it was resampled to as well as
+// on the file.
+static std::string decodedHashKey(const DownmixedAudio& audio) {
+  return audio.contentHash + "@" + std::to_string(audio.sampleRate);
+}
+
+// Cached requests hash the file while reading it and look the result up by
+// content, so repeat submissions of the same audio skip the extraction.
+// Opened audio was hashed when it was read.
+static std::shared_ptr<const Extraction> extractionFor(const ExtractRequest& req) {
+  if (req.audio) {
+    const OpenedAudio& audio = *req.audio;
+    if (!req.cache) return std::make_shared<const Extraction>(extractOpened(req, audio));
+    return cachedFor(req, detectionCacheKey(audio.cacheHash, req.secret, req.hopSize), [&]() {
+      return extractOpened(req, audio);
+    });
+  }
+  if (sniffAudioFile(req.inputPath) == AudioContainer::Other) {
+    // Compressed leaks stream through the external decoder straight into the
+    // mid signal, resampled to the signing rate.
+    const DownmixedAudio audio = decodeDownmixed(req.inputPath, req.sampleRate);
+    const auto extract = [&]() { return extractSamples(req, audio.mid.data(), audio.mid.size(), 1); };
+    if (!req.cache) return std::make_shared<const Extraction>(extract());
+    return cachedFor(req, detectionCacheKey(decodedHashKey(audio), req.secret, req.hopSize), extract);
+  }
+  if (req.cache) {
+    const HashedWav file = readAudioHashed(req.inputPath);
+    if (file.wav.sampleRate != req.sampleRate || file.wav.channels != req.channels) {
+      throw std::runtime_error("Unexpected audio format");
     }
-    
-    // Final threshold is the higher of ATH and masker contribution
-    maskingThreshold[i] = std::max(threshold, maskerContribution);
+    const size_t frames = file.wav.samples.size() / file.wav.channels;
+    return cachedFor(req, detectionCacheKey(file.contentHash, req.secret, req.hopSize), [&]() {
+      return extractSamples(req, file.wav.samples.data(), frames, file.wav.channels);
+    });
   }
-  
-  return maskingThreshold;
+  AudioFile file;
+  readAudio(req.inputPath, req.sampleRate, req.channels, req.priority, file);
+  return std::make_shared<const Extraction>(
+    extractSamples(req, file.audio.samples, file.audio.frames, file.audio.channels));
 }
 
-// Ultra-transparent watermarking using smooth, continuous phase modulation
-// Avoids clicks by using very gradual changes across frequency bins
-static void applyWatermarkToFrame(
-  std::vector<Complex>& fftL,
-  std::vector<Complex>& fftR,
-  int bit,
-  uint64_t seed,
-  double embedStrength,
-  int sampleRate = 44100
-) {
-  const int n = static_cast<int>(fftL.size());
-  const int halfN = n / 2;
-  
-  // MICRO-EMBEDDING: Spread tiny changes across MANY bins
-  // This prevents any single bin from having a noticeable change
-  const double binFreqStep = static_cast<double>(sampleRate) / n;
-  const int minBin = std::max(20, static_cast<int>(2500.0 / binFreqStep));
-  const int maxBin = std::min(halfN - 10, static_cast<int>(5000.0 / binFreqStep));
-  
-  if (maxBin <= minBin + 20) return;
-  
-  // Ultra-micro phase delta - almost imperceptible
-  const double microPhaseDelta = embedStrength * 0.005; // Extremely tiny
-  
-  XorShift64 prng(seed);
-  
-  // Apply smooth, gradual phase shifts using a cosine envelope
-  // This prevents clicks by ensuring smooth transitions
-  const int binRange = maxBin - minBin;
-  
-  for (int i = 0; i < binRange; i++) {
-    const int bin = minBin + i;
-    
-    // Cosine window to smooth the phase changes (no abrupt edges)
-    const double windowPos = static_cast<double>(i) / static_cast<double>(binRange - 1);
-    const double smoothWindow = 0.5 * (1.0 - std::cos(2.0 * kPi * windowPos));
-    
-    // Get magnitude (we preserve this exactly)
-    const double magL = std::hypot(fftL[bin].re, fftL[bin].im);
-    const double magR = std::hypot(fftR[bin].re, fftR[bin].im);
-    
-    // Skip silent bins
-    if (magL < 1e-10 && magR < 1e-10) continue;
-    
-    // Deterministic sign based on bin and seed (consistent across frames)
-    const double sign = ((prng.next() % 2) == 0) ? 1.0 : -1.0;
-    
-    // Scale by magnitude - louder bins can hide more
-    const double magScale = std::min(1.0, std::sqrt(magL * magL + magR * magR) * 10.0);
-    
-    // Final phase shift: tiny, smooth, magnitude-scaled
-    const double phaseShift = sign * microPhaseDelta * smoothWindow * magScale * (bit ? 1.0 : -1.0);
-    
-    const double phaseL = std::atan2(fftL[bin].im, fftL[bin].re);
-    const double phaseR = std::atan2(fftR[bin].im, fftR[bin].re);
-    
-    // Apply phase shift to stereo difference (less audible than direct)
-    const double newPhaseL = phaseL + phaseShift * 0.3;
-    const double newPhaseR = phaseR - phaseShift * 0.3;
-    
-    // Reconstruct with EXACT original magnitude
-    fftL[bin].re = magL * std::cos(newPhaseL);
-    fftL[bin].im = magL * std::sin(newPhaseL);
-    fftR[bin].re = magR * std::cos(newPhaseR);
-    fftR[bin].im = magR * std::sin(newPhaseR);
-    
-    // Mirror for real signal
-    const int mirror = n - bin;
-    if (mirror > 0 && mirror < n && mirror != bin) {
-      fftL[mirror].re = fftL[bin].re;
-      fftL[mirror].im = -fftL[bin].im;
-      fftR[mirror].re = fftR[bin].re;
-      fftR[mirror].im = -fftR[bin].im;
-    }
-  }
-}
-
-// Extract watermark using smooth phase detection (matches embedding)
-static int extractBitFromFrame(
-  const std::vector<Complex>& fftL,
-  const std::vector<Complex>& fftR,
-  uint64_t seed,
-  double embedStrength,
-  double& bitConfidence,
-  double& bandAgreement,
-  int sampleRate = 44100
-) {
-  const int n = static_cast<int>(fftL.size());
-  const int halfN = n / 2;
-  
-  const double binFreqStep = static_cast<double>(sampleRate) / n;
-  const int minBin = std::max(20, static_cast<int>(2500.0 / binFreqStep));
-  const int maxBin = std::min(halfN - 10, static_cast<int>(5000.0 / binFreqStep));
-  
-  if (maxBin <= minBin + 20) {
-    bitConfidence = 0.0;
-    bandAgreement = 0.0;
-    return 0;
-  }
-
-  XorShift64 prng(seed);
-  double phaseSum = 0.0;
-  double weightSum = 0.0;
-  int validBins = 0;
-  const int binRange = maxBin - minBin;
-
-  for (int i = 0; i < binRange; i++) {
-    const int bin = minBin + i;
-    
-    const double magL = std::hypot(fftL[bin].re, fftL[bin].im);
-    const double magR = std::hypot(fftR[bin].re, fftR[bin].im);
-    
-    if (magL < 1e-10 && magR < 1e-10) continue;
-    
-    const double sign = ((prng.next() % 2) == 0) ? 1.0 : -1.0;
-    
-    const double phaseL = std::atan2(fftL[bin].im, fftL[bin].re);
-    const double phaseR = std::atan2(fftR[bin].im, fftR[bin].re);
-    
-    double phaseDiff = phaseL - phaseR;
-    while (phaseDiff > kPi) phaseDiff -= 2.0 * kPi;
-    while (phaseDiff < -kPi) phaseDiff += 2.0 * kPi;
-    
-    // Weight by magnitude (louder = more reliable)
-    const double weight = std::sqrt(magL * magL + magR * magR);
-    phaseSum += sign * phaseDiff * weight;
-    weightSum += weight;
-    validBins++;
-  }
-
-  bandAgreement = validBins > 0 ? static_cast<double>(validBins) / static_cast<double>(binRange) : 0.0;
-  
-  if (weightSum > 1e-10) {
-    const double avgPhase = phaseSum / weightSum;
-    bitConfidence = std::min(1.0, std::abs(avgPhase) * 100.0);
-    return avgPhase >= 0 ? 1 : 0;
-  }
-  
-  bitConfidence = 0.0;
-  return 0;
-}
-
-static std::vector<float> getChannelSamples(const std::vector<float>& interleaved, int channels, int channelIndex) {
-  std::vector<float> out(interleaved.size() / channels);
-  for (size_t i = 0, j = channelIndex; j < interleaved.size(); i++, j += channels) {
-    out[i] = interleaved[j];
+static ExtractOutput runExtract(const ExtractRequest& req) {
+  const std::shared_ptr<const Extraction> extraction = extractionFor(req);
+
+  // Convert correlations to bits (will be refined by voting in TypeScript)
+  ExtractOutput out;
+  out.correlations = extraction->correlations;
+  out.bits.reserve(out.correlations.size());
+  for (float corr : out.correlations) {
+    out.bits.push_back(corr > 0 ? 1 : 0);
   }
+  out.blocksAnalyzed = extraction->blocksAnalyzed;
+  out.bitConfidence = extraction->bitConfidence;
+  out.bandAgreement = extraction->bandAgreement;
+  out.finished = extraction->finished;
+  out.periodsAnalyzed = extraction->periodsAnalyzed;
+  out.periodCount = extraction->periodCount;
   return out;
 }
 
-static void writeChannelSamples(std::vector<float>& interleaved, const std::vector<float>& channelData, int channels, int channelIndex) {
-  for (size_t i = 0, j = channelIndex; j < interleaved.size(); i++, j += channels) {
-    interleaved[j] = channelData[i];
+static TriageResult runTriage(const ExtractRequest& req) {
+  const std::shared_ptr<musmark_key> key = acquireKey(req.secret, req.hopSize);
+  musmark_triage triage{};
+  triage.size = sizeof(triage);
+  if (req.audio) {
+    check(musmark_analysis_triage(key.get(), req.audio->analysis.get(), toCPriority(req.priority), &triage));
+  } else if (sniffAudioFile(req.inputPath) == AudioContainer::Other) {
+    // Only the sync blocks are correlated, so an MP3 decodes just their frames.
+    const DownmixedAudio audio = decodeForTriage(req.inputPath, req.sampleRate, req.hopSize);
+    check(musmark_triage_samples(key.get(), audio.mid.data(), audio.mid.size(), 1, toCPriority(req.priority), &triage));
+  } else {
+    AudioFile file;
+    readAudio(req.inputPath, req.sampleRate, req.channels, req.priority, file);
+    check(musmark_triage_samples(key.get(), file.audio.samples, file.audio.frames, file.audio.channels,
+      toCPriority(req.priority), &triage));
+  }
+  TriageResult result;
+  result.likely = triage.likely != 0;
+  result.syncScore = triage.sync_score;
+  result.blocksAnalyzed = triage.blocks_analyzed;
+  return result;
+}
+
+static std::shared_ptr<const OpenedAudio> openAudioFile(const HashedWav& file) {
+  if (file.wav.channels <= 0) throw std::runtime_error("Invalid audio file");
+  const size_t frames = file.wav.samples.size() / file.wav.channels;
+  musmark_analysis* raw = nullptr;
+  check(musmark_analysis_create(file.wav.samples.data(), frames, file.wav.channels, &raw));
+  auto audio = std::make_shared<OpenedAudio>();
+  audio->analysis.reset(raw, musmark_analysis_destroy);
+  audio->contentHash = file.contentHash;
+  audio->cacheHash = file.contentHash;
+  audio->sampleRate = file.wav.sampleRate;
+  audio->channels = file.wav.channels;
+  audio->frames = frames;
+  return audio;
+}
+
+static std::shared_ptr<const OpenedAudio> openDecodedAudio(const DownmixedAudio& decoded) {
+  musmark_analysis* raw = nullptr;
+  check(musmark_analysis_create(decoded.mid.data(), decoded.mid.size(), 1, &raw));
+  auto audio = std::make_shared<OpenedAudio>();
+  audio->analysis.reset(raw, musmark_analysis_destroy);
+  audio->contentHash = decoded.contentHash;
+  audio->cacheHash = decodedHashKey(decoded);
+  audio->sampleRate = decoded.sampleRate;
+  audio->channels = decoded.channels;
+  audio->frames = decoded.mid.size();
+  return audio;
+}
+
+// Runs an embed on the libuv pool; the heavy loops fan out to the shared
+// scheduler from there.
+class EmbedWorker : public Napi::AsyncWorker {
+ public:
+  EmbedWorker(Napi::Env env, EmbedRequest request)
+    : Napi::AsyncWorker(env), request_(std::move(request)), deferred_(Napi::Promise::Deferred::New(env)) {}
+
+  Napi::Promise Promise() const { return deferred_.Promise(); }
+
+  void Execute() override {
+    try {
+      runEmbed(request_);
+    } catch (const std::exception& ex) {
+      SetError(ex.what());
+    }
+  }
+
+  void OnOK() override { deferred_.Resolve(Env().Null()); }
+  void OnError(const Napi::Error& error) override { deferred_.Reject(error.Value()); }
+
+ private:
+  EmbedRequest request_;
+  Napi::Promise::Deferred deferred_;
+};
+
+class ExtractWorker : public Napi::AsyncWorker {
+ public:
+  ExtractWorker(Napi::Env env, ExtractRequest request)
+    : Napi::AsyncWorker(env), request_(std::move(request)), deferred_(Napi::Promise::Deferred::New(env)) {}
+
+  Napi::Promise Promise() const { return deferred_.Promise(); }
+
+  void Execute() override {
+    try {
+      output_ = runExtract(request_);
+    } catch (const std::exception& ex) {
+      SetError(ex.what());
+    }
+  }
+
+  void OnOK() override {
+    Napi::Env env = Env();
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("bitstream", Napi::Buffer<uint8_t>::Copy(env, output_.bits.data(), output_.bits.size()));
+    result.Set("correlations", Napi::Buffer<float>::Copy(env, output_.correlations.data(), output_.correlations.size()));
+    result.Set("bitConfidence", output_.bitConfidence);
+    result.Set("bandAgreement", output_.bandAgreement);
+    result.Set("blocksAnalyzed", static_cast<double>(output_.blocksAnalyzed));
+    result.Set("finished", output_.finished);
+    result.Set("periodsAnalyzed", static_cast<double>(output_.periodsAnalyzed));
+    result.Set("periodCount", static_cast<double>(output_.periodCount));
+    deferred_.Resolve(result);
   }
+
+  void OnError(const Napi::Error& error) override { deferred_.Reject(error.Value()); }
+
+ private:
+  ExtractRequest request_;
+  ExtractOutput output_;
+  Napi::Promise::Deferred deferred_;
+};
+
+static JobPriority getPriority(const Napi::Object& options, JobPriority fallback) {
+  if (!options.Has("priority") || !options.Get("priority").IsString()) return fallback;
+  return parsePriority(options.Get("priority").As<Napi::String>(), fallback);
 }
 
 static Napi::Value EmbedWatermark(const Napi::CallbackInfo& info) {
@@ -317,366 +482,1030 @@ static Napi::Value EmbedWatermark(const Napi::CallbackInfo& info) {
 
   try {
     if (info.Length() < 4) {
-      Napi::TypeError::New(env, "Expected inputPath, outputPath, bitstream, options").ThrowAsJavaScriptException();
+      Napi::TypeError::New(env, "Expected inputPath, outputPath or outputs, bitstream, options").ThrowAsJavaScriptException();
       return env.Null();
     }
 
-  const std::string inputPath = info[0].As<Napi::String>();
-  const std::string outputPath = info[1].As<Napi::String>();
   const Napi::Buffer<uint8_t> bitBuffer = info[2].As<Napi::Buffer<uint8_t>>();
   const Napi::Object options = info[3].As<Napi::Object>();
 
-  const int sampleRate = options.Get("sampleRate").As<Napi::Number>().Int32Value();
-  const int channels = options.Get("channels").As<Napi::Number>().Int32Value();
-  const int blockSize = options.Get("blockSize").As<Napi::Number>().Int32Value();
-  const int hopSize = options.Get("hopSize").As<Napi::Number>().Int32Value();
-  const std::string secret = options.Get("secret").As<Napi::String>();
-  const double embedStrength = options.Get("embedStrength").As<Napi::Number>().DoubleValue();
-  const double rotationSeconds = options.Get("rotationSeconds").As<Napi::Number>().DoubleValue();
+  EmbedRequest req;
+  req.inputPath = info[0].As<Napi::String>();
+  if (info[1].IsArray()) {
+    const Napi::Array targets = info[1].As<Napi::Array>();
+    for (uint32_t i = 0; i < targets.Length(); i++) {
+      const Napi::Object target = targets.Get(i).As<Napi::Object>();
+      const std::string format = target.Get("format").As<Napi::String>();
+      if (format != "wav" && format != "flac") throw std::runtime_error("Output format must be wav or flac");
+      const Napi::Value depth = target.Get("bitDepth");
+      req.targets.push_back({ target.Get("path").As<Napi::String>(),
+        format == "flac" ? MUSMARK_FORMAT_FLAC : MUSMARK_FORMAT_WAV,
+        depth.IsNumber() ? depth.As<Napi::Number>().Int32Value() : 0 });
+    }
+    if (req.targets.empty()) throw std::runtime_error("Expected at least one output");
+  } else {
+    req.outputPath = info[1].As<Napi::String>();
+  }
+  req.sampleRate = options.Get("sampleRate").As<Napi::Number>().Int32Value();
+  req.channels = options.Get("channels").As<Napi::Number>().Int32Value();
+  req.blockSize = options.Get("blockSize").As<Napi::Number>().Int32Value();
+  req.hopSize = options.Get("hopSize").As<Napi::Number>().Int32Value();
+  req.secret = options.Get("secret").As<Napi::String>();
+  req.embedStrength = options.Get("embedStrength").As<Napi::Number>().DoubleValue();
+  req.rotationSeconds = options.Get("rotationSeconds").As<Napi::Number>().DoubleValue();
+  req.priority = getPriority(options, JobPriority::Batch);
 
-  std::vector<uint8_t> bitstream(bitBuffer.Data(), bitBuffer.Data() + bitBuffer.Length());
+  req.bitstream.assign(bitBuffer.Data(), bitBuffer.Data() + bitBuffer.Length());
 
-  std::vector<uint8_t> removeBits;
   if (options.Has("removeBitstream") && !options.Get("removeBitstream").IsNull()) {
     Napi::Buffer<uint8_t> removeBuffer = options.Get("removeBitstream").As<Napi::Buffer<uint8_t>>();
-    removeBits.assign(removeBuffer.Data(), removeBuffer.Data() + removeBuffer.Length());
-  }
-
-    WavData wav = readWav(inputPath);
-    if (wav.sampleRate != sampleRate || wav.channels != channels) {
-      throw std::runtime_error("Unexpected WAV format");
-    }
-
-  std::vector<float> left = getChannelSamples(wav.samples, channels, 0);
-  std::vector<float> right = channels > 1 ? getChannelSamples(wav.samples, channels, 1) : left;
-
-  const size_t totalSamples = left.size();
-  
-  // =========================================================================
-  // SPREAD SPECTRUM WATERMARKING WITH POSITION-DEPENDENT PN SEQUENCES
-  // Key insight: Using a DIFFERENT PN sequence for each bit position in the 
-  // payload makes the audio's natural PN correlation become random noise that
-  // averages out across repetitions, while the watermark stays consistent.
-  // =========================================================================
-  
-  const uint64_t baseSeed = hashSecret(secret);
-  
-  // Parameters tuned for balance between quality and detection
-  const int samplesPerBit = hopSize * 4;  // 4096 samples ≈ 0.09s per bit
-  const double strength = 0.007;  // ~0.7% base, gentle but detectable
-  
-  // Pre-generate PN sequences for each bit position in the payload
-  // This is crucial: each position gets a unique PN to decorrelate audio bias
-  const int payloadLen = static_cast<int>(bitstream.size());
-  std::vector<std::vector<double>> pnSequences(payloadLen, std::vector<double>(samplesPerBit));
-  
-  for (int pos = 0; pos < payloadLen; pos++) {
-    // Unique seed for each bit position
-    XorShift64 prng(baseSeed ^ (static_cast<uint64_t>(pos) * 0x9e3779b97f4a7c15ULL));
-    
-    // Generate raw PN
-    std::vector<double> rawPN(samplesPerBit);
-    for (int i = 0; i < samplesPerBit; i++) {
-      rawPN[i] = prng.nextDouble() * 2.0 - 1.0;
-    }
-    
-    // Low-pass filter to reduce harshness
-    const int filterWidth = 32;
-    for (int i = 0; i < samplesPerBit; i++) {
-      double sum = 0;
-      int count = 0;
-      for (int j = -filterWidth; j <= filterWidth; j++) {
-        int idx = i + j;
-        if (idx >= 0 && idx < samplesPerBit) {
-          sum += rawPN[idx];
-          count++;
-        }
+    req.removeBits.assign(removeBuffer.Data(), removeBuffer.Data() + removeBuffer.Length());
+  }
+
+    EmbedWorker* worker = new EmbedWorker(env, std::move(req));
+    Napi::Promise promise = worker->Promise();
+    worker->Queue();
+    return promise;
+  } catch (const std::exception& ex) {
+    Napi::Error::New(env, ex.what()).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+}
+
+// The first argument of extract/triage calls: an audio file path or an openAudio() handle.
+static void getExtractInput(const Napi::Value& input, ExtractRequest& req) {
+  if (input.IsExternal()) {
+    req.audio = input.As<Napi::External<AudioHandleBox>>().Data()->audio;
+    if (!req.audio) throw std::runtime_error("Audio handle is closed");
+  } else {
+    req.inputPath = input.As<Napi::String>();
+  }
+}
+
+static ExtractRequest getExtractRequest(const Napi::CallbackInfo& info) {
+  const Napi::Object options = info[1].As<Napi::Object>();
+
+  ExtractRequest req;
+  getExtractInput(info[0], req);
+  req.sampleRate = options.Get("sampleRate").As<Napi::Number>().Int32Value();
+  req.channels = options.Get("channels").As<Napi::Number>().Int32Value();
+  req.blockSize = options.Get("blockSize").As<Napi::Number>().Int32Value();
+  req.hopSize = options.Get("hopSize").As<Napi::Number>().Int32Value();
+  req.secret = options.Get("secret").As<Napi::String>();
+  req.embedStrength = options.Has("embedStrength")
+    ? options.Get("embedStrength").As<Napi::Number>().DoubleValue()
+    : 0.005;
+  req.priority = getPriority(options, JobPriority::Interactive);
+  req.cache = !options.Has("cache") || options.Get("cache").ToBoolean();
+  if (options.Has("deadlineMs") && options.Get("deadlineMs").IsNumber()) {
+    const double deadlineMs = std::max(0.0, options.Get("deadlineMs").As<Napi::Number>().DoubleValue());
+    req.hasDeadline = true;
+    req.deadline = std::chrono::steady_clock::now() +
+      std::chrono::milliseconds(static_cast<int64_t>(std::min(deadlineMs, 86400000.0)));
+  }
+  return req;
+}
+
+static Napi::Value ExtractWatermark(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  try {
+    if (info.Length() < 2) {
+      Napi::TypeError::New(env, "Expected input, options").ThrowAsJavaScriptException();
+      return env.Null();
+    }
+
+    ExtractWorker* worker = new ExtractWorker(env, getExtractRequest(info));
+    Napi::Promise promise = worker->Promise();
+    worker->Queue();
+    return promise;
+  } catch (const std::exception& ex) {
+    Napi::Error::New(env, ex.what()).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+}
+
+class TriageWorker : public Napi::AsyncWorker {
+ public:
+  TriageWorker(Napi::Env env, ExtractRequest request)
+    : Napi::AsyncWorker(env), request_(std::move(request)), deferred_(Napi::Promise::Deferred::New(env)) {}
+
+  Napi::Promise Promise() const { return deferred_.Promise(); }
+
+  void Execute() override {
+    try {
+      output_ = runTriage(request_);
+    } catch (const std::exception& ex) {
+      SetError(ex.what());
+    }
+  }
+
+  void OnOK() override {
+    Napi::Object result = Napi::Object::New(Env());
+    result.Set("likely", output_.likely);
+    result.Set("syncScore", output_.syncScore);
+    result.Set("blocksAnalyzed", static_cast<double>(output_.blocksAnalyzed));
+    deferred_.Resolve(result);
+  }
+
+  void OnError(const Napi::Error& error) override { deferred_.Reject(error.Value()); }
+
+ private:
+  ExtractRequest request_;
+  TriageResult output_;
+  Napi::Promise::Deferred deferred_;
+};
+
+static Napi::Value TriageWatermark(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  try {
+    if (info.Length() < 2) {
+      Napi::TypeError::New(env, "Expected input, options").ThrowAsJavaScriptException();
+      return env.Null();
+    }
+
+    TriageWorker* worker = new TriageWorker(env, getExtractRequest(info));
+    Napi::Promise promise = worker->Promise();
+    worker->Queue();
+    return promise;
+  } catch (const std::exception& ex) {
+    Napi::Error::New(env, ex.what()).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+}
+
+// Reads, hashes and downmixes off the event loop. A buffer source stays
+// referenced until the worker is done with it; a descriptor is read to EOF.
+class OpenAudioWorker : public Napi::AsyncWorker {
+ public:
+  OpenAudioWorker(Napi::Env env, std::string path, Napi::Value buffer, int sampleRate)
+    : Napi::AsyncWorker(env), path_(std::move(path)), sampleRate_(sampleRate),
+      deferred_(Napi::Promise::Deferred::New(env)) {
+    if (buffer.IsNumber()) {
+      fd_ = buffer.As<Napi::Number>().Int32Value();
+    } else if (buffer.IsBuffer()) {
+      const Napi::Buffer<uint8_t> data = buffer.As<Napi::Buffer<uint8_t>>();
+      data_ = data.Data();
+      size_ = data.Length();
+      buffer_ = Napi::Persistent(buffer.As<Napi::Object>());
+    }
+  }
+
+  Napi::Promise Promise() const { return deferred_.Promise(); }
+
+  void Execute() override {
+    try {
+      if (fd_ >= 0) {
+        // Pipes cannot be handed to the external decoder after the sniff,
+        // so a descriptor carries WAV or FLAC.
+        audio_ = openAudioFile(readAudioHashed(fd_));
+        return;
       }
-      pnSequences[pos][i] = sum / count;
-    }
-    
-    // Remove DC
-    const int dcWidth = 256;
-    std::vector<double> temp = pnSequences[pos];
-    for (int i = 0; i < samplesPerBit; i++) {
-      double sum = 0;
-      int count = 0;
-      for (int j = -dcWidth; j <= dcWidth; j++) {
-        int idx = i + j;
-        if (idx >= 0 && idx < samplesPerBit) {
-          sum += temp[idx];
-          count++;
-        }
+      const AudioContainer container = data_ ? sniffAudio(data_, size_) : sniffAudioFile(path_);
+      if (container == AudioContainer::Other) {
+        audio_ = openDecodedAudio(data_ ? decodeDownmixed(data_, size_, sampleRate_) : decodeDownmixed(path_, sampleRate_));
+      } else {
+        audio_ = openAudioFile(data_ ? readAudioHashed(data_, size_) : readAudioHashed(path_));
       }
-      pnSequences[pos][i] -= sum / count;
-    }
-    
-    // Normalize
-    double energy = 0;
-    for (int i = 0; i < samplesPerBit; i++) {
-      energy += pnSequences[pos][i] * pnSequences[pos][i];
-    }
-    double norm = std::sqrt(energy / samplesPerBit);
-    if (norm > 1e-10) {
-      for (int i = 0; i < samplesPerBit; i++) {
-        pnSequences[pos][i] /= norm;
+    } catch (const std::exception& ex) {
+      SetError(ex.what());
+    }
+  }
+
+  void OnOK() override {
+    Napi::Env env = Env();
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("handle", Napi::External<AudioHandleBox>::New(env, new AudioHandleBox{ audio_ },
+      [](Napi::Env, AudioHandleBox* box) { delete box; }));
+    result.Set("sampleRate", audio_->sampleRate);
+    result.Set("channels", audio_->channels);
+    result.Set("frames", static_cast<double>(audio_->frames));
+    result.Set("contentHash", audio_->contentHash);
+    deferred_.Resolve(result);
+  }
+
+  void OnError(const Napi::Error& error) override { deferred_.Reject(error.Value()); }
+
+ private:
+  std::string path_;
+  int sampleRate_;
+  int fd_ = -1;
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  Napi::ObjectReference buffer_;
+  std::shared_ptr<const OpenedAudio> audio_;
+  Napi::Promise::Deferred deferred_;
+};
+
+static Napi::Value OpenAudio(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  try {
+    if (info.Length() < 1 || !(info[0].IsString() || info[0].IsBuffer() || info[0].IsNumber())) {
+      Napi::TypeError::New(env, "Expected an audio file path, buffer or file descriptor").ThrowAsJavaScriptException();
+      return env.Null();
+    }
+    if (info[0].IsNumber() && info[0].As<Napi::Number>().Int32Value() < 0) {
+      Napi::TypeError::New(env, "File descriptor must be non-negative").ThrowAsJavaScriptException();
+      return env.Null();
+    }
+
+    const std::string path = info[0].IsString() ? std::string(info[0].As<Napi::String>()) : std::string();
+    // Only compressed files use the rate; WAV and FLAC keep their own.
+    int sampleRate = 44100;
+    if (info.Length() > 1 && info[1].IsObject()) {
+      const Napi::Object options = info[1].As<Napi::Object>();
+      if (options.Has("sampleRate") && options.Get("sampleRate").IsNumber()) {
+        sampleRate = options.Get("sampleRate").As<Napi::Number>().Int32Value();
       }
     }
-    
-    // Apply window
-    for (int i = 0; i < samplesPerBit; i++) {
-      const double window = 0.5 * (1.0 - std::cos(2.0 * kPi * i / (samplesPerBit - 1)));
-      pnSequences[pos][i] *= window;
-    }
-  }
-  
-  // Debug: show first PN stats
-  double pnSum = 0, pnAbsSum = 0;
-  for (int i = 0; i < samplesPerBit; i++) {
-    pnSum += pnSequences[0][i];
-    pnAbsSum += std::abs(pnSequences[0][i]);
-  }
-  fprintf(stderr, "EMBED PN[0] sequence: sum=%.6f absSum=%.6f\n", pnSum, pnAbsSum);
-  
-  // Embed watermark using spread spectrum with position-specific PN sequences
-  size_t bitIndex = 0;
-  for (size_t blockStart = 0; blockStart + samplesPerBit <= totalSamples; blockStart += samplesPerBit) {
-    const size_t actualBitIndex = bitIndex % bitstream.size();
-    const int bit = bitstream[actualBitIndex] ? 1 : 0;
-    
-    // Get the PN sequence for this bit position
-    const std::vector<double>& pnSequence = pnSequences[actualBitIndex];
-    
-    // Bipolar modulation: bit 1 = +PN, bit 0 = -PN
-    const double sign = bit ? 1.0 : -1.0;
-    
-    // Calculate local signal energy for adaptive strength
-    double localEnergy = 0;
-    for (int i = 0; i < samplesPerBit; i++) {
-      const double sample = (left[blockStart + i] + right[blockStart + i]) * 0.5;
-      localEnergy += sample * sample;
-    }
-    localEnergy = std::sqrt(localEnergy / samplesPerBit);
-    
-    // Adaptive strength: use psychoacoustic masking - stronger in loud parts (masked), weaker in quiet
-    const double adaptiveStrength = strength * std::clamp(localEnergy * 4.0, 0.1, 0.6);
-    
-    // Handle remove bits (for re-signing)
-    int removeBit = -1;
-    if (!removeBits.empty()) {
-      removeBit = removeBits[actualBitIndex % removeBits.size()] ? 1 : 0;
-    }
-    
-    // Apply PN sequence to audio
-    for (int i = 0; i < samplesPerBit; i++) {
-      const size_t idx = blockStart + i;
-      double delta = pnSequence[i] * sign * adaptiveStrength;
-      
-      // If removing old watermark, subtract its contribution
-      if (removeBit >= 0) {
-        const double oldSign = removeBit ? 1.0 : -1.0;
-        delta -= pnSequence[i] * oldSign * adaptiveStrength;
+    OpenAudioWorker* worker = new OpenAudioWorker(env, path, info[0], sampleRate);
+    Napi::Promise promise = worker->Promise();
+    worker->Queue();
+    return promise;
+  } catch (const std::exception& ex) {
+    Napi::Error::New(env, ex.what()).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+}
+
+static Napi::Value CloseAudio(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  if (info.Length() > 0 && info[0].IsExternal()) {
+    info[0].As<Napi::External<AudioHandleBox>>().Data()->audio.reset();
+  }
+  return env.Null();
+}
+
+// ----------------------------------------------------------------------------
+// Stream embedder (signMedia)
+// ----------------------------------------------------------------------------
+
+// A musmark_embedder fed f32le bytes straight from a decoder's stdout. Pipe
+// chunks need not end on a frame, so a partial frame waits in `carry`. The
+// key outlives the embedder that borrows it; calls are serialized by the
+// JS side, the mutex only guards against misuse.
+struct StreamEmbedder {
+  std::shared_ptr<musmark_key> key;
+  musmark_embedder* embedder = nullptr;
+  int channels = 0;
+  std::vector<char> carry;
+  std::mutex mutex;
+  ~StreamEmbedder() { musmark_embedder_destroy(embedder); }
+};
+
+struct StreamEmbedderBox {
+  std::shared_ptr<StreamEmbedder> embedder;
+};
+
+// Marks one chunk (or, with no buffer, releases the tail) off the event loop
+// and resolves with every marked byte available so far.
+class EmbedChunkWorker : public Napi::AsyncWorker {
+ public:
+  EmbedChunkWorker(Napi::Env env, std::shared_ptr<StreamEmbedder> embedder, Napi::Value buffer)
+    : Napi::AsyncWorker(env), embedder_(std::move(embedder)), deferred_(Napi::Promise::Deferred::New(env)) {
+    if (buffer.IsBuffer()) {
+      const Napi::Buffer<uint8_t> data = buffer.As<Napi::Buffer<uint8_t>>();
+      data_ = data.Data();
+      size_ = data.Length();
+      buffer_ = Napi::Persistent(buffer.As<Napi::Object>());
+    }
+  }
+
+  Napi::Promise Promise() const { return deferred_.Promise(); }
+
+  void Execute() override {
+    try {
+      StreamEmbedder& e = *embedder_;
+      std::lock_guard<std::mutex> lock(e.mutex);
+      const size_t frameBytes = static_cast<size_t>(e.channels) * sizeof(float);
+      if (data_) {
+        // Frames are copied into float storage, which also fixes alignment.
+        e.carry.insert(e.carry.end(), data_, data_ + size_);
+        const size_t frames = e.carry.size() / frameBytes;
+        if (frames > 0) {
+          std::vector<float> samples(frames * e.channels);
+          std::memcpy(samples.data(), e.carry.data(), frames * frameBytes);
+          e.carry.erase(e.carry.begin(), e.carry.begin() + frames * frameBytes);
+          check(musmark_embedder_write(e.embedder, samples.data(), frames));
+        }
+      } else {
+        check(musmark_embedder_finish(e.embedder));
       }
-      
-      left[idx] += static_cast<float>(delta);
-      right[idx] += static_cast<float>(delta);
+      output_.resize(musmark_embedder_available(e.embedder) * e.channels);
+      size_t frames = 0;
+      check(musmark_embedder_read(e.embedder, output_.data(), output_.size() / e.channels, &frames));
+    } catch (const std::exception& ex) {
+      SetError(ex.what());
     }
-    
-    bitIndex++;
   }
-  
-  std::vector<float> interleaved(wav.samples.size());
-  writeChannelSamples(interleaved, left, channels, 0);
-  if (channels > 1) {
-    writeChannelSamples(interleaved, right, channels, 1);
+
+  void OnOK() override {
+    deferred_.Resolve(Napi::Buffer<uint8_t>::Copy(Env(), reinterpret_cast<const uint8_t*>(output_.data()),
+      output_.size() * sizeof(float)));
   }
 
-    WavData outWav{ wav.sampleRate, wav.channels, std::move(interleaved) };
-    writeWav(outputPath, outWav);
+  void OnError(const Napi::Error& error) override { deferred_.Reject(error.Value()); }
+
+ private:
+  std::shared_ptr<StreamEmbedder> embedder_;
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  Napi::ObjectReference buffer_;
+  std::vector<float> output_;
+  Napi::Promise::Deferred deferred_;
+};
+
+static Napi::Value CreateEmbedder(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
 
+  try {
+    if (info.Length() < 1 || !info[0].IsObject()) {
+      Napi::TypeError::New(env, "Expected options").ThrowAsJavaScriptException();
+      return env.Null();
+    }
+    const Napi::Object options = info[0].As<Napi::Object>();
+    const std::string secret = options.Get("secret").As<Napi::String>();
+    const std::string signatureId = options.Get("signatureId").As<Napi::String>();
+    const int hopSize = options.Get("hopSize").As<Napi::Number>().Int32Value();
+
+    auto embedder = std::make_shared<StreamEmbedder>();
+    embedder->channels = options.Get("channels").As<Napi::Number>().Int32Value();
+    embedder->key = acquireKey(secret, hopSize);
+    check(musmark_embedder_create(embedder->key.get(), signatureId.c_str(), embedder->channels,
+      toCPriority(getPriority(options, JobPriority::Batch)), &embedder->embedder));
+    return Napi::External<StreamEmbedderBox>::New(env, new StreamEmbedderBox{ embedder },
+      [](Napi::Env, StreamEmbedderBox* box) { delete box; });
+  } catch (const std::exception& ex) {
+    Napi::Error::New(env, ex.what()).ThrowAsJavaScriptException();
     return env.Null();
+  }
+}
+
+static Napi::Value EmbedChunk(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  try {
+    if (info.Length() < 2 || !info[0].IsExternal() || !(info[1].IsBuffer() || info[1].IsNull())) {
+      Napi::TypeError::New(env, "Expected an embedder and a buffer or null").ThrowAsJavaScriptException();
+      return env.Null();
+    }
+    EmbedChunkWorker* worker = new EmbedChunkWorker(env,
+      info[0].As<Napi::External<StreamEmbedderBox>>().Data()->embedder, info[1]);
+    Napi::Promise promise = worker->Promise();
+    worker->Queue();
+    return promise;
   } catch (const std::exception& ex) {
     Napi::Error::New(env, ex.what()).ThrowAsJavaScriptException();
     return env.Null();
   }
 }
 
-static Napi::Value ExtractWatermark(const Napi::CallbackInfo& info) {
+static Napi::Value ConfigureScheduler(const Napi::CallbackInfo& info) {
   Napi::Env env = info.Env();
 
   try {
-    if (info.Length() < 2) {
-      Napi::TypeError::New(env, "Expected inputPath, options").ThrowAsJavaScriptException();
+    if (info.Length() < 1 || !info[0].IsObject()) {
+      Napi::TypeError::New(env, "Expected options").ThrowAsJavaScriptException();
       return env.Null();
     }
 
-  const std::string inputPath = info[0].As<Napi::String>();
-  const Napi::Object options = info[1].As<Napi::Object>();
-  const int sampleRate = options.Get("sampleRate").As<Napi::Number>().Int32Value();
-  const int channels = options.Get("channels").As<Napi::Number>().Int32Value();
-  const int blockSize = options.Get("blockSize").As<Napi::Number>().Int32Value();
-  const int hopSize = options.Get("hopSize").As<Napi::Number>().Int32Value();
-  const std::string secret = options.Get("secret").As<Napi::String>();
-  const double embedStrength = options.Has("embedStrength")
-    ? options.Get("embedStrength").As<Napi::Number>().DoubleValue()
-    : 0.005;
+    const Napi::Object options = info[0].As<Napi::Object>();
+    if (options.Has("threads") && options.Get("threads").IsNumber()) {
+      setSchedulerThreads(options.Get("threads").As<Napi::Number>().Int32Value());
+    }
+    if (options.Has("chunkBlocks") && options.Get("chunkBlocks").IsNumber()) {
+      setSchedulerChunkBlocks(options.Get("chunkBlocks").As<Napi::Number>().Int32Value());
+    }
+    return env.Null();
+  } catch (const std::exception& ex) {
+    Napi::Error::New(env, ex.what()).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+}
 
-    WavData wav = readWav(inputPath);
-    if (wav.sampleRate != sampleRate || wav.channels != channels) {
-      throw std::runtime_error("Unexpected WAV format");
-    }
-
-  std::vector<float> left = getChannelSamples(wav.samples, channels, 0);
-  std::vector<float> right = channels > 1 ? getChannelSamples(wav.samples, channels, 1) : left;
-
-  const size_t totalSamples = left.size();
-  
-  // =========================================================================
-  // SPREAD SPECTRUM EXTRACTION WITH POSITION-DEPENDENT PN SEQUENCES
-  // Must match the embedding: each bit position uses a unique PN sequence
-  // =========================================================================
-  
-  const uint64_t baseSeed = hashSecret(secret);
-  const int samplesPerBit = hopSize * 4;  // Must match embedding
-  
-  // We need to know the payload length to generate matching PN sequences
-  // Use the expected period (464 bits) from the payload structure
-  const int payloadLen = 64 + 16 + (16 + 32) * 8;  // = 464 bits
-  
-  // Pre-generate PN sequences for each bit position (matching embedding)
-  std::vector<std::vector<double>> pnSequences(payloadLen, std::vector<double>(samplesPerBit));
-  
-  for (int pos = 0; pos < payloadLen; pos++) {
-    // Unique seed for each bit position (must match embedding!)
-    XorShift64 prng(baseSeed ^ (static_cast<uint64_t>(pos) * 0x9e3779b97f4a7c15ULL));
-    
-    // Generate raw PN
-    std::vector<double> rawPN(samplesPerBit);
-    for (int i = 0; i < samplesPerBit; i++) {
-      rawPN[i] = prng.nextDouble() * 2.0 - 1.0;
-    }
-    
-    // Low-pass filter
-    const int filterWidth = 32;
-    for (int i = 0; i < samplesPerBit; i++) {
-      double sum = 0;
-      int count = 0;
-      for (int j = -filterWidth; j <= filterWidth; j++) {
-        int idx = i + j;
-        if (idx >= 0 && idx < samplesPerBit) {
-          sum += rawPN[idx];
-          count++;
-        }
+static Napi::Value GetSchedulerInfo(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  const SchedulerInfo stats = schedulerInfo();
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("threads", stats.threads);
+  result.Set("hardwareThreads", stats.hardwareThreads);
+  result.Set("cgroupLimit", stats.cgroupLimit);
+  result.Set("chunkBlocks", stats.chunkBlocks);
+  return result;
+}
+
+static Napi::Object DetectionCacheStatsToObject(Napi::Env env) {
+  const DetectionCacheStats stats = detectionCacheStats();
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("entries", static_cast<double>(stats.entries));
+  result.Set("maxEntries", static_cast<double>(stats.capacity));
+  result.Set("hits", static_cast<double>(stats.hits));
+  result.Set("misses", static_cast<double>(stats.misses));
+  result.Set("coalesced", static_cast<double>(stats.coalesced));
+  result.Set("evictions", static_cast<double>(stats.evictions));
+  return result;
+}
+
+static Napi::Value ConfigureDetectionCache(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() > 0 && info[0].IsObject()) {
+    const Napi::Object options = info[0].As<Napi::Object>();
+    if (options.Has("clear") && options.Get("clear").ToBoolean()) clearDetectionCache();
+    if (options.Has("maxEntries") && options.Get("maxEntries").IsNumber()) {
+      setDetectionCacheCapacity(options.Get("maxEntries").As<Napi::Number>().Uint32Value());
+    }
+  }
+  return DetectionCacheStatsToObject(env);
+}
+
+static Napi::Object MasterCacheStatsToObject(Napi::Env env) {
+  const MasterCacheStats stats = masterCacheStats();
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("entries", static_cast<double>(stats.entries));
+  result.Set("bytes", static_cast<double>(stats.bytes));
+  result.Set("rawBytes", static_cast<double>(stats.rawBytes));
+  result.Set("maxBytes", static_cast<double>(stats.capacityBytes));
+  result.Set("hits", static_cast<double>(stats.hits));
+  result.Set("misses", static_cast<double>(stats.misses));
+  result.Set("coalesced", static_cast<double>(stats.coalesced));
+  result.Set("evictions", static_cast<double>(stats.evictions));
+  return result;
+}
+
+static Napi::Value ConfigureMasterCache(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() > 0 && info[0].IsObject()) {
+    const Napi::Object options = info[0].As<Napi::Object>();
+    if (options.Has("clear") && options.Get("clear").ToBoolean()) clearMasterCache();
+    if (options.Has("maxBytes") && options.Get("maxBytes").IsNumber()) {
+      const double maxBytes = options.Get("maxBytes").As<Napi::Number>().DoubleValue();
+      setMasterCacheCapacity(maxBytes > 0 ? static_cast<size_t>(maxBytes) : 0);
+    }
+  }
+  return MasterCacheStatsToObject(env);
+}
+
+static Napi::Value CpuFeatures(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+  const std::vector<CpuIsa> isas = availableKernelIsas();
+  Napi::Array available = Napi::Array::New(env, isas.size());
+  for (size_t i = 0; i < isas.size(); i++) {
+    available.Set(static_cast<uint32_t>(i), Napi::String::New(env, cpuIsaName(isas[i])));
+  }
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("detected", cpuIsaName(detectCpuIsa()));
+  result.Set("active", cpuIsaName(kernels().isa));
+  result.Set("available", available);
+  return result;
+}
+
+static Napi::Value SetKernelIsa(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 1 || !info[0].IsString()) {
+    Napi::TypeError::New(env, "Expected ISA name").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+
+  const std::string name = info[0].As<Napi::String>();
+  CpuIsa isa;
+  if (!parseCpuIsa(name, isa) || !selectKernels(isa)) {
+    Napi::Error::New(env, "Kernel ISA not available on this CPU: " + name).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  return env.Null();
+}
+
+static Napi::Object WisdomToObject(Napi::Env env, const Wisdom& wisdom) {
+  Napi::Object result = Napi::Object::New(env);
+  result.Set("threads", wisdom.threads);
+  result.Set("chunkBlocks", wisdom.chunkBlocks);
+  result.Set("isa", cpuIsaName(wisdom.isa));
+  result.Set("embedSpeed", wisdom.embedSpeed);
+  result.Set("extractSpeed", wisdom.extractSpeed);
+  return result;
+}
+
+class AutotuneWorker : public Napi::AsyncWorker {
+ public:
+  AutotuneWorker(Napi::Env env, AutotuneOptions options, std::string path)
+    : Napi::AsyncWorker(env), options_(options), path_(std::move(path)), deferred_(Napi::Promise::Deferred::New(env)) {}
+
+  Napi::Promise Promise() const { return deferred_.Promise(); }
+
+  void Execute() override {
+    try {
+      wisdom_ = autotune(options_);
+      if (!path_.empty()) saveWisdom(path_, wisdom_);
+    } catch (const std::exception& ex) {
+      SetError(ex.what());
+    }
+  }
+
+  void OnOK() override {
+    Napi::Object result = WisdomToObject(Env(), wisdom_);
+    result.Set("path", path_);
+    deferred_.Resolve(result);
+  }
+
+  void OnError(const Napi::Error& error) override { deferred_.Reject(error.Value()); }
+
+ private:
+  AutotuneOptions options_;
+  std::string path_;
+  Wisdom wisdom_;
+  Napi::Promise::Deferred deferred_;
+};
+
+static Napi::Value Autotune(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  try {
+    AutotuneOptions options;
+    std::string path = defaultWisdomPath();
+    if (info.Length() > 0 && info[0].IsObject()) {
+      const Napi::Object opts = info[0].As<Napi::Object>();
+      if (opts.Has("audioSeconds") && opts.Get("audioSeconds").IsNumber()) {
+        options.audioSeconds = opts.Get("audioSeconds").As<Napi::Number>().DoubleValue();
       }
-      pnSequences[pos][i] = sum / count;
-    }
-    
-    // Remove DC
-    const int dcWidth = 256;
-    std::vector<double> temp = pnSequences[pos];
-    for (int i = 0; i < samplesPerBit; i++) {
-      double sum = 0;
-      int count = 0;
-      for (int j = -dcWidth; j <= dcWidth; j++) {
-        int idx = i + j;
-        if (idx >= 0 && idx < samplesPerBit) {
-          sum += temp[idx];
-          count++;
-        }
+      if (opts.Has("repetitions") && opts.Get("repetitions").IsNumber()) {
+        options.repetitions = opts.Get("repetitions").As<Napi::Number>().Int32Value();
       }
-      pnSequences[pos][i] -= sum / count;
-    }
-    
-    // Normalize
-    double energy = 0;
-    for (int i = 0; i < samplesPerBit; i++) {
-      energy += pnSequences[pos][i] * pnSequences[pos][i];
-    }
-    double norm = std::sqrt(energy / samplesPerBit);
-    if (norm > 1e-10) {
-      for (int i = 0; i < samplesPerBit; i++) {
-        pnSequences[pos][i] /= norm;
+      if (opts.Has("path")) {
+        // null skips saving; a string overrides the default location
+        path = opts.Get("path").IsString() ? std::string(opts.Get("path").As<Napi::String>()) : std::string();
       }
     }
-    
-    // Apply window
-    for (int i = 0; i < samplesPerBit; i++) {
-      const double window = 0.5 * (1.0 - std::cos(2.0 * kPi * i / (samplesPerBit - 1)));
-      pnSequences[pos][i] *= window;
+
+    AutotuneWorker* worker = new AutotuneWorker(env, options, path);
+    Napi::Promise promise = worker->Promise();
+    worker->Queue();
+    return promise;
+  } catch (const std::exception& ex) {
+    Napi::Error::New(env, ex.what()).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+}
+
+static Napi::Value LoadWisdom(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  const std::string path = info.Length() > 0 && info[0].IsString()
+    ? std::string(info[0].As<Napi::String>())
+    : defaultWisdomPath();
+  Wisdom wisdom;
+  if (path.empty() || !loadWisdom(path, wisdom) || !applyWisdom(wisdom)) {
+    return env.Null();
+  }
+  return WisdomToObject(env, wisdom);
+}
+
+// Synthetic material and simulated attacks write their result to a file
+// (WAV, or FLAC by extension) off the event loop.
+class AudioToolWorker : public Napi::AsyncWorker {
+ public:
+  using Produce = std::function<WavData()>;
+
+  AudioToolWorker(Napi::Env env, std::string outputPath, Produce produce, JobPriority priority)
+    : Napi::AsyncWorker(env), outputPath_(std::move(outputPath)), produce_(std::move(produce)), priority_(priority),
+      deferred_(Napi::Promise::Deferred::New(env)) {}
+
+  Napi::Promise Promise() const { return deferred_.Promise(); }
+
+  void Execute() override {
+    try {
+      const WavData wav = produce_();
+      frames_ = wav.samples.size() / wav.channels;
+      sampleRate_ = wav.sampleRate;
+      channels_ = wav.channels;
+      writeAudioFile(outputPath_, wav, priority_);
+    } catch (const std::exception& ex) {
+      SetError(ex.what());
     }
   }
-  
-  // Debug: show first PN stats
-  double pnSum = 0, pnAbsSum = 0;
-  for (int i = 0; i < samplesPerBit; i++) {
-    pnSum += pnSequences[0][i];
-    pnAbsSum += std::abs(pnSequences[0][i]);
+
+  void OnOK() override {
+    Napi::Object result = Napi::Object::New(Env());
+    result.Set("outputPath", outputPath_);
+    result.Set("frames", static_cast<double>(frames_));
+    result.Set("sampleRate", sampleRate_);
+    result.Set("channels", channels_);
+    result.Set("durationSeconds", sampleRate_ > 0 ? static_cast<double>(frames_) / sampleRate_ : 0.0);
+    deferred_.Resolve(result);
   }
-  fprintf(stderr, "EXTRACT PN[0] sequence: sum=%.6f absSum=%.6f\n", pnSum, pnAbsSum);
-  
-  std::vector<uint8_t> bits;
-  std::vector<float> correlations;  // Store actual correlation values for soft voting
-  bits.reserve(totalSamples / samplesPerBit);
-  correlations.reserve(totalSamples / samplesPerBit);
-  
-  double confidenceSum = 0.0;
-  size_t bitsAnalyzed = 0;
-  
-  // Extract correlations using position-specific PN sequences
-  size_t bitIndex = 0;
-  for (size_t blockStart = 0; blockStart + samplesPerBit <= totalSamples; blockStart += samplesPerBit) {
-    const size_t actualBitIndex = bitIndex % payloadLen;
-    const std::vector<double>& pnSequence = pnSequences[actualBitIndex];
-    
-    double correlation = 0.0;
-    double signalEnergy = 0.0;
-    double pnEnergy = 0.0;
-    
-    for (int i = 0; i < samplesPerBit; i++) {
-      const double sample = (left[blockStart + i] + right[blockStart + i]) * 0.5;
-      correlation += sample * pnSequence[i];
-      signalEnergy += sample * sample;
-      pnEnergy += pnSequence[i] * pnSequence[i];
-    }
-    
-    // Normalize correlation by signal energy for comparable values across blocks
-    double normalizedCorr = 0.0;
-    if (signalEnergy > 1e-20) {
-      normalizedCorr = correlation / std::sqrt(signalEnergy);
-    }
-    
-    correlations.push_back(static_cast<float>(normalizedCorr));
-    
-    double conf = 0;
-    if (signalEnergy > 1e-20 && pnEnergy > 1e-20) {
-      conf = std::abs(correlation) / std::sqrt(signalEnergy * pnEnergy);
-    }
-    confidenceSum += std::min(1.0, conf);
-    bitsAnalyzed++;
-    bitIndex++;
-  }
-  
-  // Convert correlations to bits (will be refined by voting in TypeScript)
-  for (size_t i = 0; i < correlations.size(); i++) {
-    bits.push_back(correlations[i] > 0 ? 1 : 0);
+
+  void OnError(const Napi::Error& error) override { deferred_.Reject(error.Value()); }
+
+ private:
+  std::string outputPath_;
+  Produce produce_;
+  JobPriority priority_;
+  size_t frames_ = 0;
+  int sampleRate_ = 0;
+  int channels_ = 0;
+  Napi::Promise::Deferred deferred_;
+};
+
+static Napi::Value SynthesizeAudio(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  try {
+    if (info.Length() < 1 || !info[0].IsString()) {
+      Napi::TypeError::New(env, "Expected outputPath, options").ThrowAsJavaScriptException();
+      return env.Null();
+    }
+    SynthOptions options;
+    JobPriority priority = JobPriority::Batch;
+    if (info.Length() > 1 && info[1].IsObject()) {
+      const Napi::Object opts = info[1].As<Napi::Object>();
+      if (opts.Has("seconds") && opts.Get("seconds").IsNumber()) {
+        options.seconds = opts.Get("seconds").As<Napi::Number>().DoubleValue();
+      }
+      if (opts.Has("sampleRate") && opts.Get("sampleRate").IsNumber()) {
+        options.sampleRate = opts.Get("sampleRate").As<Napi::Number>().Int32Value();
+      }
+      if (opts.Has("channels") && opts.Get("channels").IsNumber()) {
+        options.channels = opts.Get("channels").As<Napi::Number>().Int32Value();
+      }
+      if (opts.Has("seed") && opts.Get("seed").IsNumber()) {
+        options.seed = static_cast<uint64_t>(opts.Get("seed").As<Napi::Number>().Int64Value());
+      }
+      if (opts.Has("silence") && opts.Get("silence").IsNumber()) {
+        options.silence = opts.Get("silence").As<Napi::Number>().DoubleValue();
+      }
+      if (opts.Has("program") && opts.Get("program").IsString()) {
+        const std::string program = opts.Get("program").As<Napi::String>();
+        if (!parseSynthProgram(program, options.program)) throw std::runtime_error("Unknown program: " + program);
+      }
+      priority = getPriority(opts, JobPriority::Batch);
+    }
+
+    AudioToolWorker* worker = new AudioToolWorker(env, info[0].As<Napi::String>(), [options, priority]() {
+      return synthesizeAudio(options, priority);
+    }, priority);
+    Napi::Promise promise = worker->Promise();
+    worker->Queue();
+    return promise;
+  } catch (const std::exception& ex) {
+    Napi::Error::New(env, ex.what()).ThrowAsJavaScriptException();
+    return env.Null();
   }
+}
 
-    Napi::Object result = Napi::Object::New(env);
-    result.Set("bitstream", Napi::Buffer<uint8_t>::Copy(env, bits.data(), bits.size()));
-    result.Set("correlations", Napi::Buffer<float>::Copy(env, correlations.data(), correlations.size()));
-    result.Set("bitConfidence", bitsAnalyzed ? confidenceSum / bitsAnalyzed : 0.0);
-    result.Set("bandAgreement", 1.0);
-    result.Set("blocksAnalyzed", static_cast<double>(bitsAnalyzed));
-    return result;
+static Napi::Value SimulateAttacks(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  try {
+    if (info.Length() < 3 || !info[0].IsString() || !info[1].IsString() || !info[2].IsArray()) {
+      Napi::TypeError::New(env, "Expected inputPath, outputPath, attacks, options").ThrowAsJavaScriptException();
+      return env.Null();
+    }
+    // Parsed here so that a bad spec rejects before any work is queued.
+    std::vector<Attack> attacks;
+    const Napi::Array specs = info[2].As<Napi::Array>();
+    for (uint32_t i = 0; i < specs.Length(); i++) {
+      attacks.push_back(parseAttack(specs.Get(i).As<Napi::String>()));
+    }
+    uint64_t seed = 1;
+    JobPriority priority = JobPriority::Batch;
+    if (info.Length() > 3 && info[3].IsObject()) {
+      const Napi::Object opts = info[3].As<Napi::Object>();
+      if (opts.Has("seed") && opts.Get("seed").IsNumber()) {
+        seed = static_cast<uint64_t>(opts.Get("seed").As<Napi::Number>().Int64Value());
+      }
+      priority = getPriority(opts, JobPriority::Batch);
+    }
+
+    const std::string inputPath = info[0].As<Napi::String>();
+    AudioToolWorker* worker = new AudioToolWorker(env, info[1].As<Napi::String>(), [inputPath, attacks, seed, priority]() {
+      return applyAttacks(readAudioFile(inputPath, priority), attacks, seed, priority);
+    }, priority);
+    Napi::Promise promise = worker->Promise();
+    worker->Queue();
+    return promise;
+  } catch (const std::exception& ex) {
+    Napi::Error::New(env, ex.what()).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+}
+
+// Records reach JS through the progress queue, which node-addon-api drains
+// before OnOK, so the promise never settles ahead of the last callback.
+// Runs a plain scan, or a leased one when `leased` is set.
+class ScanWorker : public Napi::AsyncProgressQueueWorker<char> {
+ public:
+  ScanWorker(Napi::Env env, LeaseScanOptions options, bool leased, Napi::Function onResult)
+    : Napi::AsyncProgressQueueWorker<char>(env),
+      options_(std::move(options)),
+      leased_(leased),
+      deferred_(Napi::Promise::Deferred::New(env)) {
+    if (!onResult.IsEmpty()) onResult_ = Napi::Persistent(onResult);
+  }
+
+  Napi::Promise Promise() const { return deferred_.Promise(); }
+
+  void Execute(const ExecutionProgress& progress) override {
+    try {
+      ScanCallback callback;
+      if (!onResult_.IsEmpty()) {
+        callback = [&progress](const std::string& line) { progress.Send(line.data(), line.size()); };
+      }
+      if (leased_) summary_ = runLeaseScan(options_, callback);
+      else summary_.scan = scanCorpus(options_.scan, callback);
+    } catch (const std::exception& ex) {
+      SetError(ex.what());
+    }
+  }
+
+  void OnProgress(const char* data, size_t count) override {
+    onResult_.Call({ Napi::String::New(Env(), std::string(data, count)) });
+  }
+
+  void OnOK() override {
+    const ScanSummary& scan = summary_.scan;
+    Napi::Object result = Napi::Object::New(Env());
+    if (leased_) {
+      result.Set("shards", static_cast<double>(summary_.shards));
+      result.Set("reclaimed", static_cast<double>(summary_.reclaimed));
+      result.Set("lost", static_cast<double>(summary_.lost));
+      result.Set("complete", summary_.complete);
+    }
+    result.Set("scanned", static_cast<double>(scan.scanned));
+    result.Set("skipped", static_cast<double>(scan.skipped));
+    result.Set("decoded", static_cast<double>(scan.decoded));
+    result.Set("rejected", static_cast<double>(scan.rejected));
+    result.Set("failed", static_cast<double>(scan.failed));
+    result.Set("seconds", scan.seconds);
+    deferred_.Resolve(result);
+  }
+
+  void OnError(const Napi::Error& error) override { deferred_.Reject(error.Value()); }
+
+ private:
+  LeaseScanOptions options_;
+  bool leased_;
+  LeaseScanSummary summary_;
+  Napi::FunctionReference onResult_;
+  Napi::Promise::Deferred deferred_;
+};
+
+static std::vector<std::string> getStrings(const Napi::Value& value) {
+  std::vector<std::string> items;
+  if (value.IsString()) {
+    items.push_back(value.As<Napi::String>());
+  } else if (value.IsArray()) {
+    const Napi::Array array = value.As<Napi::Array>();
+    for (uint32_t i = 0; i < array.Length(); i++) items.push_back(array.Get(i).As<Napi::String>());
+  }
+  return items;
+}
+
+static std::string getString(const Napi::Object& options, const char* name) {
+  return options.Has(name) && options.Get(name).IsString() ? std::string(options.Get(name).As<Napi::String>()) : std::string();
+}
+
+static uint32_t getCount(const Napi::Object& options, const char* name, uint32_t fallback) {
+  return options.Has(name) && options.Get(name).IsNumber() ? options.Get(name).As<Napi::Number>().Uint32Value() : fallback;
+}
+
+static ScanOptions getScanOptions(const Napi::Value& secrets, const Napi::Object& opts) {
+  ScanOptions options;
+  options.secrets = getStrings(secrets);
+  options.hopSize = opts.Get("hopSize").As<Napi::Number>().Int32Value();
+  options.outputPath = getString(opts, "output");
+  options.checkpointPath = getString(opts, "checkpoint");
+  if (opts.Has("extensions") && opts.Get("extensions").IsArray()) {
+    options.extensions = getStrings(opts.Get("extensions"));
+  }
+  options.workers = getCount(opts, "workers", static_cast<uint32_t>(options.workers));
+  options.ioThreads = getCount(opts, "ioThreads", static_cast<uint32_t>(options.ioThreads));
+  options.prefetch = getCount(opts, "prefetch", static_cast<uint32_t>(options.prefetch));
+  if (opts.Has("triage") && opts.Get("triage").IsBoolean()) {
+    options.triage = opts.Get("triage").As<Napi::Boolean>().Value();
+  }
+  options.sampleRate = static_cast<int>(getCount(opts, "sampleRate", static_cast<uint32_t>(options.sampleRate)));
+  options.storePath = getString(opts, "store");
+  return options;
+}
+
+static Napi::Value QueueScan(const Napi::CallbackInfo& info, LeaseScanOptions options, bool leased) {
+  const Napi::Function onResult = info.Length() > 3 && info[3].IsFunction()
+    ? info[3].As<Napi::Function>()
+    : Napi::Function();
+  ScanWorker* worker = new ScanWorker(info.Env(), std::move(options), leased, onResult);
+  Napi::Promise promise = worker->Promise();
+  worker->Queue();
+  return promise;
+}
+
+static Napi::Value ScanCorpus(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  try {
+    if (info.Length() < 3 || !info[2].IsObject()) {
+      Napi::TypeError::New(env, "Expected inputs, secrets, options").ThrowAsJavaScriptException();
+      return env.Null();
+    }
+
+    LeaseScanOptions options;
+    options.scan = getScanOptions(info[1], info[2].As<Napi::Object>());
+    options.scan.inputs = getStrings(info[0]);
+    if (options.scan.inputs.empty() || options.scan.secrets.empty()) {
+      Napi::TypeError::New(env, "scanCorpus needs at least one input and one key").ThrowAsJavaScriptException();
+      return env.Null();
+    }
+    return QueueScan(info, std::move(options), false);
   } catch (const std::exception& ex) {
     Napi::Error::New(env, ex.what()).ThrowAsJavaScriptException();
     return env.Null();
   }
 }
 
+static Napi::Value ScanLeased(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  try {
+    if (info.Length() < 3 || !info[0].IsString() || !info[2].IsObject()) {
+      Napi::TypeError::New(env, "Expected directory, secrets, options").ThrowAsJavaScriptException();
+      return env.Null();
+    }
+
+    const Napi::Object opts = info[2].As<Napi::Object>();
+    LeaseScanOptions options;
+    options.scan = getScanOptions(info[1], opts);
+    options.directory = info[0].As<Napi::String>();
+    options.manifestPath = getString(opts, "manifest");
+    options.workerId = getString(opts, "workerId");
+    options.reportPath = getString(opts, "report");
+    options.shardSize = getCount(opts, "shardSize", static_cast<uint32_t>(options.shardSize));
+    options.leaseSeconds = static_cast<int>(getCount(opts, "leaseSeconds", static_cast<uint32_t>(options.leaseSeconds)));
+    if (options.scan.secrets.empty()) {
+      Napi::TypeError::New(env, "scanLeased needs at least one key").ThrowAsJavaScriptException();
+      return env.Null();
+    }
+    return QueueScan(info, std::move(options), true);
+  } catch (const std::exception& ex) {
+    Napi::Error::New(env, ex.what()).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+}
+
+static Napi::Value MergeLeaseScan(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 2 || !info[0].IsString() || !info[1].IsString()) {
+    Napi::TypeError::New(env, "Expected directory, reportPath").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  try {
+    const size_t records = mergeLeaseScan(info[0].As<Napi::String>(), info[1].As<Napi::String>());
+    return Napi::Number::New(env, static_cast<double>(records));
+  } catch (const std::exception& ex) {
+    Napi::Error::New(env, ex.what()).ThrowAsJavaScriptException();
+    return env.Null();
+  }
+}
+
+// The append is synced to disk, so it runs off the event loop.
+class StorePutWorker : public Napi::AsyncWorker {
+ public:
+  StorePutWorker(Napi::Env env, std::string directory, std::string signatureId, std::string payloadJson, std::string payloadHash)
+    : Napi::AsyncWorker(env),
+      directory_(std::move(directory)),
+      signatureId_(std::move(signatureId)),
+      payloadJson_(std::move(payloadJson)),
+      payloadHash_(std::move(payloadHash)),
+      deferred_(Napi::Promise::Deferred::New(env)) {}
+
+  Napi::Promise Promise() const { return deferred_.Promise(); }
+
+  void Execute() override {
+    try {
+      openSignatureStore(directory_)->put(signatureId_, payloadJson_, payloadHash_);
+    } catch (const std::exception& ex) {
+      SetError(ex.what());
+    }
+  }
+
+  void OnOK() override { deferred_.Resolve(Env().Undefined()); }
+  void OnError(const Napi::Error& error) override { deferred_.Reject(error.Value()); }
+
+ private:
+  std::string directory_;
+  std::string signatureId_;
+  std::string payloadJson_;
+  std::string payloadHash_;
+  Napi::Promise::Deferred deferred_;
+};
+
+static Napi::Value StorePut(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 4 || !info[0].IsString() || !info[1].IsString() || !info[2].IsString() || !info[3].IsString()) {
+    Napi::TypeError::New(env, "Expected directory, signatureId, payloadJson, payloadHash").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  StorePutWorker* worker = new StorePutWorker(
+    env,
+    info[0].As<Napi::String>(),
+    info[1].As<Napi::String>(),
+    info[2].As<Napi::String>(),
+    info[3].As<Napi::String>());
+  Napi::Promise promise = worker->Promise();
+  worker->Queue();
+  return promise;
+}
+
+// getMany may wait on another process's lock and replay its appends before
+// probing, so lookups run off the event loop too; misses resolve to null.
+class StoreLookupWorker : public Napi::AsyncWorker {
+ public:
+  StoreLookupWorker(Napi::Env env, std::string directory, std::vector<std::string> signatureIds)
+    : Napi::AsyncWorker(env),
+      directory_(std::move(directory)),
+      signatureIds_(std::move(signatureIds)),
+      deferred_(Napi::Promise::Deferred::New(env)) {}
+
+  Napi::Promise Promise() const { return deferred_.Promise(); }
+
+  void Execute() override {
+    try {
+      found_ = openSignatureStore(directory_)->getMany(signatureIds_);
+    } catch (const std::exception& ex) {
+      SetError(ex.what());
+    }
+  }
+
+  void OnOK() override {
+    Napi::Env env = Env();
+    Napi::Array result = Napi::Array::New(env, found_.size());
+    for (size_t i = 0; i < found_.size(); i++) {
+      if (!found_[i].found) {
+        result.Set(static_cast<uint32_t>(i), env.Null());
+        continue;
+      }
+      Napi::Object entry = Napi::Object::New(env);
+      entry.Set("payloadJson", found_[i].payloadJson);
+      entry.Set("payloadHash", found_[i].payloadHash);
+      result.Set(static_cast<uint32_t>(i), entry);
+    }
+    deferred_.Resolve(result);
+  }
+
+  void OnError(const Napi::Error& error) override { deferred_.Reject(error.Value()); }
+
+ private:
+  std::string directory_;
+  std::vector<std::string> signatureIds_;
+  std::vector<StoredSignature> found_;
+  Napi::Promise::Deferred deferred_;
+};
+
+static Napi::Value StoreLookup(const Napi::CallbackInfo& info) {
+  Napi::Env env = info.Env();
+
+  if (info.Length() < 2 || !info[0].IsString() || !info[1].IsArray()) {
+    Napi::TypeError::New(env, "Expected directory, signatureIds").ThrowAsJavaScriptException();
+    return env.Null();
+  }
+  StoreLookupWorker* worker = new StoreLookupWorker(env, info[0].As<Napi::String>(), getStrings(info[1]));
+  Napi::Promise promise = worker->Promise();
+  worker->Queue();
+  return promise;
+}
+
 static Napi::Object Init(Napi::Env env, Napi::Object exports) {
+  // Resolve the kernel table once at load so no call pays for CPUID, then let
+  // saved wisdom override the defaults.
+  kernels();
+  loadStartupWisdom();
+
   exports.Set("embedWatermark", Napi::Function::New(env, EmbedWatermark));
   exports.Set("extractWatermark", Napi::Function::New(env, ExtractWatermark));
+  exports.Set("triageWatermark", Napi::Function::New(env, TriageWatermark));
+  exports.Set("openAudio", Napi::Function::New(env, OpenAudio));
+  exports.Set("closeAudio", Napi::Function::New(env, CloseAudio));
+  exports.Set("createEmbedder", Napi::Function::New(env, CreateEmbedder));
+  exports.Set("embedChunk", Napi::Function::New(env, EmbedChunk));
+  exports.Set("configureScheduler", Napi::Function::New(env, ConfigureScheduler));
+  exports.Set("schedulerInfo", Napi::Function::New(env, GetSchedulerInfo));
+  exports.Set("configureDetectionCache", Napi::Function::New(env, ConfigureDetectionCache));
+  exports.Set("configureMasterCache", Napi::Function::New(env, ConfigureMasterCache));
+  exports.Set("cpuFeatures", Napi::Function::New(env, CpuFeatures));
+  exports.Set("setKernelIsa", Napi::Function::New(env, SetKernelIsa));
+  exports.Set("autotune", Napi::Function::New(env, Autotune));
+  exports.Set("loadWisdom", Napi::Function::New(env, LoadWisdom));
+  exports.Set("synthesizeAudio", Napi::Function::New(env, SynthesizeAudio));
+  exports.Set("simulateAttacks", Napi::Function::New(env, SimulateAttacks));
+  exports.Set("scanCorpus", Napi::Function::New(env, ScanCorpus));
+  exports.Set("scanLeased", Napi::Function::New(env, ScanLeased));
+  exports.Set("mergeLeaseScan", Napi::Function::New(env, MergeLeaseScan));
+  exports.Set("storePut", Napi::Function::New(env, StorePut));
+  exports.Set("storeLookup", Napi::Function::New(env, StoreLookup));
   return exports;
 }
 
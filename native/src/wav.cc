@@ -1,8 +1,27 @@
 #include "wav.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
 #include <fstream>
+#include <istream>
+#include <ostream>
 #include <stdexcept>
 #include <cstdint>
 #include <cstring>
+#include <iterator>
+#include <filesystem>
+#include <system_error>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#endif
+
+#include "fd_stream.h"
+
+// Size fields streaming writers leave when the length is not known yet.
+constexpr uint32_t kUnknownSize = 0xFFFFFFFF;
+// Floats read per step when the data runs to EOF.
+constexpr size_t kStreamChunk = 1 << 18;
 
 struct RiffHeader {
   char chunkId[4];
@@ -26,82 +45,520 @@ struct DataChunkHeader {
   uint32_t subchunk2Size;
 };
 
-static void readExact(std::ifstream& in, char* buffer, size_t size) {
+static void readExact(std::istream& in, char* buffer, size_t size) {
   in.read(buffer, size);
   if (in.gcount() != static_cast<std::streamsize>(size)) {
     throw std::runtime_error("Unexpected EOF");
   }
 }
 
+// Skips forward without seeking so pipes work as well as files.
+static void skipBytes(std::istream& in, uint64_t size) {
+  in.ignore(static_cast<std::streamsize>(size));
+  if (in.gcount() != static_cast<std::streamsize>(size)) {
+    throw std::runtime_error("Unexpected EOF");
+  }
+}
+
+// Reads a fmt chunk whose header was already consumed. WAVE_FORMAT_EXTENSIBLE
+// (multichannel files) is reported as the format of its subformat GUID.
+static void readFmt(std::istream& in, uint32_t size, FmtChunk& fmt) {
+  constexpr uint32_t kBaseSize = 16;
+  constexpr uint32_t kExtensibleSize = 40;
+  constexpr uint16_t kExtensible = 0xFFFE;
+  if (size < kBaseSize) {
+    throw std::runtime_error("Invalid fmt chunk");
+  }
+  std::memcpy(fmt.subchunk1Id, "fmt ", 4);
+  fmt.subchunk1Size = size;
+  readExact(in, reinterpret_cast<char*>(&fmt.audioFormat), kBaseSize);
+  uint32_t consumed = kBaseSize;
+  if (fmt.audioFormat == kExtensible && size >= kExtensibleSize) {
+    char extension[kExtensibleSize - kBaseSize];
+    readExact(in, extension, sizeof(extension));
+    std::memcpy(&fmt.audioFormat, extension + 8, sizeof(uint16_t));
+    consumed = kExtensibleSize;
+  }
+  skipBytes(in, uint64_t(size - consumed) + (size & 1));
+}
+
+// Reads whole frames until the stream ends; a trailing partial frame is dropped.
+static std::vector<float> readSamplesToEnd(std::istream& in, size_t channels) {
+  std::vector<float> samples;
+  for (;;) {
+    const size_t have = samples.size();
+    samples.resize(have + kStreamChunk);
+    in.read(reinterpret_cast<char*>(samples.data() + have), kStreamChunk * sizeof(float));
+    const size_t got = static_cast<size_t>(in.gcount()) / sizeof(float);
+    samples.resize(have + got);
+    if (got < kStreamChunk) break;
+  }
+  samples.resize(samples.size() - samples.size() % channels);
+  return samples;
+}
+
+// Integer PCM converted to float as it is read, as decodeFlac scales it.
+// `size` of ~0 reads to the end of the stream.
+static std::vector<float> readPcmSamples(std::istream& in, const FmtChunk& fmt, uint64_t size) {
+  const size_t bytes = fmt.bitsPerSample / 8;
+  const float scale = 1.0f / static_cast<float>(1u << (fmt.bitsPerSample - 1));
+  std::vector<float> samples;
+  if (size != ~uint64_t(0)) samples.reserve(static_cast<size_t>(size / bytes));
+  std::vector<unsigned char> buffer(kStreamChunk * bytes);
+  while (size > 0) {
+    const size_t want = static_cast<size_t>(std::min<uint64_t>(size, buffer.size()));
+    in.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(want));
+    const size_t got = static_cast<size_t>(in.gcount());
+    for (size_t i = 0; i + bytes <= got; i += bytes) {
+      // Assemble in the top bytes of an int32 so the sign comes out right.
+      uint32_t raw = 0;
+      for (size_t b = 0; b < bytes; b++) raw |= uint32_t(buffer[i + b]) << (8 * (4 - bytes + b));
+      samples.push_back(static_cast<float>(static_cast<int32_t>(raw) >> (8 * (4 - bytes))) * scale);
+    }
+    if (got < want) {
+      if (size != ~uint64_t(0)) throw std::runtime_error("Unexpected EOF");
+      break;
+    }
+    if (size != ~uint64_t(0)) size -= got;
+  }
+  samples.resize(samples.size() - samples.size() % fmt.numChannels);
+  return samples;
+}
+
 WavData readWav(const std::string& path) {
   std::ifstream in(path, std::ios::binary);
   if (!in) {
     throw std::runtime_error("Failed to open WAV file");
   }
+  return readWav(in);
+}
 
+WavData readWav(std::istream& in) {
   RiffHeader riff{};
   readExact(in, reinterpret_cast<char*>(&riff), sizeof(RiffHeader));
   if (std::strncmp(riff.chunkId, "RIFF", 4) != 0 || std::strncmp(riff.format, "WAVE", 4) != 0) {
     throw std::runtime_error("Invalid WAV file");
   }
 
+  // Chunks may come in any order before the audio; broadcast files often put
+  // JUNK or bext ahead of fmt.
   FmtChunk fmt{};
-  readExact(in, reinterpret_cast<char*>(&fmt), sizeof(FmtChunk));
-  if (std::strncmp(fmt.subchunk1Id, "fmt ", 4) != 0) {
-    throw std::runtime_error("Invalid fmt chunk");
+  bool haveFmt = false;
+  DataChunkHeader dataHeader{};
+  for (;;) {
+    readExact(in, reinterpret_cast<char*>(&dataHeader), sizeof(DataChunkHeader));
+    if (std::strncmp(dataHeader.subchunk2Id, "data", 4) == 0) break;
+    if (std::strncmp(dataHeader.subchunk2Id, "fmt ", 4) == 0) {
+      readFmt(in, dataHeader.subchunk2Size, fmt);
+      haveFmt = true;
+      continue;
+    }
+    skipBytes(in, uint64_t(dataHeader.subchunk2Size) + (dataHeader.subchunk2Size & 1));
   }
-  if (fmt.subchunk1Size > 16) {
-    in.seekg(fmt.subchunk1Size - 16, std::ios::cur);
+  if (!haveFmt) {
+    throw std::runtime_error("Invalid fmt chunk");
   }
-  if (fmt.audioFormat != 3 || fmt.bitsPerSample != 32) {
-    throw std::runtime_error("Only 32-bit float WAV supported");
+  const bool pcm = fmt.audioFormat == 1 && (fmt.bitsPerSample == 16 || fmt.bitsPerSample == 24);
+  if (!pcm && (fmt.audioFormat != 3 || fmt.bitsPerSample != 32)) {
+    throw std::runtime_error("Only 32-bit float and 16/24-bit PCM WAV supported");
   }
 
-  DataChunkHeader dataHeader{};
-  readExact(in, reinterpret_cast<char*>(&dataHeader), sizeof(DataChunkHeader));
-  while (std::strncmp(dataHeader.subchunk2Id, "data", 4) != 0) {
-    in.seekg(dataHeader.subchunk2Size, std::ios::cur);
-    readExact(in, reinterpret_cast<char*>(&dataHeader), sizeof(DataChunkHeader));
+  if (fmt.numChannels == 0) {
+    throw std::runtime_error("Invalid fmt chunk");
   }
 
-  const size_t sampleCount = dataHeader.subchunk2Size / sizeof(float);
-  std::vector<float> samples(sampleCount);
-  readExact(in, reinterpret_cast<char*>(samples.data()), dataHeader.subchunk2Size);
+  const bool unknownSize = dataHeader.subchunk2Size == kUnknownSize ||
+    (dataHeader.subchunk2Size == 0 && (riff.chunkSize == 0 || riff.chunkSize == kUnknownSize));
+  if (pcm) {
+    WavData wav{ static_cast<int>(fmt.sampleRate), static_cast<int>(fmt.numChannels),
+      readPcmSamples(in, fmt, unknownSize ? ~uint64_t(0) : dataHeader.subchunk2Size) };
+    wav.bitsPerSample = fmt.bitsPerSample;
+    return wav;
+  }
+  std::vector<float> samples;
+  if (unknownSize) {
+    samples = readSamplesToEnd(in, fmt.numChannels);
+  } else {
+    samples.resize(dataHeader.subchunk2Size / sizeof(float));
+    readExact(in, reinterpret_cast<char*>(samples.data()), samples.size() * sizeof(float));
+  }
 
   return { static_cast<int>(fmt.sampleRate), static_cast<int>(fmt.numChannels), std::move(samples) };
 }
 
+WavData readWav(int fd) {
+  FdReadBuf buf(fd);
+  std::istream in(&buf);
+  return readWav(in);
+}
+
 void writeWav(const std::string& path, const WavData& data) {
   std::ofstream out(path, std::ios::binary);
   if (!out) {
     throw std::runtime_error("Failed to open output WAV file");
   }
+  writeWav(out, data);
+}
+
+// The 44-byte WAV header. Sizes that do not fit 32 bits (or are not
+// known) become placeholders, which readers take as "until EOF".
+struct WavHeader {
+  RiffHeader riff;
+  FmtChunk fmt;
+  DataChunkHeader data;
+};
+
+static_assert(sizeof(WavHeader) == 44, "WAV header must be packed");
 
-  const uint32_t dataSize = static_cast<uint32_t>(data.samples.size() * sizeof(float));
+// `bitsPerSample` 32 is float, 16 and 24 are integer PCM.
+static WavHeader makeHeader(int sampleRate, int channels, uint64_t dataSize, int bitsPerSample = 32) {
   const uint32_t fmtChunkSize = 16;
-  const uint32_t riffSize = 4 + (8 + fmtChunkSize) + (8 + dataSize);
+  const uint64_t headerSize = 4 + (8 + fmtChunkSize) + 8;
+  const bool fits = dataSize < kUnknownSize - headerSize;
+  const uint64_t riffSize = fits ? headerSize + dataSize : 0;
 
-  RiffHeader riff{};
-  std::memcpy(riff.chunkId, "RIFF", 4);
-  riff.chunkSize = riffSize;
-  std::memcpy(riff.format, "WAVE", 4);
+  WavHeader header{};
+  std::memcpy(header.riff.chunkId, "RIFF", 4);
+  header.riff.chunkSize = fits ? static_cast<uint32_t>(riffSize) : kUnknownSize;
+  std::memcpy(header.riff.format, "WAVE", 4);
 
-  FmtChunk fmt{};
+  FmtChunk& fmt = header.fmt;
   std::memcpy(fmt.subchunk1Id, "fmt ", 4);
   fmt.subchunk1Size = fmtChunkSize;
-  fmt.audioFormat = 3;
-  fmt.numChannels = static_cast<uint16_t>(data.channels);
-  fmt.sampleRate = static_cast<uint32_t>(data.sampleRate);
-  fmt.bitsPerSample = 32;
+  fmt.audioFormat = bitsPerSample == 32 ? 3 : 1;
+  fmt.numChannels = static_cast<uint16_t>(channels);
+  fmt.sampleRate = static_cast<uint32_t>(sampleRate);
+  fmt.bitsPerSample = static_cast<uint16_t>(bitsPerSample);
   fmt.byteRate = fmt.sampleRate * fmt.numChannels * (fmt.bitsPerSample / 8);
   fmt.blockAlign = fmt.numChannels * (fmt.bitsPerSample / 8);
 
-  DataChunkHeader dataHeader{};
-  std::memcpy(dataHeader.subchunk2Id, "data", 4);
-  dataHeader.subchunk2Size = dataSize;
+  std::memcpy(header.data.subchunk2Id, "data", 4);
+  header.data.subchunk2Size = fits ? static_cast<uint32_t>(dataSize) : kUnknownSize;
+  return header;
+}
+
+void writeWav(std::ostream& out, const WavData& data) {
+  const uint64_t dataSize = data.samples.size() * sizeof(float);
+  const WavHeader header = makeHeader(data.sampleRate, data.channels, dataSize);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(WavHeader));
+  out.write(reinterpret_cast<const char*>(data.samples.data()), static_cast<std::streamsize>(dataSize));
+}
+
+void writeWav(const std::string& path, const WavData& data, int bitsPerSample) {
+  if (bitsPerSample == 32) {
+    writeWav(path, data);
+    return;
+  }
+  if (bitsPerSample != 16 && bitsPerSample != 24) {
+    throw std::runtime_error("WAV depth must be 16, 24 or 32 bits");
+  }
+  std::ofstream out(path, std::ios::binary);
+  if (!out) {
+    throw std::runtime_error("Failed to open output WAV file");
+  }
+  const size_t bytes = static_cast<size_t>(bitsPerSample / 8);
+  const WavHeader header = makeHeader(data.sampleRate, data.channels, data.samples.size() * bytes, bitsPerSample);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(WavHeader));
+
+  // Rounded and clipped as writeFlac does, a piece at a time.
+  const double scale = double(1u << (bitsPerSample - 1));
+  const double high = scale - 1;
+  std::vector<char> buffer(kStreamChunk * bytes);
+  for (size_t at = 0; at < data.samples.size(); at += kStreamChunk) {
+    const size_t count = std::min(kStreamChunk, data.samples.size() - at);
+    for (size_t i = 0; i < count; i++) {
+      const double v = std::floor(double(data.samples[at + i]) * scale + 0.5);
+      const int32_t q = static_cast<int32_t>(std::clamp(v, -scale, high));
+      for (size_t b = 0; b < bytes; b++) buffer[i * bytes + b] = static_cast<char>((q >> (8 * b)) & 0xFF);
+    }
+    out.write(buffer.data(), static_cast<std::streamsize>(count * bytes));
+  }
+  if (!out.flush()) {
+    throw std::runtime_error("Failed to write output WAV file");
+  }
+}
+
+void writeWav(int fd, const WavData& data) {
+  if (data.channels <= 0) {
+    throw std::runtime_error("Invalid channel count");
+  }
+  const size_t frames = data.samples.size() / data.channels;
+  WavStreamWriter writer(fd, data.sampleRate, data.channels, frames);
+  writer.write(data.samples.data(), frames);
+  writer.finish();
+}
+
+WavStreamWriter::WavStreamWriter(int fd, int sampleRate, int channels, uint64_t frames)
+    : fd_(fd), channels_(channels), declared_(frames), headerAt_(fdPosition(fd)) {
+  if (channels <= 0 || sampleRate <= 0) {
+    throw std::runtime_error("Invalid WAV format");
+  }
+  const uint64_t dataSize = frames == kUnknownFrames ? ~uint64_t(0) : frames * channels * sizeof(float);
+  const WavHeader header = makeHeader(sampleRate, channels, dataSize);
+  writeFd(fd_, &header, sizeof(WavHeader));
+}
+
+void WavStreamWriter::write(const float* samples, size_t frames) {
+  writeFd(fd_, samples, frames * channels_ * sizeof(float));
+  written_ += frames;
+}
+
+void WavStreamWriter::finish() {
+  if (written_ == declared_ || headerAt_ < 0) return;
+  const uint64_t dataSize = written_ * channels_ * sizeof(float);
+  const uint64_t riffSize = 4 + (8 + 16) + (8 + dataSize);
+  // Too long for 32-bit sizes: the placeholders stay, as for a pipe.
+  if (riffSize >= kUnknownSize) return;
+  const uint32_t riffField = static_cast<uint32_t>(riffSize);
+  const uint32_t dataField = static_cast<uint32_t>(dataSize);
+  writeFdAt(fd_, static_cast<uint64_t>(headerAt_) + offsetof(WavHeader, riff.chunkSize), &riffField, 4);
+  writeFdAt(fd_, static_cast<uint64_t>(headerAt_) + offsetof(WavHeader, data.subchunk2Size), &dataField, 4);
+}
+
+// ----------------------------------------------------------------------------
+// Positional writer
+// ----------------------------------------------------------------------------
+
+#if defined(_WIN32)
+
+WavRangeWriter::WavRangeWriter(const std::string&, int, int, uint64_t) : fd_(-1), channels_(0), frames_(0) {
+  throw std::runtime_error("Positional WAV writes are not available on Windows");
+}
+WavRangeWriter::~WavRangeWriter() {}
+void WavRangeWriter::write(uint64_t, const float*, size_t) {}
+void WavRangeWriter::finish() {}
+
+#else
+
+WavRangeWriter::WavRangeWriter(const std::string& path, int sampleRate, int channels, uint64_t frames)
+    : fd_(-1), channels_(channels), frames_(frames) {
+  if (channels <= 0 || sampleRate <= 0) {
+    throw std::runtime_error("Invalid WAV format");
+  }
+  OwnedFd out(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+  if (out.fd < 0) {
+    throw std::runtime_error("Failed to open output WAV file");
+  }
+  const uint64_t dataSize = frames * channels * sizeof(float);
+  const WavHeader header = makeHeader(sampleRate, channels, dataSize);
+  preallocateFd(out.fd, 0, sizeof(WavHeader) + dataSize);
+  writeFdAt(out.fd, 0, &header, sizeof(WavHeader));
+  fd_ = out.fd;
+  out.fd = -1;
+}
+
+WavRangeWriter::~WavRangeWriter() {
+  OwnedFd closing(fd_);
+}
+
+void WavRangeWriter::write(uint64_t firstFrame, const float* samples, size_t frames) {
+  if (firstFrame + frames > frames_) {
+    throw std::runtime_error("WAV range is past the end of the file");
+  }
+  const uint64_t frameBytes = static_cast<uint64_t>(channels_) * sizeof(float);
+  writeFdAt(fd_, sizeof(WavHeader) + firstFrame * frameBytes, samples, frames * frameBytes);
+}
+
+void WavRangeWriter::finish() {
+  OwnedFd out(fd_);
+  fd_ = -1;
+  if (!out.close()) {
+    throw std::runtime_error("Failed to write output WAV file");
+  }
+}
+
+#endif
+
+// ----------------------------------------------------------------------------
+// Chunk-preserving writer
+// ----------------------------------------------------------------------------
+
+std::vector<WavChunk> listWavChunks(const std::string& path) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in) {
+    throw std::runtime_error("Failed to open WAV file");
+  }
+  const uint64_t fileSize = static_cast<uint64_t>(in.tellg());
+  in.seekg(0);
+  RiffHeader riff{};
+  readExact(in, reinterpret_cast<char*>(&riff), sizeof(RiffHeader));
+  if (std::strncmp(riff.chunkId, "RIFF", 4) != 0 || std::strncmp(riff.format, "WAVE", 4) != 0) {
+    throw std::runtime_error("Invalid WAV file");
+  }
+
+  std::vector<WavChunk> chunks;
+  uint64_t pos = sizeof(RiffHeader);
+  while (pos + sizeof(DataChunkHeader) <= fileSize) {
+    DataChunkHeader header{};
+    in.seekg(static_cast<std::streamoff>(pos));
+    readExact(in, reinterpret_cast<char*>(&header), sizeof(DataChunkHeader));
+    WavChunk chunk;
+    chunk.id.assign(header.subchunk2Id, 4);
+    chunk.offset = pos + sizeof(DataChunkHeader);
+    chunk.size = header.subchunk2Size;
+    if (chunk.id == "data" && (header.subchunk2Size == kUnknownSize || header.subchunk2Size == 0)) {
+      chunk.size = fileSize - chunk.offset;
+    }
+    // A truncated last chunk keeps what is there.
+    chunk.size = std::min(chunk.size, fileSize - chunk.offset);
+    chunks.push_back(chunk);
+    pos = chunk.offset + chunk.size + (chunk.size & 1);
+  }
+  return chunks;
+}
+
+WavLayout readWavLayout(const std::string& path) {
+  WavLayout layout;
+  layout.chunks = listWavChunks(path);
+  std::ifstream in(path, std::ios::binary);
+  FmtChunk fmt{};
+  bool haveFmt = false;
+  for (const WavChunk& chunk : layout.chunks) {
+    if (chunk.id == "fmt " && !haveFmt) {
+      in.seekg(static_cast<std::streamoff>(chunk.offset));
+      readFmt(in, static_cast<uint32_t>(chunk.size), fmt);
+      haveFmt = true;
+    } else if (chunk.id == "data" && layout.dataOffset == 0) {
+      layout.dataOffset = chunk.offset;
+      layout.dataSize = chunk.size;
+    }
+  }
+  if (!haveFmt || layout.dataOffset == 0 || fmt.numChannels == 0) {
+    throw std::runtime_error("Invalid WAV file");
+  }
+  if (fmt.audioFormat != 3 || fmt.bitsPerSample != 32) {
+    throw std::runtime_error("Only 32-bit float WAV supported");
+  }
+  layout.sampleRate = static_cast<int>(fmt.sampleRate);
+  layout.channels = fmt.numChannels;
+  const uint64_t frameBytes = uint64_t(fmt.numChannels) * sizeof(float);
+  layout.dataSize -= layout.dataSize % frameBytes;
+  return layout;
+}
+
+// What the output holds in place of each source chunk: its own fmt and data,
+// everything else as it was.
+struct PreservedLayout {
+  RiffHeader riff;
+  WavHeader audio;
+};
+
+static PreservedLayout preservedLayout(const std::vector<WavChunk>& chunks, const WavData& data) {
+  bool haveFmt = false;
+  bool haveData = false;
+  for (const WavChunk& chunk : chunks) {
+    haveFmt = haveFmt || chunk.id == "fmt ";
+    haveData = haveData || chunk.id == "data";
+  }
+  if (!haveFmt || !haveData) {
+    throw std::runtime_error("Invalid WAV file");
+  }
+
+  const uint64_t dataSize = data.samples.size() * sizeof(float);
+  PreservedLayout layout{};
+  layout.audio = makeHeader(data.sampleRate, data.channels, dataSize);
+  uint64_t riffSize = 4;
+  for (const WavChunk& chunk : chunks) {
+    if (chunk.id == "fmt ") riffSize += sizeof(FmtChunk);
+    else if (chunk.id == "data") riffSize += sizeof(DataChunkHeader) + dataSize;
+    else riffSize += sizeof(DataChunkHeader) + chunk.size + (chunk.size & 1);
+  }
+  layout.riff = layout.audio.riff;
+  layout.riff.chunkSize = riffSize < kUnknownSize ? static_cast<uint32_t>(riffSize) : kUnknownSize;
+  return layout;
+}
+
+#if !defined(_WIN32)
+
+static void writeWavCopyingChunks(const std::string& path, const WavData& data, const std::string& source,
+    const std::vector<WavChunk>& chunks, const PreservedLayout& layout) {
+  OwnedFd in(::open(source.c_str(), O_RDONLY | O_CLOEXEC));
+  if (in.fd < 0) {
+    throw std::runtime_error("Failed to open WAV file");
+  }
+  OwnedFd out(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+  if (out.fd < 0) {
+    throw std::runtime_error("Failed to open output WAV file");
+  }
+
+  static const char pad = 0;
+  writeFd(out.fd, &layout.riff, sizeof(RiffHeader));
+  for (const WavChunk& chunk : chunks) {
+    if (chunk.id == "fmt ") {
+      writeFd(out.fd, &layout.audio.fmt, sizeof(FmtChunk));
+    } else if (chunk.id == "data") {
+      writeFd(out.fd, &layout.audio.data, sizeof(DataChunkHeader));
+      writeFd(out.fd, data.samples.data(), data.samples.size() * sizeof(float));
+    } else {
+      copyFdRange(in.fd, chunk.offset - sizeof(DataChunkHeader), out.fd, sizeof(DataChunkHeader) + chunk.size);
+      if (chunk.size & 1) writeFd(out.fd, &pad, 1);
+    }
+  }
+  if (!out.close()) {
+    throw std::runtime_error("Failed to write output WAV file");
+  }
+}
+
+#endif
+
+void writeWavPreserving(const std::string& path, const WavData& data, const std::string& source) {
+  const std::vector<WavChunk> chunks = listWavChunks(source);
+  const PreservedLayout layout = preservedLayout(chunks, data);
+
+#if !defined(_WIN32)
+  std::error_code ec;
+  if (!std::filesystem::equivalent(path, source, ec)) {
+    writeWavCopyingChunks(path, data, source, chunks, layout);
+    return;
+  }
+#endif
+
+  // Signing in place: the kept chunks have to be read before the file is
+  // truncated. They are metadata, so small.
+  std::vector<std::string> kept(chunks.size());
+  {
+    std::ifstream in(source, std::ios::binary);
+    for (size_t i = 0; i < chunks.size(); i++) {
+      if (chunks[i].id == "fmt " || chunks[i].id == "data") continue;
+      kept[i].resize(sizeof(DataChunkHeader) + chunks[i].size);
+      in.seekg(static_cast<std::streamoff>(chunks[i].offset - sizeof(DataChunkHeader)));
+      readExact(in, &kept[i][0], kept[i].size());
+    }
+  }
+
+  std::ofstream out(path, std::ios::binary);
+  if (!out) {
+    throw std::runtime_error("Failed to open output WAV file");
+  }
+  out.write(reinterpret_cast<const char*>(&layout.riff), sizeof(RiffHeader));
+  for (size_t i = 0; i < chunks.size(); i++) {
+    if (chunks[i].id == "fmt ") {
+      out.write(reinterpret_cast<const char*>(&layout.audio.fmt), sizeof(FmtChunk));
+    } else if (chunks[i].id == "data") {
+      out.write(reinterpret_cast<const char*>(&layout.audio.data), sizeof(DataChunkHeader));
+      out.write(reinterpret_cast<const char*>(data.samples.data()),
+        static_cast<std::streamsize>(data.samples.size() * sizeof(float)));
+    } else {
+      out.write(kept[i].data(), static_cast<std::streamsize>(kept[i].size()));
+      if (chunks[i].size & 1) out.put(0);
+    }
+  }
+  if (!out.flush()) {
+    throw std::runtime_error("Failed to write output WAV file");
+  }
+}
+
+WavData readRawPcm(std::istream& in, int sampleRate, int channels) {
+  if (sampleRate <= 0 || channels <= 0) {
+    throw std::runtime_error("Raw PCM needs a sample rate and channel count");
+  }
+  std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  const size_t frameBytes = sizeof(float) * channels;
+  std::vector<float> samples((bytes.size() / frameBytes) * channels);
+  std::memcpy(samples.data(), bytes.data(), samples.size() * sizeof(float));
+  return { sampleRate, channels, std::move(samples) };
+}
 
-  out.write(reinterpret_cast<char*>(&riff), sizeof(RiffHeader));
-  out.write(reinterpret_cast<char*>(&fmt), sizeof(FmtChunk));
-  out.write(reinterpret_cast<char*>(&dataHeader), sizeof(DataChunkHeader));
-  out.write(reinterpret_cast<const char*>(data.samples.data()), dataSize);
+void writeRawPcm(std::ostream& out, const WavData& data) {
+  out.write(reinterpret_cast<const char*>(data.samples.data()), data.samples.size() * sizeof(float));
 }
@@ -1,4 +1,7 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
 #include <string>
 #include <vector>
 
@@ -6,7 +9,102 @@ struct WavData {
   int sampleRate;
   int channels;
   std::vector<float> samples;
+  int bitsPerSample = 32;  // depth of the source; 32 for float WAV
 };
 
+// Reads 32-bit float and 16/24-bit integer PCM (converted to float, with
+// bitsPerSample set to the source depth); writes float.
 WavData readWav(const std::string& path);
 void writeWav(const std::string& path, const WavData& data);
+// 32 writes float; 16 and 24 write integer PCM, rounded and clipped.
+void writeWav(const std::string& path, const WavData& data, int bitsPerSample);
+
+// Stream variants never seek, so they work on stdin/stdout and pipes. A data
+// chunk of unknown size (0xFFFFFFFF, or 0 with no RIFF size either, as
+// encoders streaming to a pipe write it) runs to the end of the stream.
+WavData readWav(std::istream& in);
+void writeWav(std::ostream& out, const WavData& data);
+
+// Descriptor variants (fd_stream.h), e.g. the stdout of a spawned decoder.
+WavData readWav(int fd);
+void writeWav(int fd, const WavData& data);
+
+// Float WAV written as it is produced. The header goes out first, with the
+// real sizes when the frame count is given and fits, placeholders otherwise;
+// finish() writes the real sizes over the placeholders when the descriptor
+// can seek. Readers of the unpatched stream read to EOF.
+class WavStreamWriter {
+ public:
+  static constexpr uint64_t kUnknownFrames = ~uint64_t(0);
+
+  WavStreamWriter(int fd, int sampleRate, int channels, uint64_t frames = kUnknownFrames);
+  void write(const float* samples, size_t frames);
+  void finish();
+  uint64_t framesWritten() const { return written_; }
+
+ private:
+  int fd_;
+  int channels_;
+  uint64_t declared_;
+  uint64_t written_ = 0;
+  int64_t headerAt_;  // offset of the header, -1 when the descriptor cannot seek
+};
+
+// Float WAV file of known length written in any order. The file is created
+// at its final size with its final header, and write() puts frames straight
+// at their offset (pwrite), so several threads can each write the range they
+// just finished while others are still computing theirs. finish() closes the
+// file and reports what the kernel could not write. Not available on Windows.
+class WavRangeWriter {
+ public:
+  WavRangeWriter(const std::string& path, int sampleRate, int channels, uint64_t frames);
+  ~WavRangeWriter();
+  WavRangeWriter(const WavRangeWriter&) = delete;
+  WavRangeWriter& operator=(const WavRangeWriter&) = delete;
+
+  // Safe to call from several threads for disjoint ranges.
+  void write(uint64_t firstFrame, const float* samples, size_t frames);
+  void finish();
+
+ private:
+  int fd_;
+  int channels_;
+  uint64_t frames_;
+};
+
+// One RIFF chunk of a WAV file: its four-character id and where its payload
+// starts (8 bytes after the chunk header) and ends.
+struct WavChunk {
+  std::string id;
+  uint64_t offset = 0;
+  uint64_t size = 0;
+};
+
+// Every chunk of `path` in file order, fmt and data included, found by
+// walking the headers without reading any payload. A data chunk of unknown
+// size ends at the end of the file.
+std::vector<WavChunk> listWavChunks(const std::string& path);
+
+// Format and sample location of a float WAV file, for readers that fetch the
+// samples in pieces. Throws for anything but 32-bit float.
+struct WavLayout {
+  int sampleRate = 0;
+  int channels = 0;
+  uint64_t dataOffset = 0;  // first sample byte
+  uint64_t dataSize = 0;    // whole frames only
+  std::vector<WavChunk> chunks;
+};
+
+WavLayout readWavLayout(const std::string& path);
+
+// Writes `data` as float WAV with every chunk of the WAV file `source` other
+// than fmt and data (bext, iXML, LIST, cue, JUNK, ...) copied verbatim and in
+// its original place, before or after the audio. The copies are made by the
+// kernel from file to file, without passing through this process; a source
+// that is also the destination is read into memory first. On Windows the
+// chunks are copied through streams.
+void writeWavPreserving(const std::string& path, const WavData& data, const std::string& source);
+
+// Headerless interleaved 32-bit float (f32le) samples, read to EOF.
+WavData readRawPcm(std::istream& in, int sampleRate, int channels);
+void writeRawPcm(std::ostream& out, const WavData& data);
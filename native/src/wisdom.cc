@@ -0,0 +1,218 @@
+#include "wisdom.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+#include "engine.h"
+#include "kernels.h"
+#include "scheduler.h"
+
+// ============================================================================
+// AUTOTUNING
+// Tunes one dimension at a time on a synthetic signal: kernel ISA first on a
+// single thread (isolates per-core speed), then the thread count, then the
+// chunk size for that thread count.
+// ============================================================================
+
+namespace {
+
+struct BenchSignal {
+  std::vector<float> left;
+  std::vector<float> right;
+  PnBank bank;
+  std::vector<uint8_t> bits;
+};
+
+struct Measurement {
+  double embedSeconds = 0.0;
+  double extractSeconds = 0.0;
+  double total() const { return embedSeconds + extractSeconds; }
+};
+
+// Music-like test signal: a few detuned partials with a slow envelope plus
+// broadband noise, so the adaptive strength path sees realistic levels.
+BenchSignal makeBenchSignal(double seconds) {
+  const int sampleRate = 44100;
+  const size_t frames = static_cast<size_t>(seconds * sampleRate);
+  BenchSignal signal;
+  signal.left.resize(frames);
+  signal.right.resize(frames);
+
+  XorShift64 noise(0x5eed5eedULL);
+  const double partials[] = { 110.0, 220.5, 331.0, 440.0, 659.3, 1318.5 };
+  for (size_t i = 0; i < frames; i++) {
+    const double t = static_cast<double>(i) / sampleRate;
+    const double envelope = 0.5 + 0.4 * std::sin(2.0 * kPi * 0.25 * t);
+    double tone = 0.0;
+    for (double f : partials) tone += std::sin(2.0 * kPi * f * t) / 6.0;
+    const double n1 = noise.nextDouble() * 2.0 - 1.0;
+    const double n2 = noise.nextDouble() * 2.0 - 1.0;
+    signal.left[i] = static_cast<float>(0.3 * envelope * tone + 0.02 * n1);
+    signal.right[i] = static_cast<float>(0.3 * envelope * tone + 0.02 * n2);
+  }
+
+  signal.bank = buildPnBank(hashSecret("musmark-autotune"), kPayloadBits, samplesPerBitFor(1024), JobPriority::Batch);
+  signal.bits.resize(kPayloadBits);
+  for (int i = 0; i < kPayloadBits; i++) signal.bits[i] = noise.next() & 1;
+  return signal;
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+Measurement measure(const BenchSignal& signal, int repetitions) {
+  Measurement best;
+  best.embedSeconds = best.extractSeconds = 1e30;
+  const std::vector<uint8_t> noRemove;
+  for (int r = 0; r < repetitions; r++) {
+    std::vector<float> left = signal.left;
+    std::vector<float> right = signal.right;
+
+    auto start = std::chrono::steady_clock::now();
+    embedBlocks(left.data(), right.data(), left.size(), 0, signal.bank, signal.bits, noRemove, JobPriority::Batch);
+    best.embedSeconds = std::min(best.embedSeconds, secondsSince(start));
+
+    start = std::chrono::steady_clock::now();
+    correlateBlocks(left.data(), right.data(), left.size(), 0, signal.bank, JobPriority::Batch);
+    best.extractSeconds = std::min(best.extractSeconds, secondsSince(start));
+  }
+  return best;
+}
+
+}  // namespace
+
+Wisdom autotune(const AutotuneOptions& options) {
+  const BenchSignal signal = makeBenchSignal(std::max(1.0, options.audioSeconds));
+  const int repetitions = std::max(1, options.repetitions);
+  const int hardware = hardwareThreadCount();
+
+  Wisdom wisdom;
+  wisdom.hardwareThreads = hardware;
+  wisdom.detectedIsa = detectCpuIsa();
+
+  // 1. Kernel ISA, single threaded.
+  setSchedulerThreads(1);
+  setSchedulerChunkBlocks(8);
+  double bestTime = 1e30;
+  for (CpuIsa isa : availableKernelIsas()) {
+    selectKernels(isa);
+    const double time = measure(signal, repetitions).total();
+    if (time < bestTime) {
+      bestTime = time;
+      wisdom.isa = isa;
+    }
+  }
+  selectKernels(wisdom.isa);
+
+  // 2. Thread count: powers of two up to the machine size, plus the size itself.
+  std::vector<int> threadCandidates;
+  for (int t = 1; t < hardware; t *= 2) threadCandidates.push_back(t);
+  threadCandidates.push_back(hardware);
+  bestTime = 1e30;
+  for (int threads : threadCandidates) {
+    setSchedulerThreads(threads);
+    const double time = measure(signal, repetitions).total();
+    if (time < bestTime) {
+      bestTime = time;
+      wisdom.threads = threads;
+    }
+  }
+  setSchedulerThreads(wisdom.threads);
+
+  // 3. Chunk size for that thread count.
+  Measurement best;
+  bestTime = 1e30;
+  for (int chunk : { 1, 2, 4, 8, 16, 32, 64 }) {
+    setSchedulerChunkBlocks(chunk);
+    const Measurement m = measure(signal, repetitions);
+    if (m.total() < bestTime) {
+      bestTime = m.total();
+      best = m;
+      wisdom.chunkBlocks = chunk;
+    }
+  }
+  setSchedulerChunkBlocks(wisdom.chunkBlocks);
+
+  const double audioSeconds = static_cast<double>(signal.left.size()) / 44100.0;
+  wisdom.embedSpeed = audioSeconds / std::max(best.embedSeconds, 1e-9);
+  wisdom.extractSpeed = audioSeconds / std::max(best.extractSeconds, 1e-9);
+  return wisdom;
+}
+
+std::string defaultWisdomPath() {
+  if (const char* env = std::getenv("MUSMARK_WISDOM")) return env;
+  const char* home = std::getenv("HOME");
+  if (!home) home = std::getenv("USERPROFILE");
+  if (!home) return "";
+  return (std::filesystem::path(home) / ".musmark" / "wisdom").string();
+}
+
+bool loadWisdom(const std::string& path, Wisdom& out) {
+  std::ifstream in(path);
+  if (!in) return false;
+
+  Wisdom wisdom;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') continue;
+    std::istringstream fields(line);
+    std::string key;
+    std::string value;
+    fields >> key >> value;
+    if (key == "threads") wisdom.threads = std::atoi(value.c_str());
+    else if (key == "chunkBlocks") wisdom.chunkBlocks = std::atoi(value.c_str());
+    else if (key == "isa") parseCpuIsa(value, wisdom.isa);
+    else if (key == "hardwareThreads") wisdom.hardwareThreads = std::atoi(value.c_str());
+    else if (key == "detectedIsa") parseCpuIsa(value, wisdom.detectedIsa);
+    else if (key == "embedSpeed") wisdom.embedSpeed = std::atof(value.c_str());
+    else if (key == "extractSpeed") wisdom.extractSpeed = std::atof(value.c_str());
+  }
+  if (wisdom.threads <= 0 || wisdom.chunkBlocks <= 0) return false;
+  out = wisdom;
+  return true;
+}
+
+void saveWisdom(const std::string& path, const Wisdom& wisdom) {
+  const std::filesystem::path target(path);
+  if (target.has_parent_path()) std::filesystem::create_directories(target.parent_path());
+
+  // Write beside the target and rename so readers never see a partial file.
+  const std::string tmpPath = path + ".tmp";
+  {
+    std::ofstream out(tmpPath);
+    if (!out) throw std::runtime_error("Failed to write wisdom file");
+    out << "# musmark wisdom v1\n";
+    out << "hardwareThreads " << wisdom.hardwareThreads << "\n";
+    out << "detectedIsa " << cpuIsaName(wisdom.detectedIsa) << "\n";
+    out << "threads " << wisdom.threads << "\n";
+    out << "chunkBlocks " << wisdom.chunkBlocks << "\n";
+    out << "isa " << cpuIsaName(wisdom.isa) << "\n";
+    out << "embedSpeed " << wisdom.embedSpeed << "\n";
+    out << "extractSpeed " << wisdom.extractSpeed << "\n";
+  }
+  std::filesystem::rename(tmpPath, target);
+}
+
+bool applyWisdom(const Wisdom& wisdom) {
+  if (wisdom.hardwareThreads != hardwareThreadCount() || wisdom.detectedIsa != detectCpuIsa()) {
+    return false;
+  }
+  // MUSMARK_THREADS and MUSMARK_ISA are explicit operator choices; they win.
+  if (!std::getenv("MUSMARK_THREADS")) setSchedulerThreads(wisdom.threads);
+  if (!std::getenv("MUSMARK_ISA")) selectKernels(wisdom.isa);
+  setSchedulerChunkBlocks(wisdom.chunkBlocks);
+  return true;
+}
+
+void loadStartupWisdom() {
+  const std::string path = defaultWisdomPath();
+  Wisdom wisdom;
+  if (!path.empty() && loadWisdom(path, wisdom)) applyWisdom(wisdom);
+}
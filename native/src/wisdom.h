@@ -0,0 +1,40 @@
+#pragma once
+#include <string>
+#include "cpu.h"
+
+// Machine-specific tuning results, in the spirit of FFTW wisdom. Produced by
+// autotune() on the target box and loaded at startup.
+struct Wisdom {
+  int threads = 0;       // scheduler worker count
+  int chunkBlocks = 0;   // payload blocks per scheduler task
+  CpuIsa isa = CpuIsa::Scalar;
+  // Fingerprint of the machine the numbers were measured on; wisdom from a
+  // different box is ignored rather than applied blindly.
+  int hardwareThreads = 0;
+  CpuIsa detectedIsa = CpuIsa::Scalar;
+  // Best measured throughput, seconds of audio processed per wall second.
+  double embedSpeed = 0.0;
+  double extractSpeed = 0.0;
+};
+
+struct AutotuneOptions {
+  double audioSeconds = 30.0;  // length of the synthetic benchmark signal
+  int repetitions = 3;         // best-of-N timing per candidate
+};
+
+// Benchmarks candidate configurations on synthetic audio and returns the
+// winners. Leaves the winning configuration active.
+Wisdom autotune(const AutotuneOptions& options);
+
+// MUSMARK_WISDOM, else $HOME/.musmark/wisdom.
+std::string defaultWisdomPath();
+
+bool loadWisdom(const std::string& path, Wisdom& out);
+void saveWisdom(const std::string& path, const Wisdom& wisdom);
+
+// Applies wisdom to the scheduler and kernel table. Returns false (and
+// changes nothing) when it was recorded on a different machine.
+bool applyWisdom(const Wisdom& wisdom);
+
+// Loads and applies the default wisdom file if one exists.
+void loadStartupWisdom();
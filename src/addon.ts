@@ -1,4 +1,35 @@
 import path from "path";
+import type {
+  JobPriority,
+  SchedulerOptions,
+  SchedulerInfo,
+  CpuFeatures,
+  KernelIsa,
+  AutotuneOptions,
+  WisdomInfo,
+  SynthesizeOptions,
+  AttackSpec,
+  SimulateAttacksOptions,
+  AudioToolResult,
+  TriageResult,
+  DetectionCacheOptions,
+  OpenAudioOptions,
+  DetectionCacheStats,
+  MasterCacheOptions,
+  MasterCacheStats,
+  ScanOptions,
+  ScanResult,
+  ScanSummary,
+  LeasedScanOptions,
+  LeasedScanSummary,
+  WatermarkPayload,
+  OutputTarget,
+} from "./types";
+
+// Opaque native reference held by an AudioHandle
+type NativeAudio = { readonly __brand: "NativeAudio" };
+// Opaque native incremental embedder behind a StreamEmbedder
+type NativeEmbedder = { readonly __brand: "NativeEmbedder" };
 
 // Resolve the native addon relative to this file's location
 const addonPath = path.resolve(__dirname, "..", "native", "build", "Release", "watermark.node");
@@ -6,7 +37,7 @@ const addonPath = path.resolve(__dirname, "..", "native", "build", "Release", "w
 const addon = require(addonPath) as {
   embedWatermark: (
     inputPath: string,
-    outputPath: string,
+    output: string | { path: string; format: "wav" | "flac"; bitDepth?: number }[],
     bitstream: Buffer,
     options: {
       sampleRate: number;
@@ -17,10 +48,11 @@ const addon = require(addonPath) as {
       embedStrength: number;
       rotationSeconds: number;
       removeBitstream?: Buffer | null;
+      priority?: JobPriority;
     }
-  ) => void;
+  ) => Promise<void>;
   extractWatermark: (
-    inputPath: string,
+    input: string | NativeAudio,
     options: {
       sampleRate: number;
       channels: number;
@@ -28,14 +60,80 @@ const addon = require(addonPath) as {
       hopSize: number;
       secret: string;
       embedStrength?: number;
+      priority?: JobPriority;
+      cache?: boolean;
+      deadlineMs?: number;
     }
-  ) => {
+  ) => Promise<{
     bitstream: Buffer;
     correlations: Buffer;
     bitConfidence: number;
     bandAgreement: number;
     blocksAnalyzed: number;
-  };
+    finished: boolean;
+    periodsAnalyzed: number;
+    periodCount: number;
+  }>;
+  triageWatermark: (
+    input: string | NativeAudio,
+    options: { sampleRate: number; channels: number; blockSize: number; hopSize: number; secret: string; priority?: JobPriority }
+  ) => Promise<TriageResult>;
+  openAudio: (source: string | Buffer | number, options: { sampleRate?: number }) => Promise<{
+    handle: NativeAudio;
+    sampleRate: number;
+    channels: number;
+    frames: number;
+    contentHash: string;
+  }>;
+  closeAudio: (handle: NativeAudio) => void;
+  createEmbedder: (options: {
+    secret: string;
+    hopSize: number;
+    signatureId: string;
+    channels: number;
+    priority?: JobPriority;
+  }) => NativeEmbedder;
+  embedChunk: (embedder: NativeEmbedder, chunk: Buffer | null) => Promise<Buffer>;
+  configureScheduler: (options: SchedulerOptions) => void;
+  schedulerInfo: () => SchedulerInfo;
+  configureDetectionCache: (options?: DetectionCacheOptions) => DetectionCacheStats;
+  configureMasterCache: (options?: MasterCacheOptions) => MasterCacheStats;
+  cpuFeatures: () => CpuFeatures;
+  setKernelIsa: (isa: KernelIsa) => void;
+  autotune: (options: { audioSeconds?: number; repetitions?: number; path?: string | null }) => Promise<WisdomInfo>;
+  loadWisdom: (path?: string) => WisdomInfo | null;
+  synthesizeAudio: (outputPath: string, options: SynthesizeOptions) => Promise<AudioToolResult>;
+  simulateAttacks: (
+    inputPath: string,
+    outputPath: string,
+    attacks: AttackSpec[],
+    options: SimulateAttacksOptions
+  ) => Promise<AudioToolResult>;
+  scanCorpus: (
+    inputs: string[],
+    secrets: string[],
+    options: {
+      hopSize: number;
+      output?: string;
+      checkpoint?: string;
+      extensions?: string[];
+      workers?: number;
+      ioThreads?: number;
+      prefetch?: number;
+      triage?: boolean;
+      sampleRate?: number;
+    },
+    onResult?: (line: string) => void
+  ) => Promise<ScanSummary>;
+  scanLeased: (
+    directory: string,
+    secrets: string[],
+    options: Omit<LeasedScanOptions, "onResult"> & { hopSize: number },
+    onResult?: (line: string) => void
+  ) => Promise<LeasedScanSummary>;
+  mergeLeaseScan: (directory: string, reportPath: string) => number;
+  storePut: (directory: string, signatureId: string, payloadJson: string, payloadHash: string) => Promise<void>;
+  storeLookup: (directory: string, signatureIds: string[]) => Promise<({ payloadJson: string; payloadHash: string } | null)[]>;
 };
 
 export interface EmbedOptions {
@@ -47,6 +145,9 @@ export interface EmbedOptions {
   embedStrength?: number;
   rotationSeconds?: number;
   removeBitstream?: Uint8Array | null;
+  priority?: JobPriority;
+  cache?: boolean;
+  deadlineMs?: number;
 }
 
 export interface ExtractResult {
@@ -55,15 +156,33 @@ export interface ExtractResult {
   bitConfidence: number;
   bandAgreement: number;
   blocksAnalyzed: number;
+  finished: boolean;
+  periodsAnalyzed: number;
+  periodCount: number;
 }
 
-export function embedWatermark(
+// Targets get an explicit format so the native side never guesses.
+function resolveTargets(targets: OutputTarget[]): { path: string; format: "wav" | "flac"; bitDepth?: number }[] {
+  return targets.map((target) => ({
+    path: target.path,
+    format: target.format ?? (target.path.toLowerCase().endsWith(".flac") ? "flac" : "wav"),
+    bitDepth: target.bitDepth,
+  }));
+}
+
+/**
+ * Signs `inputPath` into one output path, or into every target of a list
+ * from a single read and embed, with the encodes running in parallel.
+ */
+export async function embedWatermark(
   inputPath: string,
-  outputPath: string,
+  output: string | OutputTarget[],
   bitstream: Uint8Array,
   options: EmbedOptions
-): void {
-  addon.embedWatermark(inputPath, outputPath, Buffer.from(bitstream), {
+): Promise<void> {
+  if (Array.isArray(output) && output.length === 0) throw new Error("sign() needs at least one output");
+  const target = Array.isArray(output) ? resolveTargets(output) : output;
+  await addon.embedWatermark(inputPath, target, Buffer.from(bitstream), {
     sampleRate: options.sampleRate ?? 44100,
     channels: options.channels ?? 2,
     blockSize: options.blockSize ?? 4096,
@@ -72,17 +191,97 @@ export function embedWatermark(
     embedStrength: options.embedStrength ?? 0.0005,
     rotationSeconds: options.rotationSeconds ?? 5,
     removeBitstream: options.removeBitstream ? Buffer.from(options.removeBitstream) : null,
+    priority: options.priority ?? "batch",
   });
 }
 
-export function extractWatermark(inputPath: string, options: EmbedOptions): ExtractResult {
-  const result = addon.extractWatermark(inputPath, {
+/**
+ * An audio file decoded and downmixed once by openAudio(). Pass it to detect()
+ * and triage() in place of a path to analyse the same recording repeatedly
+ * without reading or converting it again.
+ */
+export class AudioHandle {
+  /** @internal */
+  readonly native: NativeAudio;
+  readonly sampleRate: number;
+  readonly channels: number;
+  readonly frames: number;
+  /** SHA-256 of the file bytes */
+  readonly contentHash: string;
+
+  /** @internal */
+  constructor(opened: Awaited<ReturnType<typeof addon.openAudio>>) {
+    this.native = opened.handle;
+    this.sampleRate = opened.sampleRate;
+    this.channels = opened.channels;
+    this.frames = opened.frames;
+    this.contentHash = opened.contentHash;
+  }
+
+  get durationSeconds(): number {
+    return this.frames / this.sampleRate;
+  }
+
+  /** Releases the samples now rather than at garbage collection; calls already started finish normally. */
+  close(): void {
+    addon.closeAudio(this.native);
+  }
+}
+
+/**
+ * WAV and FLAC keep their own rate. Compressed files (MP3, Ogg, ...) are
+ * decoded by ffmpeg at `options.sampleRate`, which should be the signing rate.
+ * A number is a file descriptor (e.g. a pipe from a decoder) carrying WAV or
+ * FLAC; it is read to EOF and not closed.
+ */
+export async function openAudio(source: string | Buffer | number, options: OpenAudioOptions = {}): Promise<AudioHandle> {
+  return new AudioHandle(await addon.openAudio(source, { sampleRate: options.sampleRate ?? 44100 }));
+}
+
+/**
+ * Marks interleaved f32le PCM as it streams past, e.g. between an ffmpeg
+ * decoder and encoder. Chunks may split frames anywhere. Output trails input
+ * by less than one block, and finish() releases the rest; the concatenated
+ * output equals a whole-file embed of the same samples. Each call runs off
+ * the event loop; wait for one before making the next.
+ */
+export class StreamEmbedder {
+  private readonly native: NativeEmbedder;
+
+  constructor(signatureId: string, channels: number, options: EmbedOptions) {
+    this.native = addon.createEmbedder({
+      secret: options.secret,
+      hopSize: options.hopSize ?? 1024,
+      signatureId,
+      channels,
+      priority: options.priority ?? "batch",
+    });
+  }
+
+  write(chunk: Buffer): Promise<Buffer> {
+    return addon.embedChunk(this.native, chunk);
+  }
+
+  finish(): Promise<Buffer> {
+    return addon.embedChunk(this.native, null);
+  }
+}
+
+function nativeInput(input: string | AudioHandle): string | NativeAudio {
+  return typeof input === "string" ? input : input.native;
+}
+
+export async function extractWatermark(input: string | AudioHandle, options: EmbedOptions): Promise<ExtractResult> {
+  const result = await addon.extractWatermark(nativeInput(input), {
     sampleRate: options.sampleRate ?? 44100,
     channels: options.channels ?? 2,
     blockSize: options.blockSize ?? 4096,
     hopSize: options.hopSize ?? 1024,
     secret: options.secret,
     embedStrength: options.embedStrength ?? 0.0005,
+    priority: options.priority ?? "interactive",
+    cache: options.cache ?? true,
+    deadlineMs: options.deadlineMs,
   });
 
   return {
@@ -95,5 +294,101 @@ export function extractWatermark(inputPath: string, options: EmbedOptions): Extr
     bitConfidence: result.bitConfidence,
     bandAgreement: result.bandAgreement,
     blocksAnalyzed: result.blocksAnalyzed,
+    finished: result.finished,
+    periodsAnalyzed: result.periodsAnalyzed,
+    periodCount: result.periodCount,
   };
 }
+
+export function triageWatermark(input: string | AudioHandle, options: EmbedOptions): Promise<TriageResult> {
+  return addon.triageWatermark(nativeInput(input), {
+    sampleRate: options.sampleRate ?? 44100,
+    channels: options.channels ?? 2,
+    blockSize: options.blockSize ?? 4096,
+    hopSize: options.hopSize ?? 1024,
+    secret: options.secret,
+    priority: options.priority ?? "interactive",
+  });
+}
+
+export function configureScheduler(options: SchedulerOptions): void {
+  addon.configureScheduler(options);
+}
+
+export function schedulerInfo(): SchedulerInfo {
+  return addon.schedulerInfo();
+}
+
+/** Resizes or clears the native detection cache; returns its counters. */
+export function configureDetectionCache(options: DetectionCacheOptions = {}): DetectionCacheStats {
+  return addon.configureDetectionCache(options);
+}
+
+/** Resizes or clears the native cache of decoded masters used by sign(); returns its counters. */
+export function configureMasterCache(options: MasterCacheOptions = {}): MasterCacheStats {
+  return addon.configureMasterCache(options);
+}
+
+export function cpuFeatures(): CpuFeatures {
+  return addon.cpuFeatures();
+}
+
+export function setKernelIsa(isa: KernelIsa): void {
+  addon.setKernelIsa(isa);
+}
+
+export function autotune(options: AutotuneOptions = {}): Promise<WisdomInfo> {
+  return addon.autotune(options);
+}
+
+export function loadWisdom(wisdomPath?: string): WisdomInfo | null {
+  return wisdomPath === undefined ? addon.loadWisdom() : addon.loadWisdom(wisdomPath);
+}
+
+/** Writes reproducible synthetic program material to `outputPath` (WAV, or FLAC by extension). */
+export function synthesizeAudio(outputPath: string, options: SynthesizeOptions = {}): Promise<AudioToolResult> {
+  return addon.synthesizeAudio(outputPath, options);
+}
+
+/** Applies `attacks` in order to a WAV or FLAC file, in-process, and writes the result. */
+export function simulateAttacks(
+  inputPath: string,
+  outputPath: string,
+  attacks: AttackSpec[],
+  options: SimulateAttacksOptions = {}
+): Promise<AudioToolResult> {
+  return addon.simulateAttacks(inputPath, outputPath, attacks, options);
+}
+
+export function scanCorpus(inputs: string[], secrets: string[], options: ScanOptions): Promise<ScanSummary> {
+  const { onResult, ...rest } = options;
+  return addon.scanCorpus(
+    inputs,
+    secrets,
+    { ...rest, hopSize: options.hopSize ?? 1024 },
+    onResult ? (line) => onResult(JSON.parse(line) as ScanResult) : undefined
+  );
+}
+
+export function scanLeased(directory: string, secrets: string[], options: LeasedScanOptions): Promise<LeasedScanSummary> {
+  const { onResult, ...rest } = options;
+  return addon.scanLeased(
+    directory,
+    secrets,
+    { ...rest, hopSize: options.hopSize ?? 1024 },
+    onResult ? (line) => onResult(JSON.parse(line) as ScanResult) : undefined
+  );
+}
+
+export function mergeLeaseScan(directory: string, reportPath: string): number {
+  return addon.mergeLeaseScan(directory, reportPath);
+}
+
+export function storeSignature(directory: string, payload: WatermarkPayload, payloadHash: string): Promise<void> {
+  return addon.storePut(directory, payload.signature_id, JSON.stringify(payload), payloadHash);
+}
+
+export async function lookupSignatures(directory: string, signatureIds: string[]): Promise<(WatermarkPayload | null)[]> {
+  const entries = await addon.storeLookup(directory, signatureIds);
+  return entries.map((entry) => (entry ? (JSON.parse(entry.payloadJson) as WatermarkPayload) : null));
+}
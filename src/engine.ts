@@ -1,25 +1,122 @@
 /**
  * musmark-engine — public API
  *
- * sign()   — embed a watermark into a 32-bit float WAV file
- * detect() — extract and identify a watermark from a WAV file
+ * sign()   — embed a watermark into a 32-bit float WAV or FLAC file
+ * signMedia() — sign any format ffmpeg reads into any it writes, streamed
+ * detect() — extract and identify a watermark from a WAV or FLAC file
+ * triage() — cheap check for the sync pattern of one key
+ * openAudio() — read a file once for many detect()/triage() calls
+ * scanCorpus() — bulk detection over files and directories, streamed to JSONL
+ * scanLeased() — the same scan shared by many processes via a shared directory
  *
- * Both functions work only on 32-bit float WAV files.
- * Use ffmpeg to transcode before calling (see README for examples).
+ * sign(), detect(), triage() and openAudio() work on 32-bit float WAV and on
+ * FLAC (decoded and encoded natively). Detection also takes compressed leaks
+ * (MP3, Ogg, ...), decoded by an ffmpeg child process, and signMedia() signs
+ * them through ffmpeg decoder and encoder processes.
  */
 
 import crypto from "crypto";
-import { embedWatermark, extractWatermark } from "./addon";
+import { spawn, ChildProcess } from "child_process";
+import { promises as fsp } from "fs";
+import { Transform } from "stream";
+import { pipeline } from "stream/promises";
+import {
+  embedWatermark,
+  StreamEmbedder,
+  extractWatermark,
+  triageWatermark,
+  openAudio,
+  AudioHandle,
+  configureScheduler,
+  schedulerInfo,
+  configureDetectionCache,
+  configureMasterCache,
+  cpuFeatures,
+  setKernelIsa,
+  autotune,
+  loadWisdom,
+  synthesizeAudio,
+  simulateAttacks,
+  scanCorpus as scanCorpusNative,
+  scanLeased as scanLeasedNative,
+  mergeLeaseScan,
+  storeSignature,
+  lookupSignatures,
+} from "./addon";
 import { encodePayload, decodeBitstream, applySoftMajorityVoting, buildBitstream } from "./payload";
-import type { SignResult, DetectResult, WatermarkOptions, SignatureLookupFn, WatermarkPayload } from "./types";
+import type {
+  SignResult,
+  DetectResult,
+  WatermarkOptions,
+  SignatureLookupFn,
+  WatermarkPayload,
+  JobPriority,
+  SchedulerOptions,
+  SchedulerInfo,
+  KernelIsa,
+  CpuFeatures,
+  AutotuneOptions,
+  WisdomInfo,
+  SynthesizeOptions,
+  SynthProgram,
+  AttackSpec,
+  SimulateAttacksOptions,
+  AudioToolResult,
+  TriageResult,
+  DetectionCacheOptions,
+  OpenAudioOptions,
+  DetectionCacheStats,
+  MasterCacheOptions,
+  MasterCacheStats,
+  ScanOptions,
+  ScanResult,
+  ScanSummary,
+  LeasedScanOptions,
+  LeasedScanSummary,
+  OutputTarget,
+  SignMediaOptions,
+} from "./types";
 
-export type { SignResult, DetectResult, WatermarkOptions, SignatureLookupFn, WatermarkPayload };
+export type {
+  SignResult,
+  DetectResult,
+  WatermarkOptions,
+  SignatureLookupFn,
+  WatermarkPayload,
+  JobPriority,
+  SchedulerOptions,
+  SchedulerInfo,
+  KernelIsa,
+  CpuFeatures,
+  AutotuneOptions,
+  WisdomInfo,
+  SynthesizeOptions,
+  SynthProgram,
+  AttackSpec,
+  SimulateAttacksOptions,
+  AudioToolResult,
+  TriageResult,
+  DetectionCacheOptions,
+  OpenAudioOptions,
+  DetectionCacheStats,
+  MasterCacheOptions,
+  MasterCacheStats,
+  ScanOptions,
+  ScanResult,
+  ScanSummary,
+  LeasedScanOptions,
+  LeasedScanSummary,
+  OutputTarget,
+  SignMediaOptions,
+};
+export { openAudio, AudioHandle, configureScheduler, schedulerInfo, configureDetectionCache, configureMasterCache, cpuFeatures, setKernelIsa, autotune, loadWisdom, synthesizeAudio, simulateAttacks, mergeLeaseScan, lookupSignatures };
 
 /**
- * Embed a watermark into a 32-bit float WAV file.
+ * Embed a watermark into a 32-bit float WAV or FLAC file.
  *
- * @param inputWavPath  Path to the input float32 WAV file
- * @param outputWavPath Path to write the watermarked float32 WAV file
+ * @param inputWavPath  Path to the input float32 WAV or FLAC file
+ * @param outputWavPath Path to write the watermarked file; FLAC (at the source depth) when it ends in .flac.
+ *                      A list of targets writes every deliverable from one read and one embed.
  * @param projectId     Arbitrary project identifier (stored in your DB, not embedded)
  * @param recipientId   Who received this copy (stored in your DB, not embedded)
  * @param options       Watermark options (secret key is required)
@@ -27,24 +124,157 @@ export type { SignResult, DetectResult, WatermarkOptions, SignatureLookupFn, Wat
  */
 export async function sign(
   inputWavPath: string,
-  outputWavPath: string,
+  outputWavPath: string | OutputTarget[],
   projectId: string,
   recipientId: string,
   options: WatermarkOptions
 ): Promise<SignResult> {
   const { payload, payloadHash, bitstream } = encodePayload(projectId, recipientId);
 
-  embedWatermark(inputWavPath, outputWavPath, bitstream, {
+  await embedWatermark(inputWavPath, outputWavPath, bitstream, {
     secret: options.secret,
     sampleRate: options.sampleRate,
     channels: options.channels,
     embedStrength: options.embedStrength,
     blockSize: options.blockSize,
     hopSize: options.hopSize,
+    priority: options.priority,
   });
 
+  if (options.store) await storeSignature(options.store, payload, payloadHash);
+
+  const outputPaths = Array.isArray(outputWavPath) ? outputWavPath.map((target) => target.path) : [outputWavPath];
+  return {
+    outputPath: outputPaths[0],
+    outputPaths,
+    signatureId: payload.signature_id,
+    payloadHash,
+    payload,
+  };
+}
+
+// PCM handed to the native embedder per call. Pipe reads are 64 KiB, so
+// they are gathered to let one call mark many blocks in parallel.
+const MEDIA_CHUNK_BYTES = 1 << 20;
+
+function ffmpegProgram(): string {
+  return process.env.MUSMARK_FFMPEG || "ffmpeg";
+}
+
+// Settles when the process exits: resolves on status 0, rejects with the end
+// of its stderr otherwise. Failures of processes that were not killed by us
+// are also appended to `failures`, in the order they happen.
+function exited(child: ChildProcess, name: string, failures: Error[]): Promise<void> {
+  let stderr = "";
+  child.stderr?.on("data", (data: Buffer) => {
+    stderr = (stderr + data.toString()).slice(-4096);
+  });
+  return new Promise((resolve, reject) => {
+    child.once("error", (error) => {
+      failures.push(error);
+      reject(error);
+    });
+    child.once("close", (code, signal) => {
+      if (code === 0) return resolve();
+      const error = new Error(`${name} failed (${signal ?? `exit code ${code}`}): ${stderr.trim()}`);
+      if (!(child.killed && signal !== null)) failures.push(error);
+      reject(error);
+    });
+  });
+}
+
+// Gathers decoded PCM into MEDIA_CHUNK_BYTES batches and marks each off the
+// event loop. The transform callback waits for the native call, so a slow
+// embedder stops reads from the decoder and a slow encoder stops the
+// embedder: backpressure runs through the whole chain.
+function embeddingStream(embedder: StreamEmbedder): Transform {
+  let pending: Buffer[] = [];
+  let pendingBytes = 0;
+  const take = (): Buffer => {
+    const batch = Buffer.concat(pending, pendingBytes);
+    pending = [];
+    pendingBytes = 0;
+    return batch;
+  };
+  return new Transform({
+    transform(chunk: Buffer, _encoding, done) {
+      pending.push(chunk);
+      pendingBytes += chunk.length;
+      if (pendingBytes < MEDIA_CHUNK_BYTES) return done();
+      embedder.write(take()).then((marked) => done(null, marked), done);
+    },
+    flush(done) {
+      embedder
+        .write(take())
+        .then(async (marked) => Buffer.concat([marked, await embedder.finish()]))
+        .then((marked) => done(null, marked), done);
+    },
+  });
+}
+
+/**
+ * Sign any format ffmpeg reads into any format it writes, e.g. an MP3 or AAC
+ * delivery from a master in whatever container. An ffmpeg decoder, the native
+ * embedder and an ffmpeg encoder run at the same time, connected by pipes
+ * with backpressure: no temporary files, and memory stays bounded whatever
+ * the length. The audio is decoded as float at `options.sampleRate` and
+ * `options.channels` (44100, 2 by default). On failure both processes are
+ * stopped and the partial output is removed. ffmpeg must be on PATH, or
+ * MUSMARK_FFMPEG must name it.
+ *
+ * @param input         Any file ffmpeg can read (its first audio stream is signed)
+ * @param output        Output file; its extension picks the format unless encoderArgs say otherwise
+ * @param projectId     Arbitrary project identifier (stored in your DB, not embedded)
+ * @param recipientId   Who received this copy (stored in your DB, not embedded)
+ * @param options       sign() options plus encoderArgs / decoderArgs
+ */
+export async function signMedia(
+  input: string,
+  output: string,
+  projectId: string,
+  recipientId: string,
+  options: SignMediaOptions
+): Promise<SignResult> {
+  const { payload, payloadHash } = encodePayload(projectId, recipientId);
+  const channels = options.channels ?? 2;
+  const pcm = ["-f", "f32le", "-ar", String(options.sampleRate ?? 44100), "-ac", String(channels)];
+
+  const embedder = new StreamEmbedder(payload.signature_id, channels, options);
+  // "file:" keeps ffmpeg from reading a path like "x:y" as a protocol.
+  const decoder = spawn(
+    ffmpegProgram(),
+    ["-nostdin", "-v", "error", "-i", `file:${input}`, "-map", "0:a:0", ...(options.decoderArgs ?? []), "-c:a", "pcm_f32le", ...pcm, "pipe:1"],
+    { stdio: ["ignore", "pipe", "pipe"] }
+  );
+  const encoder = spawn(
+    ffmpegProgram(),
+    ["-v", "error", "-y", ...pcm, "-i", "pipe:0", ...(options.encoderArgs ?? []), `file:${output}`],
+    { stdio: ["pipe", "ignore", "pipe"] }
+  );
+
+  const failures: Error[] = [];
+  const stages = [
+    pipeline(decoder.stdout!, embeddingStream(embedder), encoder.stdin!),
+    exited(decoder, "ffmpeg decoder", failures),
+    exited(encoder, "ffmpeg encoder", failures),
+  ];
+  try {
+    await Promise.all(stages);
+  } catch (error) {
+    decoder.kill();
+    encoder.kill();
+    await Promise.allSettled(stages);
+    await fsp.rm(output, { force: true });
+    // The process that failed first says more than the broken pipes it
+    // leaves behind.
+    throw failures[0] ?? error;
+  }
+
+  if (options.store) await storeSignature(options.store, payload, payloadHash);
+
   return {
-    outputPath: outputWavPath,
+    outputPath: output,
+    outputPaths: [output],
     signatureId: payload.signature_id,
     payloadHash,
     payload,
@@ -52,28 +282,33 @@ export async function sign(
 }
 
 /**
- * Extract and identify a watermark from a 32-bit float WAV file.
+ * Extract and identify a watermark from a 32-bit float WAV or FLAC file.
  *
- * @param inputWavPath  Path to the float32 WAV file to analyse
+ * @param input         Path to the float32 WAV or FLAC file to analyse, or a handle from openAudio()
  * @param options       Must use the same secret key used during signing
  * @param lookupFn      Async or sync function that receives a signatureId and returns
- *                      the stored payload from your database, or null if not found
+ *                      the stored payload from your database, or null if not found.
+ *                      Optional when options.store is set; consulted on store misses.
  * @returns             DetectResult — check `detected` and `payload` fields
  */
 export async function detect(
-  inputWavPath: string,
+  input: string | AudioHandle,
   options: WatermarkOptions,
-  lookupFn: SignatureLookupFn
+  lookupFn?: SignatureLookupFn
 ): Promise<DetectResult> {
-  const extracted = extractWatermark(inputWavPath, {
+  const extracted = await extractWatermark(input, {
     secret: options.secret,
     sampleRate: options.sampleRate,
     channels: options.channels,
     embedStrength: options.embedStrength,
     blockSize: options.blockSize,
     hopSize: options.hopSize,
+    priority: options.priority,
+    cache: options.cache,
+    deadlineMs: options.deadlineMs,
   });
 
+  // Periods a deadline skipped are zero and carry no vote.
   const votedBitstream = applySoftMajorityVoting(extracted.correlations);
   const decoded = decodeBitstream(votedBitstream);
 
@@ -82,13 +317,19 @@ export async function detect(
     bandAgreement: extracted.bandAgreement,
     blocksAnalyzed: extracted.blocksAnalyzed,
     errorCount: decoded.errorCount,
+    periodsAnalyzed: extracted.periodsAnalyzed,
+    periodCount: extracted.periodCount,
   };
+  const finished = extracted.finished;
 
   if (!decoded.success || !decoded.signatureId) {
-    return { detected: false, confidence: 0, payload: null, payloadHash: decoded.payloadHash, stats };
+    return { detected: false, confidence: 0, payload: null, payloadHash: decoded.payloadHash, finished, stats };
   }
 
-  const storedPayload = await lookupFn(decoded.signatureId);
+  let storedPayload: WatermarkPayload | null | undefined = options.store
+    ? (await lookupSignatures(options.store, [decoded.signatureId]))[0]
+    : null;
+  if (!storedPayload && lookupFn) storedPayload = await lookupFn(decoded.signatureId);
 
   const bitRecoveryRatio = Math.max(0, 1 - decoded.errorCount / 32);
   const confidence = Math.round(
@@ -105,10 +346,73 @@ export async function detect(
     confidence,
     payload: storedPayload ?? null,
     payloadHash: decoded.payloadHash,
+    finished,
     stats,
   };
 }
 
+/**
+ * Sync-only pre-check, about 1/7 of the work of detect(). A `likely` result
+ * means the sync pattern of this key is present and detect() is worth running.
+ *
+ * @param input    Path to a float32 WAV or FLAC file, or a handle from openAudio()
+ * @param options  Same secret and hop size as used for signing
+ */
+export async function triage(input: string | AudioHandle, options: WatermarkOptions): Promise<TriageResult> {
+  return triageWatermark(input, {
+    secret: options.secret,
+    sampleRate: options.sampleRate,
+    channels: options.channels,
+    blockSize: options.blockSize,
+    hopSize: options.hopSize,
+    priority: options.priority,
+  });
+}
+
+/**
+ * Scan files and directories (walked recursively) for watermarks under any of
+ * several keys. Work runs on a native reader/worker pipeline: a sync-only
+ * triage per key, then full detection only where the sync pattern shows up.
+ * Records are written to `options.output` and passed to `options.onResult`
+ * as they complete, in completion order.
+ *
+ * With `options.checkpoint`, paths recorded by an earlier run are skipped, so
+ * an interrupted scan resumes by calling it again with the same options.
+ *
+ * No lookup function is involved: records carry the decoded signatureId and
+ * the caller joins them against its own storage.
+ */
+export function scanCorpus(
+  inputs: string | string[],
+  keys: string | string[],
+  options: ScanOptions = {}
+): Promise<ScanSummary> {
+  return scanCorpusNative(
+    Array.isArray(inputs) ? inputs : [inputs],
+    Array.isArray(keys) ? keys : [keys],
+    options
+  );
+}
+
+/**
+ * Join a scan shared by any number of processes, on one or many machines,
+ * through `directory` on a shared filesystem. The first caller splits
+ * `options.manifest` into shards; every caller then claims shards through
+ * lease files, renews its lease while scanning and takes over leases that
+ * expired, so a crashed process only delays its shard. Resolves once every
+ * shard is done, after writing `options.report` if given.
+ *
+ * A shard may be scanned twice after a reclaim; the report (or
+ * mergeLeaseScan()) keeps one record per path, in manifest order.
+ */
+export function scanLeased(
+  directory: string,
+  keys: string | string[],
+  options: LeasedScanOptions = {}
+): Promise<LeasedScanSummary> {
+  return scanLeasedNative(directory, Array.isArray(keys) ? keys : [keys], options);
+}
+
 /**
  * Compute the SHA-256 of a file (useful for audit logging).
  */
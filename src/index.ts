@@ -1,8 +1,55 @@
-export { sign, detect, sha256File } from "./engine";
+export {
+  sign,
+  signMedia,
+  detect,
+  triage,
+  openAudio,
+  AudioHandle,
+  sha256File,
+  configureScheduler,
+  schedulerInfo,
+  configureDetectionCache,
+  configureMasterCache,
+  cpuFeatures,
+  setKernelIsa,
+  autotune,
+  loadWisdom,
+  synthesizeAudio,
+  simulateAttacks,
+  scanCorpus,
+  scanLeased,
+  mergeLeaseScan,
+  lookupSignatures,
+} from "./engine";
 export type {
   SignResult,
   DetectResult,
   WatermarkOptions,
   SignatureLookupFn,
   WatermarkPayload,
+  JobPriority,
+  SchedulerOptions,
+  SchedulerInfo,
+  KernelIsa,
+  CpuFeatures,
+  AutotuneOptions,
+  WisdomInfo,
+  SynthesizeOptions,
+  SynthProgram,
+  AttackSpec,
+  SimulateAttacksOptions,
+  AudioToolResult,
+  TriageResult,
+  DetectionCacheOptions,
+  OpenAudioOptions,
+  DetectionCacheStats,
+  MasterCacheOptions,
+  MasterCacheStats,
+  ScanOptions,
+  ScanResult,
+  ScanSummary,
+  LeasedScanOptions,
+  LeasedScanSummary,
+  OutputTarget,
+  SignMediaOptions,
 } from "./types";
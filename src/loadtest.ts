@@ -0,0 +1,444 @@
+/**
+ * Load generator for sign() and detect() on synthetic inputs.
+ *
+ * Requests are issued either in a closed loop (`--concurrency` callers, each
+ * starting its next request when the last one returns) or open loop at
+ * `--rate` arrivals per second (Poisson, seeded), at most `--concurrency` in
+ * flight and the rest queued. Latency counts from arrival, so queueing shows
+ * up in the percentiles instead of being hidden by a slow generator.
+ *
+ * One JSON report goes to stdout (or --out): latency percentiles per
+ * operation, event-loop lag, throughput in audio-hours per hour and peak RSS,
+ * together with the machine and the configuration, so runs of different
+ * releases can be diffed directly.
+ *
+ *   npm run build && node dist/loadtest.js --mode mixed --concurrency 8 --duration 60
+ *   node dist/loadtest.js --mode detect --rate 20 --concurrency 64 --out detect-20rps.json
+ */
+
+import fs, { promises as fsp } from "fs";
+import os from "os";
+import path from "path";
+import { performance } from "perf_hooks";
+import { sign, detect, synthesizeAudio, configureScheduler, schedulerInfo } from "./engine";
+import type { SynthProgram, WatermarkPayload } from "./types";
+
+type Operation = "sign" | "detect";
+
+// One payload period (464 bits) takes about 43 s at 44.1 kHz; shorter clips
+// never carry a whole payload, so every detect() would fail.
+const MIN_CLIP_SECONDS = 45;
+
+interface LoadTestConfig {
+  mode: "sign" | "detect" | "mixed";
+  /** Fraction of requests that are sign() in mixed mode */
+  signShare: number;
+  /** Requests in flight at most; callers in closed-loop mode */
+  concurrency: number;
+  /** Arrivals per second; 0 runs closed loop */
+  rate: number;
+  /** Seconds during which requests are issued; the run then drains */
+  duration: number;
+  /** Stop issuing after this many requests; 0 for no limit */
+  requests: number;
+  /** Requests run and discarded before measuring */
+  warmup: number;
+  clipSeconds: number;
+  /** Distinct synthetic sources, used round robin */
+  inputs: number;
+  program: SynthProgram;
+  seed: number;
+  secret: string;
+  /** detect() result cache; off by default since the inputs repeat */
+  cache: boolean;
+  /** Native worker threads; 0 keeps the default */
+  threads: number;
+  dir: string;
+  keep: boolean;
+  out: string;
+  label: string;
+}
+
+interface Sample {
+  operation: Operation;
+  latencyMs: number;
+  serviceMs: number;
+  ok: boolean;
+  decoded: boolean;
+}
+
+interface LatencyStats {
+  count: number;
+  mean: number;
+  p50: number;
+  p95: number;
+  p99: number;
+  max: number;
+}
+
+const USAGE = `usage: node dist/loadtest.js [options]
+
+  --mode sign|detect|mixed   operations to issue (default mixed)
+  --sign-share F             sign() fraction in mixed mode (default 0.2)
+  --concurrency N            requests in flight at most (default 4)
+  --rate R                   open loop at R arrivals/s; 0 = closed loop (default 0)
+  --duration S               seconds of arrivals (default 30)
+  --requests N               stop after N requests (default: no limit)
+  --warmup N                 unmeasured requests first (default: concurrency)
+  --clip-seconds S           length of each synthetic input, at least 45 (default 60)
+  --inputs N                 distinct inputs (default 4)
+  --program music|speech|mixed   synthetic material (default mixed)
+  --seed N                   inputs and arrivals (default 1)
+  --secret KEY               watermark key (default musmark-loadtest)
+  --cache                    let detect() reuse cached extractions
+  --threads N                native worker threads (default: all cores)
+  --dir DIR                  scratch directory (default: a new temp dir)
+  --keep                     leave the scratch files behind
+  --out FILE                 write the report to FILE instead of stdout
+  --label NAME               release label in the report (default: package version)
+`;
+
+function packageVersion(): string {
+  try {
+    return JSON.parse(fs.readFileSync(path.join(__dirname, "..", "package.json"), "utf8")).version ?? "unknown";
+  } catch {
+    return "unknown";
+  }
+}
+
+function parseArgs(argv: string[]): LoadTestConfig {
+  const config: LoadTestConfig = {
+    mode: "mixed",
+    signShare: 0.2,
+    concurrency: 4,
+    rate: 0,
+    duration: 30,
+    requests: 0,
+    warmup: -1,
+    clipSeconds: 60,
+    inputs: 4,
+    program: "mixed",
+    seed: 1,
+    secret: "musmark-loadtest",
+    cache: false,
+    threads: 0,
+    dir: "",
+    keep: false,
+    out: "",
+    label: packageVersion(),
+  };
+
+  const number = (flag: string, value: string | undefined, min: number, max: number): number => {
+    const parsed = Number(value);
+    if (value === undefined || value === "" || !Number.isFinite(parsed) || parsed < min || parsed > max) {
+      throw new Error(`Invalid value for ${flag}: ${value}`);
+    }
+    return parsed;
+  };
+
+  for (let i = 0; i < argv.length; i++) {
+    const arg = argv[i];
+    const value = () => {
+      if (i + 1 >= argv.length) throw new Error(`Missing value for ${arg}`);
+      return argv[++i];
+    };
+    if (arg === "--mode") {
+      const mode = value();
+      if (mode !== "sign" && mode !== "detect" && mode !== "mixed") throw new Error(`Unknown mode: ${mode}`);
+      config.mode = mode;
+    } else if (arg === "--sign-share") config.signShare = number(arg, value(), 0, 1);
+    else if (arg === "--concurrency") config.concurrency = Math.floor(number(arg, value(), 1, 1 << 16));
+    else if (arg === "--rate") config.rate = number(arg, value(), 0, 1e6);
+    else if (arg === "--duration") config.duration = number(arg, value(), 0.1, 86400 * 7);
+    else if (arg === "--requests") config.requests = Math.floor(number(arg, value(), 0, 1e9));
+    else if (arg === "--warmup") config.warmup = Math.floor(number(arg, value(), 0, 1e6));
+    else if (arg === "--clip-seconds") config.clipSeconds = number(arg, value(), MIN_CLIP_SECONDS, 86400);
+    else if (arg === "--inputs") config.inputs = Math.floor(number(arg, value(), 1, 1024));
+    else if (arg === "--program") {
+      const program = value();
+      if (program !== "music" && program !== "speech" && program !== "mixed") throw new Error(`Unknown program: ${program}`);
+      config.program = program;
+    } else if (arg === "--seed") config.seed = Math.floor(number(arg, value(), 0, 2 ** 31));
+    else if (arg === "--secret") config.secret = value();
+    else if (arg === "--cache") config.cache = true;
+    else if (arg === "--threads") config.threads = Math.floor(number(arg, value(), 0, 4096));
+    else if (arg === "--dir") config.dir = value();
+    else if (arg === "--keep") config.keep = true;
+    else if (arg === "--out") config.out = value();
+    else if (arg === "--label") config.label = value();
+    else throw new Error(`Unknown option: ${arg}`);
+  }
+  if (config.warmup < 0) config.warmup = config.concurrency;
+  return config;
+}
+
+// xorshift32, so arrival times and the operation mix repeat for a seed.
+function makeRandom(seed: number): () => number {
+  let state = (seed ^ 0x9e3779b9) >>> 0 || 1;
+  return () => {
+    state ^= state << 13;
+    state >>>= 0;
+    state ^= state >>> 17;
+    state ^= state << 5;
+    state >>>= 0;
+    return state / 4294967296;
+  };
+}
+
+/**
+ * Event-loop lag: a 10 ms timer re-armed on every tick records how late it
+ * fired. Measured directly rather than with monitorEventLoopDelay(), whose
+ * readings include the sampling interval on some Node versions.
+ */
+function startLagProbe(): () => number[] {
+  const intervalMs = 10;
+  const lags: number[] = [];
+  let expected = performance.now() + intervalMs;
+  let timer: NodeJS.Timeout;
+  const tick = () => {
+    const now = performance.now();
+    lags.push(Math.max(0, now - expected));
+    expected = now + intervalMs;
+    timer = setTimeout(tick, intervalMs);
+  };
+  timer = setTimeout(tick, intervalMs);
+  return () => {
+    clearTimeout(timer);
+    return lags;
+  };
+}
+
+function latencyStats(values: number[]): LatencyStats {
+  if (values.length === 0) return { count: 0, mean: 0, p50: 0, p95: 0, p99: 0, max: 0 };
+  const sorted = [...values].sort((a, b) => a - b);
+  // Nearest rank, so a percentile is always a latency that was observed.
+  const rank = (p: number) => sorted[Math.min(sorted.length - 1, Math.ceil((p / 100) * sorted.length) - 1)];
+  const round = (ms: number) => Math.round(ms * 1000) / 1000;
+  return {
+    count: sorted.length,
+    mean: round(sorted.reduce((sum, v) => sum + v, 0) / sorted.length),
+    p50: round(rank(50)),
+    p95: round(rank(95)),
+    p99: round(rank(99)),
+    max: round(sorted[sorted.length - 1]),
+  };
+}
+
+/** Synthesizes the inputs and signs each once, so detect() has marked audio to read. */
+async function prepareInputs(config: LoadTestConfig, payloads: Map<string, WatermarkPayload>) {
+  const sources: string[] = [];
+  const signed: string[] = [];
+  for (let i = 0; i < config.inputs; i++) {
+    const source = path.join(config.dir, `source-${i}.wav`);
+    await synthesizeAudio(source, { seconds: config.clipSeconds, program: config.program, seed: config.seed + i });
+    const marked = path.join(config.dir, `signed-${i}.wav`);
+    const result = await sign(source, marked, "loadtest", `input-${i}`, { secret: config.secret });
+    payloads.set(result.signatureId, result.payload);
+    sources.push(source);
+    signed.push(marked);
+  }
+  return { sources, signed };
+}
+
+async function run(config: LoadTestConfig) {
+  if (config.threads > 0) configureScheduler({ threads: config.threads });
+  const ownsDir = !config.dir;
+  if (ownsDir) config.dir = await fsp.mkdtemp(path.join(os.tmpdir(), "musmark-loadtest-"));
+  else await fsp.mkdir(config.dir, { recursive: true });
+
+  try {
+    const payloads = new Map<string, WatermarkPayload>();
+    const inputs = await prepareInputs(config, payloads);
+    const lookup = async (signatureId: string) => payloads.get(signatureId) ?? null;
+    const random = makeRandom(config.seed);
+
+    // Each in-flight sign() writes to its own slot, so disk use stays at
+    // `concurrency` outputs however long the run.
+    const freeSlots = Array.from({ length: config.concurrency }, (_, i) => i);
+    let nextInput = 0;
+    const errors: string[] = [];
+
+    const pickOperation = (): Operation => {
+      if (config.mode !== "mixed") return config.mode;
+      return random() < config.signShare ? "sign" : "detect";
+    };
+
+    const execute = async (operation: Operation, arrival: number): Promise<Sample> => {
+      const input = nextInput++ % config.inputs;
+      const slot = freeSlots.pop()!;
+      const start = performance.now();
+      let ok = true;
+      let decoded = false;
+      try {
+        if (operation === "sign") {
+          const output = path.join(config.dir, `out-${slot}.wav`);
+          await sign(inputs.sources[input], output, "loadtest", `request-${input}`, { secret: config.secret });
+        } else {
+          const result = await detect(inputs.signed[input], { secret: config.secret, cache: config.cache }, lookup);
+          decoded = result.detected;
+        }
+      } catch (error) {
+        ok = false;
+        if (errors.length < 5) errors.push(error instanceof Error ? error.message : String(error));
+      } finally {
+        freeSlots.push(slot);
+      }
+      const end = performance.now();
+      return { operation, latencyMs: end - arrival, serviceMs: end - start, ok, decoded };
+    };
+
+    // Warm-up: keys, caches and the native pool reach steady state first.
+    for (let done = 0; done < config.warmup; done += config.concurrency) {
+      const batch = Math.min(config.concurrency, config.warmup - done);
+      await Promise.all(Array.from({ length: batch }, () => execute(pickOperation(), performance.now())));
+    }
+    errors.length = 0;
+
+    const samples: Sample[] = [];
+    let peakRss = process.memoryUsage().rss;
+    const rssTimer = setInterval(() => {
+      peakRss = Math.max(peakRss, process.memoryUsage().rss);
+    }, 50);
+    const cpuStart = process.cpuUsage();
+    const runStart = performance.now();
+    const deadline = runStart + config.duration * 1000;
+    const limitReached = (issued: number) => config.requests > 0 && issued >= config.requests;
+    let issued = 0;
+    let maxQueued = 0;
+    const stopLagProbe = startLagProbe();
+
+    if (config.rate > 0) {
+      // Open loop: arrivals follow their own schedule; a request waits in
+      // the queue while `concurrency` others are in flight.
+      const queue: Array<{ operation: Operation; arrival: number }> = [];
+      const inFlight = new Set<Promise<void>>();
+      const dispatch = () => {
+        while (inFlight.size < config.concurrency && queue.length > 0) {
+          const next = queue.shift()!;
+          const task: Promise<void> = execute(next.operation, next.arrival).then((sample) => {
+            samples.push(sample);
+            inFlight.delete(task);
+            dispatch();
+          });
+          inFlight.add(task);
+        }
+      };
+
+      let nextArrival = runStart;
+      while (nextArrival < deadline && !limitReached(issued)) {
+        const wait = nextArrival - performance.now();
+        if (wait > 0) await new Promise((resolve) => setTimeout(resolve, wait));
+        queue.push({ operation: pickOperation(), arrival: nextArrival });
+        issued++;
+        maxQueued = Math.max(maxQueued, queue.length);
+        dispatch();
+        nextArrival += (-Math.log(1 - random()) / config.rate) * 1000;
+      }
+      while (inFlight.size > 0) await Promise.race(inFlight);
+    } else {
+      // Closed loop: each caller issues its next request as soon as the
+      // previous one returns.
+      const caller = async () => {
+        while (performance.now() < deadline && !limitReached(issued)) {
+          issued++;
+          samples.push(await execute(pickOperation(), performance.now()));
+        }
+      };
+      await Promise.all(Array.from({ length: config.concurrency }, caller));
+    }
+
+    const lags = stopLagProbe();
+    clearInterval(rssTimer);
+    peakRss = Math.max(peakRss, process.memoryUsage().rss);
+    const wallSeconds = (performance.now() - runStart) / 1000;
+    const cpu = process.cpuUsage(cpuStart);
+
+    const completed = samples.filter((s) => s.ok);
+    const byOperation = (operation: Operation) => completed.filter((s) => s.operation === operation);
+    const detections = byOperation("detect");
+    const audioSeconds = completed.length * config.clipSeconds;
+
+    return {
+      label: config.label,
+      version: packageVersion(),
+      timestamp: new Date().toISOString(),
+      machine: {
+        node: process.version,
+        platform: process.platform,
+        arch: process.arch,
+        cpus: os.cpus().length,
+        cpuModel: os.cpus()[0]?.model ?? "unknown",
+        totalMemoryMb: Math.round(os.totalmem() / 1048576),
+        scheduler: schedulerInfo(),
+      },
+      config: {
+        mode: config.mode,
+        signShare: config.mode === "mixed" ? config.signShare : undefined,
+        concurrency: config.concurrency,
+        arrival: config.rate > 0 ? "poisson" : "closed",
+        rate: config.rate,
+        duration: config.duration,
+        requests: config.requests,
+        warmup: config.warmup,
+        clipSeconds: config.clipSeconds,
+        inputs: config.inputs,
+        program: config.program,
+        seed: config.seed,
+        cache: config.cache,
+      },
+      wallSeconds: Math.round(wallSeconds * 1000) / 1000,
+      cpuSeconds: Math.round(((cpu.user + cpu.system) / 1e6) * 1000) / 1000,
+      requests: {
+        issued,
+        completed: completed.length,
+        failed: samples.length - completed.length,
+        maxQueued,
+        detectDecoded: detections.filter((s) => s.decoded).length,
+      },
+      latencyMs: {
+        all: latencyStats(completed.map((s) => s.latencyMs)),
+        sign: latencyStats(byOperation("sign").map((s) => s.latencyMs)),
+        detect: latencyStats(detections.map((s) => s.latencyMs)),
+      },
+      serviceMs: {
+        sign: latencyStats(byOperation("sign").map((s) => s.serviceMs)),
+        detect: latencyStats(detections.map((s) => s.serviceMs)),
+      },
+      eventLoopLagMs: latencyStats(lags),
+      throughput: {
+        requestsPerSecond: Math.round((completed.length / wallSeconds) * 1000) / 1000,
+        audioHoursPerHour: Math.round((audioSeconds / wallSeconds) * 1000) / 1000,
+      },
+      peakRssMb: Math.round((peakRss / 1048576) * 10) / 10,
+      maxRssMb: Math.round((process.resourceUsage().maxRSS / 1024) * 10) / 10,
+      errors,
+    };
+  } finally {
+    if (ownsDir && !config.keep) await fsp.rm(config.dir, { recursive: true, force: true });
+  }
+}
+
+async function main() {
+  if (process.argv.includes("-h") || process.argv.includes("--help")) {
+    process.stdout.write(USAGE);
+    return;
+  }
+  let config: LoadTestConfig;
+  try {
+    config = parseArgs(process.argv.slice(2));
+  } catch (error) {
+    process.stderr.write(`loadtest: ${(error as Error).message}\n\n${USAGE}`);
+    process.exit(2);
+  }
+  const report = JSON.stringify(await run(config), null, 2) + "\n";
+  if (config.out) await fsp.writeFile(config.out, report);
+  else process.stdout.write(report);
+  if (config.out) process.stderr.write(`loadtest: report written to ${config.out}\n`);
+}
+
+if (require.main === module) {
+  main().catch((error) => {
+    process.stderr.write(`loadtest: ${error instanceof Error ? error.message : String(error)}\n`);
+    process.exit(1);
+  });
+}
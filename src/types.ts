@@ -5,9 +5,35 @@ export interface WatermarkPayload {
   timestamp: string;
 }
 
+/** One deliverable of a sign() pass. */
+export interface OutputTarget {
+  path: string;
+  /** Default: "flac" for a .flac path, "wav" otherwise */
+  format?: "wav" | "flac";
+  /**
+   * WAV: 16 or 24 (integer PCM) or 32 (float, the default). FLAC: 8 to 24,
+   * default the source depth (24 for a float source).
+   */
+  bitDepth?: number;
+}
+
+/** Options of signMedia(): sign() options plus the two ffmpeg command lines. */
+export interface SignMediaOptions extends WatermarkOptions {
+  /**
+   * Encoder options, placed before the output path, e.g.
+   * ["-c:a", "libmp3lame", "-q:a", "2"]. Default: ffmpeg's choice for the
+   * output extension.
+   */
+  encoderArgs?: string[];
+  /** Decoder options applied to the decoded audio (-ss, -t, -af, ...). */
+  decoderArgs?: string[];
+}
+
 export interface SignResult {
-  /** The watermarked audio file path (WAV, float32) */
+  /** The watermarked audio file path (float32 WAV, or FLAC for a .flac path); the first target's with several */
   outputPath: string;
+  /** Every file written, in the order the targets were given */
+  outputPaths: string[];
   /** Unique ID for this signature — store this in your database */
   signatureId: string;
   /** SHA-256 of the full payload JSON — use for integrity verification */
@@ -17,7 +43,7 @@ export interface SignResult {
 }
 
 export interface DetectResult {
-  /** True when the watermark was decoded and a matching signature was found in the lookup fn */
+  /** True when the watermark was decoded and a matching signature was found in the store or lookup fn */
   detected: boolean;
   /** 0–100 confidence score */
   confidence: number;
@@ -25,12 +51,17 @@ export interface DetectResult {
   payload: WatermarkPayload | null;
   /** SHA-256 of the embedded payload bytes */
   payloadHash: string | null;
+  /** False when options.deadlineMs stopped the analysis before every payload period was read */
+  finished: boolean;
   /** Raw extraction stats for debugging */
   stats: {
     bitConfidence: number;
     bandAgreement: number;
     blocksAnalyzed: number;
     errorCount: number;
+    /** Payload periods (~43 s each at the default hop size) correlated, of periodCount */
+    periodsAnalyzed: number;
+    periodCount: number;
   };
 }
 
@@ -42,6 +73,109 @@ export interface WatermarkOptions {
   embedStrength?: number;
   blockSize?: number;
   hopSize?: number;
+  /**
+   * Scheduling class on the shared native pool. Defaults to "batch" for sign()
+   * and "interactive" for detect(); interactive work preempts batch work.
+   */
+  priority?: JobPriority;
+  /**
+   * Directory of an embedded signature store. sign() records every payload
+   * there and detect() looks decoded ids up there before calling lookupFn.
+   */
+  store?: string;
+  /**
+   * detect() only. Reuse the result of an earlier extraction of identical
+   * audio under the same key and hop size. Default: true.
+   */
+  cache?: boolean;
+  /**
+   * detect() only. Latency budget in milliseconds, counted from the call.
+   * Payload periods are analysed most reliable first and the best decode
+   * reached in time is returned with `finished: false`. At least one period
+   * is always analysed.
+   */
+  deadlineMs?: number;
+}
+
+export type JobPriority = "interactive" | "batch";
+
+export interface SchedulerOptions {
+  /** Worker thread count; 0 restores the default (CPU count capped by the cgroup quota) */
+  threads?: number;
+  /** Payload blocks handed to a worker per task */
+  chunkBlocks?: number;
+}
+
+export type KernelIsa = "scalar" | "sse4.2" | "avx2" | "avx512";
+
+export interface CpuFeatures {
+  /** Highest ISA level the CPU and OS support */
+  detected: KernelIsa;
+  /** ISA level of the kernels currently in use */
+  active: KernelIsa;
+  /** Levels that can be passed to setKernelIsa() on this machine */
+  available: KernelIsa[];
+}
+
+export interface SchedulerInfo {
+  threads: number;
+  hardwareThreads: number;
+  /** Whole CPUs allowed by the cgroup CPU quota, 0 when unlimited */
+  cgroupLimit: number;
+  chunkBlocks: number;
+}
+
+export interface TriageResult {
+  /** The sync pattern is clearly present; run detect() */
+  likely: boolean;
+  /** Fraction of sync bits recovered, ~0.5 by chance */
+  syncScore: number;
+  blocksAnalyzed: number;
+}
+
+export interface OpenAudioOptions {
+  /** Rate compressed files (MP3, Ogg, ...) are decoded at; match the signing rate. Default: 44100 */
+  sampleRate?: number;
+}
+
+export interface DetectionCacheOptions {
+  /** Extractions kept, least recently used evicted first; 0 disables caching. Default: 1024 */
+  maxEntries?: number;
+  /** Drop every cached extraction */
+  clear?: boolean;
+}
+
+export interface DetectionCacheStats {
+  entries: number;
+  maxEntries: number;
+  hits: number;
+  /** Extractions actually run */
+  misses: number;
+  /** Requests that waited on an identical request already in progress */
+  coalesced: number;
+  evictions: number;
+}
+
+export interface MasterCacheOptions {
+  /** Compressed bytes of decoded masters kept for signing, least recently used evicted first; 0 disables the cache. Default: $MUSMARK_MASTER_CACHE_MB, else 0 */
+  maxBytes?: number;
+  /** Drop every cached master */
+  clear?: boolean;
+}
+
+export interface MasterCacheStats {
+  entries: number;
+  /** Compressed size of the cached masters */
+  bytes: number;
+  /** Their decoded size */
+  rawBytes: number;
+  maxBytes: number;
+  hits: number;
+  /** Masters read and decoded from storage */
+  misses: number;
+  /** Requests that waited on a read of the same file already in progress */
+  coalesced: number;
+  evictions: number;
 }
 
 /**
@@ -51,3 +185,151 @@ export interface WatermarkOptions {
 export type SignatureLookupFn = (
   signatureId: string
 ) => Promise<WatermarkPayload | null | undefined> | WatermarkPayload | null | undefined;
+
+export interface AutotuneOptions {
+  /** Length of the synthetic benchmark signal in seconds. Default: 30 */
+  audioSeconds?: number;
+  /** Best-of-N timing per candidate. Default: 3 */
+  repetitions?: number;
+  /**
+   * Where to save the wisdom file. Default: $MUSMARK_WISDOM or ~/.musmark/wisdom.
+   * Pass null to tune without saving.
+   */
+  path?: string | null;
+}
+
+export interface WisdomInfo {
+  threads: number;
+  chunkBlocks: number;
+  isa: KernelIsa;
+  /** Seconds of audio embedded per wall-clock second with these settings */
+  embedSpeed: number;
+  /** Seconds of audio correlated per wall-clock second with these settings */
+  extractSpeed: number;
+  /** File the wisdom was saved to (autotune only) */
+  path?: string;
+}
+
+export type SynthProgram = "music" | "speech" | "mixed";
+
+export interface SynthesizeOptions {
+  /** Default: 30 */
+  seconds?: number;
+  /** Default: 44100 */
+  sampleRate?: number;
+  /** Default: 2 */
+  channels?: number;
+  /** Same seed, same samples, on any machine and thread count. Default: 1 */
+  seed?: number;
+  /** Default: "mixed" (phrases of music and speech) */
+  program?: SynthProgram;
+  /** Fraction of half-second sections left as digital silence. Default: 0.05 */
+  silence?: number;
+  priority?: JobPriority;
+}
+
+/**
+ * One simulated attack, "name:value": "mp3:128" (transform coding at that
+ * bitrate), "lowpass:8000", "resample:22050" (there and back), "gain:-6",
+ * "crop:1.5" (seconds off the start), "noise:30" (SNR in dB), "speed:1.02".
+ */
+export type AttackSpec = string;
+
+export interface SimulateAttacksOptions {
+  /** Seeds the added noise. Default: 1 */
+  seed?: number;
+  priority?: JobPriority;
+}
+
+export interface AudioToolResult {
+  outputPath: string;
+  frames: number;
+  sampleRate: number;
+  channels: number;
+  durationSeconds: number;
+}
+
+export interface ScanOptions {
+  hopSize?: number;
+  /** JSONL file receiving one record per file as it completes */
+  output?: string;
+  /**
+   * Checkpoint file listing finished paths. Paths already listed are skipped
+   * and `output` is appended to, so a crashed scan can be rerun as is.
+   */
+  checkpoint?: string;
+  /** File extensions picked up when walking directories. Default: [".wav", ".flac"] */
+  extensions?: string[];
+  /** Files analysed at once. Default: 4 */
+  workers?: number;
+  /** Files read at once. Default: 2 */
+  ioThreads?: number;
+  /** Decoded files kept queued ahead of the workers. Default: 8 */
+  prefetch?: number;
+  /** Run the sync-only check before full detection. Default: true */
+  triage?: boolean;
+  /** Rate compressed files (MP3, Ogg, ...) are decoded at; match the signing rate. Default: 44100 */
+  sampleRate?: number;
+  /** Signature store used to attribute decoded ids (adds `found` and `payload` to records) */
+  store?: string;
+  /** Called for every record as it is written */
+  onResult?: (result: ScanResult) => void;
+}
+
+export interface ScanResult {
+  path: string;
+  /** Present when the file could not be read or analysed */
+  error?: string;
+  decoded?: boolean;
+  /** Index into the keys array of the key that decoded the file */
+  key?: number | null;
+  signatureId?: string | null;
+  payloadHash?: string | null;
+  confidence?: number;
+  /** With a store: whether the id is in it, and the stored payload */
+  found?: boolean;
+  payload?: WatermarkPayload | null;
+  /** Best sync-pattern score over all keys, ~0.5 for unmarked audio */
+  syncScore?: number;
+  /** Only for decoded files */
+  stats?: {
+    bitConfidence: number;
+    bandAgreement: number;
+    blocksAnalyzed: number;
+    errorCount: number;
+  };
+}
+
+export interface ScanSummary {
+  scanned: number;
+  /** Already listed in the checkpoint */
+  skipped: number;
+  decoded: number;
+  /** Files every key rejected at triage */
+  rejected: number;
+  failed: number;
+  seconds: number;
+}
+
+export interface LeasedScanOptions extends Omit<ScanOptions, "output" | "checkpoint"> {
+  /** Manifest with one path per line. Only the process that creates the job needs it. */
+  manifest?: string;
+  /** Lease owner name. Default: hostname-pid */
+  workerId?: string;
+  /** Manifest lines per shard. Default: 256 */
+  shardSize?: number;
+  /** A lease not renewed for this long is reclaimed by another process. Default: 60 */
+  leaseSeconds?: number;
+  /** Merged, deduplicated JSONL report, written once every shard is done */
+  report?: string;
+}
+
+export interface LeasedScanSummary extends ScanSummary {
+  /** Shards completed by this process */
+  shards: number;
+  /** Shards taken over from expired leases */
+  reclaimed: number;
+  /** Shards dropped because another process reclaimed them */
+  lost: number;
+  complete: boolean;
+}